@@ -0,0 +1,155 @@
+/**
+ * Microbenchmark of the fragment GC lookups: the per-base GC prefix counts
+ * (one uint32_t per base, as Transcript::GCCount_ was) against the
+ * GCBitVector (one bit per base, with rank support).
+ *
+ * usage : gcCountBench [numTranscripts] [meanLength] [numQueries]
+ *
+ * A random "transcriptome" is generated and packed 2 bits per base, as in
+ * the index.  For each representation, this reports the memory, the time
+ * to build it for every transcript, and the time for random fragment GC
+ * lookups (as Transcript::gcFrac does them, in updateEffectiveLengths and
+ * when mapping).  The lookups of both are checked to agree.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "GCBitVector.hpp"
+#include "RefSeqView.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct Query {
+  uint32_t txp;
+  uint32_t start;
+  uint32_t end;
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  size_t numTxps = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 20000;
+  size_t meanLen = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 2000;
+  size_t numQueries = (argc > 3) ? std::strtoull(argv[3], nullptr, 10) : 20000000;
+
+  std::mt19937_64 gen(42);
+  std::uniform_int_distribution<size_t> lenDist(meanLen / 4, (7 * meanLen) / 4);
+  std::uniform_int_distribution<int> baseDist(0, 3);
+  const char nucs[] = {'A', 'C', 'G', 'T'};
+
+  std::vector<std::string> seqs(numTxps);
+  std::vector<uint64_t> offsets(numTxps);
+  uint64_t totLen{0};
+  for (size_t t = 0; t < numTxps; ++t) {
+    seqs[t].resize(lenDist(gen));
+    for (auto& c : seqs[t]) {
+      c = nucs[baseDist(gen)];
+    }
+    offsets[t] = totLen;
+    totLen += seqs[t].size();
+  }
+  std::vector<uint64_t> refWords((totLen + 31) / 32, 0);
+  for (size_t t = 0; t < numTxps; ++t) {
+    for (size_t i = 0; i < seqs[t].size(); ++i) {
+      uint64_t p = offsets[t] + i;
+      uint64_t c = std::string("ACGT").find(seqs[t][i]);
+      refWords[p >> 5] |= c << (2 * (p & 31));
+    }
+  }
+
+  std::vector<Query> queries(numQueries);
+  std::uniform_int_distribution<size_t> txpDist(0, numTxps - 1);
+  std::uniform_int_distribution<uint32_t> fragLenDist(50, 600);
+  for (auto& q : queries) {
+    q.txp = txpDist(gen);
+    uint32_t len = seqs[q.txp].size();
+    uint32_t fl = std::min(fragLenDist(gen), len);
+    q.start = std::uniform_int_distribution<uint32_t>(0, len - fl)(gen);
+    q.end = q.start + fl - 1;
+  }
+
+  // per-base prefix counts
+  auto start = Clock::now();
+  std::vector<std::vector<uint32_t>> prefixCounts(numTxps);
+  size_t prefixBytes{0};
+  for (size_t t = 0; t < numTxps; ++t) {
+    auto& counts = prefixCounts[t];
+    counts.resize(seqs[t].size());
+    uint32_t tot{0};
+    for (size_t i = 0; i < seqs[t].size(); ++i) {
+      auto c = seqs[t][i];
+      tot += (c == 'G' or c == 'C') ? 1 : 0;
+      counts[i] = tot;
+    }
+    prefixBytes += counts.size() * sizeof(uint32_t);
+  }
+  double prefixBuild = secondsSince(start);
+
+  // bit vectors, from the ASCII and from the 2-bit sequences
+  start = Clock::now();
+  std::vector<GCBitVector> bitVectors(numTxps);
+  for (size_t t = 0; t < numTxps; ++t) {
+    bitVectors[t].build(seqs[t].c_str(), seqs[t].size());
+  }
+  double asciiBuild = secondsSince(start);
+
+  start = Clock::now();
+  size_t bitBytes{0};
+  for (size_t t = 0; t < numTxps; ++t) {
+    bitVectors[t].build(
+        RefSeqView(refWords.data(), offsets[t], seqs[t].size()));
+    bitBytes += bitVectors[t].sizeInBytes();
+  }
+  double twoBitBuild = secondsSince(start);
+
+  start = Clock::now();
+  uint64_t prefixSum{0};
+  for (auto& q : queries) {
+    auto& counts = prefixCounts[q.txp];
+    prefixSum += counts[q.end] - ((q.start > 0) ? counts[q.start - 1] : 0);
+  }
+  double prefixQuery = secondsSince(start);
+
+  start = Clock::now();
+  uint64_t bitSum{0};
+  for (auto& q : queries) {
+    bitSum += bitVectors[q.txp].count(q.start, q.end);
+  }
+  double bitQuery = secondsSince(start);
+
+  size_t mismatches{0};
+  for (size_t i = 0; i < std::min(numQueries, size_t(1000000)); ++i) {
+    auto& q = queries[i];
+    auto& counts = prefixCounts[q.txp];
+    uint32_t expected = counts[q.end] - ((q.start > 0) ? counts[q.start - 1] : 0);
+    mismatches += (bitVectors[q.txp].count(q.start, q.end) != expected) ? 1 : 0;
+  }
+
+  std::cout << "transcripts : " << numTxps << ", bases : " << totLen
+            << ", queries : " << numQueries << "\n\n";
+  std::cout << "representation\tMB\tbits/base\tbuild (s)\tquery (ns)\n";
+  std::cout << "prefix counts\t" << prefixBytes / 1e6 << '\t'
+            << (8.0 * prefixBytes) / totLen << '\t' << prefixBuild << '\t'
+            << 1e9 * prefixQuery / numQueries << '\n';
+  std::cout << "bit vector (ASCII)\t" << bitBytes / 1e6 << '\t'
+            << (8.0 * bitBytes) / totLen << '\t' << asciiBuild << '\t'
+            << 1e9 * bitQuery / numQueries << '\n';
+  std::cout << "bit vector (2-bit)\t" << bitBytes / 1e6 << '\t'
+            << (8.0 * bitBytes) / totLen << '\t' << twoBitBuild << '\t'
+            << 1e9 * bitQuery / numQueries << '\n';
+  std::cout << "\nchecksums : " << prefixSum << " / " << bitSum
+            << ", mismatches : " << mismatches << '\n';
+  return (prefixSum == bitSum and mismatches == 0) ? 0 : 1;
+}
@@ -0,0 +1,171 @@
+/**
+ * Microbenchmark of the contention on the transcript masses in the online
+ * inference: adding the mass of every alignment to its transcript with a
+ * compare-and-swap loop on the (shared) atomic mass, as Transcript::addMass
+ * does, against summing the mass of a mini-batch per thread, in a
+ * TranscriptMassAccumulator, and adding the sums at the end of the
+ * mini-batch.
+ *
+ * usage : massAccumulationBench [numTranscripts] [alignmentsPerThread] [hotFraction]
+ *
+ * The alignments go to transcripts drawn from a skewed distribution: a
+ * fraction (hotFraction, 0.3 by default) of them go to 16 "hot" transcripts
+ * (as to the mitochondrial and ribosomal transcripts of a typical library),
+ * and the rest are spread uniformly over the others.  Each thread processes
+ * mini-batches of 5000 fragments of 4 alignments each.  For 8, 32 and 64
+ * threads, this reports the time per alignment of both, the rate at which
+ * the compare-and-swap of the former (and of the latter's once-per-batch
+ * updates) had to be retried, and checks that both added the same mass.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "SalmonMath.hpp"
+#include "TranscriptMassAccumulator.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+constexpr size_t fragsPerBatch{5000};
+constexpr size_t alignmentsPerFrag{4};
+constexpr size_t numHot{16};
+
+// The mass of a transcript, updated as by salmon::utils::incLoopLog, and
+// counting the retries
+struct TranscriptMass {
+  std::atomic<double> mass{salmon::math::LOG_0};
+  static std::atomic<uint64_t> numRetries;
+
+  void addMass(double inc) {
+    double oldMass = mass.load();
+    uint64_t retries{0};
+    while (!mass.compare_exchange_weak(oldMass,
+                                       salmon::math::logAdd(oldMass, inc))) {
+      ++retries;
+    }
+    if (retries > 0) {
+      numRetries += retries;
+    }
+  }
+};
+
+std::atomic<uint64_t> TranscriptMass::numRetries{0};
+
+struct Result {
+  double nsPerAlignment;
+  double retriesPerUpdate;
+  double totalMass;
+};
+
+// Run numThreads threads over their alignments, either with or without an
+// accumulator
+Result run(const std::vector<std::vector<uint32_t>>& tids,
+           size_t numTranscripts, bool accumulate) {
+  std::vector<TranscriptMass> masses(numTranscripts);
+  TranscriptMass::numRetries = 0;
+  std::atomic<uint64_t> numUpdates{0};
+  // every alignment gets the same mass, and every batch the same forgetting
+  // mass, so that the totals can be compared
+  const double logProb = std::log(1.0 / alignmentsPerFrag);
+  const double logForgettingMass = 0.0;
+
+  auto start = Clock::now();
+  std::vector<std::thread> threads;
+  for (auto& threadTids : tids) {
+    threads.emplace_back([&, logProb]() -> void {
+      TranscriptMassAccumulator acc;
+      size_t batchSize = fragsPerBatch * alignmentsPerFrag;
+      uint64_t updates{0};
+      for (size_t b = 0; b < threadTids.size(); b += batchSize) {
+        size_t e = std::min(threadTids.size(), b + batchSize);
+        if (accumulate) {
+          for (size_t i = b; i < e; ++i) {
+            acc.add(threadTids[i], logProb);
+          }
+          updates += acc.size();
+          acc.flush(masses, logForgettingMass);
+        } else {
+          for (size_t i = b; i < e; ++i) {
+            masses[threadTids[i]].addMass(logForgettingMass + logProb);
+          }
+          updates += e - b;
+        }
+      }
+      numUpdates += updates;
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  double elapsed = secondsSince(start);
+
+  uint64_t numAlignments{0};
+  for (auto& threadTids : tids) {
+    numAlignments += threadTids.size();
+  }
+  double total{salmon::math::LOG_0};
+  for (auto& m : masses) {
+    total = salmon::math::logAdd(total, m.mass.load());
+  }
+  return {1e9 * elapsed / numAlignments,
+          static_cast<double>(TranscriptMass::numRetries) / numUpdates,
+          std::exp(total)};
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  size_t numTranscripts = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 200000;
+  size_t perThread = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 1000000;
+  double hotFraction = (argc > 3) ? std::atof(argv[3]) : 0.3;
+
+  std::cout << "transcripts : " << numTranscripts
+            << ", alignments per thread : " << perThread
+            << ", fraction to the " << numHot << " hot transcripts : "
+            << hotFraction << " (" << std::thread::hardware_concurrency()
+            << " hardware threads)\n\n";
+  std::cout << "threads\tCAS (ns/aln)\tCAS retries/update\taccumulated "
+               "(ns/aln)\taccumulated retries/update\tspeedup\n";
+
+  for (size_t numThreads : {8, 32, 64}) {
+    std::vector<std::vector<uint32_t>> tids(numThreads);
+    for (size_t t = 0; t < numThreads; ++t) {
+      std::mt19937 gen(static_cast<uint32_t>(t + 1));
+      std::uniform_real_distribution<> coin(0.0, 1.0);
+      std::uniform_int_distribution<uint32_t> hot(0, numHot - 1);
+      std::uniform_int_distribution<uint32_t> cold(
+          numHot, static_cast<uint32_t>(numTranscripts - 1));
+      tids[t].resize(perThread);
+      for (auto& tid : tids[t]) {
+        tid = (coin(gen) < hotFraction) ? hot(gen) : cold(gen);
+      }
+    }
+
+    auto cas = run(tids, numTranscripts, false);
+    auto acc = run(tids, numTranscripts, true);
+    if (std::abs(cas.totalMass - acc.totalMass) > 1e-6 * cas.totalMass) {
+      std::cerr << "the total masses differ : " << cas.totalMass << " vs. "
+                << acc.totalMass << "\n";
+      return 1;
+    }
+    std::cout << numThreads << '\t' << cas.nsPerAlignment << '\t'
+              << cas.retriesPerUpdate << '\t' << acc.nsPerAlignment << '\t'
+              << acc.retriesPerUpdate << '\t'
+              << cas.nsPerAlignment / acc.nsPerAlignment << '\n';
+  }
+  return 0;
+}
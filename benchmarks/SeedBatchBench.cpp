@@ -0,0 +1,177 @@
+/**
+ * Microbenchmark of batched seed lookups (--seedBatchSize): looking up the
+ * seed k-mers of the reads of a batch, interleaved across the reads, before
+ * mapping them one at a time, against looking each read's seeds up as it is
+ * mapped.
+ *
+ * usage : seedBatchBench [tableLog2] [numReads] [workPerSeed]
+ *
+ * The index is modeled by its lookup: a k-mer is hashed into a bit array
+ * (the MPHF), which gives a slot in a position table, which gives a
+ * position in the contig sequence; three dependent random reads into tables
+ * much larger than the cache (2^tableLog2 entries; the default, 2^27, is
+ * 2 GB).  workPerSeed is the (dependent) work that follows each lookup in
+ * the mapping of a read.  For batches of 16 - 64 reads, this reports the
+ * time per seed of
+ *   - per-read : each seed is looked up as the read is mapped (the default),
+ *   - interleaved : the seeds of the batch are first looked up, interleaved
+ *     across the reads (as SeedPrefetcher does, through the index's lookup),
+ *   - prefetched : the lookups of the batch are split into stages, each of
+ *     which prefetches the address the next one reads (the batched hash
+ *     probe; not possible through the index's interface, for comparison).
+ *
+ * The modeled lookup is a few instructions, so the out-of-order core
+ * overlaps the misses of the interleaved lookups.  The index's own lookup
+ * (getRefPos) is far longer, and SeedPrefetcher's lookups are followed by
+ * the mapper's own, so the interleaved figure here is not the effect of
+ * --seedBatchSize; that is measured end to end, on real reads, with
+ * scripts/bench_quant.sh.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+inline uint64_t mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+constexpr size_t seedsPerRead{4};
+
+struct Tables {
+  std::vector<uint64_t> mphfBits;
+  std::vector<uint64_t> positions;
+  std::vector<uint64_t> contigs;
+  uint64_t mask;
+
+  size_t bitWord(uint64_t h) const { return (h >> 6) & (mphfBits.size() - 1); }
+  uint64_t slot(uint64_t h, uint64_t bits) const { return (h ^ bits) & mask; }
+
+  uint64_t lookup(uint64_t kmer) const {
+    uint64_t h = mix(kmer);
+    uint64_t s = slot(h, mphfBits[bitWord(h)]);
+    return contigs[positions[s]];
+  }
+};
+
+// the mapping work that depends on a lookup
+inline uint64_t work(uint64_t v, int n) {
+  for (int i = 0; i < n; ++i) {
+    v = v * 6364136223846793005ULL + 1442695040888963407ULL;
+  }
+  return v;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  size_t tableLog2 = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 27;
+  size_t numReads = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 200000;
+  int workPerSeed = (argc > 3) ? std::atoi(argv[3]) : 100;
+
+  size_t n = size_t(1) << tableLog2;
+  Tables t;
+  std::mt19937_64 gen(42);
+  t.mask = n - 1;
+  t.mphfBits.resize(n / 8);
+  for (auto& w : t.mphfBits) {
+    w = gen();
+  }
+  t.positions.resize(n);
+  t.contigs.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    t.positions[i] = mix(i) & t.mask;
+    t.contigs[i] = i;
+  }
+  std::vector<uint64_t> seeds(numReads * seedsPerRead);
+  for (auto& s : seeds) {
+    s = gen();
+  }
+  size_t numSeeds = seeds.size();
+
+  auto mapRead = [&](size_t r) -> uint64_t {
+    uint64_t v{0};
+    for (size_t s = 0; s < seedsPerRead; ++s) {
+      v += work(t.lookup(seeds[r * seedsPerRead + s]), workPerSeed);
+    }
+    return v;
+  };
+
+  auto start = Clock::now();
+  uint64_t sink{0};
+  for (size_t r = 0; r < numReads; ++r) {
+    sink += mapRead(r);
+  }
+  double perRead = secondsSince(start);
+
+  std::cout << "table entries : " << n << ", reads : " << numReads
+            << ", seeds per read : " << seedsPerRead
+            << ", work per seed : " << workPerSeed << "\n\n";
+  std::cout << "batch\tper-read (ns/seed)\tinterleaved (ns/seed)\tprefetched (ns/seed)\n";
+
+  std::vector<uint64_t> hashes, slots;
+  for (size_t batch : {16, 32, 64}) {
+    start = Clock::now();
+    for (size_t r0 = 0; r0 < numReads; r0 += batch) {
+      size_t r1 = std::min(numReads, r0 + batch);
+      uint64_t found{0};
+      for (size_t s = 0; s < seedsPerRead; ++s) {
+        for (size_t r = r0; r < r1; ++r) {
+          found += t.lookup(seeds[r * seedsPerRead + s]);
+        }
+      }
+      sink += found & 1;
+      for (size_t r = r0; r < r1; ++r) {
+        sink += mapRead(r);
+      }
+    }
+    double interleaved = secondsSince(start);
+
+    hashes.resize(batch * seedsPerRead);
+    slots.resize(batch * seedsPerRead);
+    start = Clock::now();
+    for (size_t r0 = 0; r0 < numReads; r0 += batch) {
+      size_t r1 = std::min(numReads, r0 + batch);
+      size_t m = (r1 - r0) * seedsPerRead;
+      const uint64_t* batchSeeds = &seeds[r0 * seedsPerRead];
+      for (size_t j = 0; j < m; ++j) {
+        hashes[j] = mix(batchSeeds[j]);
+        __builtin_prefetch(&t.mphfBits[t.bitWord(hashes[j])]);
+      }
+      for (size_t j = 0; j < m; ++j) {
+        slots[j] = t.slot(hashes[j], t.mphfBits[t.bitWord(hashes[j])]);
+        __builtin_prefetch(&t.positions[slots[j]]);
+      }
+      for (size_t j = 0; j < m; ++j) {
+        __builtin_prefetch(&t.contigs[t.positions[slots[j]]]);
+      }
+      for (size_t r = r0; r < r1; ++r) {
+        sink += mapRead(r);
+      }
+    }
+    double prefetched = secondsSince(start);
+
+    std::cout << batch << '\t' << 1e9 * perRead / numSeeds << '\t'
+              << 1e9 * interleaved / numSeeds << '\t'
+              << 1e9 * prefetched / numSeeds << '\n';
+  }
+  std::cout << "\n(checksum " << (sink & 0xFF) << ")\n";
+  return 0;
+}
@@ -0,0 +1,44 @@
+# Find the zstd compression library.
+#
+# Sets ZSTD_FOUND, ZSTD_INCLUDE_DIRS and ZSTD_LIBRARIES.  A specific
+# installation can be selected with ZSTD_ROOT.
+
+find_package(PkgConfig)
+pkg_check_modules(PC_ZSTD QUIET libzstd)
+
+find_path(ZSTD_INCLUDE_DIR zstd.h
+  HINTS
+    ${ZSTD_ROOT} ENV ZSTD_ROOT
+    ${PC_ZSTD_INCLUDEDIR}
+    ${PC_ZSTD_INCLUDE_DIRS}
+  PATH_SUFFIXES include)
+
+find_library(ZSTD_LIBRARY NAMES zstd libzstd
+  HINTS
+    ${ZSTD_ROOT} ENV ZSTD_ROOT
+    ${PC_ZSTD_LIBDIR}
+    ${PC_ZSTD_LIBRARY_DIRS}
+  PATH_SUFFIXES lib lib64)
+
+if(ZSTD_INCLUDE_DIR)
+  file(STRINGS "${ZSTD_INCLUDE_DIR}/zstd.h" _zstd_version_lines
+    REGEX "^#define[ \t]+ZSTD_VERSION_(MAJOR|MINOR|RELEASE)[ \t]+[0-9]+")
+  foreach(_part MAJOR MINOR RELEASE)
+    string(REGEX REPLACE ".*#define[ \t]+ZSTD_VERSION_${_part}[ \t]+([0-9]+).*" "\\1"
+      _zstd_${_part} "${_zstd_version_lines}")
+  endforeach()
+  set(ZSTD_VERSION "${_zstd_MAJOR}.${_zstd_MINOR}.${_zstd_RELEASE}")
+  unset(_zstd_version_lines)
+endif()
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(Zstd REQUIRED_VARS
+                                  ZSTD_LIBRARY ZSTD_INCLUDE_DIR
+                                  VERSION_VAR ZSTD_VERSION)
+
+if(ZSTD_FOUND)
+  set(ZSTD_LIBRARIES    ${ZSTD_LIBRARY})
+  set(ZSTD_INCLUDE_DIRS ${ZSTD_INCLUDE_DIR})
+endif()
+
+mark_as_advanced(ZSTD_INCLUDE_DIR ZSTD_LIBRARY)
@@ -0,0 +1,92 @@
+# Running the EM over each connected component of the equivalence classes on
+# its own (--componentEM) must give the counts of the global EM: with a single
+# thread (so that the classes, and the starting point, are the same), the
+# NumReads of each transcript agree up to the convergence tolerance, with
+# both the VBEM (the default) and the EM.
+# Uses the index built by TestSalmonQuasi.cmake.
+
+set(SAMPLE_DIR ${TOPLEVEL_DIR}/sample_data)
+if (NOT EXISTS ${SAMPLE_DIR}/sample_salmon_quasi_index)
+    message(FATAL_ERROR "The sample index (built by salmon_read_test_quasi) is missing")
+endif()
+
+# The NumReads column of a quant.sf, in thousandths of a read (it is written
+# with 3 decimals), as OUT_VAR; and the names of the transcripts as NAMES_VAR
+function(read_num_reads QUANT_FILE OUT_VAR NAMES_VAR)
+    file(STRINGS ${QUANT_FILE} LINES)
+    list(REMOVE_AT LINES 0)
+    set(COUNTS "")
+    set(NAMES "")
+    foreach(LINE ${LINES})
+        string(REPLACE "\t" ";" FIELDS "${LINE}")
+        list(GET FIELDS 0 NAME)
+        list(GET FIELDS 4 NUM_READS)
+        if (NOT NUM_READS MATCHES "^[0-9]+\\.[0-9][0-9][0-9]$")
+            message(FATAL_ERROR "Unexpected NumReads ${NUM_READS} in ${QUANT_FILE}")
+        endif()
+        string(REPLACE "." "" NUM_READS "${NUM_READS}")
+        # (without leading zeros, which math() would read as octal)
+        string(REGEX REPLACE "^0+([0-9])" "\\1" NUM_READS "${NUM_READS}")
+        list(APPEND COUNTS ${NUM_READS})
+        list(APPEND NAMES ${NAME})
+    endforeach()
+    set(${OUT_VAR} ${COUNTS} PARENT_SCOPE)
+    set(${NAMES_VAR} ${NAMES} PARENT_SCOPE)
+endfunction()
+
+foreach(EM_MODE vbem em)
+    foreach(EM_RUN global component)
+        set(OUT_DIR sample_salmon_${EM_MODE}_${EM_RUN}_quant)
+        set(QUANT_COMMAND ${CMAKE_BINARY_DIR}/salmon quant -i sample_salmon_quasi_index
+            -l IU -1 reads_1.fastq -2 reads_2.fastq -p 1 -o ${OUT_DIR})
+        if (EM_MODE STREQUAL "em")
+            list(APPEND QUANT_COMMAND --useEM)
+        endif()
+        if (EM_RUN STREQUAL "component")
+            list(APPEND QUANT_COMMAND --componentEM)
+        endif()
+        execute_process(COMMAND ${QUANT_COMMAND}
+                        WORKING_DIRECTORY ${SAMPLE_DIR}
+                        RESULT_VARIABLE QUANT_RESULT
+                        )
+        if (QUANT_RESULT OR NOT EXISTS ${SAMPLE_DIR}/${OUT_DIR}/quant.sf)
+            message(FATAL_ERROR "Error running ${QUANT_COMMAND}")
+        endif()
+    endforeach()
+
+    read_num_reads(${SAMPLE_DIR}/sample_salmon_${EM_MODE}_global_quant/quant.sf
+                   GLOBAL_COUNTS GLOBAL_NAMES)
+    read_num_reads(${SAMPLE_DIR}/sample_salmon_${EM_MODE}_component_quant/quant.sf
+                   COMPONENT_COUNTS COMPONENT_NAMES)
+    if (NOT GLOBAL_NAMES STREQUAL COMPONENT_NAMES)
+        message(FATAL_ERROR "The ${EM_MODE} runs with and without --componentEM quantified different transcripts")
+    endif()
+
+    # Each count may differ by a read, plus 5% of it (the runs stop at
+    # different iterations, once the relative changes are under 1%)
+    list(LENGTH GLOBAL_COUNTS NUM_TRANSCRIPTS)
+    math(EXPR LAST "${NUM_TRANSCRIPTS} - 1")
+    set(TOTAL_GLOBAL 0)
+    foreach(I RANGE ${LAST})
+        list(GET GLOBAL_COUNTS ${I} G)
+        list(GET COMPONENT_COUNTS ${I} C)
+        list(GET GLOBAL_NAMES ${I} NAME)
+        math(EXPR TOTAL_GLOBAL "${TOTAL_GLOBAL} + ${G}")
+        if (G GREATER C)
+            math(EXPR DIFF "${G} - ${C}")
+            set(LARGER ${G})
+        else()
+            math(EXPR DIFF "${C} - ${G}")
+            set(LARGER ${C})
+        endif()
+        math(EXPR ALLOWED "1000 + (${LARGER} * 5) / 100")
+        if (DIFF GREATER ALLOWED)
+            message(FATAL_ERROR "The ${EM_MODE} NumReads of ${NAME} is ${G} thousandths with the global EM, but ${C} with --componentEM")
+        endif()
+    endforeach()
+    if (NOT TOTAL_GLOBAL GREATER 0)
+        message(FATAL_ERROR "The ${EM_MODE} run assigned no reads")
+    endif()
+endforeach()
+
+message("The counts of --componentEM are those of the global EM")
@@ -0,0 +1,57 @@
+# The mapping records saved with --reorderReads must be those of the reads in
+# the order of the input: with a single thread (so that the chunks are the
+# same), the record file is the same as the one saved without reordering.
+# Uses the index built by TestSalmonQuasi.cmake.
+
+set(SAMPLE_DIR ${TOPLEVEL_DIR}/sample_data)
+if (NOT EXISTS ${SAMPLE_DIR}/sample_salmon_quasi_index)
+    message(FATAL_ERROR "The sample index (built by salmon_read_test_quasi) is missing")
+endif()
+
+foreach(LIB_MODE paired single)
+    if (LIB_MODE STREQUAL "paired")
+        set(READS -l IU -1 reads_1.fastq -2 reads_2.fastq)
+    else()
+        set(READS -l U -r reads_1.fastq)
+    endif()
+
+    foreach(ORDER ordered reordered)
+        set(OUT_DIR sample_salmon_${LIB_MODE}_${ORDER}_quant)
+        set(QUANT_COMMAND ${CMAKE_BINARY_DIR}/salmon quant -i sample_salmon_quasi_index
+            ${READS} -p 1 --saveMappings ${OUT_DIR}.mappings -o ${OUT_DIR})
+        if (ORDER STREQUAL "reordered")
+            list(APPEND QUANT_COMMAND --reorderReads)
+        endif()
+        execute_process(COMMAND ${QUANT_COMMAND}
+                        WORKING_DIRECTORY ${SAMPLE_DIR}
+                        RESULT_VARIABLE QUANT_RESULT
+                        )
+        if (QUANT_RESULT)
+            message(FATAL_ERROR "Error running ${QUANT_COMMAND}")
+        endif()
+    endforeach()
+
+    execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files
+                            sample_salmon_${LIB_MODE}_ordered_quant.mappings
+                            sample_salmon_${LIB_MODE}_reordered_quant.mappings
+                    WORKING_DIRECTORY ${SAMPLE_DIR}
+                    RESULT_VARIABLE COMPARE_RESULT
+                    )
+    if (COMPARE_RESULT)
+        message(FATAL_ERROR "The mapping records of the ${LIB_MODE}-end reads saved with --reorderReads are not in the order of the input")
+    endif()
+
+    # and the reordered records can be quantified again
+    set(REPLAY_COMMAND ${CMAKE_BINARY_DIR}/salmon quant -i sample_salmon_quasi_index
+        -l A --fromMappings sample_salmon_${LIB_MODE}_reordered_quant.mappings
+        -o sample_salmon_${LIB_MODE}_replayed_quant)
+    execute_process(COMMAND ${REPLAY_COMMAND}
+                    WORKING_DIRECTORY ${SAMPLE_DIR}
+                    RESULT_VARIABLE REPLAY_RESULT
+                    )
+    if (REPLAY_RESULT OR NOT EXISTS ${SAMPLE_DIR}/sample_salmon_${LIB_MODE}_replayed_quant/quant.sf)
+        message(FATAL_ERROR "Error running ${REPLAY_COMMAND}")
+    endif()
+endforeach()
+
+message("The mapping records saved with --reorderReads are in the order of the input")
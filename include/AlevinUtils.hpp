@@ -41,6 +41,7 @@
 
 #include "SalmonConfig.hpp"
 #include "SalmonUtils.hpp"
+#include "PackedSeq.hpp"
 // #include "IndexHeader.hpp"
 
 #include "pufferfish/sparsepp/spp.h"
@@ -82,6 +83,16 @@ namespace alevin{
                     ProtocolT& pt,
                     std::string& umi);
 
+    // As above, but cut from the 2-bit encoding of the read (which has the
+    // layout of AlevinUMIKmer), so umi is set to the UMI's k-mer word.
+    // Returns false if the read is too short to hold the UMI; validUMI is
+    // set to false if the UMI has a base other than A/C/G/T.
+    template <typename ProtocolT>
+    bool extractUMI(const fastx_parser::PackedSeq& read,
+                    ProtocolT& pt,
+                    uint64_t& umi,
+                    bool& validUMI);
+
     template <typename ProtocolT>
     nonstd::optional<std::string> extractBarcode(std::string& read, ProtocolT& pt);
 
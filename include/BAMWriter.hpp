@@ -0,0 +1,155 @@
+#ifndef __BAM_WRITER_HPP__
+#define __BAM_WRITER_HPP__
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <zlib.h>
+
+namespace salmon {
+namespace bam_utils {
+
+// The BAM flags
+constexpr uint16_t BAM_FPAIRED{0x1};
+constexpr uint16_t BAM_FPROPER_PAIR{0x2};
+constexpr uint16_t BAM_FUNMAP{0x4};
+constexpr uint16_t BAM_FMUNMAP{0x8};
+constexpr uint16_t BAM_FREVERSE{0x10};
+constexpr uint16_t BAM_FMREVERSE{0x20};
+constexpr uint16_t BAM_FREAD1{0x40};
+constexpr uint16_t BAM_FREAD2{0x80};
+constexpr uint16_t BAM_FSECONDARY{0x100};
+
+/**
+ * The fields of a BAM record, as given by the mapping code.  The sequence
+ * is that of the read; it is reverse complemented here if the record is
+ * (BAM_FREVERSE).  If cigar is null, the record has no CIGAR (i.e. it is
+ * unmapped); if it doesn't describe an alignment of the whole read (or is
+ * empty), the read is written as aligned without gaps (<length>M).
+ */
+struct BAMRecord {
+  const char* name{nullptr};
+  size_t nameLen{0};
+  uint16_t flag{0};
+  int32_t refID{-1};
+  int32_t pos{-1};
+  uint8_t mapq{255};
+  const std::string* cigar{nullptr};
+  const char* seq{nullptr};
+  size_t seqLen{0};
+  int32_t nextRefID{-1};
+  int32_t nextPos{-1};
+  int32_t tlen{0};
+  // the AS (alignment score) tag, if hasScore
+  bool hasScore{false};
+  int32_t score{0};
+  // the NH (number of alignments) tag, if > 0
+  uint32_t numAlignments{0};
+};
+
+/**
+ * Encodes BAM records into a buffer owned by the caller (the buffer of a
+ * mapping thread, which is handed to the BAMWriter after each chunk).  The
+ * encoder only holds scratch space, so each thread has its own.
+ */
+class BAMRecordEncoder {
+public:
+  void append(const BAMRecord& r, std::string& out);
+
+private:
+  // parse cigar into cigarOps_; false if it isn't an alignment of
+  // (exactly) seqLen bases
+  bool parseCigar_(const std::string& cigar, size_t seqLen, uint32_t& refLen);
+
+  std::vector<uint32_t> cigarOps_;
+};
+
+// The binary header (magic, text and references) of a BAM file
+std::string encodeHeader(const std::string& text,
+                         const std::vector<std::pair<std::string, uint32_t>>& refs);
+
+} // namespace bam_utils
+} // namespace salmon
+
+/**
+ * Writes BAM (records encoded with salmon::bam_utils) to a file, or to
+ * stdout.
+ *
+ * The mapping threads encode their records into their own buffers, and hand
+ * each (full) buffer over with write(), which only swaps it into a free slot
+ * of a ring; a pool of threads compresses the buffers in the ring into BGZF
+ * blocks concurrently, and a writer thread writes them out in the order in
+ * which they were handed over.  The records of a buffer are written
+ * together, and each buffer starts a new BGZF block.  If every slot is
+ * taken, write() waits for one to be written out, which bounds the memory
+ * used when the output can't keep up with the mapping.
+ *
+ * Nothing here is specific to BAM records beyond the end-of-file block, so
+ * the mapping record file of --saveMappings (see MappingRecords.hpp), which
+ * is BGZF as well, is written through a BAMWriter too.
+ */
+class BAMWriter {
+public:
+  // Write to path ("-" for stdout), compressing with numThreads threads
+  BAMWriter(const std::string& path, uint32_t numThreads,
+            int level = Z_DEFAULT_COMPRESSION);
+  ~BAMWriter();
+
+  // true if the output could be opened, and everything written so far was
+  bool good() const;
+
+  // Write the header (see bam_utils::encodeHeader), before any record; it
+  // is only written the first time.
+  void writeHeader(std::string header);
+
+  // Hand the encoded records in buf over to be written; buf is left empty
+  // (with the capacity of a buffer that was written before).
+  void write(std::string& buf);
+
+  // Write the end-of-file block, and close the output; returns good().
+  bool close();
+
+private:
+  enum class SlotState : uint8_t { EMPTY, FILLED, COMPRESSED };
+
+  struct DeflateJob {
+    SlotState state{SlotState::EMPTY};
+    bool ok{true};
+    std::string in;
+    std::vector<unsigned char> out;
+  };
+
+  void compressWorker_();
+  void writeOut_();
+  bool compressJob_(DeflateJob& job, z_stream& zs);
+
+  std::FILE* fp_{nullptr};
+  bool ownsFile_{false};
+  int level_;
+
+  std::vector<std::unique_ptr<DeflateJob>> ring_;
+  uint64_t fillID_{0};
+  uint64_t compressID_{0};
+  uint64_t writeID_{0};
+  bool ok_{true};
+  bool wroteHeader_{false};
+  bool closing_{false};
+  bool closed_{false};
+
+  mutable std::mutex m_;
+  std::condition_variable producerCV_;
+  std::condition_variable workerCV_;
+  std::condition_variable writerCV_;
+
+  std::vector<std::thread> workers_;
+  std::thread writer_;
+};
+
+#endif // __BAM_WRITER_HPP__
@@ -31,11 +31,11 @@
 
 namespace bfs = boost::filesystem;
 using JqueueT = moodycamel::ConcurrentQueue<uint32_t>;
-using eqMapT = cuckoohash_map<TranscriptGroup, SCTGValue, TranscriptGroupHasher>;
+using eqMapT = EqClassMapT<SCTGValue>;
 using tgrouplabelt = std::vector<uint32_t>;
 using tgroupweightvec = std::vector<double>;
 using SCExpT = ReadExperiment<EquivalenceClassBuilder<SCTGValue>>;
-using EqMapT = cuckoohash_map<TranscriptGroup, SCTGValue, TranscriptGroupHasher>;
+using EqMapT = EqClassMapT<SCTGValue>;
 
 constexpr double digammaMin = 1e-10;
 
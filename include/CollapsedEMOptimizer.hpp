@@ -34,6 +34,19 @@ public:
       ExpT& readExp, SalmonOpts& sopt,
       std::function<bool(const std::vector<double>&)>& writeBootstrap,
       double relDiffTolerance, uint32_t maxIter);
+
+private:
+  // optimize and gatherBootstraps, over the equivalence classes packed
+  // with weights of type WeightT (see PackedEqClasses.hpp)
+  template <typename WeightT, typename ExpT>
+  bool optimize_(ExpT& readExp, SalmonOpts& sopt, double tolerance,
+                 uint32_t maxIter);
+
+  template <typename WeightT, typename ExpT>
+  bool gatherBootstraps_(
+      ExpT& readExp, SalmonOpts& sopt,
+      std::function<bool(const std::vector<double>&)>& writeBootstrap,
+      double relDiffTolerance, uint32_t maxIter);
 };
 
 #endif // COLLAPSED_EM_OPTIMIZER_HPP
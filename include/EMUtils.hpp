@@ -3,11 +3,11 @@
 
 #include <vector>
 #include "tbb/atomic.h"
+#include "PackedEqClasses.hpp"
 #include "Transcript.hpp"
 
-template <typename VecT>
-void EMUpdate_(std::vector<std::vector<uint32_t>>& txpGroupLabels,
-               std::vector<std::vector<double>>& txpGroupCombinedWeights,
+template <typename VecT, typename WeightT>
+void EMUpdate_(const PackedEqClasses<WeightT>& eqs,
                const std::vector<uint64_t>& txpGroupCounts,
                std::vector<Transcript>& transcripts, const VecT& alphaIn,
                VecT& alphaOut);
@@ -0,0 +1,131 @@
+#ifndef __EQ_CLASS_COMPONENTS_HPP__
+#define __EQ_CLASS_COMPONENTS_HPP__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include <boost/pending/disjoint_sets.hpp>
+
+#include "PackedEqClasses.hpp"
+
+/**
+ * The connected components of the (packed) equivalence classes: two
+ * transcripts are in the same component if some chain of classes links them.
+ *
+ * The likelihood factors over the components, so the EM can be run on each
+ * of them on its own (see --componentEM).  The components are found with a
+ * union-find over the labels of the classes, as ClusterForest does during
+ * the online phase.  Building this reorders the packed classes, so that the
+ * classes of each component are contiguous.  The components are numbered
+ * from the largest (in the number of transcript entries of its classes,
+ * which is what a pass over it costs) to the smallest.
+ */
+struct EqClassComponents {
+  template <typename WeightT>
+  EqClassComponents(PackedEqClasses<WeightT>& eqs, size_t numTranscripts) {
+    constexpr uint32_t noComponent{std::numeric_limits<uint32_t>::max()};
+    std::vector<size_t> rank(numTranscripts, 0);
+    std::vector<size_t> parent(numTranscripts, 0);
+    boost::disjoint_sets<size_t*, size_t*> sets(rank.data(), parent.data());
+    for (size_t t = 0; t < numTranscripts; ++t) {
+      sets.make_set(t);
+    }
+
+    // link the transcripts of each class
+    std::vector<bool> present(numTranscripts, false);
+    for (size_t i = 0; i < eqs.size(); ++i) {
+      auto b = eqs.offsets[i];
+      auto e = eqs.offsets[i + 1];
+      auto first = eqs.txps[b];
+      present[first] = true;
+      for (auto j = b + 1; j < e; ++j) {
+        present[eqs.txps[j]] = true;
+        sets.union_set(first, eqs.txps[j]);
+      }
+    }
+
+    // number the components (in the order in which they're first seen), and
+    // add up the cost of a pass over each
+    std::vector<uint32_t> rootComponent(numTranscripts, noComponent);
+    std::vector<uint64_t> numEntries;
+    std::vector<uint32_t> classComponent(eqs.size());
+    for (size_t i = 0; i < eqs.size(); ++i) {
+      auto root = sets.find_set(eqs.txps[eqs.offsets[i]]);
+      if (rootComponent[root] == noComponent) {
+        rootComponent[root] = static_cast<uint32_t>(numEntries.size());
+        numEntries.push_back(0);
+      }
+      classComponent[i] = rootComponent[root];
+      numEntries[classComponent[i]] += eqs.groupSize(i);
+    }
+
+    // and renumber them, largest first
+    size_t numComponents = numEntries.size();
+    std::vector<uint32_t> bySize(numComponents);
+    std::iota(bySize.begin(), bySize.end(), 0);
+    std::stable_sort(bySize.begin(), bySize.end(),
+                     [&numEntries](uint32_t a, uint32_t b) -> bool {
+                       return numEntries[a] > numEntries[b];
+                     });
+    std::vector<uint32_t> renumber(numComponents);
+    for (size_t c = 0; c < numComponents; ++c) {
+      renumber[bySize[c]] = static_cast<uint32_t>(c);
+    }
+
+    // group the classes (and the transcripts) by component
+    classOffsets.assign(numComponents + 1, 0);
+    for (auto& c : classComponent) {
+      c = renumber[c];
+      ++classOffsets[c + 1];
+    }
+    std::partial_sum(classOffsets.begin(), classOffsets.end(),
+                     classOffsets.begin());
+    std::vector<uint32_t> order(eqs.size());
+    std::vector<uint64_t> next(classOffsets.begin(), classOffsets.end() - 1);
+    for (size_t i = 0; i < eqs.size(); ++i) {
+      order[next[classComponent[i]]++] = static_cast<uint32_t>(i);
+    }
+    eqs.reorder(order);
+
+    txpOffsets.assign(numComponents + 1, 0);
+    std::vector<uint32_t> txpComponent(numTranscripts, noComponent);
+    for (size_t t = 0; t < numTranscripts; ++t) {
+      if (present[t]) {
+        txpComponent[t] = renumber[rootComponent[sets.find_set(t)]];
+        ++txpOffsets[txpComponent[t] + 1];
+      }
+    }
+    std::partial_sum(txpOffsets.begin(), txpOffsets.end(), txpOffsets.begin());
+    txps.resize(txpOffsets.back());
+    next.assign(txpOffsets.begin(), txpOffsets.end() - 1);
+    for (size_t t = 0; t < numTranscripts; ++t) {
+      if (present[t]) {
+        txps[next[txpComponent[t]]++] = static_cast<uint32_t>(t);
+      }
+    }
+  }
+
+  // The number of components
+  size_t size() const { return classOffsets.size() - 1; }
+
+  size_t numClasses(size_t c) const {
+    return classOffsets[c + 1] - classOffsets[c];
+  }
+
+  size_t numTranscripts(size_t c) const {
+    return txpOffsets[c + 1] - txpOffsets[c];
+  }
+
+  // The classes of component c are [classOffsets[c], classOffsets[c+1]) of
+  // the (reordered) packed classes
+  std::vector<uint64_t> classOffsets;
+  // and its transcripts are txps[txpOffsets[c]] ... txps[txpOffsets[c+1]-1]
+  std::vector<uint64_t> txpOffsets;
+  std::vector<uint32_t> txps;
+};
+
+#endif // __EQ_CLASS_COMPONENTS_HPP__
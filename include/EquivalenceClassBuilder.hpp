@@ -1,6 +1,8 @@
 #ifndef EQUIVALENCE_CLASS_BUILDER_HPP
 #define EQUIVALENCE_CLASS_BUILDER_HPP
 
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <mutex>
 #include <thread>
@@ -11,13 +13,25 @@
 #include "spdlog/spdlog.h"
 #include "nonstd/optional.hpp"
 
+#include "SalmonMemoryUtils.hpp"
 #include "SalmonUtils.hpp"
 #include "TranscriptGroup.hpp"
 #include "concurrentqueue.h"
 #include "cuckoohash_map.hh"
+#include "parallel_hashmap/phmap.h"
 #include "pufferfish/sparsepp/spp.h"
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
 
 struct EmptyBarcodeMapType {};
+
+// The map from equivalence class labels to their values, whose buckets are
+// backed by huge pages if requested (--hugePages).
+template <typename TGValueType>
+using EqClassMapT = cuckoohash_map<
+    TranscriptGroup, TGValueType, TranscriptGroupHasher,
+    std::equal_to<TranscriptGroup>,
+    salmon::memory_utils::HugePageAllocator<std::pair<const TranscriptGroup, TGValueType>>>;
 using SparseBarcodeMapType = spp::sparse_hash_map<uint32_t, spp::sparse_hash_map<uint64_t, uint32_t>>;
 using BarcodeT = uint32_t;
 using UMIT = uint64_t;
@@ -66,6 +80,16 @@ struct SCTGValue {
   }
   //////////////////////////////////////////////////////////////////
 
+  // add the counts of o (of the same class) to this one
+  void merge(const SCTGValue& o) {
+    count += o.count;
+    for (auto& bc : o.barcodeGroup) {
+      for (auto& umi : bc.second) {
+        barcodeGroup[bc.first][umi.first] += umi.second;
+      }
+    }
+  }
+
   // const is a lie
   void normalizeAux() const {}
 
@@ -110,6 +134,15 @@ struct TGValue {
   TGValue(int, BarcodeT bc, UMIT umi)
   { std::cerr<<"invalid initialization in eqbuilder"<<std::endl; exit(1); }
 
+  // add the count and (unnormalized) weights of o (of the same class) to
+  // this one
+  void merge(const TGValue& o) {
+    count += o.count;
+    for (size_t i = 0; i < weights.size(); ++i) {
+      weights[i] += o.weights[i];
+    }
+  }
+
   // const is a lie
   void normalizeAux() const {
     double sumOfAux{0.0};
@@ -143,7 +176,17 @@ public:
   void setMaxResizeThreads(uint32_t t) { countMap_.set_max_resize_threads(t); }
   uint32_t getMaxResizeThreads() const { return countMap_.get_max_resize_threads(); }
 
-  void start() { active_ = true; }
+  // If threadLocal (--threadLocalEqClasses), the classes added by each thread
+  // (with addGroup) are counted in maps of its own, rather than in the shared
+  // (concurrent) map, and are merged in finish().  This must be set before
+  // start().
+  void setThreadLocal(bool threadLocal) { threadLocal_ = threadLocal; }
+
+  void start() {
+    active_ = true;
+    // (so that the threads don't keep adding to the maps of an earlier run)
+    builderID_ = ++nextBuilderID_();
+  }
 
   bool alv_finish(){
     active_ = false;
@@ -162,6 +205,9 @@ public:
 
   bool finish() {
     active_ = false;
+    if (threadLocal_) {
+      return finishThreadLocal_();
+    }
     size_t totalCount{0};
     auto lt = countMap_.lock_table();
     for (auto& kv : lt) {
@@ -212,7 +258,7 @@ public:
                               std::vector<uint32_t>& eqclass_counts,
                               std::vector<Transcript>& transcripts);
 
-  cuckoohash_map<TranscriptGroup, TGValueType, TranscriptGroupHasher>& eqMap(){
+  EqClassMapT<TGValueType>& eqMap(){
     return countMap_;
   }
 
@@ -226,12 +272,119 @@ public:
   }
 
 private:
+  using LocalMapT = phmap::flat_hash_map<TranscriptGroup, TGValueType, TranscriptGroupHasher>;
+
+  // The classes are split among the maps of a thread by their hash, into
+  // the same shards for every thread, so that finish() can merge the maps
+  // shard by shard, in parallel.
+  static constexpr size_t numShards_{64};
+
+  struct LocalMaps {
+    std::vector<LocalMapT> shards = std::vector<LocalMapT>(numShards_);
+  };
+
+  static std::atomic<uint64_t>& nextBuilderID_() {
+    static std::atomic<uint64_t> id{0};
+    return id;
+  }
+
+  // The shard of the calling thread's maps that the class with hash h goes
+  // to; the maps are created the first time a thread adds a class.
+  LocalMapT& localShard_(size_t h) {
+    thread_local uint64_t ownerID{0};
+    thread_local LocalMaps* maps{nullptr};
+    if (ownerID != builderID_) {
+      std::lock_guard<std::mutex> lock(localMapsMut_);
+      localMaps_.emplace_back(new LocalMaps);
+      maps = localMaps_.back().get();
+      ownerID = builderID_;
+    }
+    return maps->shards[(h >> 32) % numShards_];
+  }
+
+  // Merge the maps of the threads (each shard in a task of its own, into the
+  // first map that holds it), and move the classes into countVec_
+  bool finishThreadLocal_() {
+    auto start = std::chrono::steady_clock::now();
+    size_t numLocalEntries{0};
+    for (auto& lm : localMaps_) {
+      for (auto& shard : lm->shards) {
+        numLocalEntries += shard.size();
+      }
+    }
+
+    std::vector<LocalMapT> merged(numShards_);
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, numShards_),
+        [&](const tbb::blocked_range<size_t>& range) -> void {
+          for (size_t s = range.begin(); s != range.end(); ++s) {
+            auto& out = merged[s];
+            for (auto& lm : localMaps_) {
+              auto& in = lm->shards[s];
+              if (out.empty()) {
+                out.swap(in);
+                continue;
+              }
+              for (auto& kv : in) {
+                auto it = out.find(kv.first);
+                if (it == out.end()) {
+                  out.emplace(std::move(const_cast<TranscriptGroup&>(kv.first)),
+                              std::move(kv.second));
+                } else {
+                  it->second.merge(kv.second);
+                }
+              }
+              // release the memory of the thread's shard as soon as it's merged
+              LocalMapT().swap(in);
+            }
+            for (auto& kv : out) {
+              kv.second.normalizeAux();
+            }
+          }
+        });
+    localMaps_.clear();
+
+    size_t numClasses{0};
+    for (auto& shard : merged) {
+      numClasses += shard.size();
+    }
+    size_t totalCount{0};
+    countVec_.reserve(countVec_.size() + numClasses);
+    for (auto& shard : merged) {
+      for (auto& kv : shard) {
+        totalCount += kv.second.count;
+        countVec_.emplace_back(std::move(const_cast<TranscriptGroup&>(kv.first)),
+                               std::move(kv.second));
+      }
+      LocalMapT().swap(shard);
+    }
+
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    logger_->info("Merged the thread-local equivalence class maps ({:n} "
+                  "entries) in {:.3f} seconds", numLocalEntries, seconds);
+    logger_->info("Computed {:n} rich equivalence classes "
+                  "for further processing",
+                  countVec_.size());
+    logger_->info("Counted {:n} total reads in the equivalence classes ",
+                  totalCount);
+    return true;
+  }
+
   std::atomic<bool> active_;
-  cuckoohash_map<TranscriptGroup, TGValueType, TranscriptGroupHasher> countMap_;
+  EqClassMapT<TGValueType> countMap_;
   std::vector<std::pair<const TranscriptGroup, TGValueType>> countVec_;
   std::shared_ptr<spdlog::logger> logger_;
+
+  bool threadLocal_{false};
+  uint64_t builderID_{0};
+  std::vector<std::unique_ptr<LocalMaps>> localMaps_;
+  std::mutex localMapsMut_;
 };
 
+template <typename TGValueType>
+constexpr size_t EquivalenceClassBuilder<TGValueType>::numShards_;
+
 template <>
 inline void EquivalenceClassBuilder<TGValue>::addGroup(TranscriptGroup&& g,
                                                        std::vector<double>& weights) {
@@ -243,6 +396,16 @@ inline void EquivalenceClassBuilder<TGValue>::addGroup(TranscriptGroup&& g,
       x.weights[i] += weights[i];
     }
   };
+  if (threadLocal_) {
+    auto& shard = localShard_(g.hash);
+    auto it = shard.find(g);
+    if (it == shard.end()) {
+      shard.emplace(std::move(g), TGValue(weights, 1));
+    } else {
+      upfn(it->second);
+    }
+    return;
+  }
   TGValue v(weights, 1);
   countMap_.upsert(g, upfn, v);
 }
@@ -7,15 +7,21 @@
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
+#include <mutex>
+#include <string>
 #include <thread>
+#include <type_traits>
 #include <vector>
 
 extern "C" {
 #include "kseq.h"
 }
 
+#include "blockingconcurrentqueue.h"
 #include "concurrentqueue.h"
 
+#include "PackedSeq.hpp"
+
 #ifndef __FASTX_PARSER_PRECXX14_MAKE_UNIQUE__
 #define __FASTX_PARSER_PRECXX14_MAKE_UNIQUE__
 
@@ -82,6 +88,65 @@ struct ReadQualPair {
   ReadQual second;
 };
 
+/**
+ * A non-owning view of one field (sequence, name) of a record.  The bytes
+ * live in the arena of the ReadChunk that holds the record (or in the
+ * mapped input file), so the view is only valid while the consumer holds
+ * that chunk (i.e. until the next call to refill() or finishedWithGroup()).
+ */
+class ReadView {
+public:
+  const char* data() const { return data_; }
+  size_t size() const { return len_; }
+  size_t length() const { return len_; }
+  bool empty() const { return len_ == 0; }
+  char operator[](size_t i) const { return data_[i]; }
+  const char* begin() const { return data_; }
+  const char* end() const { return data_ + len_; }
+  std::string toString() const { return std::string(data_, len_); }
+
+  // used by the parser: the arena may move while a chunk is being filled,
+  // so fields record their offset and are bound to the final arena address
+  // once the chunk is complete.
+  void setOffset(size_t offset, size_t len) {
+    offset_ = offset;
+    len_ = static_cast<uint32_t>(len);
+  }
+  void bind(const char* arenaBase) {
+    if (offset_ != directOffset_) {
+      data_ = arenaBase + offset_;
+    }
+  }
+  // or point straight at bytes that outlive the chunk (i.e. a memory mapped
+  // input file, see enableMappedInput()); bind() leaves these alone.
+  void setDirect(const char* p, size_t len) {
+    data_ = p;
+    offset_ = directOffset_;
+    len_ = static_cast<uint32_t>(len);
+  }
+
+private:
+  static constexpr size_t directOffset_{~static_cast<size_t>(0)};
+  const char* data_{nullptr};
+  size_t offset_{0};
+  uint32_t len_{0};
+};
+
+struct ReadSeqView {
+  ReadView seq;
+  ReadView name;
+};
+
+struct ReadPairView {
+  ReadSeqView first;
+  ReadSeqView second;
+};
+
+template <typename T> struct is_paired_record : std::false_type {};
+template <> struct is_paired_record<ReadPair> : std::true_type {};
+template <> struct is_paired_record<ReadQualPair> : std::true_type {};
+template <> struct is_paired_record<ReadPairView> : std::true_type {};
+
 template <typename T> class ReadChunk {
 public:
   ReadChunk(size_t want) : group_(want), want_(want), have_(want) {}
@@ -92,8 +157,21 @@ public:
   typename std::vector<T>::iterator begin() { return group_.begin(); }
   typename std::vector<T>::iterator end() { return group_.begin() + have_; }
 
+  // The contiguous storage backing the records of view types (ReadSeqView,
+  // ReadPairView).  It is cleared, but keeps its capacity, each time the
+  // chunk is recycled, so a warmed-up parser does no per-record allocation.
+  std::vector<char>& arena() { return arena_; }
+
+  // The 2-bit encodings of the records' sequences, one per read (so two per
+  // record of a paired type, mate i of record r at 2 * r + i), filled in
+  // by the parser if enablePackedReads() is set.  Like the arena, these keep
+  // their storage when the chunk is recycled.
+  std::vector<PackedSeq>& packed() { return packed_; }
+
 private:
   std::vector<T> group_;
+  std::vector<char> arena_;
+  std::vector<PackedSeq> packed_;
   size_t want_;
   size_t have_;
 };
@@ -112,6 +190,11 @@ public:
   inline size_t size() { return chunk_->size(); }
   inline size_t want() const { return chunk_->want(); }
   T& operator[](size_t i) { return (*chunk_)[i]; }
+  // the 2-bit encoding of (mate `mate` of) record i; only available if the
+  // parser was told to enablePackedReads().
+  const PackedSeq& packed(size_t i, size_t mate = 0) {
+    return chunk_->packed()[is_paired_record<T>::value ? 2 * i + mate : i];
+  }
   typename std::vector<T>::iterator begin() { return chunk_->begin(); }
   typename std::vector<T>::iterator end() {
     return chunk_->begin() + chunk_->size();
@@ -125,6 +208,39 @@ private:
   moodycamel::ConsumerToken ct_;
 };
 
+/**
+ * How long the parsing and consuming threads spent waiting on each other,
+ * and how much parsing was done by consumers (see enableConsumerParsing()).
+ */
+struct ParserStats {
+  // time consumers spent in refill() with no chunk of reads available
+  uint64_t consumerStarvedNs{0};
+  // time the parsing threads spent waiting for an empty chunk to fill, or
+  // for room to hand a filled one over
+  uint64_t parserStarvedNs{0};
+  // time consumers spent parsing in place of waiting
+  uint64_t consumerParsingNs{0};
+  // number of times a consumer started (or resumed) parsing a file, and
+  // the number of times it handed the file back to return to consuming
+  uint64_t numConsumerParses{0};
+  uint64_t numConsumerSuspends{0};
+};
+
+// How a thread waits on the other side of the parser, i.e. a consumer for a
+// chunk of reads or a parsing thread for an empty chunk to fill.
+enum class WaitStrategy : uint8_t {
+  // spin, then yield, with exponential backoff.  This has the lowest
+  // latency, but a waiting thread keeps (most of) its core busy.
+  SPIN,
+  // sleep on a semaphore until the chunk is available, so that waiting
+  // threads use (almost) no CPU; e.g. when reading is I/O bound.
+  BLOCK
+};
+
+// A file (or file pair) whose parsing is in progress; defined in the
+// implementation, since it holds the kseq state.
+struct ParseJob;
+
 template <typename T> class FastxParser {
 public:
   FastxParser(std::vector<std::string> files, uint32_t numConsumers,
@@ -134,6 +250,39 @@ public:
               uint32_t numConsumers, uint32_t numParsers = 1,
               uint32_t chunkSize = 1000);
   ~FastxParser();
+  // Number of threads (per parsing thread) used to decompress the input.
+  // The default, 0, inflates the input on the parsing thread itself.  This
+  // must be set before the call to start().
+  void setDecompressionThreads(uint32_t numThreads);
+  // If enabled, a consumer that has waited in refill() for a while with no
+  // reads available, while files (pairs) remain to be parsed, parses one of
+  // them itself.  It hands the file back (to be resumed by the next thread
+  // that needs reads) and returns to consuming as soon as there is no empty
+  // chunk left to fill, i.e. once the consumers, rather than the parsers,
+  // are the bottleneck.  This lets the split between parsing and consuming
+  // threads follow the load rather than being fixed up front.  It must be
+  // set before the call to start().
+  void enableConsumerParsing(bool enable);
+  // How threads wait for chunks (WaitStrategy::SPIN by default).  This
+  // must be set before the call to start().
+  void setWaitStrategy(WaitStrategy ws);
+  // If enabled, uncompressed files are memory mapped and parsed in place
+  // rather than read through kseq.  Such a file (pair) is split into
+  // segments of one chunk's worth of records (at matching records for the
+  // two mates), so that all threads that parse -- dedicated ones as well as
+  // consumers, see enableConsumerParsing() -- can work on it at once.  View
+  // records (ReadSeqView, ReadPairView) then point into the mapping, unless
+  // a field spans several lines.  Compressed input is read as before.  This
+  // must be set before the call to start().
+  void enableMappedInput(bool enable);
+  // If enabled, the parsing threads also pack the sequence of every read at
+  // 2 bits per base, along with a mask of its non-ACGT bases (see
+  // PackedSeq and ReadGroup::packed()), so that consumers can cut k-mers
+  // (e.g. barcodes and UMIs) out of it without re-encoding the ASCII.  This
+  // must be set before the call to start().
+  void enablePackedReads(bool enable);
+  // Waiting / parsing times accumulated so far.
+  ParserStats stats() const;
   bool start();
   bool stop();
   ReadGroup<T> getReadGroup();
@@ -144,10 +293,52 @@ private:
   moodycamel::ProducerToken getProducerToken_();
   moodycamel::ConsumerToken getConsumerToken_();
 
+  // body of the dedicated parsing thread i
+  int parseWorker_(size_t i);
+  // a suspended job if there is one, or else a newly opened file (pair)
+  ParseJob* nextJob_();
+  ParseJob* openJob_(uint32_t fileID);
+  // Parse `job` until the end of the file or, if canSuspend, until there is
+  // no empty chunk left.  The tokens are those of a dedicated parsing
+  // thread, or nullptr for a consumer.
+  int runJob_(ParseJob& job, bool canSuspend, moodycamel::ConsumerToken* cCont,
+              moodycamel::ProducerToken* pRead);
+  // runJob_ for a memory mapped file (pair), which other threads may be
+  // parsing at the same time.
+  int runMappedJob_(ParseJob& job, bool canSuspend,
+                    moodycamel::ConsumerToken* cCont,
+                    moodycamel::ProducerToken* pRead);
+  // dispose of the job after runJob_ returned `res`; returns `res`.
+  int finishJob_(ParseJob* job, int res);
+  bool getEmptyChunk_(std::unique_ptr<ReadChunk<T>>& chunk,
+                      moodycamel::ConsumerToken* cCont, bool canSuspend);
+  void pushChunk_(std::unique_ptr<ReadChunk<T>>& chunk, size_t numRecords,
+                  moodycamel::ProducerToken* pRead);
+  // called by a starved consumer; returns false if there was nothing to parse
+  bool consumerParse_();
+  bool refillBlocking_(ReadGroup<T>& seqs);
+  // take a chunk from `queue` once `sema` says it holds one
+  void takeSignaled_(moodycamel::ConcurrentQueue<std::unique_ptr<ReadChunk<T>>>& queue,
+                     std::unique_ptr<ReadChunk<T>>& chunk,
+                     moodycamel::ConsumerToken* token);
+  // put `chunk` back in the container queue (and signal it)
+  void recycleChunk_(std::unique_ptr<ReadChunk<T>>&& chunk,
+                     moodycamel::ProducerToken* token);
+
   std::vector<std::string> inputStreams_;
   std::vector<std::string> inputStreams2_;
   uint32_t numParsers_;
+  uint32_t numDecompressionThreads_{0};
+  bool consumerParsing_{false};
+  WaitStrategy waitStrategy_{WaitStrategy::SPIN};
+  bool mappedInput_{false};
+  bool packedReads_{false};
+  // the number of files (pairs) that have not been completely parsed yet
   std::atomic<uint32_t> numParsing_;
+  // set when some file could not be parsed
+  std::atomic<bool> failed_{false};
+  // the minimum of the return codes of the files parsed by consumers
+  std::atomic<int> consumerResult_{0};
 
   // NOTE: Would like to use std::future<int> here instead, but that
   // solution doesn't seem to work.  It's unclear exactly why
@@ -165,6 +356,24 @@ private:
 
   // holds the indices of files (file-pairs) to be processed
   moodycamel::ConcurrentQueue<uint32_t> workQueue_;
+  // files (file-pairs) that a consumer started parsing and handed back
+  moodycamel::ConcurrentQueue<ParseJob*> suspendedJobs_;
+  // Memory mapped files (pairs).  Several threads may hold such a job, and
+  // the records handed out may point into its mapping, so they are only
+  // released by stop().
+  std::vector<std::unique_ptr<ParseJob>> mappedJobs_;
+  std::mutex mappedJobsMutex_;
+
+  // Count the chunks in readQueue_ and seqContainerQueue_, respectively.
+  // They are always signaled, but only waited on with WaitStrategy::BLOCK.
+  moodycamel::details::mpmc_sema::LightweightSemaphore readySema_;
+  moodycamel::details::mpmc_sema::LightweightSemaphore emptySema_;
+
+  std::atomic<uint64_t> consumerStarvedNs_{0};
+  std::atomic<uint64_t> parserStarvedNs_{0};
+  std::atomic<uint64_t> consumerParsingNs_{0};
+  std::atomic<uint64_t> numConsumerParses_{0};
+  std::atomic<uint64_t> numConsumerSuspends_{0};
 
   std::vector<std::unique_ptr<moodycamel::ProducerToken>> produceReads_;
   std::vector<std::unique_ptr<moodycamel::ConsumerToken>> consumeContainers_;
@@ -0,0 +1,235 @@
+#ifndef FASTX_PARSER_STREAMS_HPP
+#define FASTX_PARSER_STREAMS_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <zlib.h>
+
+// from zstd.h (ZSTD_DCtx / ZSTD_DStream), which is only needed, and only
+// available, when salmon is built with zstd support (HAVE_ZSTD).
+struct ZSTD_DCtx_s;
+
+namespace fastx_parser {
+
+// The compression of an input file, as told by its first bytes.
+enum class Compression : uint8_t {
+  NONE,
+  GZIP,
+  // gzip made up of BGZF blocks (i.e. as written by bgzip)
+  BGZF,
+  ZSTD
+};
+
+Compression detectCompression(const std::string& fname);
+
+/**
+ * The source of (decompressed) bytes from which kseq pulls records.
+ * read() follows the convention expected by kseq; it returns the number
+ * of bytes written to buf, 0 at the end of the stream, and -1 on error.
+ */
+class InputStream {
+public:
+  virtual ~InputStream() {}
+  virtual int read(void* buf, unsigned len) = 0;
+};
+
+// The read function handed to KSEQ_INIT
+inline int readInputStream(InputStream* s, void* buf, unsigned len) {
+  return s->read(buf, len);
+}
+
+/**
+ * Plain or gzip-compressed input, inflated on the calling thread through
+ * zlib's gzread.  This is the historical behavior of the parser.
+ */
+class GzInputStream : public InputStream {
+public:
+  explicit GzInputStream(const std::string& fname);
+  ~GzInputStream() override;
+  int read(void* buf, unsigned len) override;
+
+private:
+  gzFile fp_{nullptr};
+};
+
+/**
+ * zstd-compressed input, decompressed on the calling thread.  If salmon was
+ * built without zstd support, reading from it fails.
+ */
+class ZstdInputStream : public InputStream {
+public:
+  explicit ZstdInputStream(const std::string& fname);
+  ~ZstdInputStream() override;
+  int read(void* buf, unsigned len) override;
+
+private:
+  std::FILE* fp_{nullptr};
+  ZSTD_DCtx_s* ds_{nullptr};
+  std::vector<char> in_;
+  size_t inPos_{0};
+  size_t inLen_{0};
+  bool eof_{false};
+  // the last call to the decoder finished a frame (or none was started)
+  bool frameDone_{true};
+  bool ok_{true};
+};
+
+/**
+ * Input that is decompressed off of the parsing thread.
+ *
+ * If the file is BGZF (a series of independent gzip members, each carrying
+ * its compressed size in the "BC" extra sub-field), a reader thread splits
+ * it into batches of blocks that are inflated concurrently by a small pool
+ * of workers, and the consumer receives the inflated batches back in file
+ * order.  Likewise, a zstd file made up of many (reasonably small) frames,
+ * as written by pzstd or by concatenating compressed pieces, is split at
+ * its frame boundaries, which can be found from the frame and block
+ * headers.  Any other input (plain text, regular, possibly multi-member,
+ * gzip, or zstd with a single large frame) cannot be split without
+ * decompressing it, so the reader thread simply decompresses it
+ * sequentially ahead of the consumer.
+ */
+class ParallelInflateStream : public InputStream {
+public:
+  ParallelInflateStream(const std::string& fname, uint32_t numWorkers,
+                        Compression compression);
+  ~ParallelInflateStream() override;
+  int read(void* buf, unsigned len) override;
+
+private:
+  enum class SlotState : uint8_t { EMPTY, READ, DONE };
+
+  struct InflateJob {
+    SlotState state{SlotState::EMPTY};
+    bool ok{true};
+    std::vector<unsigned char> in;
+    // (offset into in, compressed size, inflated size) for each block
+    std::vector<std::tuple<size_t, uint32_t, uint32_t>> blocks;
+    std::vector<char> out;
+    size_t outLen{0};
+  };
+
+  void readBGZF_();
+  void readZstdFrames_();
+  void readSequential_();
+  void inflateWorker_();
+  bool inflateJob_(InflateJob& job, z_stream& zs);
+  bool decodeZstdJob_(InflateJob& job, ZSTD_DCtx_s* dctx);
+  // claim the next free slot in the ring (or nullptr if we are stopping).
+  InflateJob* acquireSlot_();
+  void publishSlot_(bool needsInflate);
+  void finishReading_(bool ok);
+
+  std::string fname_;
+  Compression compression_;
+  // the blocks handed to the workers are zstd frames, not BGZF blocks
+  bool zstdFrames_{false};
+  std::FILE* fp_{nullptr};
+  // the input, when it is decompressed sequentially (see readSequential_)
+  std::unique_ptr<InputStream> source_{nullptr};
+
+  std::vector<std::unique_ptr<InflateJob>> ring_;
+  uint64_t readID_{0};
+  uint64_t consumeID_{0};
+  uint64_t inflateID_{0};
+  bool readerDone_{false};
+  bool readerOK_{true};
+  bool stop_{false};
+
+  std::mutex m_;
+  std::condition_variable readerCV_;
+  std::condition_variable workerCV_;
+  std::condition_variable consumerCV_;
+
+  std::thread reader_;
+  std::vector<std::thread> workers_;
+
+  InflateJob* cur_{nullptr};
+  size_t curPos_{0};
+};
+
+// true if the file starts with a BGZF block header
+bool isBGZF(const std::string& fname);
+
+/**
+ * A read-only memory mapping of an uncompressed FASTA/Q file.  Records are
+ * located directly in the mapping (see nextMappedRecord), so they can be
+ * handed out without being copied through kseq's buffers, and different
+ * parts of the file can be parsed by different threads.
+ */
+class MappedFastxFile {
+public:
+  explicit MappedFastxFile(const std::string& fname);
+  ~MappedFastxFile();
+  MappedFastxFile(const MappedFastxFile&) = delete;
+  MappedFastxFile& operator=(const MappedFastxFile&) = delete;
+  bool ok() const { return data_ != nullptr; }
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  const char* data_{nullptr};
+  size_t size_{0};
+};
+
+// true if fname is a non-empty regular file that doesn't look compressed
+// (i.e. it can be mapped and parsed in place).
+bool isMappable(const std::string& fname);
+
+/**
+ * A record located in a MappedFastxFile.  If the sequence (or quality
+ * string) spans several lines, [seq, seq + seqSpan) includes the line
+ * breaks, and seqLen (qualLen) gives the length without them; the field
+ * then has to be copied out with copyStripped().
+ */
+struct MappedRecord {
+  const char* name{nullptr};
+  size_t nameLen{0};
+  const char* seq{nullptr};
+  size_t seqSpan{0};
+  size_t seqLen{0};
+  const char* qual{nullptr};
+  size_t qualSpan{0};
+  size_t qualLen{0};
+};
+
+/**
+ * Parse the record starting at (or, as with kseq, after any junk following)
+ * data[pos], and advance pos past it.  The return value follows kseq_read:
+ * the sequence length, -1 at the end of the data, or -2 if a FASTQ record
+ * is truncated or its quality string doesn't match its sequence.
+ */
+int nextMappedRecord(const char* data, size_t size, size_t& pos,
+                     MappedRecord& rec);
+
+/**
+ * Advance pos past the record at data[pos], returning as nextMappedRecord
+ * does.  The common case of a 4-line FASTQ record is recognized from its
+ * line breaks alone, which makes this cheaper than parsing the record; it is
+ * used to find the boundaries of the segments handed to different threads.
+ */
+int skipMappedRecord(const char* data, size_t size, size_t& pos);
+
+// Copy [src, src + span) to dst, dropping line breaks; returns the number
+// of bytes written.
+size_t copyStripped(const char* src, size_t span, char* dst);
+
+/**
+ * Open `fname` for parsing.  If numDecompressionThreads is 0 the file is
+ * read through gzread on the parsing thread; otherwise decompression is
+ * moved to a ParallelInflateStream with (up to) that many workers.
+ */
+std::unique_ptr<InputStream> openInputStream(const std::string& fname,
+                                             uint32_t numDecompressionThreads);
+
+} // namespace fastx_parser
+
+#endif // FASTX_PARSER_STREAMS_HPP
@@ -0,0 +1,151 @@
+#ifndef __GC_BIT_VECTOR_HPP__
+#define __GC_BIT_VECTOR_HPP__
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "RefSeqView.hpp"
+
+/**
+ * The GC content of a sequence, as one bit per base (set for G / C) with
+ * rank support, so that the number of G / C bases in any window is exact
+ * and takes two lookups.
+ *
+ * The bits are stored in blocks of 256 bases (4 words), each of which is
+ * prefixed by a header word holding the number of G / C bases before the
+ * block (in the low 32 bits) and, in one byte each, the number in the
+ * block before its 2nd, 3rd and 4th word (in bits 40-47, 48-55 and 56-63):
+ * 5 words (40 bytes) per block, or 1.25 bits per base, against the 32 bits
+ * per base of a prefix-count array.  A lookup reads a single block, so it
+ * touches one or two cache lines, and takes a single popcount.
+ */
+class GCBitVector {
+public:
+  static constexpr size_t wordsPerBlock{5};
+  static constexpr size_t basesPerBlock{64 * (wordsPerBlock - 1)};
+
+  // build from an ASCII sequence (either case)
+  void build(const char* seq, size_t len) {
+    init_(len);
+    uint64_t total{0};
+    for (size_t b = 0; b < numBlocks_(); ++b) {
+      uint64_t* blk = &data_[wordsPerBlock * b];
+      uint64_t blockStart = total;
+      for (size_t w = 0; w + 1 < wordsPerBlock; ++w) {
+        size_t start = b * basesPerBlock + 64 * w;
+        size_t end = std::min(start + 64, len);
+        uint64_t bits{0};
+        for (size_t i = start; i < end; ++i) {
+          auto c = std::toupper(seq[i]);
+          bits |= static_cast<uint64_t>(c == 'G' or c == 'C') << (i - start);
+        }
+        blk[1 + w] = bits;
+        setHeader_(blk, w, blockStart, total);
+        total += popcount_(bits);
+      }
+    }
+  }
+
+  // build from a 2-bit sequence, 32 bases at a time
+  void build(const RefSeqView& seq) {
+    size_t len = seq.size();
+    init_(len);
+    uint64_t total{0};
+    for (size_t b = 0; b < numBlocks_(); ++b) {
+      uint64_t* blk = &data_[wordsPerBlock * b];
+      uint64_t blockStart = total;
+      for (size_t w = 0; w + 1 < wordsPerBlock; ++w) {
+        uint64_t bits{0};
+        for (size_t h = 0; h < 2; ++h) {
+          size_t start = b * basesPerBlock + 64 * w + 32 * h;
+          if (start >= len) {
+            break;
+          }
+          size_t k = std::min(len - start, size_t(32));
+          bits |= static_cast<uint64_t>(gcMask(seq.word(start, k))) << (32 * h);
+        }
+        blk[1 + w] = bits;
+        setHeader_(blk, w, blockStart, total);
+        total += popcount_(bits);
+      }
+    }
+  }
+
+  size_t size() const { return len_; }
+  size_t sizeInBytes() const { return data_.capacity() * sizeof(uint64_t); }
+
+  // The number of G / C bases in [0, p] (i.e. inclusive of p, as the
+  // per-base GC prefix counts were); requires p < size().
+  inline uint32_t count(size_t p) const {
+    const uint64_t* blk = &data_[wordsPerBlock * (p / basesPerBlock)];
+    size_t off = p % basesPerBlock;
+    size_t w = off >> 6;
+    uint64_t header = blk[0];
+    uint64_t mask = ~uint64_t(0) >> (63 - (off & 63));
+    return static_cast<uint32_t>(header & 0xFFFFFFFF) +
+           static_cast<uint32_t>((header >> (32 + 8 * w)) & 0xFF) +
+           static_cast<uint32_t>(popcount_(blk[1 + w] & mask));
+  }
+
+  // The number of G / C bases in [s, e] (closed on both sides).
+  inline uint32_t count(size_t s, size_t e) const {
+    return count(e) - ((s > 0) ? count(s - 1) : 0);
+  }
+
+  /**
+   * Given 32 2-bit bases (A = 0, C = 1, G = 2, T = 3, first base in the low
+   * bits), return a 32-bit mask with bit i set iff base i is a G or a C.
+   * C and G are the codes whose two bits differ, so the mask is the XOR of
+   * the high and low bit of each base, compacted.
+   */
+  static inline uint32_t gcMask(uint64_t w) {
+    uint64_t x = (w ^ (w >> 1)) & 0x5555555555555555ULL;
+    x = (x | (x >> 1)) & 0x3333333333333333ULL;
+    x = (x | (x >> 2)) & 0x0F0F0F0F0F0F0F0FULL;
+    x = (x | (x >> 4)) & 0x00FF00FF00FF00FFULL;
+    x = (x | (x >> 8)) & 0x0000FFFF0000FFFFULL;
+    x = (x | (x >> 16)) & 0x00000000FFFFFFFFULL;
+    return static_cast<uint32_t>(x);
+  }
+
+private:
+  // Without the popcnt instruction (the default on x86-64), the builtin is a
+  // call into libgcc, which is slower than the inline bit-parallel count.
+  static inline uint64_t popcount_(uint64_t x) {
+#if defined(__POPCNT__) || !defined(__x86_64__)
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (x * 0x0101010101010101ULL) >> 56;
+#endif
+  }
+
+  // Called with the count before each word w of a block; records the count
+  // before the block (for w = 0), or the count in the block before w.
+  static void setHeader_(uint64_t* blk, size_t w, uint64_t blockStart,
+                         uint64_t total) {
+    if (w == 0) {
+      blk[0] = blockStart;
+    } else {
+      blk[0] |= (total - blockStart) << (32 + 8 * w);
+    }
+  }
+
+  size_t numBlocks_() const { return (len_ + basesPerBlock - 1) / basesPerBlock; }
+
+  void init_(size_t len) {
+    len_ = len;
+    data_.assign(wordsPerBlock * numBlocks_(), 0);
+    data_.shrink_to_fit();
+  }
+
+  std::vector<uint64_t> data_;
+  size_t len_{0};
+};
+
+#endif // __GC_BIT_VECTOR_HPP__
@@ -0,0 +1,148 @@
+#ifndef __MAPPING_RECORDS_HPP__
+#define __MAPPING_RECORDS_HPP__
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "pufferfish/Util.hpp"
+
+class Transcript;
+
+namespace fastx_parser {
+class ParallelInflateStream;
+}
+
+/**
+ * The mapping record file (--saveMappings / --fromMappings) holds what
+ * quantification needs to know about the mappings of every fragment of a
+ * read library, so that the library can be quantified again (e.g. with
+ * other bias or inference options) without being mapped again.
+ *
+ * It is BGZF (written by the BAMWriter, read back by a
+ * fastx_parser::ParallelInflateStream), and contains
+ *
+ *   - a header (see FileHeader), and
+ *   - a chunk for each chunk of reads processed by a mapping thread : the
+ *     number of fragments and of encoded bytes (uint32 each), followed by
+ *     the fragments.
+ *
+ * A fragment is its number of alignments (a varint; unmapped fragments are
+ * recorded, with 0 alignments, so that the fragments are counted as when
+ * they were mapped), then, if it has any, a byte of flags and its
+ * alignments.  An alignment is its target (as a zigzag varint delta from
+ * that of the previous alignment of the fragment), position, orientation
+ * and mate status, read length, fragment length, score, number of hits and
+ * the estimated alignment probability (if it isn't 1), plus the position
+ * (relative to the read's), length and score of the mate, if both ends
+ * are mapped.  The integers are little endian.  The CIGAR strings are not
+ * kept, as they aren't used in quantification.
+ */
+namespace salmon {
+namespace mapping_records {
+
+using QuasiAlignment = pufferfish::util::QuasiAlignment;
+
+constexpr uint32_t formatVersion{1};
+
+// What the file records about the run that wrote it
+struct FileHeader {
+  uint32_t version{formatVersion};
+  // the targets of the index that was mapped against (see
+  // transcriptNamesHash), so that the file is only replayed against it
+  uint64_t numTranscripts{0};
+  uint64_t namesHash{0};
+  // the library type (LibraryFormat::formatID()), and whether it was to be
+  // detected automatically (-l A)
+  uint8_t libFormatID{0};
+  bool autoDetect{false};
+};
+
+std::string encodeHeader(const FileHeader& header);
+
+uint64_t transcriptNamesHash(const std::vector<Transcript>& transcripts);
+
+/**
+ * Encodes the fragments of a chunk of reads.  Each mapping thread has its
+ * own encoder, and hands the chunk to the BAMWriter once it's mapped.
+ */
+class ChunkEncoder {
+public:
+  // isPaired : both ends of the fragment were mapped (as used when sampling
+  // the sequence bias)
+  void append(bool isPaired, const std::vector<QuasiAlignment>& alignments);
+
+  // Move the encoded chunk into out, and start a new one
+  void finish(std::string& out);
+
+  uint32_t numFragments() const { return numFragments_; }
+
+private:
+  std::string payload_;
+  uint32_t numFragments_{0};
+};
+
+/**
+ * Decodes the fragments of a chunk, as read by
+ * MappingRecordReader::nextChunk, one after another.
+ */
+class ChunkDecoder {
+public:
+  ChunkDecoder(const std::string& chunk)
+      : p_(chunk.data()), end_(chunk.data() + chunk.size()) {}
+
+  // Decode the next fragment into alignments (which is cleared first);
+  // false if the chunk is malformed
+  bool next(bool& isPaired, std::vector<QuasiAlignment>& alignments);
+
+private:
+  bool getVarint_(uint64_t& v);
+  bool getBytes_(void* out, size_t len);
+
+  const char* p_;
+  const char* end_;
+  // the (unused) CIGAR of the decoded alignments
+  std::string cigar_;
+};
+
+/**
+ * Reads the chunks of a mapping record file.  The file is inflated off of
+ * the calling threads; the chunks are handed out, one at a time, to the
+ * threads that call nextChunk, which decode them on their own.
+ */
+class MappingRecordReader {
+public:
+  // Open path, and read its header (see good())
+  MappingRecordReader(const std::string& path, uint32_t numThreads);
+  ~MappingRecordReader();
+
+  // true if the file could be opened, has a valid header, and everything
+  // read from it so far was valid
+  bool good() const;
+  // why the file is not good() (empty if it is)
+  std::string error() const;
+
+  const FileHeader& header() const { return header_; }
+
+  // Read the next chunk; false at the end of the file (or if it isn't
+  // good())
+  bool nextChunk(uint32_t& numFragments, std::string& chunk);
+
+private:
+  bool readFully_(void* buf, size_t len, bool& atEnd);
+  void fail_(std::string msg);
+
+  std::unique_ptr<fastx_parser::ParallelInflateStream> in_;
+  FileHeader header_;
+  bool ok_{true};
+  bool done_{false};
+  std::string error_;
+  mutable std::mutex m_;
+};
+
+} // namespace mapping_records
+} // namespace salmon
+
+#endif // __MAPPING_RECORDS_HPP__
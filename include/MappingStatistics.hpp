@@ -2,6 +2,7 @@
 #define __SALMON_MAPPING_STATISTICS__
 
 #include <atomic>
+#include <chrono>
 
 // class to collect statistics we may want about mapping / alignment
 class MappingStatistics {
@@ -12,6 +13,35 @@ public:
   std::atomic<uint64_t> numFragmentsFiltered{0};
   std::atomic<uint64_t> numDecoyFragments{0};
   std::atomic<uint64_t> numDovetails{0};
+  // Time (in ns) the mapping threads waited for reads, the parsing threads
+  // waited on the mapping threads, and the mapping threads spent parsing
+  // (see fastx_parser::ParserStats).
+  std::atomic<uint64_t> mapperStarvedNs{0};
+  std::atomic<uint64_t> parserStarvedNs{0};
+  std::atomic<uint64_t> mapperParsingNs{0};
+  // Data TLB misses during mapping, if they were counted (--countTLBMisses).
+  std::atomic<uint64_t> dtlbMisses{0};
+  std::atomic<bool> dtlbMissesCounted{false};
+  // Lookups in, and hits of, the duplicate read caches (--dupCacheSize).
+  std::atomic<uint64_t> numDupCacheLookups{0};
+  std::atomic<uint64_t> numDupCacheHits{0};
+  // The staged pipeline (--inferenceThreads) : its threads and queue depth
+  // (0 if it wasn't used), the chunks handed from the mapping threads to the
+  // inference threads, and the time (in ns) the mapping threads waited for a
+  // free slot in the queue and the inference threads waited for a chunk.
+  uint32_t numInferenceThreads{0};
+  uint32_t inferenceQueueDepth{0};
+  std::atomic<uint64_t> numInferenceBatches{0};
+  std::atomic<uint64_t> mapperQueueWaitNs{0};
+  std::atomic<uint64_t> inferenceQueueWaitNs{0};
+  // Startup: the time taken to start the read parser, to load the index and
+  // then the transcripts, and from the start of quantification to the start
+  // of the mapping threads (the parser runs while the index loads).
+  std::chrono::steady_clock::time_point startupBegin{std::chrono::steady_clock::now()};
+  double parserStartSeconds{0.0};
+  double indexLoadSeconds{0.0};
+  double transcriptLoadSeconds{0.0};
+  double secondsToMapping{0.0};
 };
 
 #endif // __SALMON_MAPPING_STATISTICS__
@@ -0,0 +1,106 @@
+#ifndef __MINIMIZER_ORDER_HPP__
+#define __MINIMIZER_ORDER_HPP__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "FastxParser.hpp"
+
+/**
+ * An order in which to map the reads of a chunk: by the minimizer of each
+ * read (the k-mer of the read, or of its first mate, whose canonical form
+ * has the smallest hash), so that reads that share a k-mer -- and so likely
+ * come from the same part of the transcriptome -- are mapped one after the
+ * other, and their lookups hit the same contigs, and cache lines, of the
+ * index.  The reads themselves aren't moved; order[j] is the index of the
+ * j-th read to map.  If disabled, the order is that of the chunk.
+ */
+class MinimizerOrder {
+public:
+  MinimizerOrder(bool enabled, uint32_t k)
+      : enabled_(enabled), k_(std::min(k, uint32_t(32))) {}
+
+  bool enabled() const { return enabled_; }
+
+  // Compute the order of the n reads of the group rg.
+  template <typename ReadGroupT> void compute(ReadGroupT& rg, size_t n) {
+    if (!enabled_) {
+      return;
+    }
+    keys_.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      keys_[i] = {key_(rg[i]), static_cast<uint32_t>(i)};
+    }
+    // by minimizer, and then in the order of the chunk
+    std::sort(keys_.begin(), keys_.end());
+  }
+
+  size_t operator[](size_t j) const { return enabled_ ? keys_[j].second : j; }
+
+  /**
+   * The minimizer hash of seq (over its canonical k-mers, with k <= 32), or
+   * the largest hash if it has no k-mer without an N.
+   */
+  static uint64_t minimizer(const char* seq, size_t len, uint32_t k) {
+    uint64_t best = ~uint64_t(0);
+    if (len < k) {
+      return best;
+    }
+    uint64_t mask = (k == 32) ? ~uint64_t(0) : ((uint64_t(1) << (2 * k)) - 1);
+    uint32_t shift = 2 * (k - 1);
+    uint64_t fw{0}, rc{0};
+    uint32_t valid{0};
+    for (size_t i = 0; i < len; ++i) {
+      uint64_t c;
+      switch (seq[i]) {
+      case 'A': case 'a': c = 0; break;
+      case 'C': case 'c': c = 1; break;
+      case 'G': case 'g': c = 2; break;
+      case 'T': case 't': c = 3; break;
+      default:
+        valid = 0;
+        continue;
+      }
+      fw = ((fw << 2) | c) & mask;
+      rc = (rc >> 2) | ((3 - c) << shift);
+      if (++valid >= k) {
+        best = std::min(best, mix_(std::min(fw, rc)));
+      }
+    }
+    return best;
+  }
+
+private:
+  template <typename RecordT>
+  typename std::enable_if<fastx_parser::is_paired_record<RecordT>::value, uint64_t>::type
+  key_(RecordT& r) const {
+    return minimizer(r.first.seq.data(), r.first.seq.size(), k_);
+  }
+
+  template <typename RecordT>
+  typename std::enable_if<!fastx_parser::is_paired_record<RecordT>::value, uint64_t>::type
+  key_(RecordT& r) const {
+    return minimizer(r.seq.data(), r.seq.size(), k_);
+  }
+
+  // an invertible mix, so that the order of the minimizers is random
+  // rather than lexicographic (which would favour poly-A k-mers)
+  static uint64_t mix_(uint64_t x) {
+    x ^= x >> 31;
+    x *= 0x7fb5d329728ea185ULL;
+    x ^= x >> 27;
+    x *= 0x81dadef4bc2dd44dULL;
+    x ^= x >> 33;
+    return x;
+  }
+
+  bool enabled_;
+  uint32_t k_;
+  std::vector<std::pair<uint64_t, uint32_t>> keys_;
+};
+
+#endif // __MINIMIZER_ORDER_HPP__
@@ -0,0 +1,164 @@
+#ifndef __PACKED_EQ_CLASSES_HPP__
+#define __PACKED_EQ_CLASSES_HPP__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * The (valid) equivalence classes of an EquivalenceClassBuilder<TGValue>,
+ * packed for the offline inference.
+ *
+ * In the builder's eqVec, every class holds its transcripts, weights and
+ * combined weights in vectors of its own, so each pass of the EM (or of a
+ * bootstrap, or of the Gibbs sampler) over the classes follows three
+ * pointers per class, to allocations scattered over the heap.  Here, the
+ * transcripts (and weights) of all of the classes are laid out one after the
+ * other in single arrays, with those of class i in [offsets[i],
+ * offsets[i+1]), and the counts are kept in an array of their own, so a pass
+ * reads each array front to back.
+ *
+ * Only the transcripts of a class are packed (not the range factorization
+ * bins that follow them in its label), and the weights can be held in single
+ * precision (WeightT = float), which halves the memory the passes read.
+ * classIDs maps each packed class back to its entry of eqVec.
+ */
+template <typename WeightT = double>
+struct PackedEqClasses {
+  PackedEqClasses() = default;
+
+  // Pack the valid classes of eqVec; the combined weights are copied from
+  // the classes that have them, and are 0 for the others.
+  template <typename EQVecT> explicit PackedEqClasses(const EQVecT& eqVec) {
+    size_t numClasses{0};
+    size_t numEntries{0};
+    for (auto& kv : eqVec) {
+      if (kv.first.valid) {
+        ++numClasses;
+        numEntries += kv.second.weights.size();
+      }
+    }
+    offsets.reserve(numClasses + 1);
+    counts.reserve(numClasses);
+    classIDs.reserve(numClasses);
+    txps.reserve(numEntries);
+    weights.reserve(numEntries);
+    combinedWeights.reserve(numEntries);
+
+    offsets.push_back(0);
+    for (size_t eqID = 0; eqID < eqVec.size(); ++eqID) {
+      auto& kv = eqVec[eqID];
+      if (!kv.first.valid) {
+        continue;
+      }
+      // the weights have an entry per transcript; the label may have
+      // (range factorization) bins after them
+      size_t groupSize = kv.second.weights.size();
+      const auto& auxs = kv.second.combinedWeights;
+      bool hasCombined = (auxs.size() == groupSize);
+      for (size_t i = 0; i < groupSize; ++i) {
+        txps.push_back(kv.first.txps[i]);
+        weights.push_back(static_cast<WeightT>(kv.second.weights[i]));
+        combinedWeights.push_back(hasCombined ? static_cast<WeightT>(auxs[i])
+                                              : WeightT(0));
+      }
+      offsets.push_back(txps.size());
+      counts.push_back(kv.second.count);
+      classIDs.push_back(static_cast<uint32_t>(eqID));
+    }
+  }
+
+  // The number of (packed) classes
+  size_t size() const { return counts.size(); }
+
+  // The number of transcripts in class i
+  size_t groupSize(size_t i) const { return offsets[i + 1] - offsets[i]; }
+
+  // Remove the classes i for which drop[i] is true, keeping the rest in
+  // order
+  void remove(const std::vector<bool>& drop) {
+    size_t out{0};
+    uint64_t outOffset{0};
+    for (size_t i = 0; i < size(); ++i) {
+      uint64_t b = offsets[i];
+      uint64_t e = offsets[i + 1];
+      if (drop[i]) {
+        continue;
+      }
+      offsets[out] = outOffset;
+      for (uint64_t j = b; j < e; ++j, ++outOffset) {
+        txps[outOffset] = txps[j];
+        weights[outOffset] = weights[j];
+        combinedWeights[outOffset] = combinedWeights[j];
+      }
+      counts[out] = counts[i];
+      classIDs[out] = classIDs[i];
+      ++out;
+    }
+    offsets[out] = outOffset;
+    offsets.resize(out + 1);
+    counts.resize(out);
+    classIDs.resize(out);
+    txps.resize(outOffset);
+    weights.resize(outOffset);
+    combinedWeights.resize(outOffset);
+  }
+
+  // Reorder the classes, so that the i-th is the one that was order[i]
+  // (order is a permutation of the classes)
+  void reorder(const std::vector<uint32_t>& order) {
+    PackedEqClasses<WeightT> r;
+    r.offsets.reserve(offsets.size());
+    r.counts.reserve(counts.size());
+    r.classIDs.reserve(classIDs.size());
+    r.txps.reserve(txps.size());
+    r.weights.reserve(weights.size());
+    r.combinedWeights.reserve(combinedWeights.size());
+    r.offsets.push_back(0);
+    for (auto i : order) {
+      r.txps.insert(r.txps.end(), txps.begin() + offsets[i],
+                    txps.begin() + offsets[i + 1]);
+      r.weights.insert(r.weights.end(), weights.begin() + offsets[i],
+                       weights.begin() + offsets[i + 1]);
+      r.combinedWeights.insert(r.combinedWeights.end(),
+                               combinedWeights.begin() + offsets[i],
+                               combinedWeights.begin() + offsets[i + 1]);
+      r.offsets.push_back(r.txps.size());
+      r.counts.push_back(counts[i]);
+      r.classIDs.push_back(classIDs[i]);
+    }
+    std::swap(*this, r);
+  }
+
+  // Copy the combined weights (in the precision of WeightT) back to the
+  // classes of eqVec that were packed, and not removed since, for what reads
+  // them from there (e.g. the Gibbs sampler).  The weights are only copied
+  // back if withWeights, i.e. if they were replaced after packing (as with
+  // --noRichEqClasses); otherwise, eqVec keeps the weights it was packed
+  // from, which those packed may be a rounding of (e.g. for --dumpEqWeights).
+  template <typename EQVecT>
+  void storeWeights(EQVecT& eqVec, bool withWeights) const {
+    for (size_t i = 0; i < size(); ++i) {
+      auto& v = eqVec[classIDs[i]].second;
+      if (withWeights) {
+        std::copy(weights.begin() + offsets[i],
+                  weights.begin() + offsets[i + 1], v.weights.begin());
+      }
+      v.combinedWeights.assign(combinedWeights.begin() + offsets[i],
+                               combinedWeights.begin() + offsets[i + 1]);
+    }
+  }
+
+  // The start of each class in txps (and the weights), and the end of the
+  // last one
+  std::vector<uint64_t> offsets;
+  std::vector<uint32_t> txps;
+  std::vector<WeightT> weights;
+  std::vector<WeightT> combinedWeights;
+  std::vector<uint64_t> counts;
+  // The index of each class in eqVec
+  std::vector<uint32_t> classIDs;
+};
+
+#endif // __PACKED_EQ_CLASSES_HPP__
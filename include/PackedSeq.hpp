@@ -0,0 +1,115 @@
+#ifndef __PACKED_SEQ_HPP__
+#define __PACKED_SEQ_HPP__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace fastx_parser {
+
+/**
+ * A sequence packed at 2 bits per base (A = 0, C = 1, G = 2, T = 3), 32
+ * bases to a word, with base i in bits [2 * (i % 32), 2 * (i % 32) + 2) of
+ * word i / 32.  This is the layout of pufferfish's 2-bit reference sequence
+ * and of combinelib's k-mers (e.g. alevin's UMIs), so that k-mers can be cut
+ * out of it with a shift and a mask.  Any character other than A/C/G/T
+ * (either case) is stored as A and flagged in the N-mask, which holds one
+ * bit per base.
+ */
+class PackedSeq {
+public:
+  void encode(const char* s, size_t len) {
+    static const CodeTable codes;
+    len_ = len;
+    numN_ = 0;
+    bits_.assign((len + 31) / 32, 0);
+    nmask_.assign((len + 63) / 64, 0);
+    for (size_t i = 0; i < len; ++i) {
+      uint64_t c = codes.code[static_cast<unsigned char>(s[i])];
+      if (c > 3) {
+        nmask_[i >> 6] |= uint64_t(1) << (i & 63);
+        ++numN_;
+        c = 0;
+      }
+      bits_[i >> 5] |= c << (2 * (i & 31));
+    }
+  }
+
+  size_t size() const { return len_; }
+  bool empty() const { return len_ == 0; }
+
+  uint8_t base(size_t i) const {
+    return (bits_[i >> 5] >> (2 * (i & 31))) & 0x3;
+  }
+  bool isN(size_t i) const { return (nmask_[i >> 6] >> (i & 63)) & 1; }
+  bool hasN() const { return numN_ > 0; }
+
+  // true if any base in [pos, pos + len) is not A/C/G/T
+  bool hasN(size_t pos, size_t len) const {
+    if (numN_ == 0 or len == 0) {
+      return false;
+    }
+    size_t end = pos + len;
+    while (pos < end) {
+      size_t off = pos & 63;
+      size_t n = std::min(end - pos, 64 - off);
+      uint64_t m = (n == 64) ? ~uint64_t(0) : ((uint64_t(1) << n) - 1) << off;
+      if (nmask_[pos >> 6] & m) {
+        return true;
+      }
+      pos += n;
+    }
+    return false;
+  }
+
+  // The k <= 32 bases starting at pos, in the layout of the packed sequence
+  // (the first base in the lowest bits).  Requires pos + k <= size().
+  uint64_t word(size_t pos, size_t k) const {
+    size_t bit = 2 * pos;
+    size_t w = bit >> 6;
+    size_t off = bit & 63;
+    uint64_t v = bits_[w] >> off;
+    if (off + 2 * k > 64) {
+      v |= bits_[w + 1] << (64 - off);
+    }
+    return (k == 32) ? v : v & ((uint64_t(1) << (2 * k)) - 1);
+  }
+
+  // As word(), but with the first base in the highest bits (the layout of
+  // jellyfish's mer_dna, and so of the contexts of the SBModel).
+  uint64_t wordMSBFirst(size_t pos, size_t k) const {
+    return reverseBases(word(pos, k), k);
+  }
+
+  // reverse the order of the k 2-bit bases of w
+  static uint64_t reverseBases(uint64_t w, size_t k) {
+    w = ((w >> 2) & 0x3333333333333333ULL) | ((w & 0x3333333333333333ULL) << 2);
+    w = ((w >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((w & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    w = __builtin_bswap64(w);
+    return w >> (64 - 2 * k);
+  }
+
+private:
+  struct CodeTable {
+    uint8_t code[256];
+    CodeTable() {
+      for (auto& c : code) {
+        c = 4;
+      }
+      code['A'] = code['a'] = 0;
+      code['C'] = code['c'] = 1;
+      code['G'] = code['g'] = 2;
+      code['T'] = code['t'] = 3;
+    }
+  };
+
+  std::vector<uint64_t> bits_;
+  std::vector<uint64_t> nmask_;
+  size_t len_{0};
+  size_t numN_{0};
+};
+
+} // namespace fastx_parser
+
+#endif // __PACKED_SEQ_HPP__
@@ -0,0 +1,70 @@
+#ifndef SALMON_QUANT_JOB_UTILS
+#define SALMON_QUANT_JOB_UTILS
+
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "spdlog/spdlog.h"
+
+class SalmonIndex;
+
+namespace salmon {
+
+namespace job_utils {
+
+/**
+ * Helpers for running `salmon quant` jobs against an index that is loaded
+ * once (by `salmon serve`, and by `salmon quant --batch`).  Each job runs in
+ * a process forked from the one that loaded the index; the job shares the
+ * loaded index with it (its pages are only read), but the rest of its state
+ * is its own, so that it runs exactly as `salmon quant` would with the same
+ * arguments.
+ */
+
+/**
+ * Load the index in indexDir, and register it as the resident index (see
+ * index_utils::residentIndex), which the quantification of the jobs then
+ * uses.  Exits if indexDir isn't a (pufferfish-based) salmon index.
+ */
+std::shared_ptr<SalmonIndex>
+loadResidentIndex(const std::string& indexDir, uint32_t prefetchThreads,
+                  std::shared_ptr<spdlog::logger>& log);
+
+/**
+ * The (long) names of the options of mapping-based `salmon quant` that args
+ * set.  The arguments are parsed with quant's own options, so that every
+ * form quant accepts is recognized ("-p 8", "-p8", "--threads=8", or an
+ * unambiguous abbreviation such as "--ind idx"); arguments that aren't
+ * options of quant are ignored.  Throws a boost::program_options::error if args can't
+ * be parsed (e.g. an option is missing its value).
+ */
+std::set<std::string> quantOptionNames(const std::vector<std::string>& args);
+
+// true if args would have `salmon quant` run in alignment-based mode (by the
+// same test as the dispatch of the quant command).
+bool isAlignmentModeJob(const std::vector<std::string>& args);
+
+/**
+ * Start a job: fork, and in the child, close the descriptors in closeFds,
+ * make outFd its stdout and stderr (unless it is -1), change to the
+ * directory cwd and run `salmon quant` with the arguments args, exiting
+ * with its status.  Returns
+ * the pid of the child (or -1 if it couldn't be started) to the parent.
+ */
+pid_t startQuantJob(const std::vector<std::string>& args,
+                    const std::string& cwd, int outFd,
+                    const std::vector<int>& closeFds);
+
+// The exit status of a job from its status (as returned by waitpid); a job
+// that was killed by a signal has status 128 + the signal number.
+int jobExitCode(int waitStatus);
+
+} // namespace job_utils
+
+} // namespace salmon
+
+#endif // SALMON_QUANT_JOB_UTILS
@@ -0,0 +1,94 @@
+#ifndef __READ_DUPLICATE_CACHE_HPP__
+#define __READ_DUPLICATE_CACHE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "xxhash.h"
+
+/**
+ * A bounded cache of the mappings of recently seen reads (or read pairs),
+ * keyed by their exact sequence(s), so that a read identical to one seen
+ * before takes its mappings from the cache rather than being mapped and
+ * aligned again.  It is owned by a single mapping thread, and so isn't
+ * synchronized.
+ *
+ * The cache is direct-mapped: each read hashes to one slot, and a read that
+ * misses replaces whatever the slot held.  The key of each slot is kept in
+ * full, so a hit is always an exact duplicate.  ValueT is what the caller
+ * records about the mapping of a read.
+ */
+template <typename ValueT> class ReadDuplicateCache {
+public:
+  struct Entry {
+    std::string key; // the sequence of the read, then that of its mate
+    uint32_t leftLen{0};
+    uint64_t hash{0};
+    bool occupied{false};
+    ValueT value;
+  };
+
+  // A cache of (about, rounded up to a power of 2) numEntries reads; no
+  // reads are cached if numEntries is 0.
+  explicit ReadDuplicateCache(size_t numEntries) {
+    if (numEntries > 0) {
+      size_t n{1};
+      while (n < numEntries) {
+        n <<= 1;
+      }
+      entries_.resize(n);
+      mask_ = n - 1;
+    }
+  }
+
+  bool enabled() const { return !entries_.empty(); }
+
+  /**
+   * Look up the read (left, and right if it is paired).  Returns true if it
+   * was cached, and sets slot to its entry.  Otherwise, returns false and
+   * sets slot to the entry in which to cache the read, once it is mapped
+   * (with fill()).
+   */
+  bool lookup(const std::string& left, const std::string& right,
+              Entry*& slot) {
+    uint64_t h = XXH64(left.data(), left.size(), 0);
+    if (!right.empty()) {
+      h = XXH64(right.data(), right.size(), h);
+    }
+    ++numLookups_;
+    slot = &entries_[h & mask_];
+    bool hit = slot->occupied and slot->hash == h and
+               slot->leftLen == left.size() and
+               slot->key.size() == left.size() + right.size() and
+               slot->key.compare(0, left.size(), left) == 0 and
+               slot->key.compare(left.size(), right.size(), right) == 0;
+    if (hit) {
+      ++numHits_;
+    } else {
+      slot->hash = h;
+      slot->occupied = false;
+    }
+    return hit;
+  }
+
+  // Record (left, right) as the key of slot, whose value has been set.
+  void fill(Entry* slot, const std::string& left, const std::string& right) {
+    slot->key.assign(left);
+    slot->key.append(right);
+    slot->leftLen = static_cast<uint32_t>(left.size());
+    slot->occupied = true;
+  }
+
+  uint64_t numLookups() const { return numLookups_; }
+  uint64_t numHits() const { return numHits_; }
+
+private:
+  std::vector<Entry> entries_;
+  size_t mask_{0};
+  uint64_t numLookups_{0};
+  uint64_t numHits_{0};
+};
+
+#endif // __READ_DUPLICATE_CACHE_HPP__
@@ -23,6 +23,10 @@
 // Logger includes
 #include "spdlog/spdlog.h"
 
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
+#include "tbb/task_scheduler_init.h"
+
 // Boost includes
 #include <boost/filesystem.hpp>
 #include <boost/range/irange.hpp>
@@ -31,6 +35,7 @@
 #include "cereal/archives/json.hpp"
 
 // Standard includes
+#include <chrono>
 #include <fstream>
 #include <memory>
 #include <vector>
@@ -130,8 +135,25 @@ public:
     auto indexType = versionInfo.indexType();
     // ==== Figure out the index type
 
-    salmonIndex_.reset(new SalmonIndex(sopt.jointLog, indexType));
-    salmonIndex_->load(indexDirectory);
+    auto loadStart = std::chrono::steady_clock::now();
+    // Under `salmon serve`, the index is already loaded.
+    salmonIndex_ = salmon::index_utils::residentIndex(indexDirectory.string());
+    if (salmonIndex_) {
+      sopt.jointLog->info("Using the resident index loaded from {}",
+                          indexDirectory.string());
+    } else {
+      salmonIndex_.reset(new SalmonIndex(sopt.jointLog, indexType));
+      salmonIndex_->load(indexDirectory,
+                         sopt.prefetchIndex ? sopt.numThreads : 0);
+    }
+    if (sopt.hugePageMode != salmon::memory_utils::HugePageMode::OFF) {
+      auto advised = salmon::memory_utils::adviseHugePages();
+      sopt.jointLog->info("Marked {:.1f} MB of loaded index for huge pages",
+                          advised / (1024.0 * 1024.0));
+    }
+
+    auto indexLoaded = std::chrono::steady_clock::now();
+    indexLoadSeconds_ = std::chrono::duration<double>(indexLoaded - loadStart).count();
 
     // Now we'll have either an FMD-based index or a QUASI index
     // dispatch on the correct type.
@@ -156,6 +178,9 @@ public:
 
     // Create the cluster forest for this set of transcripts
     clusters_.reset(new ClusterForest(transcripts_.size(), transcripts_));
+    transcriptLoadSeconds_ = std::chrono::duration<double>(
+                                 std::chrono::steady_clock::now() - indexLoaded)
+                                 .count();
   }
 
   EQBuilderT& equivalenceClassBuilder() { return eqBuilder_; }
@@ -262,6 +287,11 @@ public:
 
   SalmonIndex* getIndex() { return salmonIndex_.get(); }
 
+  // Time spent loading the index, and then the transcripts from it, when
+  // the experiment was constructed.
+  double indexLoadSeconds() const { return indexLoadSeconds_; }
+  double transcriptLoadSeconds() const { return transcriptLoadSeconds_; }
+
   template <typename PuffIndexT>
   void loadTranscriptsFromPuff(PuffIndexT* idx_, const SalmonOpts& sopt) {
     // Get the list of reference names
@@ -274,17 +304,18 @@ public:
     numDecoys_ = 0;
 
     log->info("Index contained {:n} targets", numRecords);
-    transcripts_.reserve(numRecords);
     std::vector<uint32_t> lengths;
     lengths.reserve(numRecords);
-    size_t numIndexedRefs = idx_->getIndexedRefCount();
     auto k = idx_->k();
-    int64_t numShort{0};
     double alpha = 0.005;
-    auto& allRefSeq = idx_->refseq_;
-    auto& refAccumLengths = idx_->refAccumLengths_;
+
+    // A first, serial (and cheap) pass finds the targets to load, and where
+    // each is in the index, which skips the short targets.
+    std::vector<int64_t> indexIds(numRecords, -1);
+    std::vector<uint8_t> decoyFlags(numRecords, 0);
+    size_t numToLoad{0};
+    int64_t numShort{0};
     for (auto i : boost::irange(size_t(0), numRecords)) {
-      uint32_t id = i;
       bool isShort = refLengths[i] <= k;
       bool isDecoy = idx_->isDecoy(i - numShort);
 
@@ -294,34 +325,52 @@ public:
                   "Skipping loading of decoys.");
         break;
       }
-
-      const char* name = refNames[i].c_str();
-      uint32_t len = refLengths[i];
-      // copy over the length, then we're done.
-      transcripts_.emplace_back(id, name, len, alpha);
-      auto& txp = transcripts_.back();
-      txp.setCompleteLength(completeRefLengths[i]);
-
-      // TODO : PF_INTEGRATION
-      // We won't every have the sequence for a decoy
-      // NOTE : The below is a huge hack right now.  Since we have
-      // the whole reference sequence in 2-bit in the index, there is
-      // really no reason to convert to ASCII and keep a duplicate
-      // copy around.
-      if (!isDecoy and !isShort and (sopt.biasCorrect or sopt.gcBiasCorrect)) {
-        auto tid = i - numShort;
-        int64_t refAccPos = tid > 0 ? refAccumLengths[tid - 1] : 0;
-        int64_t refTotalLength = refAccumLengths[tid] - refAccPos;
-        if (len != refTotalLength) {
-          log->warn("len : {:n}, but txp.RefLength : {:n} :: refTotalLength : {:n}", len, txp.RefLength, refTotalLength);
-        }
-        char* tseq = pufferfish::util::getRefSeqOwned(allRefSeq, refAccPos, refTotalLength);
-        txp.setSequenceOwned(tseq, sopt.gcBiasCorrect, sopt.reduceGCMemory);
+      if (!isShort) {
+        indexIds[i] = i - numShort;
       }
-      txp.setDecoy(isDecoy);
+      decoyFlags[i] = isDecoy ? 1 : 0;
       numShort += isShort ? 1 : 0;
-      if (isDecoy) { 
-        ++numDecoys_; 
+      ++numToLoad;
+    }
+
+    // Then, the transcripts are constructed in parallel (each is independent
+    // of the others).  Their GC content, if it's needed, is only computed
+    // when it's first used (see Transcript::gcDesc).
+    bool needSeq = sopt.biasCorrect or sopt.gcBiasCorrect;
+    transcripts_.resize(numToLoad);
+    {
+      tbb::task_scheduler_init tbbScheduler(sopt.numThreads);
+      tbb::parallel_for(
+          tbb::blocked_range<size_t>(size_t(0), numToLoad),
+          [&](const tbb::blocked_range<size_t>& range) -> void {
+            for (auto i : boost::irange(range.begin(), range.end())) {
+              uint32_t id = i;
+              const char* name = refNames[i].c_str();
+              uint32_t len = refLengths[i];
+              bool isDecoy = decoyFlags[i];
+              auto& txp = transcripts_[i];
+              // copy over the length, then we're done.
+              txp = Transcript(id, name, len, alpha);
+              txp.setCompleteLength(completeRefLengths[i]);
+
+              // We won't every have the sequence for a decoy.  The transcript
+              // refers to its sequence in the (2-bit) reference sequence of
+              // the index, rather than keeping a copy of its own.
+              if (!isDecoy and indexIds[i] >= 0 and needSeq) {
+                auto seqView = RefSeqView::fromIndex(idx_, indexIds[i]);
+                if (len != seqView.size()) {
+                  log->warn("len : {:n}, but txp.RefLength : {:n} :: refTotalLength : {:n}", len, txp.RefLength, seqView.size());
+                }
+                txp.setSequenceView(seqView, sopt.gcBiasCorrect);
+              }
+              txp.setDecoy(isDecoy);
+            }
+          });
+    }
+
+    for (auto& txp : transcripts_) {
+      if (txp.isDecoy()) {
+        ++numDecoys_;
       } else { // only use this reference for length class computation if not a decoy
         lengths.push_back(txp.RefLength);
       }
@@ -368,7 +417,7 @@ public:
       // auto txpSeq = idx_->seq.substr(idx_->txpOffsets[i], len);
       // Set the transcript sequence
       txp.setSequenceBorrowed(idx_->seq.c_str() + idx_->txpOffsets[i],
-                              sopt.gcBiasCorrect, sopt.reduceGCMemory);
+                              sopt.gcBiasCorrect);
       txp.setDecoy(isDecoy);
       if (isDecoy) { ++numDecoys_; }
 
@@ -800,7 +849,8 @@ private:
   /**
    * The index we've built on the set of transcripts.
    */
-  std::unique_ptr<SalmonIndex> salmonIndex_{nullptr};
+  // shared with `salmon serve`, when it is the resident index
+  std::shared_ptr<SalmonIndex> salmonIndex_{nullptr};
   /**
    * The cluster forest maintains the dynamic relationship
    * defined by transcripts and reads --- if two transcripts
@@ -808,6 +858,8 @@ private:
    * in the same cluster.
    */
   std::unique_ptr<ClusterForest> clusters_;
+  double indexLoadSeconds_{0.0};
+  double transcriptLoadSeconds_{0.0};
   /**
    *
    *
@@ -32,6 +32,7 @@ public:
       : fmt_(rl.fmt_), unmatedFilenames_(rl.unmatedFilenames_),
         mateOneFilenames_(rl.mateOneFilenames_),
         mateTwoFilenames_(rl.mateTwoFilenames_),
+        mappingRecordFile_(rl.mappingRecordFile_),
         libTypeCounts_(std::vector<std::atomic<uint64_t>>(
             LibraryFormat::maxLibTypeID() + 1)) {
     size_t mc = LibraryFormat::maxLibTypeID() + 1;
@@ -51,6 +52,7 @@ public:
       : fmt_(rl.fmt_), unmatedFilenames_(std::move(rl.unmatedFilenames_)),
         mateOneFilenames_(std::move(rl.mateOneFilenames_)),
         mateTwoFilenames_(std::move(rl.mateTwoFilenames_)),
+        mappingRecordFile_(std::move(rl.mappingRecordFile_)),
         libTypeCounts_(std::vector<std::atomic<uint64_t>>(
             LibraryFormat::maxLibTypeID() + 1)) {
     size_t mc = LibraryFormat::maxLibTypeID() + 1;
@@ -86,6 +88,18 @@ public:
     unmatedFilenames_ = unmatedFilenames;
   }
 
+  /**
+   * Read the mappings of this library from the given mapping record file
+   * (written with --saveMappings), rather than mapping its reads.
+   */
+  void setMappingRecordFile(const std::string& mappingRecordFile) {
+    mappingRecordFile_ = mappingRecordFile;
+  }
+
+  bool fromMappingRecords() const { return !mappingRecordFile_.empty(); }
+
+  const std::string& mappingRecordFile() const { return mappingRecordFile_; }
+
   /**
    * Return true if this read library is for paired-end reads and false
    * otherwise.
@@ -161,6 +175,9 @@ public:
   }
 
   bool isRegularFile() {
+    if (fromMappingRecords()) {
+      return boost::filesystem::is_regular_file(mappingRecordFile_);
+    }
     if (isPairedEnd()) {
       for (auto& m1 : mateOneFilenames_) {
         if (!boost::filesystem::is_regular_file(m1)) {
@@ -185,7 +202,9 @@ public:
   std::vector<std::string> readFilesAsVector() {
     std::stringstream sstr;
     std::vector<std::string> fnames;
-    if (isPairedEnd()) {
+    if (fromMappingRecords()) {
+      fnames.push_back(mappingRecordFile_);
+    } else if (isPairedEnd()) {
       size_t n1 = mateOneFilenames_.size();
       size_t n2 = mateTwoFilenames_.size();
       if (n1 == 0 or n2 == 0 or n1 != n2) {
@@ -217,7 +236,9 @@ public:
 
   std::string readFilesAsString() {
     std::stringstream sstr;
-    if (isPairedEnd()) {
+    if (fromMappingRecords()) {
+      sstr << "[ " << mappingRecordFile_ << " ]";
+    } else if (isPairedEnd()) {
       size_t n1 = mateOneFilenames_.size();
       size_t n2 = mateTwoFilenames_.size();
       if (n1 == 0 or n2 == 0 or n1 != n2) {
@@ -267,6 +288,15 @@ public:
     errorStream << "\nThe following errors were detected with the read files\n";
     errorStream << "======================================================\n";
 
+    if (fromMappingRecords()) {
+      // the reads were mapped when the file was written
+      std::vector<std::string> recordFile{mappingRecordFile_};
+      if (!allExist_(recordFile, errorStream)) {
+        throw std::invalid_argument(errorStream.str());
+      }
+      return;
+    }
+
     if (isPairedEnd()) {
       size_t n1 = mateOneFilenames_.size();
       size_t n2 = mateTwoFilenames_.size();
@@ -349,6 +379,7 @@ private:
   std::vector<std::string> unmatedFilenames_;
   std::vector<std::string> mateOneFilenames_;
   std::vector<std::string> mateTwoFilenames_;
+  std::string mappingRecordFile_;
   std::vector<std::atomic<uint64_t>> libTypeCounts_;
   std::atomic<uint64_t> numCompat_;
   std::unique_ptr<LibraryTypeDetector> detector_{nullptr};
@@ -0,0 +1,76 @@
+#ifndef __REF_SEQ_VIEW_HPP__
+#define __REF_SEQ_VIEW_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * A non-owning view of one reference (transcript) in the 2-bit reference
+ * sequence of a pufferfish index (the index's refseq_).  The bases are
+ * laid out as in fastx_parser::PackedSeq (A = 0, C = 1, G = 2, T = 3, 32
+ * bases to a word, first base in the lowest bits), but the reference need
+ * not start at a word boundary.  The index has no Ns (they were replaced
+ * when it was built), so neither has the view.
+ *
+ * The view is only valid for as long as the index is loaded.
+ */
+class RefSeqView {
+public:
+  RefSeqView() {}
+  RefSeqView(const uint64_t* words, uint64_t offset, uint32_t len)
+      : words_(words), offset_(offset), len_(len) {}
+
+  // The view of reference `tid` in the index `idx`.
+  template <typename PuffIndexT>
+  static RefSeqView fromIndex(const PuffIndexT* idx, size_t tid) {
+    auto& refAccumLengths = idx->refAccumLengths_;
+    uint64_t start = (tid > 0) ? refAccumLengths[tid - 1] : 0;
+    uint64_t len = refAccumLengths[tid] - start;
+    return RefSeqView(idx->refseq_.get(), start, static_cast<uint32_t>(len));
+  }
+
+  bool valid() const { return words_ != nullptr; }
+  uint32_t size() const { return len_; }
+
+  uint8_t base(size_t i) const {
+    uint64_t p = offset_ + i;
+    return (words_[p >> 5] >> (2 * (p & 31))) & 0x3;
+  }
+
+  char charAt(size_t i) const { return "ACGT"[base(i)]; }
+
+  // 1 if base i is a G or a C
+  uint8_t isGC(size_t i) const {
+    auto b = base(i);
+    return (b == 1 or b == 2) ? 1 : 0;
+  }
+
+  // The k <= 32 bases starting at pos, in the layout of
+  // fastx_parser::PackedSeq::word().  Requires pos + k <= size().
+  uint64_t word(size_t pos, size_t k) const {
+    uint64_t bit = 2 * (offset_ + pos);
+    uint64_t w = bit >> 6;
+    uint64_t off = bit & 63;
+    uint64_t v = words_[w] >> off;
+    if (off + 2 * k > 64) {
+      v |= words_[w + 1] << (64 - off);
+    }
+    return (k == 32) ? v : v & ((uint64_t(1) << (2 * k)) - 1);
+  }
+
+  // The ASCII (upper-case) sequence, decoded into `out`.
+  void decode(std::string& out) const {
+    out.resize(len_);
+    for (size_t i = 0; i < len_; ++i) {
+      out[i] = charAt(i);
+    }
+  }
+
+private:
+  const uint64_t* words_{nullptr};
+  uint64_t offset_{0};
+  uint32_t len_{0};
+};
+
+#endif // __REF_SEQ_VIEW_HPP__
@@ -32,6 +32,10 @@ public:
 
   bool addSequence(const char* seqIn, bool revCmp, double weight = 1.0);
   bool addSequence(const Mer& mer, double weight);
+  // As addSequence(), for the context given as a 2-bit word in the layout of
+  // fastx_parser::PackedSeq::word() (first base in the lowest bits), so
+  // that it can be taken straight from a packed sequence.
+  bool addPackedContext(uint64_t ctx, bool revCmp, double weight = 1.0);
 
   Eigen::MatrixXd& counts();
   Eigen::MatrixXd& marginals();
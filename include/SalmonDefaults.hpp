@@ -14,8 +14,25 @@ namespace defaults {
   constexpr const double incompatPrior{0.0};
   constexpr const char quasiMappingDefaultFile[] = "";
   constexpr const char quasiMappingImplicitFile[] = "-";
+  const std::string mappingsFormatStr{"SAM"};
+  constexpr const uint32_t numBAMThreads{0};
   constexpr const bool metaMode{false};
   constexpr const bool disableMappingCache{true};
+  constexpr const uint32_t numDecompressionThreads{0};
+  constexpr const bool readArena{false};
+  constexpr const bool mmapReads{false};
+  constexpr const bool consumerParsing{false};
+  const std::string parserWaitStrategyStr{"SPIN"};
+  constexpr const bool prefetchIndex{false};
+  const std::string hugePagesStr{"OFF"};
+  constexpr const bool countTLBMisses{false};
+  constexpr const uint32_t dupCacheSize{0};
+  constexpr const uint32_t seedBatchSize{0};
+  constexpr const bool reorderReads{false};
+  constexpr const uint32_t numInferenceThreads{0};
+  constexpr const uint32_t inferenceQueueDepth{0};
+  constexpr const bool threadLocalEqClasses{false};
+  constexpr const bool batchMassUpdates{false};
 
   // advanced
   constexpr const bool validateMappings{true};
@@ -64,6 +81,8 @@ namespace defaults {
   constexpr const uint32_t numPreBurninFrags{5000};
   constexpr const bool useEM{false};
   constexpr const bool useVBOpt{true};
+  constexpr const bool floatEqWeights{false};
+  constexpr const bool componentEM{false};
   constexpr const uint32_t sigDigits{3};
   constexpr const uint32_t rangeFactorizationBins{4};
   constexpr const uint32_t numGibbsSamples{0};
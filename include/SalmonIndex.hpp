@@ -15,6 +15,7 @@
 #include "pufferfish/PufferfishSparseIndex.hpp"
 
 #include "SalmonConfig.hpp"
+#include "SalmonIndexUtils.hpp"
 #include "SalmonIndexVersionInfo.hpp"
 
 // declaration of quasi index function
@@ -28,7 +29,10 @@ public:
         seqHash256_(""), nameHash256_(""), seqHash512_(""), nameHash512_(""),
         decoySeqHash256_(""), decoyNameHash256_("") {}
 
-  void load(const boost::filesystem::path& indexDir) {
+  // If prefetchThreads is not 0, the index files are first read into the
+  // page cache by that many threads (see index_utils::prefetchIndexFiles).
+  void load(const boost::filesystem::path& indexDir,
+            uint32_t prefetchThreads = 0) {
     namespace bfs = boost::filesystem;
 
     // Check if version file exists and, if so, read it.
@@ -54,7 +58,7 @@ public:
       infostr << "Error: This version of salmon does not support indexing using the RapMap index.";
       throw std::invalid_argument(infostr.str());
     } else if (indexType == SalmonIndexType::PUFF) {
-      loadPuffIndex_(indexDir);
+      loadPuffIndex_(indexDir, prefetchThreads);
     } else {
       fmt::MemoryWriter infostr;
       infostr << "Error: Unknown index type.";
@@ -112,8 +116,16 @@ private:
     return ret;
   }
 
-  bool loadPuffIndex_(const boost::filesystem::path& indexDir) {
+  bool loadPuffIndex_(const boost::filesystem::path& indexDir,
+                      uint32_t prefetchThreads) {
     namespace bfs = boost::filesystem;
+    if (prefetchThreads > 0) {
+      auto pf = salmon::index_utils::prefetchIndexFiles(indexDir.string(),
+                                                        prefetchThreads);
+      logger_->info("Prefetched {} index files ({:.1f} MB) into the page "
+                    "cache in {:.2f}s",
+                    pf.numFiles, pf.numBytes / (1024.0 * 1024.0), pf.seconds);
+    }
     logger_->info("Loading pufferfish index");
     // Read the actual Quasi index
     { // quasi-based
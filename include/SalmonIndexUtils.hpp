@@ -0,0 +1,50 @@
+#ifndef SALMON_INDEX_UTILS
+#define SALMON_INDEX_UTILS
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+class SalmonIndex;
+
+namespace salmon {
+
+namespace index_utils {
+
+struct PrefetchStats {
+  size_t numFiles{0};
+  size_t numBytes{0};
+  double seconds{0.0};
+};
+
+/**
+ * Read the files of the index in indexDir into the page cache ahead of
+ * deserializing them.  Each file is mapped read-only (and shared), and its
+ * pages are faulted in by up to numThreads threads at once, working on
+ * pieces of the files (largest files first), so that a large index is read
+ * at the throughput of the storage rather than that of one sequential
+ * reader.  The mappings are dropped again once the pages are resident; the
+ * page cache holding them is shared by all the processes that load the same
+ * index, so a second process started while (or shortly after) the first
+ * loads reads it from memory.
+ */
+PrefetchStats prefetchIndexFiles(const std::string& indexDir,
+                                 uint32_t numThreads);
+
+/**
+ * An index that is already loaded in this process (by `salmon serve`, which
+ * then runs each quantification job in a forked copy of itself).  The
+ * quantification of a job looks it up, and uses it rather than loading the
+ * index in indexDir again.  The registry doesn't own the index.
+ */
+void setResidentIndex(const std::string& indexDir,
+                      const std::shared_ptr<SalmonIndex>& index);
+// The resident index, if it was loaded from indexDir, and nullptr otherwise.
+std::shared_ptr<SalmonIndex> residentIndex(const std::string& indexDir);
+
+} // namespace index_utils
+
+} // namespace salmon
+
+#endif // SALMON_INDEX_UTILS
@@ -35,11 +35,13 @@
 // Future C++ convenience classes
 #include "core/range.hpp"
 
+#include "FastxParser.hpp"
 #include "SalmonDefaults.hpp"
 #include "SalmonMath.hpp"
 #include "SalmonUtils.hpp"
 #include "Transcript.hpp"
 #include "AlignmentGroup.hpp"
+#include "BAMWriter.hpp"
 #include "ProgramOptionsGenerator.hpp"
 #include "ReadExperiment.hpp"
 #include "SalmonOpts.hpp"
@@ -281,5 +283,158 @@ inline void filterAndCollectAlignments(
   // done moving our alinged / score jointMEMs over to QuasiAlignment objects
 }
 
+// Uniform access to the records handed out by the parser, whether they own
+// their bytes (ReadSeq / ReadPair) or are views into the arena of their
+// chunk (ReadSeqView / ReadPairView).  The pufferfish mapping routines take
+// a std::string, so the bases of a view are copied into the caller's
+// (reused) buffer; owning records are returned as-is.
+inline std::string& readSequence(fastx_parser::ReadSeq& r, std::string& /*buf*/) {
+  return r.seq;
+}
+
+inline std::string& readSequence(fastx_parser::ReadSeqView& r, std::string& buf) {
+  buf.assign(r.seq.data(), r.seq.size());
+  return buf;
+}
+
+inline fmt::StringRef readName(const fastx_parser::ReadSeq& r) {
+  return fmt::StringRef(r.name.data(), r.name.size());
+}
+
+inline fmt::StringRef readName(const fastx_parser::ReadSeqView& r) {
+  return fmt::StringRef(r.name.data(), r.name.size());
+}
+
+// The SAM writer needs owning records; only used when writing mappings.
+inline fastx_parser::ReadSeq& ownedRecord(fastx_parser::ReadSeq& r,
+                                          fastx_parser::ReadSeq& /*buf*/) {
+  return r;
+}
+
+inline fastx_parser::ReadSeq& ownedRecord(fastx_parser::ReadSeqView& r,
+                                          fastx_parser::ReadSeq& buf) {
+  buf.seq.assign(r.seq.data(), r.seq.size());
+  buf.name.assign(r.name.data(), r.name.size());
+  return buf;
+}
+
+inline fastx_parser::ReadPair& ownedRecord(fastx_parser::ReadPair& rp,
+                                           fastx_parser::ReadPair& /*buf*/) {
+  return rp;
+}
+
+inline fastx_parser::ReadPair& ownedRecord(fastx_parser::ReadPairView& rp,
+                                           fastx_parser::ReadPair& buf) {
+  ownedRecord(rp.first, buf.first);
+  ownedRecord(rp.second, buf.second);
+  return buf;
+}
+
+/**
+ * Append the BAM records of the mappings of a read (and of its mate, if
+ * rightSeq isn't empty) to out, as the SAM writer would write them : both
+ * ends of a paired mapping, the mapped end of an orphan mapping with its
+ * mate as unmapped (placed with it), and the first mapping as the primary
+ * one.  The transcript ids of the mappings are the references of the BAM
+ * header; the CIGAR is <read length>M unless the alignment was computed.
+ */
+inline void appendBAMRecords(fmt::StringRef name, const std::string& leftSeq,
+                             const std::string& rightSeq,
+                             const std::vector<pufferfish::util::QuasiAlignment>& alignments,
+                             salmon::bam_utils::BAMRecordEncoder& enc,
+                             std::string& out) {
+  using namespace salmon::bam_utils;
+  // (the mate suffix isn't part of the name of the template)
+  size_t nameLen = name.size();
+  if (nameLen > 2 and name.data()[nameLen - 2] == '/' and
+      (name.data()[nameLen - 1] == '1' or name.data()[nameLen - 1] == '2')) {
+    nameLen -= 2;
+  }
+  uint32_t numAlignments = static_cast<uint32_t>(alignments.size());
+  auto record = [&](const std::string& seq, uint16_t flag, int32_t tid,
+                    int32_t pos, const std::string& cigar, int32_t score) {
+    BAMRecord r;
+    r.name = name.data();
+    r.nameLen = nameLen;
+    r.flag = flag;
+    r.refID = tid;
+    r.pos = std::max(pos, 0);
+    r.cigar = &cigar;
+    r.seq = seq.data();
+    r.seqLen = seq.size();
+    r.hasScore = true;
+    r.score = score;
+    r.numAlignments = numAlignments;
+    return r;
+  };
+
+  bool primary{true};
+  for (auto& qa : alignments) {
+    uint16_t secondary = primary ? 0 : BAM_FSECONDARY;
+    primary = false;
+    int32_t tid = static_cast<int32_t>(qa.tid);
+    switch (qa.mateStatus) {
+    case MateStatus::PAIRED_END_PAIRED: {
+      uint16_t flag = BAM_FPAIRED | BAM_FPROPER_PAIR | secondary;
+      auto left = record(leftSeq,
+                         flag | BAM_FREAD1 | (qa.fwd ? 0 : BAM_FREVERSE) |
+                             (qa.mateIsFwd ? 0 : BAM_FMREVERSE),
+                         tid, qa.pos, qa.cigar, qa.score);
+      auto right = record(rightSeq,
+                          flag | BAM_FREAD2 | (qa.mateIsFwd ? 0 : BAM_FREVERSE) |
+                              (qa.fwd ? 0 : BAM_FMREVERSE),
+                          tid, qa.matePos, qa.mateCigar, qa.mateScore);
+      left.nextRefID = right.nextRefID = tid;
+      left.nextPos = right.pos;
+      right.nextPos = left.pos;
+      // (the leftmost end has the positive template length)
+      int32_t tlen = static_cast<int32_t>(qa.fragLen);
+      left.tlen = (left.pos <= right.pos) ? tlen : -tlen;
+      right.tlen = -left.tlen;
+      enc.append(left, out);
+      enc.append(right, out);
+    } break;
+    case MateStatus::PAIRED_END_LEFT:
+    case MateStatus::PAIRED_END_RIGHT: {
+      bool isLeft = (qa.mateStatus == MateStatus::PAIRED_END_LEFT);
+      auto mapped = record(isLeft ? leftSeq : rightSeq,
+                           BAM_FPAIRED | BAM_FMUNMAP | secondary |
+                               (isLeft ? BAM_FREAD1 : BAM_FREAD2) |
+                               (qa.fwd ? 0 : BAM_FREVERSE),
+                           tid, qa.pos, qa.cigar, qa.score);
+      auto unmapped = record(isLeft ? rightSeq : leftSeq,
+                             BAM_FPAIRED | BAM_FUNMAP | secondary |
+                                 (isLeft ? BAM_FREAD2 : BAM_FREAD1) |
+                                 (qa.fwd ? 0 : BAM_FMREVERSE),
+                             tid, qa.pos, qa.cigar, 0);
+      unmapped.cigar = nullptr;
+      unmapped.hasScore = false;
+      mapped.nextRefID = unmapped.nextRefID = tid;
+      mapped.nextPos = unmapped.nextPos = mapped.pos;
+      enc.append(mapped, out);
+      enc.append(unmapped, out);
+    } break;
+    default: {
+      auto single = record(leftSeq, secondary | (qa.fwd ? 0 : BAM_FREVERSE),
+                           tid, qa.pos, qa.cigar, qa.score);
+      enc.append(single, out);
+    } break;
+    }
+  }
+}
+
+// Apply the parsing options (--decompressionThreads, --consumerParsing,
+// --parserWaitStrategy, --mmapReads) to a read parser; must be called before
+// the parser is started.
+template <typename ParserT>
+inline void configureReadParser(ParserT& parser, const SalmonOpts& sopt) {
+  parser.setDecompressionThreads(sopt.numDecompressionThreads);
+  parser.enableConsumerParsing(sopt.consumerParsing);
+  parser.setWaitStrategy(sopt.blockingParserWait
+                             ? fastx_parser::WaitStrategy::BLOCK
+                             : fastx_parser::WaitStrategy::SPIN);
+  parser.enableMappedInput(sopt.mmapReads);
+}
+
   } // namespace mapping_utils
 } // namespace salmon
@@ -0,0 +1,114 @@
+#ifndef SALMON_MEMORY_UTILS
+#define SALMON_MEMORY_UTILS
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace salmon {
+
+namespace memory_utils {
+
+// How large tables are backed by huge pages (--hugePages).
+enum class HugePageMode : uint8_t {
+  // regular allocations
+  OFF,
+  // transparent huge pages: large tables are mapped 2MB-aligned and marked
+  // with madvise(MADV_HUGEPAGE), and so is the loaded index
+  THP,
+  // large tables are taken from the pool of explicitly reserved huge pages
+  // (MAP_HUGETLB), falling back to THP when the pool is exhausted; the
+  // index, which is allocated by pufferfish, is handled as with THP
+  HUGETLB
+};
+
+constexpr size_t hugePageLen{2 * 1024 * 1024};
+
+// The mode is global, and must be set before any table is allocated
+// through a HugePageAllocator.
+void setHugePageMode(HugePageMode mode);
+HugePageMode hugePageMode();
+
+// An anonymous mapping of (at least) `bytes` backed according to the huge
+// page mode; throws std::bad_alloc on failure.
+void* allocateLarge(size_t bytes);
+void deallocateLarge(void* p, size_t bytes);
+
+/**
+ * Mark all large anonymous mappings of the process (i.e. the heap memory
+ * holding the loaded index) for transparent huge pages, and, where the
+ * kernel supports it (MADV_COLLAPSE, Linux 6.1), collapse them into huge
+ * pages right away rather than leaving it to khugepaged.  Returns the
+ * number of bytes advised.
+ */
+size_t adviseHugePages();
+
+/**
+ * An allocator for large tables (e.g. the buckets of the equivalence class
+ * map): allocations of at least a huge page go through allocateLarge(), the
+ * others through operator new.  With HugePageMode::OFF, all of them do.
+ */
+template <typename T> class HugePageAllocator {
+public:
+  using value_type = T;
+
+  HugePageAllocator() noexcept {}
+  template <typename U>
+  HugePageAllocator(const HugePageAllocator<U>&) noexcept {}
+
+  T* allocate(size_t n) {
+    size_t bytes = n * sizeof(T);
+    if (useLarge(bytes)) {
+      return static_cast<T*>(allocateLarge(bytes));
+    }
+    return static_cast<T*>(::operator new(bytes));
+  }
+
+  void deallocate(T* p, size_t n) {
+    size_t bytes = n * sizeof(T);
+    if (useLarge(bytes)) {
+      deallocateLarge(p, bytes);
+    } else {
+      ::operator delete(p);
+    }
+  }
+
+  template <typename U> bool operator==(const HugePageAllocator<U>&) const {
+    return true;
+  }
+  template <typename U> bool operator!=(const HugePageAllocator<U>&) const {
+    return false;
+  }
+
+private:
+  static bool useLarge(size_t bytes) {
+    return bytes >= hugePageLen and hugePageMode() != HugePageMode::OFF;
+  }
+};
+
+/**
+ * Counts the data TLB load misses of the calling thread and of the threads
+ * it starts after start() (through perf_event_open, so only on Linux, and
+ * only where perf events are permitted).  The counts of those threads are
+ * included once they have been joined.
+ */
+class DTLBMissCounter {
+public:
+  DTLBMissCounter() {}
+  ~DTLBMissCounter();
+  DTLBMissCounter(const DTLBMissCounter&) = delete;
+  DTLBMissCounter& operator=(const DTLBMissCounter&) = delete;
+  // returns false if the counter is not available
+  bool start();
+  // the number of misses since start()
+  uint64_t stop();
+
+private:
+  int fd_{-1};
+};
+
+} // namespace memory_utils
+
+} // namespace salmon
+
+#endif // SALMON_MEMORY_UTILS
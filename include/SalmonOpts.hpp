@@ -12,9 +12,17 @@
 
 #include "pufferfish/Util.hpp"
 #include "SalmonDefaults.hpp"
+#include "SalmonMemoryUtils.hpp"
 
 enum class SalmonQuantMode { MAP = 1, ALIGN = 2 };
 
+class BAMWriter;
+namespace salmon {
+namespace mapping_records {
+class MappingRecordReader;
+}
+}
+
 /**
  * A structure to hold some common options used
  * by Salmon so that we don't have to pass them
@@ -152,8 +160,8 @@ struct SalmonOpts {
 
   uint64_t numRequiredFragments; //
   uint64_t minRequiredFrags;
-  bool reduceGCMemory; // Use a memory-efficient (rank-based) data structure for
-                       // computing fragment GC content
+  bool reduceGCMemory; // [Deprecated] GC content is always stored in a
+                       // memory-efficient (rank-based) data structure
   // uint32_t gcSampFactor; // The factor by which to down-sample the GC
   // distribution of transcripts
   uint32_t pdfSampFactor; // The factor by which to down-sample the fragment
@@ -186,6 +194,13 @@ struct SalmonOpts {
 
   bool useVBOpt; // Use Variational Bayesian EM instead of "regular" EM in the
                  // batch passes
+  bool floatEqWeights{salmon::defaults::floatEqWeights}; // Hold the equivalence
+                                                         // class weights in single
+                                                         // precision in the EM and
+                                                         // the bootstraps.
+  bool componentEM{salmon::defaults::componentEM}; // Run the offline EM on each
+                                                   // connected component of the
+                                                   // equivalence classes on its own.
   uint32_t sigDigits; // number of siginificant digits to print for EffectiveLength
                       // and NumReads
   bool useRangeFactorization{false}; // enable range factorization
@@ -201,6 +216,19 @@ struct SalmonOpts {
   std::ofstream qmFile;
   std::unique_ptr<std::ostream> qmStream{nullptr};
   std::shared_ptr<spdlog::logger> qmLog{nullptr};
+  std::string mappingsFormatStr{salmon::defaults::mappingsFormatStr};
+  bool writeBAMMappings{false}; // Write the mappings as BAM (--mappingsFormat)
+  uint32_t numBAMThreads{0}; // The threads compressing the BAM output (0 : half
+                             // of the mapping threads)
+  std::shared_ptr<BAMWriter> bamWriter{nullptr}; // (in place of qmLog)
+
+  // The mapping record file (see MappingRecords.hpp)
+  std::string saveMappingsFile; // Record the mappings in this file (--saveMappings)
+  std::shared_ptr<BAMWriter> mappingRecordWriter{nullptr};
+  std::string fromMappingsFile; // Quantify the mappings recorded in this file,
+                                // rather than the reads (--fromMappings)
+  std::shared_ptr<salmon::mapping_records::MappingRecordReader>
+      mappingRecordReader{nullptr};
 
   std::unique_ptr<std::ofstream> unmappedFile{nullptr};
   bool writeUnmappedNames; // write the names of unmapped reads
@@ -254,6 +282,39 @@ struct SalmonOpts {
   uint32_t numThreads;
   uint32_t numQuantThreads;
   uint32_t numParseThreads;
+  uint32_t numDecompressionThreads{0}; // Threads used (per parsing thread) to
+                                       // decompress the read files.
+  bool readArena{false}; // Parse records into a per-chunk arena and hand them
+                         // out as views rather than as per-record strings.
+  bool mmapReads{false}; // Memory map uncompressed read files and parse them
+                         // in place (in parallel, across the parsing threads).
+  bool consumerParsing{false}; // Mapping threads that run out of reads parse
+                               // (part of) the input themselves.
+  std::string parserWaitStrategyStr{salmon::defaults::parserWaitStrategyStr};
+  bool blockingParserWait{false}; // Threads waiting on the read parser sleep
+                                  // rather than spin (--parserWaitStrategy BLOCK).
+  bool prefetchIndex{false}; // Read the index files into the page cache, in
+                             // parallel, before loading the index.
+  std::string hugePagesStr{salmon::defaults::hugePagesStr};
+  salmon::memory_utils::HugePageMode hugePageMode{
+      salmon::memory_utils::HugePageMode::OFF}; // (--hugePages)
+  bool countTLBMisses{false}; // Count the dTLB misses of the mapping phase.
+  uint32_t dupCacheSize{0}; // The number of reads in the per-thread cache of
+                            // the mappings of duplicate reads (0 disables it).
+  uint32_t seedBatchSize{0}; // Look up the seeds of this many reads at once,
+                             // before mapping them (0 disables it).
+  bool reorderReads{false}; // Map the reads of each chunk in the order of
+                            // their minimizers.
+  uint32_t numInferenceThreads{0}; // Quantify the mapped chunks on this many
+                                   // threads of their own (0 : on the mapping
+                                   // threads).
+  uint32_t inferenceQueueDepth{0}; // The number of mapped chunks that can be
+                                   // queued for them (0 : chosen from the
+                                   // number of threads).
+  bool threadLocalEqClasses{false}; // Count the equivalence classes in maps
+                                    // of each thread's own, merged at the end.
+  bool batchMassUpdates{false}; // Sum the transcript masses of each mini-batch
+                                // per thread, and add them at its end.
 
   // Related to alignment verification
   bool validateMappings;
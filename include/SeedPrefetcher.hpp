@@ -0,0 +1,119 @@
+#ifndef __SEED_PREFETCHER_HPP__
+#define __SEED_PREFETCHER_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "FastxParser.hpp"
+#include "pufferfish/CanonicalKmer.hpp"
+
+/**
+ * Lookups of the seed k-mers of a group of reads, ahead of mapping them.
+ *
+ * Mapping a read starts with looking up its first k-mers in the index (the
+ * MPHF, then the position and contig tables), and each of these lookups is
+ * a chain of dependent cache misses.  Before a batch of reads is mapped, the
+ * prefetcher looks up their seed k-mers (the first, every k-th, and the
+ * last, up to maxSeedsPerRead of each read and mate), interleaved across the
+ * reads (the first seed of every read, then the second, ...), so that the
+ * mapping of each read may find the lines it reads in the cache.
+ *
+ * The index's tables aren't exposed, so the lookups go through its own
+ * getRefPos: they are synchronous, one after another, and their misses
+ * don't overlap (beyond what the out-of-order core finds between adjacent
+ * calls).  The mapper then looks each seed up again, so this at least
+ * doubles the hashing of the seeds; it only pays off if the second lookups
+ * save more than that, which hasn't been measured on real reads (see
+ * --seedBatchSize).
+ *
+ * The batch should be small enough for what it loads to stay in the cache
+ * until its reads are mapped (16 - 64 reads).
+ */
+template <typename IndexT> class SeedPrefetcher {
+public:
+  static constexpr size_t maxSeedsPerRead{6};
+
+  SeedPrefetcher(IndexT* idx, uint32_t batchSize)
+      : idx_(idx), batchSize_(batchSize), k_(idx->k()) {
+    kmerBuf_.reserve(k_);
+  }
+
+  bool enabled() const { return batchSize_ > 0; }
+  size_t batchSize() const { return batchSize_; }
+
+  // Look up the seeds of the reads [first, last) of the read group rg, in
+  // the order in which they are mapped (the j-th read mapped is rg[order[j]]).
+  template <typename ReadGroupT, typename OrderT>
+  void prefetch(ReadGroupT& rg, size_t first, size_t last, const OrderT& order) {
+    reads_.clear();
+    for (size_t j = first; j < last; ++j) {
+      addRecord_(rg[order[j]]);
+    }
+    for (size_t s = 0; s < maxSeedsPerRead; ++s) {
+      bool any{false};
+      for (auto& r : reads_) {
+        if (s >= numSeeds_(r.second)) {
+          continue;
+        }
+        any = true;
+        lookup_(r.first + seedPos_(r.second, s));
+      }
+      if (!any) {
+        break;
+      }
+    }
+  }
+
+private:
+  template <typename RecordT>
+  typename std::enable_if<fastx_parser::is_paired_record<RecordT>::value>::type
+  addRecord_(RecordT& r) {
+    addRead_(r.first.seq.data(), r.first.seq.size());
+    addRead_(r.second.seq.data(), r.second.seq.size());
+  }
+
+  template <typename RecordT>
+  typename std::enable_if<!fastx_parser::is_paired_record<RecordT>::value>::type
+  addRecord_(RecordT& r) {
+    addRead_(r.seq.data(), r.seq.size());
+  }
+
+  void addRead_(const char* seq, size_t len) {
+    if (len >= k_) {
+      reads_.emplace_back(seq, len);
+    }
+  }
+
+  size_t numSeeds_(size_t len) const {
+    size_t n = (len - 1) / k_ + 1;
+    return (n < maxSeedsPerRead) ? n : maxSeedsPerRead;
+  }
+
+  // The s-th seed is at s * k, but the last is the last k-mer of the read.
+  size_t seedPos_(size_t len, size_t s) const {
+    return (s + 1 == numSeeds_(len)) ? len - k_ : s * k_;
+  }
+
+  void lookup_(const char* kmer) {
+    kmerBuf_.assign(kmer, k_);
+    if (!km_.fromStr(kmerBuf_)) {
+      return;
+    }
+    auto phits = idx_->getRefPos(km_);
+    numFound_ += phits.empty() ? 0 : 1;
+  }
+
+  IndexT* idx_;
+  size_t batchSize_;
+  size_t k_;
+  std::vector<std::pair<const char*, size_t>> reads_;
+  std::string kmerBuf_;
+  pufferfish::CanonicalKmer km_;
+  // (only so that the result of the lookups is used)
+  uint64_t numFound_{0};
+};
+
+#endif // __SEED_PREFETCHER_HPP__
@@ -2,7 +2,9 @@
 #define TRANSCRIPT
 
 #include "FragmentLengthDistribution.hpp"
+#include "GCBitVector.hpp"
 #include "GCFragModel.hpp"
+#include "RefSeqView.hpp"
 #include "SalmonMath.hpp"
 #include "SalmonStringUtils.hpp"
 #include "SalmonUtils.hpp"
@@ -14,6 +16,7 @@
 #include <cmath>
 #include <limits>
 #include <memory>
+#include <thread>
 
 //#include "rapmap/bit_array.h"
 #include "pufferfish/compact_vector/compact_vector.hpp"
@@ -36,7 +39,7 @@ public:
   using Rank9bPointer = std::unique_ptr<rank9b>;
 
   Transcript()
-      : RefName(nullptr), RefLength(std::numeric_limits<uint32_t>::max()),
+      : RefName(), RefLength(std::numeric_limits<uint32_t>::max()),
         CompleteLength(std::numeric_limits<uint32_t>::max()),
         EffectiveLength(-1.0), id(std::numeric_limits<uint32_t>::max()),
         logPerBasePrior_(salmon::math::LOG_0), priorMass_(salmon::math::LOG_0),
@@ -87,12 +90,9 @@ public:
 
     SAMSequence_ = std::move(other.SAMSequence_);
     Sequence_ = std::move(other.Sequence_);
-    GCCount_ = std::move(other.GCCount_);
-    reduceGCMemory_ = other.reduceGCMemory_;
-    gcFracLen_ = other.gcFracLen_;
-    lastRegularSample_ = other.lastRegularSample_;
-    gcBitArray_ = std::move(other.gcBitArray_);
-    gcRank_ = std::move(other.gcRank_);
+    refSeq_ = other.refSeq_;
+    gcCounts_ = std::move(other.gcCounts_);
+    gcState_.store(other.gcState_.load());
 
     uniqueCount_.store(other.uniqueCount_);
     totalCount_.store(other.totalCount_.load());
@@ -119,12 +119,9 @@ public:
     EffectiveLength = other.EffectiveLength;
     SAMSequence_ = std::move(other.SAMSequence_);
     Sequence_ = std::move(other.Sequence_);
-    GCCount_ = std::move(other.GCCount_);
-    reduceGCMemory_ = other.reduceGCMemory_;
-    gcFracLen_ = other.gcFracLen_;
-    lastRegularSample_ = other.lastRegularSample_;
-    gcBitArray_ = std::move(other.gcBitArray_);
-    gcRank_ = std::move(other.gcRank_);
+    refSeq_ = other.refSeq_;
+    gcCounts_ = std::move(other.gcCounts_);
+    gcState_.store(other.gcState_.load());
 
     uniqueCount_.store(other.uniqueCount_);
     totalCount_.store(other.totalCount_.load());
@@ -334,116 +331,48 @@ public:
 
     double contextSize = outsideContext + insideContext;
     int lastPos = RefLength - 1;
-    if (!reduceGCMemory_) {
-      auto cs = (s > 0) ? GCCount_[s - 1] : 0;
-      auto ce = GCCount_[e];
-
-      int fs = s - outside5p;
-      int fe = s + inside5p;
-      int ts = e - inside3p;
-      int te = e + outside3p;
-
-      bool fpLeftExists = (fs >= 0);
-      bool fpRightExists = (fe <= lastPos);
-      bool tpLeftExists = (ts >= 0);
-      bool tpRightExists = (te <= lastPos);
-
-      auto fps = (fpLeftExists) ? GCCount_[fs] : 0;
-      auto fpe = (fpRightExists) ? GCCount_[fe] : ce;
-      auto tps = (tpLeftExists) ? GCCount_[ts] : 0;
-      auto tpe = (tpRightExists) ? GCCount_[te] : ce;
-
-      // now, clamp to actual bounds
-      fs = (fs < 0) ? 0 : fs;
-      fe = (fe > lastPos) ? lastPos : fe;
-      ts = (ts < 0) ? 0 : ts;
-      te = (te > lastPos) ? lastPos : te;
-      int fpContextSize = (!fpLeftExists) ? (fe + 1) : (fe - fs);
-      int tpContextSize = (!tpLeftExists) ? (te + 1) : (te - ts);
-      contextSize = static_cast<double>(fpContextSize + tpContextSize);
-      if (contextSize == 0) {
-        // std::cerr << "" << std::endl;
-        return GCDesc();
-      }
-      valid = true;
-
-      int32_t fragFrac = std::lrint((100.0 * (ce - cs)) / (e - s + 1));
-      int32_t contextFrac =
-          std::lrint((100.0 * (((fpe - fps) + (tpe - tps)) / (contextSize))));
-      /*
-      if (contextFrac > 100) {
-        std::cerr << "NOTE : 5' count = " << (fpeCount - fpsCount) << ", 3'
-      count =" << (tpeCount - tpsCount) << ", context size = " << contextSize <<
-      std::endl; std::cerr << "s = " << s << ", e = " << e << ", l = " <<
-      RefLength << ", fs = " << fs  << ", fe =  " << fe << ", ts = " << ts << ",
-      te = " << te << std::endl; std::cerr << "fpsCount = " << fpsCount <<
-          ", fpeCount = " << fpeCount <<
-          ", tpsCount = " << tpsCount <<
-          ", tpeCount = " << tpeCount  <<
-          ", fpContextSize = " << fpContextSize  <<
-          ", tpContextSize = " << tpContextSize << std::endl;
-
-      }
-      */
-      GCDesc desc = {fragFrac, contextFrac};
-      return desc;
-    } else {
-      auto cs = (s > 0) ? gcCountInterp_(s - 1) : 0;
-      auto ce = gcCountInterp_(e);
-
-      int fs = s - outside5p;
-      int fe = s + inside5p;
-      int ts = e - inside3p;
-      int te = e + outside3p;
-
-      bool fpLeftExists = (fs >= 0);
-      bool fpRightExists = (fe <= lastPos);
-      bool tpLeftExists = (ts >= 0);
-      bool tpRightExists = (te <= lastPos);
-
-      auto fps = (fpLeftExists) ? gcCountInterp_(fs) : 0;
-      auto fpe = (fpRightExists) ? gcCountInterp_(fe) : ce;
-      auto tps = (tpLeftExists) ? gcCountInterp_(ts) : 0;
-      auto tpe = (tpRightExists) ? gcCountInterp_(te) : ce;
-
-      // now, clamp to actual bounds
-      fs = (fs < 0) ? 0 : fs;
-      fe = (fe > lastPos) ? lastPos : fe;
-      ts = (ts < 0) ? 0 : ts;
-      te = (te > lastPos) ? lastPos : te;
-      int fpContextSize = (!fpLeftExists) ? (fe + 1) : (fe - fs);
-      int tpContextSize = (!tpLeftExists) ? (te + 1) : (te - ts);
-      contextSize = static_cast<double>(fpContextSize + tpContextSize);
-      if (contextSize == 0) {
-        return GCDesc();
-      }
-      valid = true;
-
-      int32_t fragFrac = std::lrint((100.0 * (ce - cs)) / (e - s + 1));
-      int32_t contextFrac =
-          std::lrint((100.0 * (((fpe - fps) + (tpe - tps)) / (contextSize))));
-      GCDesc desc = {fragFrac, contextFrac};
-      return desc;
-      /** PREVIOUS SAMPLED IMPL (before May 23, 2017) **/
-      /*
-        auto cs = gcCountInterp_(s);
-        auto ce = gcCountInterp_(e);
-
-        valid = true;
-        auto fps = (s >= outside5p) ? gcCountInterp_(s-outside5p) : 0;
-        auto fpe = (inside5p > 0) ? gcCountInterp_(std::min(s+inside5p,
-        lastPos)) : cs; auto tps = (inside3p > 0) ?
-        ((e >= inside3p) ? gcCountInterp_(e-inside3p) : 0) : ce;
-        auto tpe = gcCountInterp_(std::min(e+outside3p, lastPos));
-
-        int32_t fragFrac = std::lrint((100.0 * (ce - cs)) / (e - s + 1));
-        int32_t contextFrac = std::lrint((100.0 * (((fpe - fps) + (tpe - tps)) /
-        (2.0 * contextSize)))); GCDesc desc = {fragFrac, contextFrac}; return
-        desc;
-      */
+    ensureGC_();
+
+    auto cs = (s > 0) ? gcCount_(s - 1) : 0;
+    auto ce = gcCount_(e);
+
+    int fs = s - outside5p;
+    int fe = s + inside5p;
+    int ts = e - inside3p;
+    int te = e + outside3p;
+
+    bool fpLeftExists = (fs >= 0);
+    bool fpRightExists = (fe <= lastPos);
+    bool tpLeftExists = (ts >= 0);
+    bool tpRightExists = (te <= lastPos);
+
+    auto fps = (fpLeftExists) ? gcCount_(fs) : 0;
+    auto fpe = (fpRightExists) ? gcCount_(fe) : ce;
+    auto tps = (tpLeftExists) ? gcCount_(ts) : 0;
+    auto tpe = (tpRightExists) ? gcCount_(te) : ce;
+
+    // now, clamp to actual bounds
+    fs = (fs < 0) ? 0 : fs;
+    fe = (fe > lastPos) ? lastPos : fe;
+    ts = (ts < 0) ? 0 : ts;
+    te = (te > lastPos) ? lastPos : te;
+    int fpContextSize = (!fpLeftExists) ? (fe + 1) : (fe - fs);
+    int tpContextSize = (!tpLeftExists) ? (te + 1) : (te - ts);
+    contextSize = static_cast<double>(fpContextSize + tpContextSize);
+    if (contextSize == 0) {
+      return GCDesc();
     }
+    valid = true;
+
+    int32_t fragFrac = std::lrint((100.0 * (ce - cs)) / (e - s + 1));
+    int32_t contextFrac =
+        std::lrint((100.0 * (((fpe - fps) + (tpe - tps)) / (contextSize))));
+    GCDesc desc = {fragFrac, contextFrac};
+    return desc;
   }
+
   inline double gcAt(int32_t s) const {
+    ensureGC_();
     int32_t sRefLength = static_cast<int32_t>(RefLength);
     return (s < 0) ? 0.0
                    : ((s >= sRefLength) ? gcCount_(sRefLength - 1) : gcCount_(s));
@@ -452,16 +381,10 @@ public:
   // Return the fractional GC content along this transcript
   // in the interval [s,e] (note; this interval is closed on both sides).
   inline int32_t gcFrac(int32_t s, int32_t e) const {
-    if (!reduceGCMemory_) {
-      auto cs = (s > 0) ? GCCount_[s - 1] : 0;
-      auto ce = GCCount_[e];
-      return std::lrint((100.0 * (ce - cs)) / (e - s + 1));
-    } else {
-      auto cs = (s > 0) ? gcCountInterp_(s - 1) : 0;
-      auto ce = gcCountInterp_(e);
-      return std::lrint((100.0 * (ce - cs)) / (e - s + 1));
-    }
-    return 0;
+    ensureGC_();
+    auto cs = (s > 0) ? gcCount_(s - 1) : 0;
+    auto ce = gcCount_(e);
+    return std::lrint((100.0 * (ce - cs)) / (e - s + 1));
   }
 
   /**
@@ -483,32 +406,29 @@ public:
   bool isDecoy() const { return isDecoy_; }
 
   // Will *not* delete seq on destruction
-  void setSequenceBorrowed(const char* seq, bool needGC = false,
-                           bool reduceGCMemory = false) {
+  void setSequenceBorrowed(const char* seq, bool needGC = false) {
     Sequence_ = std::unique_ptr<const char, void (*)(const char*)>(
         seq,                 // store seq
         [](const char* p) {} // do nothing deleter
     );
     if (needGC) {
-      computeGCContent_(reduceGCMemory);
+      requestGCContent_();
     }
   }
 
   // Will delete seq on destruction
-  void setSequenceOwned(const char* seq, bool needGC = false,
-                        bool reduceGCMemory = false) {
+  void setSequenceOwned(const char* seq, bool needGC = false) {
     Sequence_ = std::unique_ptr<const char, void (*)(const char*)>(
         seq,                              // store seq
         [](const char* p) { delete[] p; } // do nothing deleter
     );
     if (needGC) {
-      computeGCContent_(reduceGCMemory);
+      requestGCContent_();
     }
   }
 
   // Will delete seq on destruction
-  void setSAMSequenceOwned(std::vector<uint8_t>&& seq, bool needGC = false,
-                           bool reduceGCMemory = false) {
+  void setSAMSequenceOwned(std::vector<uint8_t>&& seq, bool needGC = false) {
 
     if ((2*seq.size() < RefLength) or (2*seq.size() > RefLength + 1)) {
       std::stringstream errstream;
@@ -520,12 +440,36 @@ public:
 
     SAMSequence_ = std::move(seq);
     if (needGC) {
-      computeGCContent_(reduceGCMemory);
+      requestGCContent_();
+    }
+  }
+
+  // Will not copy the sequence; the view refers to the 2-bit reference
+  // sequence of the index, which must outlive the transcript.
+  void setSequenceView(const RefSeqView& seq, bool needGC = false) {
+    refSeq_ = seq;
+    if (needGC) {
+      requestGCContent_();
     }
   }
 
   const char* Sequence() const { return Sequence_.get(); }
 
+  // The 2-bit view of this transcript's sequence, when it was loaded from a
+  // pufferfish index (otherwise, the view is not valid()).
+  const RefSeqView& sequenceView() const { return refSeq_; }
+
+  // This transcript's ASCII sequence: either the sequence that was set, or,
+  // if the transcript has only a 2-bit view, the view decoded into `buffer`
+  // (so that the pointer is valid until `buffer` is next modified).
+  const char* asciiSequence(std::string& buffer) const {
+    if (Sequence_ or !refSeq_.valid()) {
+      return Sequence_.get();
+    }
+    refSeq_.decode(buffer);
+    return buffer.c_str();
+  }
+
   uint8_t* SAMSequence() const { return const_cast<uint8_t*>(SAMSequence_.data()); }
 
   void setCompleteLength(uint32_t completeLengthIn) {
@@ -548,130 +492,50 @@ public:
 private:
   // NOTE: Is it worth it to check if we have GC here?
   // we should never access these without bias correction.
-  inline double gcCount_(int32_t p) {
-    return (!reduceGCMemory_) ? static_cast<double>(GCCount_[p])
-                              : gcCountInterp_(p);
-  }
   inline double gcCount_(int32_t p) const {
-    return (!reduceGCMemory_) ? static_cast<double>(GCCount_[p])
-                              : gcCountInterp_(p);
-  }
-
-  /*
-    inline int32_t closestBin_(int32_t p) const {
-      return static_cast<int32_t>(std::round( static_cast<double>(p) / gcStep_
-    ));
-    }
-  */
-
-  inline double gcCountInterp_(int32_t p) const {
     int32_t sRefLength = static_cast<int32_t>(RefLength);
     if (p >= sRefLength) {
       p = sRefLength - 1;
     }
-    return static_cast<double>(gcRank_->rank(p + 1));
+    return static_cast<double>(gcCounts_.count(p));
   }
 
-  /** Previous GC count interp implementation (May 23, 2017) **/
-  /*
-    inline double gcCountInterp_(int32_t p) const {
-      //std::cerr << "in gcCountInterp\n";
-      if (p == RefLength - 1) {
-        // If p is the last position, just return the last value
-        return static_cast<double>(GCCount_.back());
-      }
+  // The GC content is computed on first use, by whichever thread needs it
+  // first, so that it is never built for the transcripts that nothing maps
+  // to (and the work is spread over the mapping / bias threads).
+  enum GCState : uint8_t { GC_NONE = 0, GC_PENDING, GC_COMPUTING, GC_READY };
 
-      // The index of the closest bin
-      auto cb = closestBin_(p);
-      // The actual position to which this bin corresponds
-      int32_t binPos = cb * gcStep_;
-      // Can't go past the end
-      if (binPos > RefLength - 1) {
-        binPos = RefLength - 1;
-        cb = GCCount_.size() - 1;
-      }
+  void requestGCContent_() {
+    gcState_.store(GC_PENDING, std::memory_order_release);
+  }
 
-      // The count of {G,C} at the checkpoint
-      auto binCount = GCCount_[cb];
-      // The count before or after the bin, until p
-      int32_t count{0};
-      const char* seq = Sequence_.get();
-
-      // we hit a sampled position
-      if (binPos == p) {
-      } else if (binPos > p) {
-        for (size_t i = binPos; i > p; --i) {
-          auto c = seq[i];
-          // If the character is a G or C, we subtract 1
-          count -= (c == 'G' or c == 'C') ? 1 : 0;
-        }
-      } else {
-        for (size_t i = binPos + 1; i <= p; ++i) {
-          auto c = seq[i];
-          // If the character is a G or C, we add 1
-          count += (c == 'G' or c == 'C') ? 1 : 0;
-        }
-      }
-      return  binCount + count;
+  inline void ensureGC_() const {
+    auto state = gcState_.load(std::memory_order_acquire);
+    if (state == GC_PENDING or state == GC_COMPUTING) {
+      computeGCOnce_();
     }
-  */
+  }
 
-  /*
-    void computeGCContentSampled_(uint32_t step) {
-        gcStep_ = step;
-        const char* seq = Sequence_.get();
-        size_t nsamp = std::ceil(static_cast<double>(RefLength) / step);
-        GCCount_.reserve(nsamp + 2);
-
-        size_t lastSamp{0};
-        size_t totGC{0};
-        for (size_t i = 0; i < RefLength; ++i) {
-            auto c = std::toupper(seq[i]);
-            if (c == 'G' or c == 'C') {
-                totGC++;
-            }
-            if (i % step == 0) {
-                GCCount_.push_back(totGC);
-                lastSamp = i;
-            }
-        }
-
-        if (lastSamp < RefLength - 1) {
-            GCCount_.push_back(totGC);
-        }
-
-        gcFracLen_ = static_cast<double>(RefLength - 1) / gcStep_;
-        lastRegularSample_ = std::ceil(gcFracLen_);
+  void computeGCOnce_() const {
+    uint8_t expected = GC_PENDING;
+    if (gcState_.compare_exchange_strong(expected, GC_COMPUTING)) {
+      // the GC counts are a cache of the (immutable) sequence
+      const_cast<Transcript*>(this)->computeGCContent_();
+      gcState_.store(GC_READY, std::memory_order_release);
+    } else {
+      while (gcState_.load(std::memory_order_acquire) != GC_READY) {
+        std::this_thread::yield();
+      }
     }
-  */
+  }
 
-  void computeGCContent_(bool reduceGCMemory) {
-    reduceGCMemory_ = reduceGCMemory;
+  void computeGCContent_() {
     const char* seq = Sequence_.get();
-    GCCount_.clear();
-    if (!reduceGCMemory) {
-      GCCount_.resize(RefLength, 0);
-      size_t totGC{0};
-      for (size_t i = 0; i < RefLength; ++i) {
-        auto c = std::toupper(seq[i]);
-        if (c == 'G' or c == 'C') {
-          totGC++;
-        }
-        GCCount_[i] = totGC;
-      }
-    } else {
-      gcBitArray_.resize(RefLength);
-      gcBitArray_.clear_mem();
-      //BIT_ARRAY* rawArray = bit_array_create(RefLength);
-      for (size_t i = 0; i < RefLength; ++i) {
-        auto c = std::toupper(seq[i]);
-        if (c == 'G' or c == 'C') {
-          gcBitArray_[i] = 1;
-          //bit_array_set_bit(rawArray, i);
-        }
-      }
-      //gcBitArray_.reset(rawArray);
-      gcRank_.reset(new rank9b(gcBitArray_.get(), RefLength));
+    if (seq != nullptr) {
+      gcCounts_.build(seq, RefLength);
+    } else if (refSeq_.valid()) {
+      // with only a 2-bit view, read G/C straight from it
+      gcCounts_.build(refSeq_);
     }
   }
 
@@ -710,6 +574,8 @@ private:
   std::unique_ptr<const char, void (*)(const char*)> Sequence_ =
       std::unique_ptr<const char, void (*)(const char*)>(nullptr,
                                                          [](const char*) {});
+  // the sequence in the index, if the transcript was loaded from one
+  RefSeqView refSeq_;
 
   std::atomic<size_t> uniqueCount_;
   std::atomic<size_t> totalCount_;
@@ -730,13 +596,8 @@ private:
   bool active_;
   bool isDecoy_{false};
 
-  bool reduceGCMemory_{false};
-  double gcFracLen_{0.0};
-  uint32_t lastRegularSample_{0};
-  std::vector<uint32_t> GCCount_;
-  //BitArrayPointer gcBitArray_{nullptr};
-  BitArray gcBitArray_;
-  Rank9bPointer gcRank_{nullptr};
+  mutable std::atomic<uint8_t> gcState_{GC_NONE};
+  GCBitVector gcCounts_;
   //BitArrayPointer polyABitArray_{nullptr};
   //Rank9bPointer polyARank_{nullptr};
   //std::vector<int32_t> polyAPos_;
@@ -0,0 +1,103 @@
+#ifndef __TRANSCRIPT_MASS_ACCUMULATOR_HPP__
+#define __TRANSCRIPT_MASS_ACCUMULATOR_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "SalmonMath.hpp"
+
+/**
+ * The (log) mass that a thread assigns to the transcripts over a mini-batch
+ * of the online inference, summed per transcript, and added to the
+ * transcripts at the end of the mini-batch.
+ *
+ * Transcript::addMass is a compare-and-swap loop on the transcript's
+ * (atomic) mass, and the most highly expressed transcripts (e.g.
+ * mitochondrial or ribosomal) are hit by every thread at once, for nearly
+ * every fragment; their updates then mostly retry.  Here, each thread sums
+ * the mass of a mini-batch in a (sparse) table of its own, and updates each
+ * transcript it touched once per mini-batch.  All of the mass of a
+ * mini-batch is scaled by the same forgetting mass, which is applied to the
+ * sums as they're added.  Each quantification thread owns one, which is used
+ * with --batchMassUpdates.
+ */
+class TranscriptMassAccumulator {
+public:
+  // Add logMass (in log space, without the forgetting mass) to transcript tid
+  inline void add(uint32_t tid, double logMass) {
+    if (2 * (touched_.size() + 1) > slots_.size()) {
+      grow_();
+    }
+    size_t mask = slots_.size() - 1;
+    size_t i = hash_(tid) & mask;
+    while (slots_[i].tid != emptyTid_ and slots_[i].tid != tid) {
+      i = (i + 1) & mask;
+    }
+    auto& slot = slots_[i];
+    if (slot.tid == emptyTid_) {
+      slot.tid = tid;
+      slot.mass = logMass;
+      touched_.push_back(static_cast<uint32_t>(i));
+    } else {
+      slot.mass = salmon::math::logAdd(slot.mass, logMass);
+    }
+  }
+
+  // Add the accumulated mass, scaled by logForgettingMass, to the
+  // transcripts (anything with addMass(double)), and start over
+  template <typename TranscriptVecT>
+  void flush(TranscriptVecT& transcripts, double logForgettingMass) {
+    for (auto i : touched_) {
+      auto& slot = slots_[i];
+      transcripts[slot.tid].addMass(logForgettingMass + slot.mass);
+      slot.tid = emptyTid_;
+    }
+    touched_.clear();
+  }
+
+  // the number of transcripts that have accumulated mass
+  size_t size() const { return touched_.size(); }
+
+private:
+  struct Slot {
+    uint32_t tid;
+    double mass;
+  };
+
+  static constexpr uint32_t emptyTid_{std::numeric_limits<uint32_t>::max()};
+
+  static inline size_t hash_(uint32_t tid) {
+    return static_cast<size_t>((static_cast<uint64_t>(tid) * 0x9E3779B97F4A7C15ULL) >> 32);
+  }
+
+  // double the table (an open addressing table with linear probing, which
+  // keeps its size from one mini-batch to the next), and re-insert what it
+  // holds
+  void grow_() {
+    std::vector<Slot> old(slots_.size() == 0 ? initialSize_ : 2 * slots_.size(),
+                          Slot{emptyTid_, 0.0});
+    old.swap(slots_);
+    std::vector<uint32_t> oldTouched;
+    oldTouched.swap(touched_);
+    touched_.reserve(slots_.size() / 2);
+    size_t mask = slots_.size() - 1;
+    for (auto j : oldTouched) {
+      size_t i = hash_(old[j].tid) & mask;
+      while (slots_[i].tid != emptyTid_) {
+        i = (i + 1) & mask;
+      }
+      slots_[i] = old[j];
+      touched_.push_back(static_cast<uint32_t>(i));
+    }
+  }
+
+  static constexpr size_t initialSize_{4096};
+
+  std::vector<Slot> slots_;
+  // the slots in use
+  std::vector<uint32_t> touched_;
+};
+
+#endif // __TRANSCRIPT_MASS_ACCUMULATOR_HPP__
@@ -0,0 +1,83 @@
+#!/bin/bash
+#
+# Compare the mapping throughput of `salmon quant` on the reads of
+# sample_data.tgz when they are compressed with gzip, BGZF (if bgzip is
+# available), zstd (a single frame), and zstd split into independent frames
+# (which are decompressed in parallel with --decompressionThreads).
+#
+# usage:
+#   bench_gz_zst.sh -s <salmon binary> -o <scratch dir> [-t <sample tarball>] \
+#       [-r <times to replicate the reads>] [-n <repeats>] [-p <threads>] \
+#       [-d <decompression threads>]
+#
+# e.g.
+#   bench_gz_zst.sh -s build/src/salmon -o /tmp/gzzst -r 200 -p 8 -d 4
+#
+# The sample reads are small, so they are concatenated -r times to get run
+# times that are long enough to compare.  Each format is run with and
+# without decompression threads, through bench_quant.sh.
+set -eu -o pipefail
+
+salmon=""
+outdir=""
+tarball="$(dirname "$0")/../sample_data.tgz"
+replicate=100
+repeats=1
+threads=4
+dthreads=4
+
+while getopts "s:o:t:r:n:p:d:" opt; do
+  case ${opt} in
+    s) salmon=${OPTARG} ;;
+    o) outdir=${OPTARG} ;;
+    t) tarball=${OPTARG} ;;
+    r) replicate=${OPTARG} ;;
+    n) repeats=${OPTARG} ;;
+    p) threads=${OPTARG} ;;
+    d) dthreads=${OPTARG} ;;
+    *) echo "unknown option"; exit 1 ;;
+  esac
+done
+
+if [ -z "${salmon}" ] || [ -z "${outdir}" ]; then
+  echo "usage: $0 -s <salmon> -o <scratch dir> [-t tarball] [-r replicate] [-n repeats] [-p threads] [-d decompression threads]"
+  exit 1
+fi
+command -v zstd > /dev/null || { echo "zstd is required"; exit 1; }
+
+bench="$(dirname "$0")/bench_quant.sh"
+mkdir -p "${outdir}"
+tar xzf "${tarball}" -C "${outdir}"
+data="${outdir}/sample_data"
+
+"${salmon}" index -t "${data}/transcripts.fasta" -i "${data}/index" > "${outdir}/index.log" 2>&1
+
+for m in 1 2; do
+  fq="${data}/reads_${m}.fastq"
+  big="${outdir}/reads_${m}.fastq"
+  rm -f "${big}"
+  for _ in $(seq 1 "${replicate}"); do cat "${fq}" >> "${big}"; done
+  gzip -c "${big}" > "${big}.gz"
+  zstd -q -f -c "${big}" > "${big}.zst"
+  # independent frames of ~4MB each (pzstd writes files of the same kind)
+  split -b 4M --filter='zstd -q -c' "${big}" > "${big}.frames.zst"
+  if command -v bgzip > /dev/null; then
+    bgzip -c "${big}" > "${big}.bgz"
+  fi
+done
+
+formats=("gz:fastq.gz" "zst:fastq.zst" "zst_frames:fastq.frames.zst")
+if command -v bgzip > /dev/null; then
+  formats+=("bgzf:fastq.bgz")
+fi
+
+ls -l "${outdir}"/reads_1.fastq*
+for f in "${formats[@]}"; do
+  label=${f%%:*}
+  ext=${f#*:}
+  echo "== ${label}"
+  "${bench}" -s "${salmon}" -i "${data}/index" -o "${outdir}/runs" -n "${repeats}" \
+    -c "${label}_dt0:--decompressionThreads 0" \
+    -c "${label}_dt${dthreads}:--decompressionThreads ${dthreads}" \
+    -- -l A -1 "${outdir}/reads_1.${ext}" -2 "${outdir}/reads_2.${ext}" -p "${threads}"
+done
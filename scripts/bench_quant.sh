@@ -0,0 +1,86 @@
+#!/bin/bash
+#
+# Compare the mapping throughput of `salmon quant` under different option
+# sets on the same reads.
+#
+# usage:
+#   bench_quant.sh -s <salmon binary> -i <index> -o <scratch dir> [-n <repeats>] \
+#       -c "label:extra quant options" [-c ...] -- <read library options>
+#
+# e.g.
+#   bench_quant.sh -s build/src/salmon -i idx -o /tmp/bench \
+#       -c "baseline:--decompressionThreads 0" \
+#       -c "parallel:--decompressionThreads 4" \
+#       -- -l A -1 reads_1.fq.gz -2 reads_2.fq.gz -p 16
+#
+#   bench_quant.sh -s build/src/salmon -i idx -o /tmp/bench -n 3 \
+#       -c "spin:--parserWaitStrategy SPIN" \
+#       -c "block:--parserWaitStrategy BLOCK" \
+#       -- -l A -r reads.fq.gz -p 32
+#
+# For every configuration, the wall-clock time, the CPU time (user + sys),
+# the number of processed fragments (from aux_info/meta_info.json), the
+# throughput and the CPU-seconds spent per million fragments are reported,
+# along with the dTLB misses per million reads for configurations run with
+# --countTLBMisses (e.g. -c "thp:--hugePages THP --countTLBMisses"), and the
+# peak resident memory, if GNU time is installed (as /usr/bin/time).
+set -eu -o pipefail
+
+salmon=""
+index=""
+outdir=""
+repeats=1
+configs=()
+
+while getopts "s:i:o:n:c:" opt; do
+  case ${opt} in
+    s) salmon=${OPTARG} ;;
+    i) index=${OPTARG} ;;
+    o) outdir=${OPTARG} ;;
+    n) repeats=${OPTARG} ;;
+    c) configs+=("${OPTARG}") ;;
+    *) echo "unknown option"; exit 1 ;;
+  esac
+done
+shift $((OPTIND - 1))
+readopts=("$@")
+
+if [ -z "${salmon}" ] || [ -z "${index}" ] || [ -z "${outdir}" ] || [ ${#configs[@]} -eq 0 ]; then
+  echo "usage: $0 -s <salmon> -i <index> -o <scratch dir> [-n repeats] -c \"label:options\" ... -- <read options>"
+  exit 1
+fi
+
+mkdir -p "${outdir}"
+TIMEFORMAT="%R %U %S"
+gnutime=""
+if /usr/bin/time -f "%M" true > /dev/null 2>&1; then
+  gnutime=/usr/bin/time
+fi
+
+printf "%-20s %6s %10s %10s %14s %14s %16s %16s %12s\n" "config" "rep" "wall(s)" "cpu(s)" "fragments" "frags/s" "cpu-s/M frags" "dTLB/M frags" "peak RSS(MB)"
+for cfg in "${configs[@]}"; do
+  label=${cfg%%:*}
+  extra=${cfg#*:}
+  for rep in $(seq 1 "${repeats}"); do
+    qdir="${outdir}/${label}_${rep}"
+    rm -rf "${qdir}"
+    rss="-"
+    if [ -n "${gnutime}" ]; then
+      # shellcheck disable=SC2086
+      "${gnutime}" -f "%e %U %S %M" -o "${outdir}/${label}_${rep}.time" \
+        "${salmon}" quant -q -i "${index}" -o "${qdir}" ${extra} "${readopts[@]}" > "${outdir}/${label}_${rep}.log" 2>&1
+      read -r wall user sys rsskb < "${outdir}/${label}_${rep}.time"
+      rss=$(( rsskb / 1024 ))
+    else
+      # shellcheck disable=SC2086
+      t=$( { time "${salmon}" quant -q -i "${index}" -o "${qdir}" ${extra} "${readopts[@]}" > "${outdir}/${label}_${rep}.log" 2>&1 ; } 2>&1 )
+      read -r wall user sys <<< "${t}"
+    fi
+    nfrag=$(grep -o '"num_processed": *[0-9]*' "${qdir}/aux_info/meta_info.json" | grep -o '[0-9]*$')
+    dtlb=$(grep -o '"dtlb_misses_per_million_reads": *[0-9.e+]*' "${qdir}/aux_info/meta_info.json" | grep -o '[0-9.e+]*$' || echo "-")
+    awk -v l="${label}" -v r="${rep}" -v w="${wall}" -v u="${user}" -v s="${sys}" -v n="${nfrag}" -v d="${dtlb}" -v m="${rss}" 'BEGIN {
+      cpu = u + s;
+      printf "%-20s %6d %10.2f %10.2f %14d %14.0f %16.2f %16s %12s\n", l, r, w, cpu, n, n / w, cpu / (n / 1000000.0), d, m;
+    }'
+  done
+done
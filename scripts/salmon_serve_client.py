@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+"""
+Send a `salmon quant` job to a running `salmon serve`, print its log as it
+runs, and exit with the job's exit status.
+
+usage:
+    salmon_serve_client.py <socket> [quant options ...]
+
+e.g.
+    salmon serve -i idx -s /tmp/salmon.sock &
+    salmon_serve_client.py /tmp/salmon.sock -l A -1 r_1.fq.gz -2 r_2.fq.gz -p 8 -o out
+
+The index is the one the server was started with (a job may not name a
+different one).  Relative paths are resolved against the working directory
+of the client.
+"""
+
+import os
+import socket
+import struct
+import sys
+
+STATUS_PREFIX = b"salmon-serve-status "
+
+
+def main():
+    if len(sys.argv) < 2 or sys.argv[1] in ("-h", "--help"):
+        sys.stderr.write(__doc__)
+        return 1
+    sock_path, args = sys.argv[1], sys.argv[2:]
+
+    conn = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    conn.connect(sock_path)
+    # the number of fields, and then each field (the working directory, then
+    # the arguments) preceded by its length, as 32-bit big-endian integers
+    fields = [os.fsencode(a) for a in [os.getcwd()] + args]
+    request = struct.pack("!I", len(fields)) + b"".join(
+        struct.pack("!I", len(f)) + f for f in fields)
+    conn.sendall(request)
+
+    # stream the log, holding back the last (partial) line, which may be the
+    # status trailer
+    out = sys.stdout.buffer
+    pending = b""
+    while True:
+        data = conn.recv(65536)
+        if not data:
+            break
+        pending += data
+        last_nl = pending.rfind(b"\n", 0, len(pending) - 1)
+        if last_nl >= 0:
+            out.write(pending[: last_nl + 1])
+            out.flush()
+            pending = pending[last_nl + 1 :]
+    conn.close()
+
+    if pending.startswith(STATUS_PREFIX):
+        return int(pending[len(STATUS_PREFIX) :].strip())
+    out.write(pending)
+    sys.stderr.write("salmon_serve_client : the server closed the connection "
+                     "before the job finished\n")
+    return 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
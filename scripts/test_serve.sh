@@ -0,0 +1,77 @@
+#!/bin/bash
+#
+# Check that a job run by `salmon serve` gives the same results as running
+# `salmon quant` directly, and report the time of each.
+#
+# usage:
+#   test_serve.sh -s <salmon binary> -i <index> -o <scratch dir> -- <read library options>
+#
+# e.g.
+#   test_serve.sh -s build/src/salmon -i idx -o /tmp/serve_test -- -l A -r reads.fq.gz
+#
+# Both runs use a single mapping thread (-p 1), so that their results are
+# deterministic; quant.sf and the equivalence classes (--dumpEq) are then
+# compared exactly.  The server runs in a directory of its own, given the
+# index by a path relative to it, so that the jobs (which run in the
+# directory of the client) must still find, and use, the resident index.
+set -eu -o pipefail
+
+salmon=""
+index=""
+outdir=""
+
+while getopts "s:i:o:" opt; do
+  case ${opt} in
+    s) salmon=${OPTARG} ;;
+    i) index=${OPTARG} ;;
+    o) outdir=${OPTARG} ;;
+    *) echo "unknown option" >&2; exit 1 ;;
+  esac
+done
+shift $((OPTIND - 1))
+if [[ "${1:-}" == "--" ]]; then
+  shift
+fi
+if [[ -z "${salmon}" || -z "${index}" || -z "${outdir}" || $# -eq 0 ]]; then
+  echo "usage: $0 -s <salmon> -i <index> -o <scratch dir> -- <read library options>" >&2
+  exit 1
+fi
+
+client="$(cd "$(dirname "$0")" && pwd)/salmon_serve_client.py"
+mkdir -p "${outdir}/server_cwd"
+sock="$(cd "${outdir}" && pwd)/salmon.sock"
+common=(-p 1 --dumpEq --seqBias --gcBias "$@")
+
+start=$(date +%s.%N)
+"${salmon}" quant -i "${index}" "${common[@]}" -o "${outdir}/quant" > "${outdir}/quant.log" 2>&1
+quant_time=$(echo "$(date +%s.%N) - ${start}" | bc)
+
+salmon_path="$(cd "$(dirname "${salmon}")" && pwd)/$(basename "${salmon}")"
+server_index="$(realpath --relative-to="${outdir}/server_cwd" "${index}")"
+serve_log="$(cd "${outdir}" && pwd)/serve.log"
+(cd "${outdir}/server_cwd" &&
+  exec "${salmon_path}" serve -i "${server_index}" -s "${sock}") > "${serve_log}" 2>&1 &
+server=$!
+trap 'kill ${server} 2> /dev/null || true' EXIT
+for _ in $(seq 600); do
+  [[ -S "${sock}" ]] && break
+  sleep 0.5
+done
+
+# the first job after the index is loaded, and a second one
+for run in 1 2; do
+  start=$(date +%s.%N)
+  python3 "${client}" "${sock}" "${common[@]}" -o "${outdir}/serve_${run}" > "${outdir}/serve_${run}.log" 2>&1
+  serve_time=$(echo "$(date +%s.%N) - ${start}" | bc)
+  printf "quant : %.2f s, serve job %d : %.2f s\n" "${quant_time}" "${run}" "${serve_time}"
+
+  if ! grep -q "Using the resident index" "${outdir}/serve_${run}.log"; then
+    echo "serve job ${run} loaded the index again, rather than using the resident one" >&2
+    exit 1
+  fi
+
+  cmp "${outdir}/quant/quant.sf" "${outdir}/serve_${run}/quant.sf"
+  cmp <(gunzip -c -f "${outdir}/quant/aux_info/eq_classes.txt"*) \
+      <(gunzip -c -f "${outdir}/serve_${run}/aux_info/eq_classes.txt"*)
+done
+echo "the results of the served jobs match those of quant"
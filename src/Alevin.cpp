@@ -633,7 +633,8 @@ void processBarcodes(std::vector<std::string>& barcodeFiles,
                      SoftMapT& barcodeSoftMap,
                      TrueBcsT& trueBarcodes,
                      CFreqMapT& freqCounter,
-                     size_t& numLowConfidentBarcode){
+                     size_t& numLowConfidentBarcode,
+                     bool consumerParsing){
   // Barcode processing always uses 2 threads now,
   // one parsing thread and one consumer thread.
   std::unique_ptr<single_parser> singleParserPtr{nullptr};
@@ -650,13 +651,21 @@ void processBarcodes(std::vector<std::string>& barcodeFiles,
   singleParserPtr.reset(new single_parser(barcodeFiles, numThreads,
                                           numParsingThreads, miniBatchSize));
 
+  // with --consumerParsing and several barcode files, the consumer parses
+  // some of them itself whenever the parsing threads fall behind.
+  singleParserPtr->enableConsumerParsing(consumerParsing);
   singleParserPtr->start();
   densityCalculator(singleParserPtr.get(), aopt,
                     freqCounter, usedNumBarcodes, totNumBarcodes);
+  auto parserStats = singleParserPtr->stats();
   singleParserPtr->stop();
 
   fmt::print(stderr, "\n\n");
   aopt.jointLog->info("Done barcode density calculation.");
+  aopt.jointLog->info("Barcode density time waiting for reads : {:.2f}s (spent parsing : {:.2f}s); "
+                      "time parsing threads waited : {:.2f}s",
+                      parserStats.consumerStarvedNs / 1e9, parserStats.consumerParsingNs / 1e9,
+                      parserStats.parserStarvedNs / 1e9);
   aopt.jointLog->info("# Barcodes Used: {}{}{} / {}{}{}.",
                       green, usedNumBarcodes, RESET_COLOR,
                       red,totNumBarcodes, RESET_COLOR);
@@ -877,7 +886,8 @@ void initiatePipeline(AlevinOpts<ProtocolT>& aopt,
                     barcodeSoftMap,
                     trueBarcodes,
                     freqCounter,
-                    numLowConfidentBarcode);
+                    numLowConfidentBarcode,
+                    sopt.consumerParsing);
     aopt.jointLog->flush();
   }
 
@@ -104,6 +104,82 @@ namespace alevin {
       exit(1);
     }
 
+    inline bool extractPackedUMI(const fastx_parser::PackedSeq& read,
+                                 uint32_t start, uint32_t umiLength,
+                                 uint64_t& umi, bool& validUMI){
+      if (read.size() < start + umiLength) {
+        return false;
+      }
+      validUMI = !read.hasN(start, umiLength);
+      umi = read.word(start, umiLength);
+      return true;
+    }
+
+    template <>
+    bool extractUMI<apt::DropSeq>(const fastx_parser::PackedSeq& read,
+                                  apt::DropSeq& pt,
+                                  uint64_t& umi,
+                                  bool& validUMI){
+      return extractPackedUMI(read, pt.barcodeLength, pt.umiLength, umi, validUMI);
+    }
+    template <>
+    bool extractUMI<apt::Chromium>(const fastx_parser::PackedSeq& read,
+                                   apt::Chromium& pt,
+                                   uint64_t& umi,
+                                   bool& validUMI){
+      return extractPackedUMI(read, pt.barcodeLength, pt.umiLength, umi, validUMI);
+    }
+    template <>
+    bool extractUMI<apt::ChromiumV3>(const fastx_parser::PackedSeq& read,
+                                     apt::ChromiumV3& pt,
+                                     uint64_t& umi,
+                                     bool& validUMI){
+      return extractPackedUMI(read, pt.barcodeLength, pt.umiLength, umi, validUMI);
+    }
+    template <>
+    bool extractUMI<apt::Gemcode>(const fastx_parser::PackedSeq& read,
+                                  apt::Gemcode& pt,
+                                  uint64_t& umi,
+                                  bool& validUMI){
+      return extractPackedUMI(read, pt.barcodeLength, pt.umiLength, umi, validUMI);
+    }
+    template <>
+    bool extractUMI<apt::Custom>(const fastx_parser::PackedSeq& read,
+                                 apt::Custom& pt,
+                                 uint64_t& umi,
+                                 bool& validUMI){
+      return extractPackedUMI(read, pt.barcodeLength, pt.umiLength, umi, validUMI);
+    }
+    template <>
+    bool extractUMI<apt::CELSeq2>(const fastx_parser::PackedSeq& read,
+                                  apt::CELSeq2& pt,
+                                  uint64_t& umi,
+                                  bool& validUMI){
+      return extractPackedUMI(read, 0, pt.umiLength, umi, validUMI);
+    }
+    template <>
+    bool extractUMI<apt::QuartzSeq2>(const fastx_parser::PackedSeq& read,
+                                     apt::QuartzSeq2& pt,
+                                     uint64_t& umi,
+                                     bool& validUMI){
+      return extractPackedUMI(read, 0, pt.umiLength, umi, validUMI);
+    }
+    template <>
+    bool extractUMI<apt::CELSeq>(const fastx_parser::PackedSeq& read,
+                                 apt::CELSeq& pt,
+                                 uint64_t& umi,
+                                 bool& validUMI){
+      return extractPackedUMI(read, 0, pt.umiLength, umi, validUMI);
+    }
+    template <>
+    bool extractUMI<apt::InDrop>(const fastx_parser::PackedSeq& read,
+                                 apt::InDrop& pt,
+                                 uint64_t& umi,
+                                 bool& validUMI){
+      std::cout<<"Incorrect call for umi extract";
+      exit(1);
+    }
+
     template <>
     nonstd::optional<std::string> extractBarcode<apt::DropSeq>(std::string& read,
                                       apt::DropSeq& pt){
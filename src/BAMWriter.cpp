@@ -0,0 +1,413 @@
+#include "BAMWriter.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// The uncompressed bytes put in a BGZF block (as in htslib, so that the
+// compressed block fits in 64 KB even if the data doesn't compress).
+constexpr size_t maxBlockData{0xff00};
+constexpr size_t maxBlockSize{0x10000};
+constexpr size_t blockHeaderSize{18};
+constexpr size_t blockFooterSize{8};
+
+// gzip header with the "BC" extra sub-field that holds the block size
+const unsigned char bgzfHeader[blockHeaderSize] = {
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0xff, 0x06, 0x00, 0x42, 0x43, 0x02, 0x00, 0x00, 0x00};
+
+// the empty block that marks the end of a BGZF file
+const unsigned char bgzfEOF[28] = {
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff,
+    0x06, 0x00, 0x42, 0x43, 0x02, 0x00, 0x1b, 0x00, 0x03, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+// (BAM is little endian)
+inline void putU32(unsigned char* p, uint32_t v) {
+  p[0] = static_cast<unsigned char>(v);
+  p[1] = static_cast<unsigned char>(v >> 8);
+  p[2] = static_cast<unsigned char>(v >> 16);
+  p[3] = static_cast<unsigned char>(v >> 24);
+}
+
+inline void appendU8(std::string& out, uint8_t v) {
+  out.push_back(static_cast<char>(v));
+}
+
+inline void appendU16(std::string& out, uint16_t v) {
+  out.push_back(static_cast<char>(v));
+  out.push_back(static_cast<char>(v >> 8));
+}
+
+inline void appendU32(std::string& out, uint32_t v) {
+  unsigned char b[4];
+  putU32(b, v);
+  out.append(reinterpret_cast<char*>(b), 4);
+}
+
+inline void appendI32(std::string& out, int32_t v) {
+  appendU32(out, static_cast<uint32_t>(v));
+}
+
+// The bin of the interval [beg, end) (from the SAM specification)
+uint16_t reg2bin(int32_t beg, int32_t end) {
+  --end;
+  if (beg >> 14 == end >> 14) {
+    return ((1 << 15) - 1) / 7 + (beg >> 14);
+  }
+  if (beg >> 17 == end >> 17) {
+    return ((1 << 12) - 1) / 7 + (beg >> 17);
+  }
+  if (beg >> 20 == end >> 20) {
+    return ((1 << 9) - 1) / 7 + (beg >> 20);
+  }
+  if (beg >> 23 == end >> 23) {
+    return ((1 << 6) - 1) / 7 + (beg >> 23);
+  }
+  if (beg >> 26 == end >> 26) {
+    return ((1 << 3) - 1) / 7 + (beg >> 26);
+  }
+  return 0;
+}
+
+// The 4-bit code of a base ("=ACMGRSVTWYHKDBN"), and that of its complement
+inline uint8_t baseCode(char c) {
+  switch (c) {
+  case 'A': case 'a': return 1;
+  case 'C': case 'c': return 2;
+  case 'G': case 'g': return 4;
+  case 'T': case 't': return 8;
+  default: return 15;
+  }
+}
+
+inline uint8_t complementCode(char c) {
+  switch (c) {
+  case 'A': case 'a': return 8;
+  case 'C': case 'c': return 4;
+  case 'G': case 'g': return 2;
+  case 'T': case 't': return 1;
+  default: return 15;
+  }
+}
+
+// Compress len bytes of data into a BGZF block appended to out; false if it
+// doesn't fit in a block (at this level) or zlib fails.
+bool appendBlock(std::vector<unsigned char>& out, const char* data,
+                 size_t len, z_stream& zs) {
+  size_t base = out.size();
+  out.resize(base + maxBlockSize);
+  unsigned char* block = out.data() + base;
+  std::memcpy(block, bgzfHeader, blockHeaderSize);
+  if (deflateReset(&zs) != Z_OK) {
+    out.resize(base);
+    return false;
+  }
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+  zs.avail_in = static_cast<uInt>(len);
+  zs.next_out = block + blockHeaderSize;
+  zs.avail_out = maxBlockSize - blockHeaderSize - blockFooterSize;
+  if (deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+    out.resize(base);
+    return false;
+  }
+  size_t clen = zs.total_out;
+  size_t blockSize = blockHeaderSize + clen + blockFooterSize;
+  block[16] = static_cast<unsigned char>((blockSize - 1) & 0xff);
+  block[17] = static_cast<unsigned char>((blockSize - 1) >> 8);
+  uLong crc = crc32(crc32(0L, Z_NULL, 0),
+                    reinterpret_cast<const Bytef*>(data),
+                    static_cast<uInt>(len));
+  putU32(block + blockHeaderSize + clen, static_cast<uint32_t>(crc));
+  putU32(block + blockHeaderSize + clen + 4, static_cast<uint32_t>(len));
+  out.resize(base + blockSize);
+  return true;
+}
+
+} // namespace
+
+namespace salmon {
+namespace bam_utils {
+
+bool BAMRecordEncoder::parseCigar_(const std::string& cigar, size_t seqLen,
+                                   uint32_t& refLen) {
+  cigarOps_.clear();
+  refLen = 0;
+  size_t queryLen{0};
+  uint32_t n{0};
+  bool haveLen{false};
+  for (char c : cigar) {
+    if (c >= '0' and c <= '9') {
+      n = 10 * n + static_cast<uint32_t>(c - '0');
+      haveLen = true;
+      continue;
+    }
+    const char* ops = "MIDNSHP=X";
+    const char* op = std::strchr(ops, c);
+    if (!haveLen or c == '\0' or op == nullptr) {
+      return false;
+    }
+    uint32_t code = static_cast<uint32_t>(op - ops);
+    cigarOps_.push_back((n << 4) | code);
+    // M, I, S, =, X consume the query; M, D, N, =, X the reference
+    if (code == 0 or code == 1 or code == 4 or code == 7 or code == 8) {
+      queryLen += n;
+    }
+    if (code == 0 or code == 2 or code == 3 or code == 7 or code == 8) {
+      refLen += n;
+    }
+    n = 0;
+    haveLen = false;
+  }
+  return !haveLen and !cigarOps_.empty() and queryLen == seqLen;
+}
+
+void BAMRecordEncoder::append(const BAMRecord& r, std::string& out) {
+  uint32_t refLen{0};
+  if (r.cigar != nullptr and !parseCigar_(*r.cigar, r.seqLen, refLen)) {
+    cigarOps_.assign(1, (static_cast<uint32_t>(r.seqLen) << 4) | 0);
+    refLen = static_cast<uint32_t>(r.seqLen);
+  } else if (r.cigar == nullptr) {
+    cigarOps_.clear();
+  }
+  // (an unplaced read is in the bin of [-1, 0))
+  uint16_t bin = (r.pos < 0) ? 4680
+                             : reg2bin(r.pos, r.pos + std::max(refLen, uint32_t(1)));
+  size_t nameLen = std::min(r.nameLen, size_t(254));
+
+  size_t start = out.size();
+  appendU32(out, 0); // the size of the record, set below
+  appendI32(out, r.refID);
+  appendI32(out, r.pos);
+  appendU8(out, static_cast<uint8_t>(nameLen + 1));
+  appendU8(out, r.mapq);
+  appendU16(out, bin);
+  appendU16(out, static_cast<uint16_t>(cigarOps_.size()));
+  appendU16(out, r.flag);
+  appendU32(out, static_cast<uint32_t>(r.seqLen));
+  appendI32(out, r.nextRefID);
+  appendI32(out, r.nextPos);
+  appendI32(out, r.tlen);
+  out.append(r.name, nameLen);
+  out.push_back('\0');
+  for (uint32_t op : cigarOps_) {
+    appendU32(out, op);
+  }
+
+  // the sequence, two bases per byte, on the strand of the reference
+  size_t seqStart = out.size();
+  out.append((r.seqLen + 1) / 2, '\0');
+  auto* packed = reinterpret_cast<unsigned char*>(&out[seqStart]);
+  bool reverse = (r.flag & BAM_FREVERSE) != 0;
+  for (size_t i = 0; i < r.seqLen; ++i) {
+    uint8_t code = reverse ? complementCode(r.seq[r.seqLen - 1 - i])
+                           : baseCode(r.seq[i]);
+    packed[i / 2] |= (i % 2 == 0) ? (code << 4) : code;
+  }
+  // no qualities
+  out.append(r.seqLen, static_cast<char>(0xff));
+
+  if (r.hasScore) {
+    out.append("ASi", 3);
+    appendI32(out, r.score);
+  }
+  if (r.numAlignments > 0) {
+    out.append("NHi", 3);
+    appendI32(out, static_cast<int32_t>(r.numAlignments));
+  }
+  putU32(reinterpret_cast<unsigned char*>(&out[start]),
+         static_cast<uint32_t>(out.size() - start - 4));
+}
+
+std::string encodeHeader(const std::string& text,
+                         const std::vector<std::pair<std::string, uint32_t>>& refs) {
+  std::string out("BAM\1", 4);
+  appendU32(out, static_cast<uint32_t>(text.size()));
+  out.append(text);
+  appendU32(out, static_cast<uint32_t>(refs.size()));
+  for (auto& ref : refs) {
+    appendU32(out, static_cast<uint32_t>(ref.first.size() + 1));
+    out.append(ref.first);
+    out.push_back('\0');
+    appendU32(out, ref.second);
+  }
+  return out;
+}
+
+} // namespace bam_utils
+} // namespace salmon
+
+BAMWriter::BAMWriter(const std::string& path, uint32_t numThreads, int level)
+    : level_(level) {
+  if (path == "-") {
+    fp_ = stdout;
+  } else {
+    fp_ = std::fopen(path.c_str(), "wb");
+    ownsFile_ = true;
+  }
+  if (fp_ == nullptr) {
+    ok_ = false;
+    closed_ = true;
+    return;
+  }
+  numThreads = std::max(numThreads, uint32_t(1));
+  // enough slots to keep every compression thread busy while the oldest
+  // buffer is written out, and to let the mapping threads run ahead a bit
+  size_t numSlots = 2 * numThreads + 2;
+  for (size_t i = 0; i < numSlots; ++i) {
+    ring_.emplace_back(new DeflateJob);
+  }
+  for (size_t i = 0; i < numThreads; ++i) {
+    workers_.emplace_back([this]() { this->compressWorker_(); });
+  }
+  writer_ = std::thread([this]() { this->writeOut_(); });
+}
+
+BAMWriter::~BAMWriter() { close(); }
+
+bool BAMWriter::good() const {
+  std::lock_guard<std::mutex> lock(m_);
+  return ok_;
+}
+
+void BAMWriter::writeHeader(std::string header) {
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    if (wroteHeader_) {
+      return;
+    }
+    wroteHeader_ = true;
+  }
+  write(header);
+}
+
+void BAMWriter::write(std::string& buf) {
+  if (buf.empty() or fp_ == nullptr) {
+    buf.clear();
+    return;
+  }
+  {
+    std::unique_lock<std::mutex> lock(m_);
+    producerCV_.wait(lock,
+                     [this]() { return fillID_ - writeID_ < ring_.size(); });
+    auto& job = *ring_[fillID_ % ring_.size()];
+    job.in.swap(buf);
+    job.state = SlotState::FILLED;
+    ++fillID_;
+  }
+  buf.clear();
+  workerCV_.notify_one();
+}
+
+bool BAMWriter::compressJob_(DeflateJob& job, z_stream& zs) {
+  job.out.clear();
+  z_stream stored;
+  bool haveStored{false};
+  bool ok{true};
+  for (size_t offset = 0; ok and offset < job.in.size(); offset += maxBlockData) {
+    size_t len = std::min(maxBlockData, job.in.size() - offset);
+    const char* data = job.in.data() + offset;
+    if (appendBlock(job.out, data, len, zs)) {
+      continue;
+    }
+    // the data doesn't compress; store it
+    if (!haveStored) {
+      std::memset(&stored, 0, sizeof(stored));
+      haveStored = (deflateInit2(&stored, 0, Z_DEFLATED, -15, 8,
+                                 Z_DEFAULT_STRATEGY) == Z_OK);
+    }
+    ok = haveStored and appendBlock(job.out, data, len, stored);
+  }
+  if (haveStored) {
+    deflateEnd(&stored);
+  }
+  return ok;
+}
+
+void BAMWriter::compressWorker_() {
+  z_stream zs;
+  std::memset(&zs, 0, sizeof(zs));
+  // -15 => a raw deflate stream; the gzip wrapper is that of BGZF
+  bool zsOK =
+      (deflateInit2(&zs, level_, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+
+  while (true) {
+    DeflateJob* job{nullptr};
+    {
+      std::unique_lock<std::mutex> lock(m_);
+      workerCV_.wait(lock,
+                     [this]() { return closing_ or compressID_ < fillID_; });
+      if (compressID_ >= fillID_) {
+        break;
+      }
+      job = ring_[compressID_ % ring_.size()].get();
+      ++compressID_;
+    }
+
+    bool ok = zsOK and compressJob_(*job, zs);
+
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      job->ok = ok;
+      job->state = SlotState::COMPRESSED;
+    }
+    writerCV_.notify_one();
+  }
+  deflateEnd(&zs);
+}
+
+void BAMWriter::writeOut_() {
+  while (true) {
+    DeflateJob* job{nullptr};
+    {
+      std::unique_lock<std::mutex> lock(m_);
+      writerCV_.wait(lock, [this]() {
+        return (writeID_ < fillID_ and
+                ring_[writeID_ % ring_.size()]->state == SlotState::COMPRESSED) or
+               (closing_ and writeID_ >= fillID_);
+      });
+      if (writeID_ >= fillID_) {
+        break;
+      }
+      job = ring_[writeID_ % ring_.size()].get();
+    }
+
+    bool ok = job->ok and
+              std::fwrite(job->out.data(), 1, job->out.size(), fp_) == job->out.size();
+
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      ok_ = ok_ and ok;
+      job->in.clear();
+      job->state = SlotState::EMPTY;
+      ++writeID_;
+    }
+    producerCV_.notify_all();
+  }
+}
+
+bool BAMWriter::close() {
+  if (closed_) {
+    return ok_;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    closing_ = true;
+  }
+  workerCV_.notify_all();
+  writerCV_.notify_all();
+  for (auto& w : workers_) {
+    w.join();
+  }
+  writer_.join();
+  bool ok = std::fwrite(bgzfEOF, 1, sizeof(bgzfEOF), fp_) == sizeof(bgzfEOF);
+  ok = (std::fflush(fp_) == 0) and ok;
+  if (ownsFile_) {
+    ok = (std::fclose(fp_) == 0) and ok;
+  }
+  fp_ = nullptr;
+  closed_ = true;
+  ok_ = ok_ and ok;
+  return ok_;
+}
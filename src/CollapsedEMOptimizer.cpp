@@ -1,4 +1,5 @@
 #include <atomic>
+#include <chrono>
 #include <unordered_map>
 #include <vector>
 #include <exception>
@@ -8,6 +9,8 @@
 #include "tbb/parallel_for_each.h"
 #include "tbb/parallel_reduce.h"
 #include "tbb/partitioner.h"
+#include "tbb/task_arena.h"
+#include "tbb/task_group.h"
 #include "tbb/task_scheduler_init.h"
 
 //#include "fastapprox.h"
@@ -22,7 +25,9 @@
 #include "AlignmentLibrary.hpp"
 #include "BootstrapWriter.hpp"
 #include "CollapsedEMOptimizer.hpp"
+#include "EqClassComponents.hpp"
 #include "MultinomialSampler.hpp"
+#include "PackedEqClasses.hpp"
 #include "ReadExperiment.hpp"
 #include "ReadPair.hpp"
 #include "SalmonMath.hpp"
@@ -100,9 +105,8 @@ std::vector<double> populatePriorAlphas_(
 /**
  * Single-threaded VBEM-update routine for use in bootstrapping
  */
-template <typename VecT>
-void VBEMUpdate_(std::vector<std::vector<uint32_t>>& txpGroupLabels,
-                 std::vector<std::vector<double>>& txpGroupCombinedWeights,
+template <typename VecT, typename WeightT>
+void VBEMUpdate_(const PackedEqClasses<WeightT>& eqs,
                  const std::vector<uint64_t>& txpGroupCounts,
                  std::vector<Transcript>& transcripts,
                  std::vector<double>& priorAlphas, double totLen,
@@ -110,7 +114,7 @@ void VBEMUpdate_(std::vector<std::vector<uint32_t>>& txpGroupLabels,
 
   assert(alphaIn.size() == alphaOut.size());
   size_t M = alphaIn.size();
-  size_t numEQClasses = txpGroupLabels.size();
+  size_t numEQClasses = eqs.size();
   double alphaSum = {0.0};
   for (size_t i = 0; i < M; ++i) {
     alphaSum += alphaIn[i] + priorAlphas[i];
@@ -133,10 +137,10 @@ void VBEMUpdate_(std::vector<std::vector<uint32_t>>& txpGroupLabels,
 
   for (size_t eqID = 0; eqID < numEQClasses; ++eqID) {
     uint64_t count = txpGroupCounts[eqID];
-    const std::vector<uint32_t>& txps = txpGroupLabels[eqID];
-    const auto& auxs = txpGroupCombinedWeights[eqID];
+    const uint32_t* txps = eqs.txps.data() + eqs.offsets[eqID];
+    const WeightT* auxs = eqs.combinedWeights.data() + eqs.offsets[eqID];
 
-    size_t groupSize = txpGroupCombinedWeights[eqID].size(); // txps.size();
+    size_t groupSize = eqs.groupSize(eqID);
     // If this is a single-transcript group,
     // then it gets the full count.  Otherwise,
     // update according to our VBEM rule.
@@ -165,18 +169,88 @@ void VBEMUpdate_(std::vector<std::vector<uint32_t>>& txpGroupLabels,
       }
 
     } else {
-      salmon::utils::incLoop(alphaOut[txps.front()], count);
+      salmon::utils::incLoop(alphaOut[txps[0]], count);
     }
   }
 }
 
+/*
+ * Run f over blocks of [begin, end); in parallel, unless the range is too
+ * short for that to pay.  The parallel loop is isolated, so that a thread
+ * that waits on it from within a task (that of a component, with
+ * --componentEM) only picks up the work of this loop meanwhile, rather than
+ * some other (long) task.
+ */
+template <typename FuncT>
+void forEachBlock_(size_t begin, size_t end, const FuncT& f) {
+  constexpr size_t minParallelLength{1024};
+  if (end - begin < minParallelLength) {
+    f(BlockedIndexRange(begin, end));
+    return;
+  }
+  tbb::this_task_arena::isolate(
+      [&]() -> void { tbb::parallel_for(BlockedIndexRange(begin, end), f); });
+}
+
+/*
+ * The pass of the "standard" EM over the equivalence classes in
+ * [classBegin, classEnd) of eqs: add the count of each class to alphaOut,
+ * split among its transcripts according to alphaIn.
+ */
+template <typename WeightT>
+void EMUpdateClasses_(const PackedEqClasses<WeightT>& eqs, size_t classBegin,
+                      size_t classEnd,
+                      const CollapsedEMOptimizer::VecType& alphaIn,
+                      CollapsedEMOptimizer::VecType& alphaOut) {
+  forEachBlock_(
+      classBegin, classEnd,
+      [&eqs, &alphaIn, &alphaOut](const BlockedIndexRange& range) -> void {
+        for (auto eqID : boost::irange(range.begin(), range.end())) {
+          uint64_t count = eqs.counts[eqID];
+          // for each transcript in this class
+          const uint32_t* txps = eqs.txps.data() + eqs.offsets[eqID];
+          const WeightT* auxs = eqs.combinedWeights.data() + eqs.offsets[eqID];
+
+          size_t groupSize = eqs.groupSize(eqID);
+          // If this is a single-transcript group,
+          // then it gets the full count.  Otherwise,
+          // update according to our VBEM rule.
+          if (BOOST_LIKELY(groupSize > 1)) {
+            double denom = 0.0;
+            for (size_t i = 0; i < groupSize; ++i) {
+              auto tid = txps[i];
+              auto aux = auxs[i];
+              double v = (alphaIn[tid]) * aux;
+              denom += v;
+            }
+
+            if (denom <= ::minEQClassWeight) {
+              // tgroup.setValid(false);
+            } else {
+              double invDenom = count / denom;
+              for (size_t i = 0; i < groupSize; ++i) {
+                auto tid = txps[i];
+                auto aux = auxs[i];
+                double v = (alphaIn[tid]) * aux;
+                if (!std::isnan(v)) {
+                  salmon::utils::incLoop(alphaOut[tid], v * invDenom);
+                }
+              }
+            }
+          } else {
+            salmon::utils::incLoop(alphaOut[txps[0]], count);
+          }
+        }
+      });
+}
+
 /*
  * Use the "standard" EM algorithm over equivalence
  * classes to estimate the latent variables (alphaOut)
  * given the current estimates (alphaIn).
  */
-template <typename EQVecT>
-void EMUpdate_(EQVecT& eqVec,
+template <typename WeightT>
+void EMUpdate_(const PackedEqClasses<WeightT>& eqs,
                std::vector<Transcript>& transcripts,
                std::vector<double>& priorAlphas,
                const CollapsedEMOptimizer::VecType& alphaIn,
@@ -184,48 +258,58 @@ void EMUpdate_(EQVecT& eqVec,
 
   assert(alphaIn.size() == alphaOut.size());
 
-  tbb::parallel_for(
-      BlockedIndexRange(size_t(0), size_t(eqVec.size())),
-      [&eqVec, &priorAlphas, &alphaIn, &alphaOut](const BlockedIndexRange& range) -> void {
-        for (auto eqID : boost::irange(range.begin(), range.end())) {
-          auto& kv = eqVec[eqID];
+  EMUpdateClasses_(eqs, 0, eqs.size(), alphaIn, alphaOut);
+}
 
-          uint64_t count = kv.second.count;
+/*
+ * The pass of the VBEM over the equivalence classes in [classBegin,
+ * classEnd) of eqs: add the count of each class to alphaOut, split among its
+ * transcripts according to expTheta.
+ */
+template <typename WeightT>
+void VBEMUpdateClasses_(const PackedEqClasses<WeightT>& eqs,
+                        size_t classBegin, size_t classEnd,
+                        CollapsedEMOptimizer::VecType& alphaOut,
+                        const CollapsedEMOptimizer::VecType& expTheta) {
+  forEachBlock_(
+      classBegin, classEnd,
+      [&eqs, &alphaOut, &expTheta](const BlockedIndexRange& range) -> void {
+        for (auto eqID : boost::irange(range.begin(), range.end())) {
+          uint64_t count = eqs.counts[eqID];
           // for each transcript in this class
-          const TranscriptGroup& tgroup = kv.first;
-          if (tgroup.valid) {
-            const std::vector<uint32_t>& txps = tgroup.txps;
-            const auto& auxs = kv.second.combinedWeights;
-
-            size_t groupSize = kv.second.weights.size(); // txps.size();
-            // If this is a single-transcript group,
-            // then it gets the full count.  Otherwise,
-            // update according to our VBEM rule.
-            if (BOOST_LIKELY(groupSize > 1)) {
-              double denom = 0.0;
+          const uint32_t* txps = eqs.txps.data() + eqs.offsets[eqID];
+          const WeightT* auxs = eqs.combinedWeights.data() + eqs.offsets[eqID];
+
+          size_t groupSize = eqs.groupSize(eqID);
+          // If this is a single-transcript group,
+          // then it gets the full count.  Otherwise,
+          // update according to our VBEM rule.
+          if (BOOST_LIKELY(groupSize > 1)) {
+            double denom = 0.0;
+            for (size_t i = 0; i < groupSize; ++i) {
+              auto tid = txps[i];
+              auto aux = auxs[i];
+              if (expTheta[tid] > 0.0) {
+                double v = expTheta[tid] * aux;
+                denom += v;
+              }
+            }
+            if (denom <= ::minEQClassWeight) {
+              // tgroup.setValid(false);
+            } else {
+              double invDenom = count / denom;
               for (size_t i = 0; i < groupSize; ++i) {
                 auto tid = txps[i];
                 auto aux = auxs[i];
-                double v = (alphaIn[tid]) * aux;
-                denom += v;
-              }
-
-              if (denom <= ::minEQClassWeight) {
-                // tgroup.setValid(false);
-              } else {
-                double invDenom = count / denom;
-                for (size_t i = 0; i < groupSize; ++i) {
-                  auto tid = txps[i];
-                  auto aux = auxs[i];
-                  double v = (alphaIn[tid]) * aux;
-                  if (!std::isnan(v)) {
-                    salmon::utils::incLoop(alphaOut[tid], v * invDenom);
-                  }
+                if (expTheta[tid] > 0.0) {
+                  double v = expTheta[tid] * aux;
+                  salmon::utils::incLoop(alphaOut[tid], v * invDenom);
                 }
               }
-            } else {
-              salmon::utils::incLoop(alphaOut[txps.front()], count);
             }
+
+          } else {
+            salmon::utils::incLoop(alphaOut[txps[0]], count);
           }
         }
       });
@@ -236,8 +320,8 @@ void EMUpdate_(EQVecT& eqVec,
  * classes to estimate the latent variables (alphaOut)
  * given the current estimates (alphaIn).
  */
-template <typename EQVecT>
-void VBEMUpdate_(EQVecT& eqVec,
+template <typename WeightT>
+void VBEMUpdate_(const PackedEqClasses<WeightT>& eqs,
                  std::vector<Transcript>& transcripts,
                  std::vector<double>& priorAlphas, double totLen,
                  const CollapsedEMOptimizer::VecType& alphaIn,
@@ -272,72 +356,95 @@ void VBEMUpdate_(EQVecT& eqVec,
                       }
                     });
 
-  tbb::parallel_for(
-      BlockedIndexRange(size_t(0), size_t(eqVec.size())),
-      [&eqVec, &alphaIn, &alphaOut,
-       &expTheta](const BlockedIndexRange& range) -> void {
-        for (auto eqID : boost::irange(range.begin(), range.end())) {
-          auto& kv = eqVec[eqID];
+  VBEMUpdateClasses_(eqs, 0, eqs.size(), alphaOut, expTheta);
+}
 
-          uint64_t count = kv.second.count;
-          // for each transcript in this class
-          const TranscriptGroup& tgroup = kv.first;
-          if (tgroup.valid) {
-            const std::vector<uint32_t>& txps = tgroup.txps;
-            const auto& auxs = kv.second.combinedWeights;
-
-            size_t groupSize = kv.second.weights.size(); // txps.size();
-            // If this is a single-transcript group,
-            // then it gets the full count.  Otherwise,
-            // update according to our VBEM rule.
-            if (BOOST_LIKELY(groupSize > 1)) {
-              double denom = 0.0;
-              for (size_t i = 0; i < groupSize; ++i) {
-                auto tid = txps[i];
-                auto aux = auxs[i];
-                if (expTheta[tid] > 0.0) {
-                  double v = expTheta[tid] * aux;
-                  denom += v;
-                }
-              }
-              if (denom <= ::minEQClassWeight) {
-                // tgroup.setValid(false);
+/*
+ * Run the EM (or VBEM) over the classes of component c of comps alone, until
+ * its transcripts converge, by the same criteria as the global loop of
+ * optimize, starting at iteration firstIt.  For the VBEM, logNorm is the
+ * (global) normalization of expTheta.  Returns the iteration at which it
+ * stopped, and sets maxRelDiff to the component's in the last one.
+ */
+template <typename WeightT>
+size_t componentEM_(const PackedEqClasses<WeightT>& eqs,
+                    const EqClassComponents& comps, size_t c, bool useVBEM,
+                    const std::vector<double>& priorAlphas,
+                    CollapsedEMOptimizer::VecType& alphas,
+                    CollapsedEMOptimizer::VecType& alphasPrime,
+                    CollapsedEMOptimizer::VecType& expTheta, double logNorm,
+                    double relDiffTolerance, double alphaCheckCutoff,
+                    size_t firstIt, size_t minIter, size_t maxIter,
+                    double& maxRelDiff) {
+  size_t classBegin = comps.classOffsets[c];
+  size_t classEnd = comps.classOffsets[c + 1];
+  const uint32_t* txps = comps.txps.data() + comps.txpOffsets[c];
+  size_t numTxps = comps.numTranscripts(c);
+
+  size_t itNum{firstIt};
+  bool converged{false};
+  while (itNum < minIter or (itNum < maxIter and !converged)) {
+    if (useVBEM) {
+      forEachBlock_(
+          0, numTxps,
+          [txps, logNorm, &priorAlphas, &alphas, &alphasPrime,
+           &expTheta](const BlockedIndexRange& range) -> void {
+            for (auto i : boost::irange(range.begin(), range.end())) {
+              auto tid = txps[i];
+              auto ap = alphas[tid].load() + priorAlphas[tid];
+              if (ap > ::digammaMin) {
+                expTheta[tid] = std::exp(boost::math::digamma(ap) - logNorm);
               } else {
-                double invDenom = count / denom;
-                for (size_t i = 0; i < groupSize; ++i) {
-                  auto tid = txps[i];
-                  auto aux = auxs[i];
-                  if (expTheta[tid] > 0.0) {
-                    double v = expTheta[tid] * aux;
-                    salmon::utils::incLoop(alphaOut[tid], v * invDenom);
-                  }
-                }
+                expTheta[tid] = 0.0;
               }
-
-            } else {
-              salmon::utils::incLoop(alphaOut[txps.front()], count);
+              alphasPrime[tid] = 0.0;
             }
-          }
+          });
+      VBEMUpdateClasses_(eqs, classBegin, classEnd, alphasPrime, expTheta);
+    } else {
+      EMUpdateClasses_(eqs, classBegin, classEnd, alphas, alphasPrime);
+    }
+
+    converged = true;
+    maxRelDiff = -std::numeric_limits<double>::max();
+    for (size_t i = 0; i < numTxps; ++i) {
+      auto tid = txps[i];
+      if (alphasPrime[tid] > alphaCheckCutoff) {
+        double relDiff =
+            std::abs(alphas[tid] - alphasPrime[tid]) / alphasPrime[tid];
+        maxRelDiff = (relDiff > maxRelDiff) ? relDiff : maxRelDiff;
+        if (relDiff > relDiffTolerance) {
+          converged = false;
         }
-      });
+      }
+      alphas[tid] = alphasPrime[tid];
+      alphasPrime[tid] = 0.0;
+    }
+    ++itNum;
+  }
+  return itNum;
 }
 
-template <typename VecT, typename EQVecT>
+/*
+ * Mark the classes whose transcripts all have (nearly) no weight under
+ * alphaIn as invalid in eqVec, and remove them from eqs.
+ */
+template <typename VecT, typename WeightT, typename EQVecT>
 size_t markDegenerateClasses(
-    EQVecT& eqVec,
+    PackedEqClasses<WeightT>& eqs, EQVecT& eqVec,
     VecT& alphaIn, Eigen::VectorXd& effLens, std::vector<bool>& available,
     std::shared_ptr<spdlog::logger> jointLog, bool verbose = false) {
 
   size_t numDropped{0};
-  for (auto& kv : eqVec) {
-    uint64_t count = kv.second.count;
+  std::vector<bool> dropped(eqs.size(), false);
+  for (size_t eqID = 0; eqID < eqs.size(); ++eqID) {
+    uint64_t count = eqs.counts[eqID];
     // for each transcript in this class
-    const TranscriptGroup& tgroup = kv.first;
-    const std::vector<uint32_t>& txps = tgroup.txps;
-    const auto& auxs = kv.second.combinedWeights;
+    const uint32_t* txps = eqs.txps.data() + eqs.offsets[eqID];
+    const WeightT* auxs = eqs.combinedWeights.data() + eqs.offsets[eqID];
 
     double denom = 0.0;
-    size_t groupSize = kv.second.weights.size();
+    size_t groupSize = eqs.groupSize(eqID);
     for (size_t i = 0; i < groupSize; ++i) {
       auto tid = txps[i];
       auto aux = auxs[i];
@@ -357,18 +464,18 @@ size_t markDegenerateClasses(
 
       errstream << "denom = 0, count = " << count << "\n";
       errstream << "class = { ";
-      for (auto e : txps) {
-        errstream << e << " ";
+      for (size_t i = 0; i < groupSize; ++i) {
+        errstream << txps[i] << " ";
       }
       errstream << "}\n";
       errstream << "alphas = { ";
-      for (auto e : txps) {
-        errstream << alphaIn[e] << " ";
+      for (size_t i = 0; i < groupSize; ++i) {
+        errstream << alphaIn[txps[i]] << " ";
       }
       errstream << "}\n";
       errstream << "weights = { ";
-      for (auto e : auxs) {
-        errstream << e << " ";
+      for (size_t i = 0; i < groupSize; ++i) {
+        errstream << auxs[i] << " ";
       }
       errstream << "}\n";
       errstream << "============================\n\n";
@@ -378,7 +485,8 @@ size_t markDegenerateClasses(
         jointLog->info(errstream.str());
       }
       ++numDropped;
-      kv.first.setValid(false);
+      dropped[eqID] = true;
+      eqVec[eqs.classIDs[eqID]].first.setValid(false);
     } else {
       for (size_t i = 0; i < groupSize; ++i) {
         auto tid = txps[i];
@@ -386,17 +494,19 @@ size_t markDegenerateClasses(
       }
     }
   }
+  if (numDropped > 0) {
+    eqs.remove(dropped);
+  }
   return numDropped;
 }
 
 CollapsedEMOptimizer::CollapsedEMOptimizer() {}
 
+template <typename WeightT>
 bool doBootstrap(
-    std::vector<std::vector<uint32_t>>& txpGroups,
-    std::vector<std::vector<double>>& txpGroupCombinedWeights,
+    const PackedEqClasses<WeightT>& eqs,
     std::vector<Transcript>& transcripts, Eigen::VectorXd& effLens,
-    const std::vector<double>& sampleWeights, std::vector<uint64_t>& origCounts,
-    uint64_t totalNumFrags,
+    const std::vector<double>& sampleWeights, uint64_t totalNumFrags,
     uint64_t numMappedFrags, double uniformTxpWeight,
     std::atomic<uint32_t>& bsNum, SalmonOpts& sopt,
     std::vector<double>& priorAlphas,
@@ -409,7 +519,8 @@ bool doBootstrap(
   // Determine up front if we're going to use scaled counts.
   bool useScaledCounts = !(sopt.useQuasi or sopt.allowOrphans);
   bool useVBEM{sopt.useVBOpt};
-  size_t numClasses = txpGroups.size();
+  size_t numClasses = eqs.size();
+  const std::vector<uint64_t>& origCounts = eqs.counts;
   CollapsedEMOptimizer::SerialVecType alphas(transcripts.size(), 0.0);
   CollapsedEMOptimizer::SerialVecType alphasPrime(transcripts.size(), 0.0);
   CollapsedEMOptimizer::SerialVecType expTheta(transcripts.size(), 0.0);
@@ -460,11 +571,10 @@ bool doBootstrap(
     while (itNum < minIter or (itNum < maxIter and !converged)) {
 
       if (useVBEM) {
-        VBEMUpdate_(txpGroups, txpGroupCombinedWeights, sampCounts, transcripts,
-                    priorAlphas, totalLen, alphas, alphasPrime, expTheta);
+        VBEMUpdate_(eqs, sampCounts, transcripts, priorAlphas, totalLen,
+                    alphas, alphasPrime, expTheta);
       } else {
-        EMUpdate_(txpGroups, txpGroupCombinedWeights, sampCounts, transcripts,
-                  alphas, alphasPrime);
+        EMUpdate_(eqs, sampCounts, transcripts, alphas, alphasPrime);
       }
 
       converged = true;
@@ -489,11 +599,10 @@ bool doBootstrap(
     // counts
     if (sopt.bootstrapReproject) {
       if (useVBEM) {
-        VBEMUpdate_(txpGroups, txpGroupCombinedWeights, origCounts, transcripts,
-                    priorAlphas, totalLen, alphas, alphasPrime, expTheta);
+        VBEMUpdate_(eqs, origCounts, transcripts, priorAlphas, totalLen,
+                    alphas, alphasPrime, expTheta);
       } else {
-        EMUpdate_(txpGroups, txpGroupCombinedWeights, origCounts, transcripts,
-                  alphas, alphasPrime);
+        EMUpdate_(eqs, origCounts, transcripts, alphas, alphasPrime);
       }
     }
 
@@ -549,6 +658,19 @@ bool CollapsedEMOptimizer::gatherBootstraps(
     ExpT& readExp, SalmonOpts& sopt,
     std::function<bool(const std::vector<double>&)>& writeBootstrap,
     double relDiffTolerance, uint32_t maxIter) {
+  if (sopt.floatEqWeights) {
+    return gatherBootstraps_<float>(readExp, sopt, writeBootstrap,
+                                    relDiffTolerance, maxIter);
+  }
+  return gatherBootstraps_<double>(readExp, sopt, writeBootstrap,
+                                   relDiffTolerance, maxIter);
+}
+
+template <typename WeightT, typename ExpT>
+bool CollapsedEMOptimizer::gatherBootstraps_(
+    ExpT& readExp, SalmonOpts& sopt,
+    std::function<bool(const std::vector<double>&)>& writeBootstrap,
+    double relDiffTolerance, uint32_t maxIter) {
 
   std::vector<Transcript>& transcripts = readExp.transcripts();
   std::vector<bool> available(transcripts.size(), false);
@@ -610,40 +732,25 @@ bool CollapsedEMOptimizer::gatherBootstraps(
   std::vector<double> priorAlphas = populatePriorAlphas_(
       transcripts, effLens, priorValue, perTranscriptPrior);
 
-  auto numRemoved =
-      markDegenerateClasses(eqVec, alphas, effLens, available, sopt.jointLog);
+  // Since we will use the same weights and transcript groups for each
+  // of the bootstrap samples (only the count vector will change), it
+  // makes sense to keep only one (packed) copy of these.
+  PackedEqClasses<WeightT> eqs(eqVec);
+
+  auto numRemoved = markDegenerateClasses(eqs, eqVec, alphas, effLens,
+                                          available, sopt.jointLog);
   sopt.jointLog->info("Marked {} weighted equivalence classes as degenerate",
                       numRemoved);
 
-  // Since we will use the same weights and transcript groups for each
-  // of the bootstrap samples (only the count vector will change), it
-  // makes sense to keep only one copy of these.
-  using TGroupLabelT = std::vector<uint32_t>;
-  using TGroupWeightVec = std::vector<double>;
-  std::vector<TGroupLabelT> txpGroups;
-  std::vector<TGroupWeightVec> txpGroupCombinedWeights;
-  std::vector<uint64_t> origCounts;
   uint64_t totalCount{0};
-
-  for (auto& kv : eqVec) {
-    uint64_t count = kv.second.count;
-    // for each transcript in this class
-    const TranscriptGroup& tgroup = kv.first;
-    if (tgroup.valid) {
-      const std::vector<uint32_t>& txps = tgroup.txps;
-      const auto& auxs = kv.second.combinedWeights;
-      txpGroups.push_back(txps);
-      // Convert to non-atomic
-      txpGroupCombinedWeights.emplace_back(auxs.begin(), auxs.end());
-      origCounts.push_back(count);
-      totalCount += count;
-    }
+  for (auto count : eqs.counts) {
+    totalCount += count;
   }
 
   double floatCount = totalCount;
-  std::vector<double> samplingWeights(txpGroups.size(), 0.0);
-  for (size_t i = 0; i < origCounts.size(); ++i) {
-    samplingWeights[i] = origCounts[i] / floatCount;
+  std::vector<double> samplingWeights(eqs.size(), 0.0);
+  for (size_t i = 0; i < eqs.size(); ++i) {
+    samplingWeights[i] = eqs.counts[i] / floatCount;
   }
 
   size_t numWorkerThreads{1};
@@ -655,8 +762,8 @@ bool CollapsedEMOptimizer::gatherBootstraps(
   std::vector<std::thread> workerThreads;
   for (size_t tn = 0; tn < numWorkerThreads; ++tn) {
     workerThreads.emplace_back(
-        doBootstrap, std::ref(txpGroups), std::ref(txpGroupCombinedWeights),
-        std::ref(transcripts), std::ref(effLens), std::ref(samplingWeights), std::ref(origCounts),
+        doBootstrap<WeightT>, std::cref(eqs),
+        std::ref(transcripts), std::ref(effLens), std::ref(samplingWeights),
         totalCount, numMappedFrags, scale, std::ref(bsCounter), std::ref(sopt),
         std::ref(priorAlphas), std::ref(writeBootstrap), relDiffTolerance,
         maxIter);
@@ -668,37 +775,37 @@ bool CollapsedEMOptimizer::gatherBootstraps(
   return true;
 }
 
-template <typename EQVecT>
+template <typename WeightT>
 void updateEqClassWeights(
-    EQVecT& eqVec,
+    PackedEqClasses<WeightT>& eqs,
     Eigen::VectorXd& effLens) {
   tbb::parallel_for(
-      BlockedIndexRange(size_t(0), size_t(eqVec.size())),
-      [&eqVec, &effLens](const BlockedIndexRange& range) -> void {
-        // For each index in the equivalence class vector
+      BlockedIndexRange(size_t(0), eqs.size()),
+      [&eqs, &effLens](const BlockedIndexRange& range) -> void {
+        // For each (packed) equivalence class
         for (auto eqID : boost::irange(range.begin(), range.end())) {
-          // The vector entry
-          auto& kv = eqVec[eqID];
           // The label of the equivalence class
-          const TranscriptGroup& k = kv.first;
+          const uint32_t* txps = eqs.txps.data() + eqs.offsets[eqID];
           // The size of the label
-          size_t classSize = kv.second.weights.size(); // k.txps.size();
+          size_t classSize = eqs.groupSize(eqID);
           // The weights of the label
-          auto& v = kv.second;
+          const WeightT* weights = eqs.weights.data() + eqs.offsets[eqID];
+          WeightT* combinedWeights =
+              eqs.combinedWeights.data() + eqs.offsets[eqID];
+          uint64_t count = eqs.counts[eqID];
 
           // Iterate over each weight and set it equal to
           // 1 / effLen of the corresponding transcript
           double wsum{0.0};
           for (size_t i = 0; i < classSize; ++i) {
-            auto tid = k.txps[i];
+            auto tid = txps[i];
             auto probStartPos = 1.0 / effLens(tid);
-            v.combinedWeights[i] =
-                kv.second.count * (v.weights[i] * probStartPos);
-            wsum += v.combinedWeights[i];
+            combinedWeights[i] = count * (weights[i] * probStartPos);
+            wsum += combinedWeights[i];
           }
           double wnorm = 1.0 / wsum;
           for (size_t i = 0; i < classSize; ++i) {
-            v.combinedWeights[i] *= wnorm;
+            combinedWeights[i] *= wnorm;
           }
         }
       });
@@ -707,6 +814,15 @@ void updateEqClassWeights(
 template <typename ExpT>
 bool CollapsedEMOptimizer::optimize(ExpT& readExp, SalmonOpts& sopt,
                                     double relDiffTolerance, uint32_t maxIter) {
+  if (sopt.floatEqWeights) {
+    return optimize_<float>(readExp, sopt, relDiffTolerance, maxIter);
+  }
+  return optimize_<double>(readExp, sopt, relDiffTolerance, maxIter);
+}
+
+template <typename WeightT, typename ExpT>
+bool CollapsedEMOptimizer::optimize_(ExpT& readExp, SalmonOpts& sopt,
+                                     double relDiffTolerance, uint32_t maxIter) {
 
   tbb::task_scheduler_init tbbScheduler(sopt.numThreads);
   std::vector<Transcript>& transcripts = readExp.transcripts();
@@ -799,56 +915,65 @@ bool CollapsedEMOptimizer::optimize(ExpT& readExp, SalmonOpts& sopt,
     }
   }
 
+  // The (valid) classes, packed for the passes of the EM below
+  PackedEqClasses<WeightT> eqs(eqVec);
+
   // If the user requested *not* to use "rich" equivalence classes,
   // then wipe out all of the weight information here and simply replace
   // the weights with the effective length terms (here, the *inverse* of
   // the effective length).  Otherwise, multiply the existing weight terms
   // by the effective length term.
   tbb::parallel_for(
-      BlockedIndexRange(size_t(0), size_t(eqVec.size())),
-      [&eqVec, &effLens, noRichEq, &sopt](const BlockedIndexRange& range) -> void {
-        // For each index in the equivalence class vector
+      BlockedIndexRange(size_t(0), eqs.size()),
+      [&eqs, &effLens, noRichEq, &sopt](const BlockedIndexRange& range) -> void {
+        // For each (packed) equivalence class
         for (auto eqID : boost::irange(range.begin(), range.end())) {
-          // The vector entry
-          auto& kv = eqVec[eqID];
           // The label of the equivalence class
-          const TranscriptGroup& k = kv.first;
+          const uint32_t* txps = eqs.txps.data() + eqs.offsets[eqID];
           // The size of the label
-          size_t classSize = kv.second.weights.size(); // k.txps.size();
+          size_t classSize = eqs.groupSize(eqID);
           // The weights of the label
-          auto& v = kv.second;
+          WeightT* weights = eqs.weights.data() + eqs.offsets[eqID];
+          WeightT* combinedWeights =
+              eqs.combinedWeights.data() + eqs.offsets[eqID];
+          uint64_t count = eqs.counts[eqID];
 
           // Iterate over each weight and set it
           double wsum{0.0};
 
           for (size_t i = 0; i < classSize; ++i) {
-            auto tid = k.txps[i];
+            auto tid = txps[i];
             double el = effLens(tid);
             if (el <= 1.0) {
               el = 1.0;
             }
             if (noRichEq) {
               // Keep length factor separate for the time being
-              v.weights[i] = 1.0;
+              weights[i] = 1.0;
             }
             // meaningful values.
             auto probStartPos = 1.0 / el;
 
             // combined weight
-            double wt = sopt.eqClassMode ? v.weights[i] : v.count * v.weights[i] * probStartPos;
-            v.combinedWeights.push_back(wt);
+            double wt = sopt.eqClassMode ? weights[i] : count * weights[i] * probStartPos;
+            combinedWeights[i] = wt;
             wsum += wt;
           }
 
           double wnorm = 1.0 / wsum;
           for (size_t i = 0; i < classSize; ++i) {
-            v.combinedWeights[i] = v.combinedWeights[i] * wnorm;
+            combinedWeights[i] = combinedWeights[i] * wnorm;
           }
         }
       });
-
-  auto numRemoved =
-      markDegenerateClasses(eqVec, alphas, effLens, available, sopt.jointLog);
+  // The classes in eqVec are read after the optimization (by the
+  // bootstraps, the Gibbs sampler and --dumpEqWeights), so they get the
+  // combined weights (and the weights, if they were replaced above) too,
+  // including those about to be marked as degenerate.
+  eqs.storeWeights(eqVec, noRichEq);
+
+  auto numRemoved = markDegenerateClasses(eqs, eqVec, alphas, effLens,
+                                          available, sopt.jointLog);
   sopt.jointLog->info("Marked {} weighted equivalence classes as degenerate",
                       numRemoved);
 
@@ -872,7 +997,15 @@ bool CollapsedEMOptimizer::optimize(ExpT& readExp, SalmonOpts& sopt,
   double alphaSum = 0.0;
   */
 
-  while (itNum < minIter or (itNum < maxIter and !converged) or needBias) {
+  // With --componentEM, the global loop only runs until the bias
+  // correction (if any) is done, and each connected component then runs
+  // on its own (below).
+  bool componentEM = sopt.componentEM;
+  auto emStart = std::chrono::steady_clock::now();
+
+  while ((!componentEM and
+          (itNum < minIter or (itNum < maxIter and !converged))) or
+         needBias) {
     if (needBias and (itNum > targetIt or converged)) {
 
       jointLog->info(
@@ -892,7 +1025,7 @@ bool CollapsedEMOptimizer::optimize(ExpT& readExp, SalmonOpts& sopt,
           jointLog->warn("Transcript {} had length {}", i, effLens(i));
         }
       }
-      updateEqClassWeights(eqVec, effLens);
+      updateEqClassWeights(eqs, effLens);
       needBias = false;
 
       if ( sopt.eqClassMode ) {
@@ -903,7 +1036,7 @@ bool CollapsedEMOptimizer::optimize(ExpT& readExp, SalmonOpts& sopt,
     }
 
     if (useVBEM) {
-      VBEMUpdate_(eqVec, transcripts, priorAlphas, totalLen, alphas,
+      VBEMUpdate_(eqs, transcripts, priorAlphas, totalLen, alphas,
                   alphasPrime, expTheta);
     } else {
       /*
@@ -914,7 +1047,7 @@ bool CollapsedEMOptimizer::optimize(ExpT& readExp, SalmonOpts& sopt,
       }
       */
 
-      EMUpdate_(eqVec, transcripts, priorAlphas, alphas, alphasPrime);
+      EMUpdate_(eqs, transcripts, priorAlphas, alphas, alphasPrime);
     }
 
     converged = true;
@@ -970,6 +1103,101 @@ bool CollapsedEMOptimizer::optimize(ExpT& readExp, SalmonOpts& sopt,
   }
   */
 
+  if (componentEM) {
+    // Group the classes (and transcripts) by connected component; the
+    // components are numbered largest first.
+    EqClassComponents comps(eqs, transcripts.size());
+
+    // The transcripts in no (valid) class get no count, as after any pass of
+    // the global EM.
+    std::vector<bool> inComponent(transcripts.size(), false);
+    for (auto t : comps.txps) {
+      inComponent[t] = true;
+    }
+    for (size_t i = 0; i < transcripts.size(); ++i) {
+      if (!inComponent[i]) {
+        alphas[i] = 0.0;
+        alphasPrime[i] = 0.0;
+      }
+    }
+
+    // Each task takes the largest component that's left, and runs the EM
+    // over it until it converges.  The passes over a large component are
+    // themselves split among the threads that are otherwise idle.
+    // The VBEM normalizes expTheta by the digamma of the sum of all of the
+    // alphas, and of the priors of all of the transcripts (as VBEMUpdate_
+    // does, including those in no class).  That cancels out within each
+    // class, but decides which of the smallest expThetas underflow to 0, so
+    // the components use the global one too.  After any pass, the alphas add
+    // up to the counts of the classes (each pass hands all of them out), so
+    // it is fixed.
+    double logNorm{0.0};
+    if (useVBEM) {
+      double alphaSum{0.0};
+      for (auto count : eqs.counts) {
+        alphaSum += count;
+      }
+      for (size_t i = 0; i < transcripts.size(); ++i) {
+        alphaSum += priorAlphas[i];
+      }
+      logNorm = boost::math::digamma(alphaSum);
+    }
+
+    size_t firstIt = itNum;
+    std::vector<size_t> componentIts(comps.size(), firstIt);
+    std::vector<double> componentRelDiffs(comps.size(), 0.0);
+    std::atomic<size_t> nextComponent{0};
+    tbb::task_group componentTasks;
+    for (size_t t = 0; t < sopt.numThreads; ++t) {
+      componentTasks.run([&]() -> void {
+        size_t c{0};
+        while ((c = nextComponent++) < comps.size()) {
+          componentIts[c] = componentEM_(
+              eqs, comps, c, useVBEM, priorAlphas, alphas, alphasPrime,
+              expTheta, logNorm, relDiffTolerance, alphaCheckCutoff, firstIt,
+              minIter, maxIter, componentRelDiffs[c]);
+        }
+      });
+    }
+    componentTasks.wait();
+
+    // Report the passes over the classes that this saved: the global loop
+    // would have run each class for as many iterations as the slowest
+    // component took.
+    uint64_t classIts{0};
+    itNum = firstIt;
+    for (size_t c = 0; c < comps.size(); ++c) {
+      classIts += (componentIts[c] - firstIt) * comps.numClasses(c);
+      itNum = std::max(itNum, componentIts[c]);
+      maxRelDiff = std::max(maxRelDiff, componentRelDiffs[c]);
+    }
+    uint64_t globalClassIts = (itNum - firstIt) * eqs.size();
+    jointLog->info("Ran the EM separately over {:n} connected components of "
+                   "the equivalence classes (the largest has {:n} classes "
+                   "over {:n} transcripts)",
+                   comps.size(), (comps.size() > 0) ? comps.numClasses(0) : 0,
+                   (comps.size() > 0) ? comps.numTranscripts(0) : 0);
+    jointLog->info(
+        "The slowest component took {:n} iterations, and a class {:.1f} on "
+        "average; {:n} class updates, rather than the {:n} of as many global "
+        "iterations ({:.1f}% saved)",
+        itNum - firstIt,
+        (eqs.size() > 0) ? static_cast<double>(classIts) / eqs.size() : 0.0,
+        classIts, globalClassIts,
+        (globalClassIts > 0)
+            ? 100.0 * (1.0 - static_cast<double>(classIts) / globalClassIts)
+            : 0.0);
+  }
+  jointLog->info(
+      "The optimization took {:.2f} seconds",
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - emStart)
+          .count());
+
+  // The bias correction re-weighted the (remaining) classes
+  if (doBiasCorrect) {
+    eqs.storeWeights(eqVec, false);
+  }
+
   // Reset the original bias correction options
   sopt.gcBiasCorrect = gcBiasCorrect;
   sopt.biasCorrect = seqBiasCorrect;
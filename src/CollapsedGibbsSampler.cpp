@@ -31,6 +31,7 @@
 #include "BootstrapWriter.hpp"
 #include "CollapsedGibbsSampler.hpp"
 #include "MultinomialSampler.hpp"
+#include "PackedEqClasses.hpp"
 #include "ReadExperiment.hpp"
 #include "ReadPair.hpp"
 #include "SalmonMath.hpp"
@@ -89,14 +90,13 @@ divide_work(Iterator begin, Iterator end, std::size_t n) {
  *RNA-seq reads. Turro E, Su S-Y, Goncalves A, Coin L, Richardson S and Lewin A.
  * Genome Biology, 2011 Feb; 12:R13.  doi: 10.1186/gb-2011-12-2-r13.
  **/
-template <typename EQVecT>
+template <typename WeightT>
 void sampleRoundNonCollapsedMultithreaded_(
-    EQVecT& eqVec,
+    const PackedEqClasses<WeightT>& eqs,
     std::vector<bool>& active, std::vector<uint32_t>& activeList,
     std::vector<uint64_t>& countMap, std::vector<double>& probMap,
     std::vector<double>& muGlobal, Eigen::VectorXd& effLens,
     const std::vector<double>& priorAlphas, std::vector<double>& txpCount,
-    std::vector<uint32_t>& offsetMap,
     bool noGammaDraw) {
 
   // generate coeff for \mu from \alpha and \effLens
@@ -169,89 +169,85 @@ void sampleRoundNonCollapsedMultithreaded_(
   std::mutex writeMut;
   // resample within each equivalence class
   tbb::parallel_for(
-      BlockedIndexRange(size_t(0), size_t(eqVec.size())),
+      BlockedIndexRange(size_t(0), eqs.size()),
       [&](const BlockedIndexRange& range) -> void {
 
         auto& txpCountLoc = combineableCounts.local().txpCount;
         auto& gen = *(combineableCounts.local().gen.get());
         for (auto eqid : boost::irange(range.begin(), range.end())) {
-          auto& eqClass = eqVec[eqid];
-          size_t offset = offsetMap[eqid];
+          // where the class starts in the packed classes (and in
+          // countMap and probMap)
+          size_t offset = eqs.offsets[eqid];
 
           // get total number of reads for an equivalence class
-          uint64_t classCount = eqClass.second.count;
+          uint64_t classCount = eqs.counts[eqid];
 
           // for each transcript in this class
-          const TranscriptGroup& tgroup = eqClass.first;
-          const size_t groupSize =
-              eqClass.second.weights.size(); // tgroup.txps.size();
-          if (tgroup.valid) {
-            const std::vector<uint32_t>& txps = tgroup.txps;
-            const auto& auxs = eqClass.second.combinedWeights;
-            const auto& weights = eqClass.second.weights;
+          const size_t groupSize = eqs.groupSize(eqid);
+          const uint32_t* txps = eqs.txps.data() + offset;
+          const WeightT* weights = eqs.weights.data() + offset;
+
+          double denom = 0.0;
+          // If this is a single-transcript group,
+          // then it gets the full count --- otherwise,
+          // sample!
+          if (BOOST_LIKELY(groupSize > 1)) {
+            // For each transcript in the group
+            double muSum = 0.0;
+            for (size_t i = 0; i < groupSize; ++i) {
+              auto tid = txps[i];
+              size_t gi = offset + i;
+              probMap[gi] = (1000.0 * muGlobal[tid]) * weights[i];
+              muSum += probMap[gi];
+              denom += probMap[gi];
+            }
 
-            double denom = 0.0;
-            // If this is a single-transcript group,
-            // then it gets the full count --- otherwise,
-            // sample!
-            if (BOOST_LIKELY(groupSize > 1)) {
-              // For each transcript in the group
-              double muSum = 0.0;
+            if (denom <= ::minEQClassWeight) {
+              {
+                std::lock_guard<std::mutex> lg(writeMut);
+                std::cerr
+                    << "[WARNING] eq class denom was too small : denom = "
+                    << denom << ", numReads = " << classCount
+                    << ". Distributing reads evenly for this class\n";
+              }
+
+              denom = 0.0;
+              muSum = 0.0;
               for (size_t i = 0; i < groupSize; ++i) {
                 auto tid = txps[i];
                 size_t gi = offset + i;
-                probMap[gi] = (1000.0 * muGlobal[tid]) * weights[i];
+                probMap[gi] = 1.0 / effLens(tid);
                 muSum += probMap[gi];
                 denom += probMap[gi];
               }
 
+              // If it's still too small --- divide evenly
               if (denom <= ::minEQClassWeight) {
-                {
-                  std::lock_guard<std::mutex> lg(writeMut);
-                  std::cerr
-                      << "[WARNING] eq class denom was too small : denom = "
-                      << denom << ", numReads = " << classCount
-                      << ". Distributing reads evenly for this class\n";
-                }
-
-                denom = 0.0;
-                muSum = 0.0;
                 for (size_t i = 0; i < groupSize; ++i) {
                   auto tid = txps[i];
                   size_t gi = offset + i;
-                  probMap[gi] = 1.0 / effLens(tid);
-                  muSum += probMap[gi];
-                  denom += probMap[gi];
-                }
-
-                // If it's still too small --- divide evenly
-                if (denom <= ::minEQClassWeight) {
-                  for (size_t i = 0; i < groupSize; ++i) {
-                    auto tid = txps[i];
-                    size_t gi = offset + i;
-                    probMap[gi] = 1.0;
-                  }
-                  denom = groupSize;
-                  muSum = groupSize;
+                  probMap[gi] = 1.0;
                 }
+                denom = groupSize;
+                muSum = groupSize;
               }
+            }
 
-              if (denom > ::minEQClassWeight) {
-                // Local multinomial
-                std::discrete_distribution<int> dist(probMap.begin() + offset,
-                                                     probMap.begin() + offset +
-                                                         groupSize);
-                for (size_t s = 0; s < classCount; ++s) {
-                  auto ind = dist(gen);
-                  ++txpCountLoc[txps[ind]];
-                }
+            if (denom > ::minEQClassWeight) {
+              // Local multinomial
+              std::discrete_distribution<int> dist(probMap.begin() + offset,
+                                                   probMap.begin() + offset +
+                                                       groupSize);
+              for (size_t s = 0; s < classCount; ++s) {
+                auto ind = dist(gen);
+                ++txpCountLoc[txps[ind]];
               }
-            } // do nothing if group size less than 2
-            else {
-              auto tid = txps[0];
-              txpCountLoc[tid] += static_cast<int>(classCount);
             }
-          } // valid group
+          } // do nothing if group size less than 2
+          else {
+            auto tid = txps[0];
+            txpCountLoc[tid] += static_cast<int>(classCount);
+          }
         }   // loop over all eq classes
       });
 
@@ -352,19 +348,17 @@ bool CollapsedGibbsSampler::sample(
   }
   **/
 
+  // The (valid) classes, packed; the entries of a class in countMap and
+  // probMap are at its offset in the packed classes.
+  PackedEqClasses<double> eqs(eqVec);
+  size_t countMapSize{eqs.txps.size()};
+
   std::vector<bool> active(numTranscripts, false);
-  size_t countMapSize{0};
-  std::vector<uint32_t> offsetMap(eqVec.size(), 0);
   for (size_t i = 0; i < eqVec.size(); ++i) {
     if (eqVec[i].first.valid) {
-      countMapSize +=
-          eqVec[i].second.weights.size(); // eqVec[i].first.txps.size();
       for (auto t : eqVec[i].first.txps) {
         active[t] = true;
       }
-      if (i < eqVec.size() - 1) {
-        offsetMap[i + 1] = countMapSize;
-      }
     }
   }
 
@@ -439,7 +433,7 @@ bool CollapsedGibbsSampler::sample(
     // Thin the chain by a factor of (numInternalRounds)
     for (size_t i = 0; i < numInternalRounds; ++i) {
       sampleRoundNonCollapsedMultithreaded_(
-          eqVec,      // encodes equivalence classes
+          eqs,        // encodes equivalence classes
           active,     // the set of active transcripts
           activeList, // the list of active transcript ids
           countMap,   // the count of reads in each eq coming from each eq class
@@ -450,7 +444,6 @@ bool CollapsedGibbsSampler::sample(
           priorAlphas, // the prior transcript counts
           alphasIn, // [input/output param] the (hard) fragment counts per txp
                     // from the previous iteration
-          offsetMap, // where the information begins for each equivalence class
           sopt.noGammaDraw      // true if we should skip the Gamma draw, false otherwise
       );
     }
@@ -4,24 +4,23 @@
 /**
  * Single-threaded EM-update routine for use in bootstrapping
  */
-template <typename VecT>
-void EMUpdate_(std::vector<std::vector<uint32_t>>& txpGroupLabels,
-               std::vector<std::vector<double>>& txpGroupCombinedWeights,
+template <typename VecT, typename WeightT>
+void EMUpdate_(const PackedEqClasses<WeightT>& eqs,
                const std::vector<uint64_t>& txpGroupCounts,
                std::vector<Transcript>& transcripts, const VecT& alphaIn,
                VecT& alphaOut) {
 
   assert(alphaIn.size() == alphaOut.size());
 
-  size_t numEqClasses = txpGroupLabels.size();
+  size_t numEqClasses = eqs.size();
   for (size_t eqID = 0; eqID < numEqClasses; ++eqID) {
     uint64_t count = txpGroupCounts[eqID];
     // for each transcript in this class
-    const std::vector<uint32_t>& txps = txpGroupLabels[eqID];
-    const auto& auxs = txpGroupCombinedWeights[eqID];
+    const uint32_t* txps = eqs.txps.data() + eqs.offsets[eqID];
+    const WeightT* auxs = eqs.combinedWeights.data() + eqs.offsets[eqID];
 
     double denom = 0.0;
-    size_t groupSize = txpGroupCombinedWeights[eqID].size(); // txps.size();
+    size_t groupSize = eqs.groupSize(eqID);
     // If this is a single-transcript group,
     // then it gets the full count.  Otherwise,
     // update according to our VBEM rule.
@@ -47,7 +46,7 @@ void EMUpdate_(std::vector<std::vector<uint32_t>>& txpGroupLabels,
         }
       }
     } else {
-      salmon::utils::incLoop(alphaOut[txps.front()], count);
+      salmon::utils::incLoop(alphaOut[txps[0]], count);
     }
   }
 }
@@ -67,18 +66,28 @@ double truncateCountVector(VecT& alphas, double cutoff) {
 }
 
 template
-void EMUpdate_<std::vector<double>>(std::vector<std::vector<uint32_t>>& txpGroupLabels,
-                                    std::vector<std::vector<double>>& txpGroupCombinedWeights,
-                                    const std::vector<uint64_t>& txpGroupCounts,
-                                    std::vector<Transcript>& transcripts, const std::vector<double>& alphaIn,
-                                    std::vector<double>& alphaOut);
+void EMUpdate_<std::vector<double>, double>(const PackedEqClasses<double>& eqs,
+                          const std::vector<uint64_t>& txpGroupCounts,
+                          std::vector<Transcript>& transcripts, const std::vector<double>& alphaIn,
+                          std::vector<double>& alphaOut);
+
+template
+void EMUpdate_<std::vector<double>, float>(const PackedEqClasses<float>& eqs,
+                          const std::vector<uint64_t>& txpGroupCounts,
+                          std::vector<Transcript>& transcripts, const std::vector<double>& alphaIn,
+                          std::vector<double>& alphaOut);
+
+template
+void EMUpdate_<std::vector<tbb::atomic<double>>, double>(const PackedEqClasses<double>& eqs,
+                          const std::vector<uint64_t>& txpGroupCounts,
+                          std::vector<Transcript>& transcripts, const std::vector<tbb::atomic<double>>& alphaIn,
+                          std::vector<tbb::atomic<double>>& alphaOut);
 
 template
-void EMUpdate_<std::vector<tbb::atomic<double>>>(std::vector<std::vector<uint32_t>>& txpGroupLabels,
-                                                 std::vector<std::vector<double>>& txpGroupCombinedWeights,
-                                                 const std::vector<uint64_t>& txpGroupCounts,
-                                                 std::vector<Transcript>& transcripts, const std::vector<tbb::atomic<double>>& alphaIn,
-                                                 std::vector<tbb::atomic<double>>& alphaOut);
+void EMUpdate_<std::vector<tbb::atomic<double>>, float>(const PackedEqClasses<float>& eqs,
+                          const std::vector<uint64_t>& txpGroupCounts,
+                          std::vector<Transcript>& transcripts, const std::vector<tbb::atomic<double>>& alphaIn,
+                          std::vector<tbb::atomic<double>>& alphaOut);
 
 template
 double truncateCountVector<std::vector<double>>(std::vector<double>& alphas, double cutoff);
@@ -95,8 +95,7 @@ void FASTAParser::populateTargets(std::vector<Transcript>& refs,
         // allocate space for the new copy
         char* seqCopy = new char[seq.length() + 1];
         std::strcpy(seqCopy, seq.c_str());
-        refs[it->second].setSequenceOwned(seqCopy, sopt.gcBiasCorrect,
-                                          sopt.reduceGCMemory);
+        refs[it->second].setSequenceOwned(seqCopy, sopt.gcBiasCorrect);
         // seqCopy will only be freed when the transcript is destructed!
       }
     }
@@ -1,23 +1,62 @@
 #include "FastxParser.hpp"
+#include "FastxParserStreams.hpp"
 #include "FastxParserThreadUtils.hpp"
 
 #include "fcntl.h"
 #include "unistd.h"
 #include <sstream>
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <stdexcept>
 #include <iostream>
+#include <mutex>
 #include <poll.h>
 #include <thread>
 #include <vector>
 #include <zlib.h>
 
 // STEP 1: declare the type of file handler and the read() function
-KSEQ_INIT(gzFile, gzread)
+KSEQ_INIT(fastx_parser::InputStream*, fastx_parser::readInputStream)
 
 namespace fastx_parser {
+// The state of a file (or file pair) that is being parsed; it can be put
+// aside by one thread and resumed by another.
+struct ParseJob {
+  uint32_t fileID{0};
+  std::unique_ptr<InputStream> fp{nullptr};
+  std::unique_ptr<InputStream> fp2{nullptr};
+  kseq_t* seq{nullptr};
+  kseq_t* seq2{nullptr};
+
+  // Set (in place of the above) for a memory mapped file (pair).  Threads
+  // claim segments of records under `m`; pos / pos2 is where the next
+  // segment starts.
+  std::unique_ptr<MappedFastxFile> map{nullptr};
+  std::unique_ptr<MappedFastxFile> map2{nullptr};
+  std::mutex m;
+  size_t pos{0};
+  size_t pos2{0};
+  // no segment is left to claim, the number of claimed segments not yet
+  // handed out, and whether the end of the job has been reported.
+  bool exhausted{false};
+  uint32_t inFlight{0};
+  bool finished{false};
+  int result{0};
+
+  ~ParseJob() {
+    // destroy the parsers before the streams they read from
+    if (seq != nullptr) {
+      kseq_destroy(seq);
+    }
+    if (seq2 != nullptr) {
+      kseq_destroy(seq2);
+    }
+  }
+};
+
 template <typename T>
 FastxParser<T>::FastxParser(std::vector<std::string> files,
                             uint32_t numConsumers, uint32_t numParsers,
@@ -72,6 +111,39 @@ FastxParser<T>::FastxParser(std::vector<std::string> files,
     auto chunk = make_unique<ReadChunk<T>>(blockSize_);
     seqContainerQueue_.enqueue(produceContainer, std::move(chunk));
   }
+  emptySema_.signal(4 * numConsumers);
+}
+
+template <typename T> void FastxParser<T>::enableMappedInput(bool enable) {
+  mappedInput_ = enable;
+}
+
+template <typename T> void FastxParser<T>::enablePackedReads(bool enable) {
+  packedReads_ = enable;
+}
+
+template <typename T>
+void FastxParser<T>::setDecompressionThreads(uint32_t numThreads) {
+  numDecompressionThreads_ = numThreads;
+}
+
+template <typename T>
+void FastxParser<T>::enableConsumerParsing(bool enable) {
+  consumerParsing_ = enable;
+}
+
+template <typename T> void FastxParser<T>::setWaitStrategy(WaitStrategy ws) {
+  waitStrategy_ = ws;
+}
+
+template <typename T> ParserStats FastxParser<T>::stats() const {
+  ParserStats st;
+  st.consumerStarvedNs = consumerStarvedNs_;
+  st.parserStarvedNs = parserStarvedNs_;
+  st.consumerParsingNs = consumerParsingNs_;
+  st.numConsumerParses = numConsumerParses_;
+  st.numConsumerSuspends = numConsumerSuspends_;
+  return st;
 }
 
 template <typename T> ReadGroup<T> FastxParser<T>::getReadGroup() {
@@ -113,6 +185,16 @@ template <typename T> FastxParser<T>::~FastxParser() {
         t->join();
       }
       isActive_ = false;
+      // only left over if parsing failed
+      numParsing_ = 0;
+      ParseJob* job{nullptr};
+      while (suspendedJobs_.try_dequeue(job)) {
+        if (!job->map) {
+          delete job;
+        }
+      }
+      mappedJobs_.clear();
+      threadResults_.push_back(consumerResult_);
       for (auto& res : threadResults_) {
         if (res == -3) {
           throw std::range_error("Error reading from the FASTA/Q stream. Make sure the file is valid.");
@@ -132,13 +214,13 @@ template <typename T> FastxParser<T>::~FastxParser() {
     return ret;
   }
 
-inline void copyRecord(kseq_t* seq, ReadSeq* s) {
+inline void copyRecord(kseq_t* seq, ReadSeq* s, std::vector<char>& /*arena*/) {
   // Copy over the sequence and read name
   s->seq.assign(seq->seq.s, seq->seq.l);
   s->name.assign(seq->name.s, seq->name.l);
 }
 
-inline void copyRecord(kseq_t* seq, ReadQual* s) {
+inline void copyRecord(kseq_t* seq, ReadQual* s, std::vector<char>& /*arena*/) {
     // Copy over the sequence and read name 
     // and quality
     s->seq.assign(seq->seq.s, seq->seq.l);
@@ -146,296 +228,558 @@ inline void copyRecord(kseq_t* seq, ReadQual* s) {
     s->qual.assign(seq->qual.s, seq->qual.l);
 }
 
+inline void appendToArena(const char* src, size_t len, std::vector<char>& arena,
+                          ReadView& v) {
+  size_t offset = arena.size();
+  arena.insert(arena.end(), src, src + len);
+  v.setOffset(offset, len);
+}
+
+inline void copyRecord(kseq_t* seq, ReadSeqView* s, std::vector<char>& arena) {
+  // Append the sequence and read name to the chunk's arena; the views
+  // are bound to the arena once the chunk is full (see bindRecords).
+  appendToArena(seq->seq.s, seq->seq.l, arena, s->seq);
+  appendToArena(seq->name.s, seq->name.l, arena, s->name);
+}
+
+inline void assignMapped(const char* p, size_t span, size_t len,
+                         std::string& dst) {
+  if (span == len) {
+    dst.assign(p, len);
+  } else {
+    dst.resize(len);
+    copyStripped(p, span, &dst[0]);
+  }
+}
+
+inline void copyRecord(const MappedRecord& r, ReadSeq* s,
+                       std::vector<char>& /*arena*/) {
+  assignMapped(r.seq, r.seqSpan, r.seqLen, s->seq);
+  s->name.assign(r.name, r.nameLen);
+}
+
+inline void copyRecord(const MappedRecord& r, ReadQual* s,
+                       std::vector<char>& /*arena*/) {
+  assignMapped(r.seq, r.seqSpan, r.seqLen, s->seq);
+  s->name.assign(r.name, r.nameLen);
+  assignMapped(r.qual, r.qualSpan, r.qualLen, s->qual);
+}
+
+inline void copyRecord(const MappedRecord& r, ReadSeqView* s,
+                       std::vector<char>& arena) {
+  // Point into the mapping, unless the sequence has to be joined from
+  // several lines.
+  if (r.seqSpan == r.seqLen) {
+    s->seq.setDirect(r.seq, r.seqLen);
+  } else {
+    size_t offset = arena.size();
+    arena.resize(offset + r.seqLen);
+    copyStripped(r.seq, r.seqSpan, arena.data() + offset);
+    s->seq.setOffset(offset, r.seqLen);
+  }
+  s->name.setDirect(r.name, r.nameLen);
+}
+
+// Records that own their storage need no fixing up before being handed out
+template <typename T> inline void bindRecords(ReadChunk<T>& /*chunk*/, size_t /*n*/) {}
+
+inline void bindRecords(ReadChunk<ReadSeqView>& chunk, size_t n) {
+  const char* base = chunk.arena().data();
+  for (size_t i = 0; i < n; ++i) {
+    chunk[i].seq.bind(base);
+    chunk[i].name.bind(base);
+  }
+}
+
+inline void bindRecords(ReadChunk<ReadPairView>& chunk, size_t n) {
+  const char* base = chunk.arena().data();
+  for (size_t i = 0; i < n; ++i) {
+    auto& r = chunk[i];
+    r.first.seq.bind(base);
+    r.first.name.bind(base);
+    r.second.seq.bind(base);
+    r.second.name.bind(base);
+  }
+}
+
+template <typename R> inline void packRead(const R& r, PackedSeq& p) {
+  p.encode(r.seq.data(), r.seq.size());
+}
 
 template <typename T>
-int parseReads(
-    std::vector<std::string>& inputStreams, std::atomic<uint32_t>& numParsing,
-    moodycamel::ConsumerToken* cCont, moodycamel::ProducerToken* pRead,
-    moodycamel::ConcurrentQueue<uint32_t>& workQueue,
-    moodycamel::ConcurrentQueue<std::unique_ptr<ReadChunk<T>>>&
-        seqContainerQueue_,
-    moodycamel::ConcurrentQueue<std::unique_ptr<ReadChunk<T>>>& readQueue_) {
-
-  using fastx_parser::thread_utils::MIN_BACKOFF_ITERS;
-  auto curMaxDelay = MIN_BACKOFF_ITERS;
-  kseq_t* seq;
-  T* s;
-  uint32_t fn{0};
-  while (workQueue.try_dequeue(fn)) {
-    auto file = inputStreams[fn];
-    std::unique_ptr<ReadChunk<T>> local;
-    while (!seqContainerQueue_.try_dequeue(*cCont, local)) {
-      fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
-      // Think of a way to do this that wouldn't be loud (or would allow a user-definable logging mechanism)
-      // std::cerr << "couldn't dequeue read chunk\n";
-    }
-    size_t numObtained{local->size()};
-    // open the file and init the parser
-    auto fp = gzopen(file.c_str(), "r");
+inline void packRecords(ReadChunk<T>& chunk, size_t n, std::false_type) {
+  auto& packed = chunk.packed();
+  if (packed.size() < n) {
+    packed.resize(n);
+  }
+  for (size_t i = 0; i < n; ++i) {
+    packRead(chunk[i], packed[i]);
+  }
+}
 
-    // The number of reads we have in the local vector
-    size_t numWaiting{0};
+template <typename T>
+inline void packRecords(ReadChunk<T>& chunk, size_t n, std::true_type) {
+  auto& packed = chunk.packed();
+  if (packed.size() < 2 * n) {
+    packed.resize(2 * n);
+  }
+  for (size_t i = 0; i < n; ++i) {
+    packRead(chunk[i].first, packed[2 * i]);
+    packRead(chunk[i].second, packed[2 * i + 1]);
+  }
+}
 
-    seq = kseq_init(fp);
-    int ksv = kseq_read(seq);
 
-    while (ksv >= 0) {
-      s = &((*local)[numWaiting++]);
+namespace {
+// returned by runJob_ when a consumer handed the job back
+constexpr const int jobSuspended{1};
+// returned by runJob_ when we stopped working on a mapped job that is not
+// finished, or that another thread finished
+constexpr const int jobShared{2};
+// how long a consumer waits for reads before it starts parsing itself
+constexpr const std::chrono::microseconds consumerParseDelay{500};
+// how long a thread blocked with WaitStrategy::BLOCK sleeps before checking
+// whether the parse has ended (or failed).
+constexpr const int64_t blockingWaitUs{5000};
+
+using ParseClock = std::chrono::steady_clock;
+
+inline uint64_t nsSince(ParseClock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             ParseClock::now() - start)
+      .count();
+}
+} // namespace
 
-      copyRecord(seq, s);
+// Read the next record (pair) of the job into s.  Returns the status of
+// kseq_read; for a pair, parsing stops at the end of the shorter file.
+template <typename T>
+inline int readRecord(ParseJob& job, T* s, std::vector<char>& arena,
+                      std::false_type /*paired*/) {
+  int ksv = kseq_read(job.seq);
+  if (ksv >= 0) {
+    copyRecord(job.seq, s, arena);
+  }
+  return ksv;
+}
 
-      // If we've filled the local vector, then dump to the concurrent queue
-      if (numWaiting == numObtained) {
-        curMaxDelay = MIN_BACKOFF_ITERS;
-        while (!readQueue_.try_enqueue(std::move(local))) {
-          fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
-        }
-        numWaiting = 0;
-        numObtained = 0;
-        // And get more empty reads
-        curMaxDelay = MIN_BACKOFF_ITERS;
-        while (!seqContainerQueue_.try_dequeue(*cCont, local)) {
-          fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
-        }
-        numObtained = local->size();
-      }
-      ksv = kseq_read(seq);
-    }
+template <typename T>
+inline int readRecord(ParseJob& job, T* s, std::vector<char>& arena,
+                      std::true_type /*paired*/) {
+  int ksv = kseq_read(job.seq);
+  int ksv2 = kseq_read(job.seq2);
+  if (ksv == -3 or ksv2 == -3) {
+    return -3;
+  } else if (ksv < 0 or ksv2 < 0) {
+    return std::min(ksv, ksv2);
+  }
+  copyRecord(job.seq, &s->first, arena);
+  copyRecord(job.seq2, &s->second, arena);
+  return ksv;
+}
 
-    if (ksv == -3) {
-      --numParsing;
-      return -3;
-    } else if (ksv < -1) {
-      --numParsing;
-      return ksv;
+// A run of records of a mapped file (pair) claimed by one thread.
+struct MappedSegment {
+  size_t pos{0};
+  size_t pos2{0};
+  size_t numRecords{0};
+};
+
+enum class SegmentClaim : uint8_t { CLAIMED, NONE, FINISHED };
+
+// Skip up to n records of f; returns the number skipped, and sets status
+// to the (negative) return code that stopped us early, if any.
+inline size_t skipRecords(const MappedFastxFile& f, size_t& pos, size_t n,
+                          int& status) {
+  size_t k{0};
+  for (; k < n; ++k) {
+    int r = skipMappedRecord(f.data(), f.size(), pos);
+    if (r < 0) {
+      status = r;
+      break;
     }
+  }
+  return k;
+}
 
-    // If we hit the end of the file and have any reads in our local buffer
-    // then dump them here.
-    if (numWaiting > 0) {
-      local->have(numWaiting);
-      curMaxDelay = MIN_BACKOFF_ITERS;
-      while (!readQueue_.try_enqueue(*pRead, std::move(local))) {
-        fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
-      }
-      numWaiting = 0;
-    } else if (numObtained > 0){
-      curMaxDelay = MIN_BACKOFF_ITERS;
-      while (!seqContainerQueue_.try_enqueue(std::move(local))) {
-        fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
+// Claim the next (up to) `want` records of the job.  If nothing is left to
+// claim, the thread to find that the last outstanding segment has been
+// handed out gets FINISHED, and must report the end of the job.
+inline SegmentClaim claimSegment(ParseJob& job, size_t want, bool paired,
+                                 MappedSegment& seg) {
+  std::lock_guard<std::mutex> l(job.m);
+  if (!job.exhausted) {
+    seg.pos = job.pos;
+    seg.pos2 = job.pos2;
+    int status{0};
+    size_t n = skipRecords(*job.map, job.pos, want, status);
+    if (paired) {
+      // as with kseq, a pair of files ends with the shorter one
+      int status2{0};
+      n = skipRecords(*job.map2, job.pos2, n, status2);
+      status = std::min(status, status2);
+    }
+    if (status < 0) {
+      job.exhausted = true;
+      if (status < -1) {
+        job.result = status;
       }
     }
-    // destroy the parser and close the file
-    kseq_destroy(seq);
-    gzclose(fp);
+    if (n > 0) {
+      seg.numRecords = n;
+      ++job.inFlight;
+      return SegmentClaim::CLAIMED;
+    }
+  }
+  if (job.inFlight == 0 and !job.finished) {
+    job.finished = true;
+    return SegmentClaim::FINISHED;
+  }
+  return SegmentClaim::NONE;
+}
+
+// Returns true if this was the last segment of the job to be handed out.
+inline bool releaseSegment(ParseJob& job) {
+  std::lock_guard<std::mutex> l(job.m);
+  --job.inFlight;
+  if (job.exhausted and job.inFlight == 0 and !job.finished) {
+    job.finished = true;
+    return true;
   }
+  return false;
+}
 
-  --numParsing;
-  return 0;
+inline bool segmentsLeft(ParseJob& job) {
+  std::lock_guard<std::mutex> l(job.m);
+  return !job.exhausted;
 }
 
+// Read the next record (pair) of a claimed segment into s; the segment's
+// boundaries were found by claimSegment, so this can't fail.
 template <typename T>
-int parseReadPair(
-    std::vector<std::string>& inputStreams,
-    std::vector<std::string>& inputStreams2, std::atomic<uint32_t>& numParsing,
-    moodycamel::ConsumerToken* cCont, moodycamel::ProducerToken* pRead,
-    moodycamel::ConcurrentQueue<uint32_t>& workQueue,
-    moodycamel::ConcurrentQueue<std::unique_ptr<ReadChunk<T>>>&
-        seqContainerQueue_,
-    moodycamel::ConcurrentQueue<std::unique_ptr<ReadChunk<T>>>& readQueue_) {
-
-  using fastx_parser::thread_utils::MIN_BACKOFF_ITERS;
-  size_t curMaxDelay = MIN_BACKOFF_ITERS;
-  kseq_t* seq;
-  kseq_t* seq2;
-  T* s;
+inline void readMappedRecord(ParseJob& job, MappedSegment& seg, T* s,
+                             std::vector<char>& arena,
+                             std::false_type /*paired*/) {
+  MappedRecord r;
+  nextMappedRecord(job.map->data(), job.map->size(), seg.pos, r);
+  copyRecord(r, s, arena);
+}
 
-  uint32_t fn{0};
-  while (workQueue.try_dequeue(fn)) {
-    // for (size_t fn = 0; fn < inputStreams.size(); ++fn) {
-    auto& file = inputStreams[fn];
-    auto& file2 = inputStreams2[fn];
+template <typename T>
+inline void readMappedRecord(ParseJob& job, MappedSegment& seg, T* s,
+                             std::vector<char>& arena,
+                             std::true_type /*paired*/) {
+  MappedRecord r;
+  nextMappedRecord(job.map->data(), job.map->size(), seg.pos, r);
+  copyRecord(r, &s->first, arena);
+  nextMappedRecord(job.map2->data(), job.map2->size(), seg.pos2, r);
+  copyRecord(r, &s->second, arena);
+}
 
-    std::unique_ptr<ReadChunk<T>> local;
-    while (!seqContainerQueue_.try_dequeue(*cCont, local)) {
-      fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
-      // Think of a way to do this that wouldn't be loud (or would allow a user-definable logging mechanism)
-      // std::cerr << "couldn't dequeue read chunk\n";
+template <typename T> ParseJob* FastxParser<T>::openJob_(uint32_t fileID) {
+  bool paired = is_paired_record<T>::value;
+  if (mappedInput_ and isMappable(inputStreams_[fileID]) and
+      (!paired or isMappable(inputStreams2_[fileID]))) {
+    std::unique_ptr<ParseJob> job(new ParseJob);
+    job->fileID = fileID;
+    job->map.reset(new MappedFastxFile(inputStreams_[fileID]));
+    if (paired) {
+      job->map2.reset(new MappedFastxFile(inputStreams2_[fileID]));
     }
-    size_t numObtained{local->size()};
-    // open the file and init the parser
-    auto fp = gzopen(file.c_str(), "r");
-    auto fp2 = gzopen(file2.c_str(), "r");
-
-    // The number of reads we have in the local vector
-    size_t numWaiting{0};
-
-    seq = kseq_init(fp);
-    seq2 = kseq_init(fp2);
-
-    int ksv = kseq_read(seq);
-    int ksv2 = kseq_read(seq2);
-    while (ksv >= 0 and ksv2 >= 0) {
-
-      s = &((*local)[numWaiting++]);
-      copyRecord(seq, &s->first);
-      copyRecord(seq2, &s->second);
-
-      // If we've filled the local vector, then dump to the concurrent queue
-      if (numWaiting == numObtained) {
-        curMaxDelay = MIN_BACKOFF_ITERS;
-        while (!readQueue_.try_enqueue(std::move(local))) {
-          fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
-        }
-        numWaiting = 0;
-        numObtained = 0;
-        // And get more empty reads
-        curMaxDelay = MIN_BACKOFF_ITERS;
-        while (!seqContainerQueue_.try_dequeue(*cCont, local)) {
-          fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
-        }
-        numObtained = local->size();
-      }
-      ksv = kseq_read(seq);
-      ksv2 = kseq_read(seq2);
+    if (job->map->ok() and (!paired or job->map2->ok())) {
+      std::lock_guard<std::mutex> l(mappedJobsMutex_);
+      mappedJobs_.push_back(std::move(job));
+      return mappedJobs_.back().get();
     }
+    // otherwise, fall back to reading the file(s) through kseq
+  }
+  auto* job = new ParseJob;
+  job->fileID = fileID;
+  if (is_paired_record<T>::value) {
+    // the decompression workers are split between the two mates.
+    uint32_t mateDecompressionThreads = (numDecompressionThreads_ + 1) / 2;
+    job->fp = openInputStream(inputStreams_[fileID], mateDecompressionThreads);
+    job->fp2 = openInputStream(inputStreams2_[fileID], mateDecompressionThreads);
+    job->seq = kseq_init(job->fp.get());
+    job->seq2 = kseq_init(job->fp2.get());
+  } else {
+    job->fp = openInputStream(inputStreams_[fileID], numDecompressionThreads_);
+    job->seq = kseq_init(job->fp.get());
+  }
+  return job;
+}
 
-    if (ksv == -3 or ksv2 == -3) {
-      --numParsing;
-      return -3;
-    } else if (ksv < -1 or ksv2 < -1) {
-      --numParsing;
-      return std::min(ksv, ksv2);
-    }
+template <typename T> ParseJob* FastxParser<T>::nextJob_() {
+  ParseJob* job{nullptr};
+  if (suspendedJobs_.try_dequeue(job)) {
+    return job;
+  }
+  uint32_t fn{0};
+  if (workQueue_.try_dequeue(fn)) {
+    return openJob_(fn);
+  }
+  return nullptr;
+}
 
-    // If we hit the end of the file and have any reads in our local buffer
-    // then dump them here.
-    if (numWaiting > 0) {
-      local->have(numWaiting);
-      curMaxDelay = MIN_BACKOFF_ITERS;
-      while (!readQueue_.try_enqueue(*pRead, std::move(local))) {
-        fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
+template <typename T>
+void FastxParser<T>::takeSignaled_(
+    moodycamel::ConcurrentQueue<std::unique_ptr<ReadChunk<T>>>& queue,
+    std::unique_ptr<ReadChunk<T>>& chunk, moodycamel::ConsumerToken* token) {
+  // The chunk was enqueued before the semaphore was signaled, so it is
+  // there, even if it may take a moment to become visible to us.
+  while (!((token != nullptr) ? queue.try_dequeue(*token, chunk)
+                              : queue.try_dequeue(chunk))) {
+    fastx_parser::thread_utils::cpuRelax();
+  }
+}
+
+template <typename T>
+void FastxParser<T>::recycleChunk_(std::unique_ptr<ReadChunk<T>>&& chunk,
+                                   moodycamel::ProducerToken* token) {
+  if (token != nullptr) {
+    seqContainerQueue_.enqueue(*token, std::move(chunk));
+  } else {
+    seqContainerQueue_.enqueue(std::move(chunk));
+  }
+  emptySema_.signal();
+}
+
+template <typename T>
+bool FastxParser<T>::getEmptyChunk_(std::unique_ptr<ReadChunk<T>>& chunk,
+                                    moodycamel::ConsumerToken* cCont,
+                                    bool canSuspend) {
+  if (waitStrategy_ == WaitStrategy::BLOCK) {
+    if (!emptySema_.tryWait()) {
+      // every chunk is full or being consumed
+      if (canSuspend) {
+        return false;
       }
-      numWaiting = 0;
-    } else if (numObtained > 0){
-      curMaxDelay = MIN_BACKOFF_ITERS;
-      while (!seqContainerQueue_.try_enqueue(std::move(local))) {
+      auto start = ParseClock::now();
+      while (!emptySema_.wait(blockingWaitUs)) {
+        if (failed_) {
+          return false;
+        }
+      }
+      parserStarvedNs_ += nsSince(start);
+    }
+    takeSignaled_(seqContainerQueue_, chunk, cCont);
+  } else {
+    auto tryGet = [this, cCont, &chunk]() -> bool {
+      return (cCont != nullptr) ? seqContainerQueue_.try_dequeue(*cCont, chunk)
+                                : seqContainerQueue_.try_dequeue(chunk);
+    };
+    if (!tryGet()) {
+      // every chunk is full or being consumed
+      if (canSuspend) {
+        return false;
+      }
+      auto start = ParseClock::now();
+      auto curMaxDelay = fastx_parser::thread_utils::MIN_BACKOFF_ITERS;
+      while (!tryGet()) {
+        if (failed_) {
+          return false;
+        }
         fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
+        // Think of a way to do this that wouldn't be loud (or would allow a user-definable logging mechanism)
+        // std::cerr << "couldn't dequeue read chunk\n";
       }
+      parserStarvedNs_ += nsSince(start);
     }
-    // destroy the parser and close the file
-    kseq_destroy(seq);
-    gzclose(fp);
-    kseq_destroy(seq2);
-    gzclose(fp2);
   }
+  chunk->have(chunk->want());
+  chunk->arena().clear();
+  return true;
+}
 
-  --numParsing;
-  return 0;
+template <typename T>
+void FastxParser<T>::pushChunk_(std::unique_ptr<ReadChunk<T>>& chunk,
+                                size_t numRecords,
+                                moodycamel::ProducerToken* pRead) {
+  chunk->have(numRecords);
+  bindRecords(*chunk, numRecords);
+  if (packedReads_) {
+    packRecords(*chunk, numRecords, is_paired_record<T>());
+  }
+  if (pRead == nullptr) {
+    // Consumers are not producers of the read queue; let it allocate
+    // rather than wait, since it never holds more than the chunks we made.
+    readQueue_.enqueue(std::move(chunk));
+  } else if (!readQueue_.try_enqueue(*pRead, std::move(chunk))) {
+    auto start = ParseClock::now();
+    auto curMaxDelay = fastx_parser::thread_utils::MIN_BACKOFF_ITERS;
+    while (!readQueue_.try_enqueue(*pRead, std::move(chunk))) {
+      fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
+    }
+    parserStarvedNs_ += nsSince(start);
+  }
+  readySema_.signal();
 }
 
-template <> bool FastxParser<ReadSeq>::start() {
-  if (numParsing_ == 0) {
-    isActive_ = true;
-    threadResults_.resize(numParsers_);
-    std::fill(threadResults_.begin(), threadResults_.end(), 0);
-    for (size_t i = 0; i < numParsers_; ++i) {
-      ++numParsing_;
-      parsingThreads_.emplace_back(new std::thread([this, i]() {
-        this->threadResults_[i] = parseReads(this->inputStreams_, this->numParsing_,
-                   this->consumeContainers_[i].get(),
-                   this->produceReads_[i].get(), this->workQueue_,
-                   this->seqContainerQueue_, this->readQueue_);
-      }));
+template <typename T>
+int FastxParser<T>::runJob_(ParseJob& job, bool canSuspend,
+                            moodycamel::ConsumerToken* cCont,
+                            moodycamel::ProducerToken* pRead) {
+  if (job.map) {
+    return runMappedJob_(job, canSuspend, cCont, pRead);
+  }
+  std::unique_ptr<ReadChunk<T>> local{nullptr};
+  // The number of reads we have in the local chunk
+  size_t numWaiting{0};
+  int ksv{0};
+  while (true) {
+    if (!local) {
+      // we only ever stop between chunks, so nothing read is left behind
+      if (!getEmptyChunk_(local, cCont, canSuspend)) {
+        return jobSuspended;
+      }
+      numWaiting = 0;
     }
-    return true;
+    ksv = readRecord(job, &((*local)[numWaiting]), local->arena(),
+                     is_paired_record<T>());
+    if (ksv < 0) {
+      break;
+    }
+    // If we've filled the local chunk, then dump it to the concurrent queue
+    if (++numWaiting == local->size()) {
+      pushChunk_(local, numWaiting, pRead);
+    }
+  }
+
+  // If we hit the end of the file and have any reads in our local buffer
+  // then dump them here.
+  if (numWaiting > 0) {
+    pushChunk_(local, numWaiting, pRead);
   } else {
-    return false;
+    recycleChunk_(std::move(local), nullptr);
   }
+  // -1 is the regular end of the file
+  return (ksv < -1) ? ksv : 0;
 }
 
-template <> bool FastxParser<ReadPair>::start() {
-  if (numParsing_ == 0) {
-    isActive_ = true;
-    // Some basic checking to ensure the read files look "sane".
-    if (inputStreams_.size() != inputStreams2_.size()) {
-      throw std::invalid_argument("There should be the same number "
-                                  "of files for the left and right reads");
+template <typename T>
+int FastxParser<T>::runMappedJob_(ParseJob& job, bool canSuspend,
+                                  moodycamel::ConsumerToken* cCont,
+                                  moodycamel::ProducerToken* pRead) {
+  // Whoever holds the last outstanding segment reports the end of the job,
+  // so there's nothing to do for us once everything has been claimed.
+  if (!segmentsLeft(job)) {
+    return jobShared;
+  }
+  // Put the job straight back, so that the next thread looking for work
+  // joins in rather than opening another file.
+  suspendedJobs_.enqueue(&job);
+  std::unique_ptr<ReadChunk<T>> local{nullptr};
+  MappedSegment seg;
+  while (true) {
+    // as in runJob_, we claim nothing we don't have a chunk for
+    if (!getEmptyChunk_(local, cCont, canSuspend)) {
+      return jobShared;
     }
-    for (size_t i = 0; i < inputStreams_.size(); ++i) {
-      auto& s1 = inputStreams_[i];
-      auto& s2 = inputStreams2_[i];
-      if (s1 == s2) {
-        throw std::invalid_argument("You provided the same file " + s1 +
-                                    " as both a left and right file");
-      }
+    auto claim = claimSegment(job, local->size(), is_paired_record<T>::value,
+                              seg);
+    if (claim != SegmentClaim::CLAIMED) {
+      recycleChunk_(std::move(local), nullptr);
+      return (claim == SegmentClaim::FINISHED) ? job.result : jobShared;
     }
+    for (size_t i = 0; i < seg.numRecords; ++i) {
+      readMappedRecord(job, seg, &((*local)[i]), local->arena(),
+                       is_paired_record<T>());
+    }
+    pushChunk_(local, seg.numRecords, pRead);
+    if (releaseSegment(job)) {
+      return job.result;
+    }
+  }
+}
 
-    threadResults_.resize(numParsers_);
-    std::fill(threadResults_.begin(), threadResults_.end(), 0);
+template <typename T> int FastxParser<T>::finishJob_(ParseJob* job, int res) {
+  if (res == jobShared) {
+    return res;
+  }
+  if (res == jobSuspended) {
+    suspendedJobs_.enqueue(job);
+    return res;
+  }
+  // mapped jobs are released by stop()
+  if (!job->map) {
+    delete job;
+  }
+  if (res < -1) {
+    failed_ = true;
+  }
+  --numParsing_;
+  return res;
+}
 
-    for (size_t i = 0; i < numParsers_; ++i) {
-      ++numParsing_;
-      parsingThreads_.emplace_back(new std::thread([this, i]() {
-            this->threadResults_[i] = parseReadPair(this->inputStreams_, this->inputStreams2_,
-                      this->numParsing_, this->consumeContainers_[i].get(),
-                      this->produceReads_[i].get(), this->workQueue_,
-                      this->seqContainerQueue_, this->readQueue_);
-      }));
+template <typename T> int FastxParser<T>::parseWorker_(size_t i) {
+  auto curMaxDelay = fastx_parser::thread_utils::MIN_BACKOFF_ITERS;
+  while (numParsing_ > 0 and !failed_) {
+    auto* job = nextJob_();
+    if (job == nullptr) {
+      // Without consumer parsing, no file is ever handed back, so we're done.
+      // Otherwise, the remaining files are being parsed by consumers, which
+      // may yet hand them back to us.
+      if (!consumerParsing_) {
+        break;
+      }
+      if (waitStrategy_ == WaitStrategy::BLOCK) {
+        std::this_thread::sleep_for(std::chrono::microseconds(blockingWaitUs));
+      } else {
+        fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
+      }
+      continue;
+    }
+    curMaxDelay = fastx_parser::thread_utils::MIN_BACKOFF_ITERS;
+    int res = finishJob_(job, runJob_(*job, false, consumeContainers_[i].get(),
+                                      produceReads_[i].get()));
+    if (res < -1) {
+      return res;
     }
-    return true;
-  } else {
-    return false;
   }
+  return 0;
 }
 
-template <> bool FastxParser<ReadQual>::start() {
-    if (numParsing_ == 0) {
-    isActive_ = true;
-    threadResults_.resize(numParsers_);
-    std::fill(threadResults_.begin(), threadResults_.end(), 0);
-    for (size_t i = 0; i < numParsers_; ++i) {
-      ++numParsing_;
-      parsingThreads_.emplace_back(new std::thread([this, i]() {
-        this->threadResults_[i] = parseReads(this->inputStreams_, this->numParsing_,
-                   this->consumeContainers_[i].get(),
-                   this->produceReads_[i].get(), this->workQueue_,
-                   this->seqContainerQueue_, this->readQueue_);
-      }));
-    }
-    return true;
-  } else {
+template <typename T> bool FastxParser<T>::consumerParse_() {
+  auto* job = nextJob_();
+  if (job == nullptr) {
     return false;
   }
+  auto start = ParseClock::now();
+  ++numConsumerParses_;
+  int res = finishJob_(job, runJob_(*job, true, nullptr, nullptr));
+  if (res == jobSuspended) {
+    ++numConsumerSuspends_;
+  } else if (res < consumerResult_) {
+    consumerResult_ = res;
+  }
+  consumerParsingNs_ += nsSince(start);
+  return true;
 }
 
-template <> bool FastxParser<ReadQualPair>::start() {
+template <typename T> bool FastxParser<T>::start() {
   if (numParsing_ == 0) {
-    isActive_ = true;
-    // Some basic checking to ensure the read files look "sane".
-    if (inputStreams_.size() != inputStreams2_.size()) {
-      throw std::invalid_argument("There should be the same number "
-                                  "of files for the left and right reads");
-    }
-    for (size_t i = 0; i < inputStreams_.size(); ++i) {
-      auto& s1 = inputStreams_[i];
-      auto& s2 = inputStreams2_[i];
-      if (s1 == s2) {
-        throw std::invalid_argument("You provided the same file " + s1 +
-                                    " as both a left and right file");
+    if (is_paired_record<T>::value) {
+      // Some basic checking to ensure the read files look "sane".
+      if (inputStreams_.size() != inputStreams2_.size()) {
+        throw std::invalid_argument("There should be the same number "
+                                    "of files for the left and right reads");
+      }
+      for (size_t i = 0; i < inputStreams_.size(); ++i) {
+        auto& s1 = inputStreams_[i];
+        auto& s2 = inputStreams2_[i];
+        if (s1 == s2) {
+          throw std::invalid_argument("You provided the same file " + s1 +
+                                      " as both a left and right file");
+        }
       }
     }
-
+    isActive_ = true;
+    numParsing_ = inputStreams_.size();
     threadResults_.resize(numParsers_);
     std::fill(threadResults_.begin(), threadResults_.end(), 0);
-
     for (size_t i = 0; i < numParsers_; ++i) {
-      ++numParsing_;
       parsingThreads_.emplace_back(new std::thread([this, i]() {
-            this->threadResults_[i] = parseReadPair(this->inputStreams_, this->inputStreams2_,
-                      this->numParsing_, this->consumeContainers_[i].get(),
-                      this->produceReads_[i].get(), this->workQueue_,
-                      this->seqContainerQueue_, this->readQueue_);
+        this->threadResults_[i] = this->parseWorker_(i);
       }));
     }
     return true;
@@ -444,23 +788,79 @@ template <> bool FastxParser<ReadQualPair>::start() {
   }
 }
 
-
 template <typename T> bool FastxParser<T>::refill(ReadGroup<T>& seqs) {
   finishedWithGroup(seqs);
+  if (waitStrategy_ == WaitStrategy::BLOCK) {
+    return refillBlocking_(seqs);
+  }
+  if (readQueue_.try_dequeue(seqs.consumerToken(), seqs.chunkPtr())) {
+    return true;
+  }
+  // nothing is ready; we're starved until a chunk shows up
   auto curMaxDelay = fastx_parser::thread_utils::MIN_BACKOFF_ITERS;
-  while (numParsing_ > 0) {
+  auto starvedSince = ParseClock::now();
+  while (numParsing_ > 0 and !failed_) {
     if (readQueue_.try_dequeue(seqs.consumerToken(), seqs.chunkPtr())) {
+      consumerStarvedNs_ += nsSince(starvedSince);
       return true;
     }
+    if (consumerParsing_ and
+        ParseClock::now() - starvedSince > consumerParseDelay) {
+      consumerStarvedNs_ += nsSince(starvedSince);
+      consumerParse_();
+      curMaxDelay = fastx_parser::thread_utils::MIN_BACKOFF_ITERS;
+      starvedSince = ParseClock::now();
+      continue;
+    }
     fastx_parser::thread_utils::backoffOrYield(curMaxDelay);
   }
+  consumerStarvedNs_ += nsSince(starvedSince);
   return readQueue_.try_dequeue(seqs.consumerToken(), seqs.chunkPtr());
 }
 
+template <typename T>
+bool FastxParser<T>::refillBlocking_(ReadGroup<T>& seqs) {
+  if (readySema_.tryWait()) {
+    takeSignaled_(readQueue_, seqs.chunkPtr(), &seqs.consumerToken());
+    return true;
+  }
+  // nothing is ready; we're starved until a chunk shows up
+  auto starvedSince = ParseClock::now();
+  while (true) {
+    // Once the parsers are done, nothing will be signaled anymore; the
+    // semaphore then counts exactly the chunks that are left.
+    if (numParsing_ == 0 or failed_) {
+      consumerStarvedNs_ += nsSince(starvedSince);
+      if (readySema_.tryWait()) {
+        takeSignaled_(readQueue_, seqs.chunkPtr(), &seqs.consumerToken());
+        return true;
+      }
+      return false;
+    }
+    // wake up periodically to notice the end of the input, and to check if
+    // we should parse ourselves.
+    int64_t waitUs = consumerParsing_
+                         ? std::chrono::duration_cast<std::chrono::microseconds>(
+                               consumerParseDelay)
+                               .count()
+                         : blockingWaitUs;
+    if (readySema_.wait(waitUs)) {
+      takeSignaled_(readQueue_, seqs.chunkPtr(), &seqs.consumerToken());
+      consumerStarvedNs_ += nsSince(starvedSince);
+      return true;
+    }
+    if (consumerParsing_) {
+      consumerStarvedNs_ += nsSince(starvedSince);
+      consumerParse_();
+      starvedSince = ParseClock::now();
+    }
+  }
+}
+
 template <typename T> void FastxParser<T>::finishedWithGroup(ReadGroup<T>& s) {
   // If this read group is holding a valid chunk, then give it back
   if (!s.empty()) {
-    seqContainerQueue_.enqueue(s.producerToken(), std::move(s.takeChunkPtr()));
+    recycleChunk_(std::move(s.takeChunkPtr()), &s.producerToken());
     s.setChunkEmpty();
   }
 }
@@ -469,4 +869,6 @@ template class FastxParser<ReadSeq>;
 template class FastxParser<ReadPair>;
 template class FastxParser<ReadQual>;
 template class FastxParser<ReadQualPair>;
+template class FastxParser<ReadSeqView>;
+template class FastxParser<ReadPairView>;
 }
@@ -0,0 +1,928 @@
+#include "FastxParserStreams.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fastx_parser {
+
+namespace {
+// number of BGZF blocks (each inflates to at most 64KB) handed to a worker
+// at once; batching amortizes the synchronization cost per block.
+constexpr const size_t blocksPerJob{16};
+// size of the chunks produced by the sequential read-ahead path.
+constexpr const size_t sequentialChunkSize{1 << 20};
+constexpr const size_t bgzfHeaderLen{12};
+
+constexpr const uint32_t zstdMagic{0xFD2FB528};
+// skippable frames have magic numbers 0x184D2A50 - 0x184D2A5F
+constexpr const uint32_t zstdSkippableMagic{0x184D2A50};
+constexpr const uint32_t zstdSkippableMask{0xFFFFFFF0};
+// The frames of a zstd file are decompressed in parallel only if they are
+// no larger than this (compressed); the reader has to hold whole frames.
+constexpr const uint64_t maxParallelFrameLen{64 << 20};
+// frames are batched until a job holds this much compressed input
+constexpr const size_t zstdBytesPerJob{1 << 20};
+// the frame size marking a frame whose decompressed size isn't given (or
+// is too large to preallocate)
+constexpr const uint32_t unknownContentSize{
+    std::numeric_limits<uint32_t>::max()};
+constexpr const uint64_t maxPreallocatedContent{1 << 30};
+
+inline uint16_t unpackLE16(const unsigned char* p) {
+  return static_cast<uint16_t>(p[0]) | (static_cast<uint16_t>(p[1]) << 8);
+}
+
+inline uint32_t unpackLE32(const unsigned char* p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline bool isGzipMemberHeader(const unsigned char* h) {
+  // magic, deflate compression method and the FEXTRA flag
+  return h[0] == 0x1f and h[1] == 0x8b and h[2] == 0x08 and (h[3] & 0x04);
+}
+
+// Look for the BGZF "BC" sub-field in the extra field of a gzip member and,
+// if it is present, return the total size of the block - 1.
+inline bool findBSIZE(const unsigned char* extra, uint16_t xlen,
+                      uint16_t& bsize) {
+  size_t p{0};
+  while (p + 4 <= xlen) {
+    uint16_t slen = unpackLE16(extra + p + 2);
+    if (extra[p] == 'B' and extra[p + 1] == 'C' and slen == 2 and
+        p + 6 <= xlen) {
+      bsize = unpackLE16(extra + p + 4);
+      return true;
+    }
+    p += 4 + slen;
+  }
+  return false;
+}
+enum class FrameStatus : uint8_t { OK, END, BAD };
+
+// Append the next zstd (or skippable) frame of fp to `in`, or skip it if
+// `in` is nullptr, by walking its frame and block headers.  frameLen is set
+// to the compressed size of the frame, and contentSize to its decompressed
+// size, or to unknownContentSize.
+FrameStatus nextZstdFrame(std::FILE* fp, std::vector<unsigned char>* in,
+                          uint64_t& frameLen, uint32_t& contentSize) {
+  auto keep = [in](const unsigned char* p, size_t len) {
+    if (in != nullptr) {
+      in->insert(in->end(), p, p + len);
+    }
+  };
+  auto copyOrSkip = [in, fp](size_t len) -> bool {
+    if (in == nullptr) {
+      return std::fseek(fp, static_cast<long>(len), SEEK_CUR) == 0;
+    }
+    size_t offset = in->size();
+    in->resize(offset + len);
+    return std::fread(in->data() + offset, 1, len, fp) == len;
+  };
+
+  // magic + frame header descriptor + window descriptor + dictionary ID +
+  // frame content size
+  unsigned char h[4 + 1 + 1 + 4 + 8];
+  size_t nread = std::fread(h, 1, 4, fp);
+  if (nread == 0 and std::feof(fp)) {
+    return FrameStatus::END;
+  } else if (nread != 4) {
+    return FrameStatus::BAD;
+  }
+  uint32_t magic = unpackLE32(h);
+  if ((magic & zstdSkippableMask) == zstdSkippableMagic) {
+    if (std::fread(h + 4, 1, 4, fp) != 4) {
+      return FrameStatus::BAD;
+    }
+    uint32_t len = unpackLE32(h + 4);
+    keep(h, 8);
+    frameLen = 8 + static_cast<uint64_t>(len);
+    contentSize = 0;
+    return copyOrSkip(len) ? FrameStatus::OK : FrameStatus::BAD;
+  } else if (magic != zstdMagic or std::fread(h + 4, 1, 1, fp) != 1) {
+    return FrameStatus::BAD;
+  }
+  uint8_t fhd = h[4];
+  uint8_t fcsFlag = fhd >> 6;
+  bool singleSegment = (fhd >> 5) & 1;
+  bool hasChecksum = (fhd >> 2) & 1;
+  if ((fhd >> 3) & 1) {
+    // reserved bit
+    return FrameStatus::BAD;
+  }
+  static const size_t dictIDLens[] = {0, 1, 2, 4};
+  static const size_t fcsLens[] = {0, 2, 4, 8};
+  size_t windowLen = singleSegment ? 0 : 1;
+  size_t dictIDLen = dictIDLens[fhd & 3];
+  size_t fcsLen = (fcsFlag == 0 and singleSegment) ? 1 : fcsLens[fcsFlag];
+  size_t restLen = windowLen + dictIDLen + fcsLen;
+  if (std::fread(h + 5, 1, restLen, fp) != restLen) {
+    return FrameStatus::BAD;
+  }
+  uint64_t fcs{0};
+  const unsigned char* fcsField = h + 5 + windowLen + dictIDLen;
+  for (size_t i = 0; i < fcsLen; ++i) {
+    fcs |= static_cast<uint64_t>(fcsField[i]) << (8 * i);
+  }
+  if (fcsLen == 2) {
+    fcs += 256;
+  }
+  contentSize = (fcsLen > 0 and fcs <= maxPreallocatedContent)
+                    ? static_cast<uint32_t>(fcs)
+                    : unknownContentSize;
+  keep(h, 5 + restLen);
+  frameLen = 5 + restLen;
+
+  bool lastBlock{false};
+  while (!lastBlock) {
+    unsigned char bh[3];
+    if (std::fread(bh, 1, 3, fp) != 3) {
+      return FrameStatus::BAD;
+    }
+    keep(bh, 3);
+    uint32_t header = static_cast<uint32_t>(bh[0]) |
+                      (static_cast<uint32_t>(bh[1]) << 8) |
+                      (static_cast<uint32_t>(bh[2]) << 16);
+    lastBlock = header & 1;
+    uint32_t blockType = (header >> 1) & 3;
+    uint32_t blockSize = header >> 3;
+    if (blockType == 3) {
+      return FrameStatus::BAD;
+    }
+    // an RLE block stores its single byte once
+    size_t stored = (blockType == 1) ? 1 : blockSize;
+    if (!copyOrSkip(stored)) {
+      return FrameStatus::BAD;
+    }
+    frameLen += 3 + stored;
+  }
+  if (hasChecksum) {
+    if (!copyOrSkip(4)) {
+      return FrameStatus::BAD;
+    }
+    frameLen += 4;
+  }
+  return FrameStatus::OK;
+}
+
+#ifdef HAVE_ZSTD
+// true if the zstd file starts with (at least) two frames that are small
+// enough to be decompressed independently.
+bool hasIndependentZstdFrames(const std::string& fname) {
+  std::FILE* fp = std::fopen(fname.c_str(), "rb");
+  if (fp == nullptr) {
+    return false;
+  }
+  uint64_t frameLen{0};
+  uint32_t contentSize{0};
+  bool res = nextZstdFrame(fp, nullptr, frameLen, contentSize) ==
+                 FrameStatus::OK and
+             frameLen <= maxParallelFrameLen and
+             nextZstdFrame(fp, nullptr, frameLen, contentSize) ==
+                 FrameStatus::OK;
+  std::fclose(fp);
+  return res;
+}
+#endif // HAVE_ZSTD
+} // namespace
+
+GzInputStream::GzInputStream(const std::string& fname) {
+  fp_ = gzopen(fname.c_str(), "r");
+}
+
+GzInputStream::~GzInputStream() {
+  if (fp_ != nullptr) {
+    gzclose(fp_);
+  }
+}
+
+int GzInputStream::read(void* buf, unsigned len) {
+  if (fp_ == nullptr) {
+    return -1;
+  }
+  return gzread(fp_, buf, len);
+}
+
+bool isBGZF(const std::string& fname) {
+  std::FILE* fp = std::fopen(fname.c_str(), "rb");
+  if (fp == nullptr) {
+    return false;
+  }
+  unsigned char h[bgzfHeaderLen];
+  bool res{false};
+  if (std::fread(h, 1, bgzfHeaderLen, fp) == bgzfHeaderLen and
+      isGzipMemberHeader(h)) {
+    uint16_t xlen = unpackLE16(h + 10);
+    std::vector<unsigned char> extra(xlen);
+    uint16_t bsize{0};
+    res = (std::fread(extra.data(), 1, xlen, fp) == xlen) and
+          findBSIZE(extra.data(), xlen, bsize);
+  }
+  std::fclose(fp);
+  return res;
+}
+
+Compression detectCompression(const std::string& fname) {
+  // Only peek at regular files; reading from a pipe would consume the bytes
+  // (gzread, used for anything else, detects gzip by itself).
+  struct stat st;
+  if (::stat(fname.c_str(), &st) != 0 or !S_ISREG(st.st_mode)) {
+    return Compression::NONE;
+  }
+  std::FILE* fp = std::fopen(fname.c_str(), "rb");
+  if (fp == nullptr) {
+    return Compression::NONE;
+  }
+  unsigned char h[4];
+  size_t n = std::fread(h, 1, 4, fp);
+  std::fclose(fp);
+  if (n >= 2 and h[0] == 0x1f and h[1] == 0x8b) {
+    return isBGZF(fname) ? Compression::BGZF : Compression::GZIP;
+  } else if (n == 4 and (unpackLE32(h) == zstdMagic or
+                         (unpackLE32(h) & zstdSkippableMask) ==
+                             zstdSkippableMagic)) {
+    return Compression::ZSTD;
+  }
+  return Compression::NONE;
+}
+
+ZstdInputStream::ZstdInputStream(const std::string& fname) {
+#ifdef HAVE_ZSTD
+  fp_ = std::fopen(fname.c_str(), "rb");
+  ds_ = ZSTD_createDStream();
+  in_.resize(ZSTD_DStreamInSize());
+  ok_ = (fp_ != nullptr and ds_ != nullptr);
+#else
+  std::cerr << "The read file " << fname
+            << " is compressed with zstd, but this build does not support "
+               "zstd-compressed input.\n";
+  ok_ = false;
+#endif
+}
+
+ZstdInputStream::~ZstdInputStream() {
+#ifdef HAVE_ZSTD
+  if (ds_ != nullptr) {
+    ZSTD_freeDStream(ds_);
+  }
+#endif
+  if (fp_ != nullptr) {
+    std::fclose(fp_);
+  }
+}
+
+int ZstdInputStream::read(void* buf, unsigned len) {
+#ifdef HAVE_ZSTD
+  if (!ok_) {
+    return -1;
+  }
+  ZSTD_outBuffer out{buf, len, 0};
+  while (out.pos < out.size) {
+    if (inPos_ == inLen_ and !eof_) {
+      inLen_ = std::fread(in_.data(), 1, in_.size(), fp_);
+      inPos_ = 0;
+      if (inLen_ == 0) {
+        if (std::ferror(fp_)) {
+          ok_ = false;
+          return -1;
+        }
+        eof_ = true;
+      }
+    }
+    ZSTD_inBuffer zin{in_.data(), inLen_, inPos_};
+    size_t outBefore = out.pos;
+    size_t ret = ZSTD_decompressStream(ds_, &out, &zin);
+    if (ZSTD_isError(ret)) {
+      ok_ = false;
+      return -1;
+    }
+    bool progress = (out.pos != outBefore) or (zin.pos != inPos_);
+    inPos_ = zin.pos;
+    if (progress) {
+      // 0 once a frame has been completely decoded and flushed
+      frameDone_ = (ret == 0);
+    } else if (eof_) {
+      break;
+    }
+  }
+  if (out.pos == 0 and !frameDone_) {
+    // the file ends within a frame
+    ok_ = false;
+    return -1;
+  }
+  return static_cast<int>(out.pos);
+#else
+  (void)buf;
+  (void)len;
+  return -1;
+#endif
+}
+
+std::unique_ptr<InputStream> openInputStream(const std::string& fname,
+                                             uint32_t numDecompressionThreads) {
+  auto compression = detectCompression(fname);
+  if (numDecompressionThreads == 0) {
+    if (compression == Compression::ZSTD) {
+      return std::unique_ptr<InputStream>(new ZstdInputStream(fname));
+    }
+    return std::unique_ptr<InputStream>(new GzInputStream(fname));
+  }
+  return std::unique_ptr<InputStream>(
+      new ParallelInflateStream(fname, numDecompressionThreads, compression));
+}
+
+MappedFastxFile::MappedFastxFile(const std::string& fname) {
+  int fd = ::open(fname.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) == 0 and st.st_size > 0) {
+    void* p = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                     MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      size_ = static_cast<size_t>(st.st_size);
+      data_ = static_cast<const char*>(p);
+      // the file is (mostly) read front to back, so read ahead aggressively
+      ::madvise(p, size_, MADV_SEQUENTIAL);
+    }
+  }
+  // the mapping stays valid after the descriptor is closed
+  ::close(fd);
+}
+
+MappedFastxFile::~MappedFastxFile() {
+  if (data_ != nullptr) {
+    ::munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+bool isMappable(const std::string& fname) {
+  struct stat st;
+  if (::stat(fname.c_str(), &st) != 0 or !S_ISREG(st.st_mode) or
+      st.st_size == 0) {
+    return false;
+  }
+  // compressed input has to go through a decompressing stream
+  return detectCompression(fname) == Compression::NONE;
+}
+
+namespace {
+// Find the end of the line starting at p (without a trailing '\r'), and the
+// start of the next one.
+inline const char* lineEnd(const char* p, const char* end, const char*& next) {
+  auto* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+  const char* e = (nl == nullptr) ? end : nl;
+  next = (nl == nullptr) ? end : nl + 1;
+  if (e > p and *(e - 1) == '\r') {
+    --e;
+  }
+  return e;
+}
+} // namespace
+
+int nextMappedRecord(const char* data, size_t size, size_t& pos,
+                     MappedRecord& rec) {
+  const char* p = data + pos;
+  const char* end = data + size;
+  // jump to the next header line
+  while (p < end and *p != '>' and *p != '@') {
+    ++p;
+  }
+  if (p == end) {
+    pos = size;
+    return -1;
+  }
+  ++p;
+  // the name runs up to the first whitespace; the rest is the comment
+  rec.name = p;
+  while (p < end and !std::isspace(static_cast<unsigned char>(*p))) {
+    ++p;
+  }
+  rec.nameLen = p - rec.name;
+  const char* next{nullptr};
+  lineEnd(p, end, next);
+  p = next;
+
+  // the sequence lines, up to the next line that starts a record or the
+  // quality header; empty lines are skipped.
+  rec.seq = p;
+  rec.seqLen = 0;
+  const char* seqEnd = p;
+  while (p < end and *p != '>' and *p != '+' and *p != '@') {
+    if (*p == '\n') {
+      ++p;
+      if (rec.seqLen == 0) {
+        rec.seq = p;
+        seqEnd = p;
+      }
+      continue;
+    }
+    seqEnd = lineEnd(p, end, next);
+    rec.seqLen += seqEnd - p;
+    p = next;
+  }
+  rec.seqSpan = seqEnd - rec.seq;
+  rec.qual = nullptr;
+  rec.qualSpan = rec.qualLen = 0;
+
+  if (p == end or *p != '+') {
+    // FASTA
+    pos = p - data;
+    return static_cast<int>(rec.seqLen);
+  }
+
+  // skip the rest of the '+' line
+  auto* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+  if (nl == nullptr) {
+    pos = size;
+    return -2;
+  }
+  p = nl + 1;
+  // the quality lines, until we have as many as there are bases
+  rec.qual = p;
+  const char* qualEnd = p;
+  do {
+    if (p == end) {
+      break;
+    }
+    qualEnd = lineEnd(p, end, next);
+    rec.qualLen += qualEnd - p;
+    p = next;
+  } while (rec.qualLen < rec.seqLen);
+  rec.qualSpan = qualEnd - rec.qual;
+  pos = p - data;
+  if (rec.qualLen != rec.seqLen) {
+    return -2;
+  }
+  return static_cast<int>(rec.seqLen);
+}
+
+int skipMappedRecord(const char* data, size_t size, size_t& pos) {
+  const char* p = data + pos;
+  const char* end = data + size;
+  if (p < end and *p == '@') {
+    const char* seq{nullptr};
+    lineEnd(p, end, seq);
+    // a single, non-empty sequence line (the fallback deals with anything
+    // kseq would treat specially)
+    if (seq < end and *seq != '>' and *seq != '+' and *seq != '@' and
+        *seq != '\n') {
+      const char* plus{nullptr};
+      const char* seqEnd = lineEnd(seq, end, plus);
+      if (seqEnd > seq and plus < end and *plus == '+') {
+        const char* qual{nullptr};
+        lineEnd(plus, end, qual);
+        if (qual < end) {
+          const char* next{nullptr};
+          const char* qualEnd = lineEnd(qual, end, next);
+          if (qualEnd - qual == seqEnd - seq) {
+            pos = next - data;
+            return static_cast<int>(seqEnd - seq);
+          }
+        }
+      }
+    }
+  }
+  MappedRecord rec;
+  return nextMappedRecord(data, size, pos, rec);
+}
+
+size_t copyStripped(const char* src, size_t span, char* dst) {
+  const char* end = src + span;
+  char* out = dst;
+  while (src < end) {
+    auto* nl = static_cast<const char*>(std::memchr(src, '\n', end - src));
+    const char* e = (nl == nullptr) ? end : nl;
+    size_t len = e - src;
+    if (len > 0 and src[len - 1] == '\r') {
+      --len;
+    }
+    std::memcpy(out, src, len);
+    out += len;
+    src = (nl == nullptr) ? end : nl + 1;
+  }
+  return out - dst;
+}
+
+ParallelInflateStream::ParallelInflateStream(const std::string& fname,
+                                             uint32_t numWorkers,
+                                             Compression compression)
+    : fname_(fname), compression_(compression) {
+  numWorkers = std::max(numWorkers, uint32_t(1));
+#ifdef HAVE_ZSTD
+  zstdFrames_ = (compression_ == Compression::ZSTD) and
+                hasIndependentZstdFrames(fname_);
+#endif
+  bool split = (compression_ == Compression::BGZF) or zstdFrames_;
+  // enough slots to keep every worker busy while the consumer drains
+  // the oldest batch.
+  size_t numSlots = split ? 2 * numWorkers + 2 : 4;
+  for (size_t i = 0; i < numSlots; ++i) {
+    ring_.emplace_back(new InflateJob);
+  }
+
+  if (split) {
+    fp_ = std::fopen(fname_.c_str(), "rb");
+    for (size_t i = 0; i < numWorkers; ++i) {
+      workers_.emplace_back([this]() { this->inflateWorker_(); });
+    }
+    if (zstdFrames_) {
+      reader_ = std::thread([this]() { this->readZstdFrames_(); });
+    } else {
+      reader_ = std::thread([this]() { this->readBGZF_(); });
+    }
+  } else {
+    if (compression_ == Compression::ZSTD) {
+      source_.reset(new ZstdInputStream(fname_));
+    } else {
+      source_.reset(new GzInputStream(fname_));
+    }
+    reader_ = std::thread([this]() { this->readSequential_(); });
+  }
+}
+
+ParallelInflateStream::~ParallelInflateStream() {
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    stop_ = true;
+  }
+  readerCV_.notify_all();
+  workerCV_.notify_all();
+  consumerCV_.notify_all();
+  if (reader_.joinable()) {
+    reader_.join();
+  }
+  for (auto& w : workers_) {
+    w.join();
+  }
+  if (fp_ != nullptr) {
+    std::fclose(fp_);
+  }
+}
+
+ParallelInflateStream::InflateJob* ParallelInflateStream::acquireSlot_() {
+  std::unique_lock<std::mutex> lock(m_);
+  readerCV_.wait(lock, [this]() {
+    return stop_ or (readID_ - consumeID_ < ring_.size());
+  });
+  if (stop_) {
+    return nullptr;
+  }
+  auto* job = ring_[readID_ % ring_.size()].get();
+  job->ok = true;
+  job->outLen = 0;
+  job->blocks.clear();
+  return job;
+}
+
+void ParallelInflateStream::publishSlot_(bool needsInflate) {
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    ring_[readID_ % ring_.size()]->state =
+        needsInflate ? SlotState::READ : SlotState::DONE;
+    ++readID_;
+  }
+  if (needsInflate) {
+    workerCV_.notify_one();
+  } else {
+    consumerCV_.notify_one();
+  }
+}
+
+void ParallelInflateStream::finishReading_(bool ok) {
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    readerDone_ = true;
+    readerOK_ = ok;
+  }
+  workerCV_.notify_all();
+  consumerCV_.notify_all();
+}
+
+void ParallelInflateStream::readBGZF_() {
+  if (fp_ == nullptr) {
+    finishReading_(false);
+    return;
+  }
+  unsigned char header[bgzfHeaderLen];
+  bool eof{false};
+  while (!eof) {
+    auto* job = acquireSlot_();
+    if (job == nullptr) {
+      return;
+    }
+    auto& in = job->in;
+    in.clear();
+    size_t totalOut{0};
+    while (job->blocks.size() < blocksPerJob) {
+      size_t nread = std::fread(header, 1, bgzfHeaderLen, fp_);
+      if (nread == 0 and std::feof(fp_)) {
+        eof = true;
+        break;
+      }
+      if (nread != bgzfHeaderLen or !isGzipMemberHeader(header)) {
+        finishReading_(false);
+        return;
+      }
+      uint16_t xlen = unpackLE16(header + 10);
+      size_t blockStart = in.size();
+      in.resize(blockStart + bgzfHeaderLen + xlen);
+      std::memcpy(in.data() + blockStart, header, bgzfHeaderLen);
+      uint16_t bsize{0};
+      if (std::fread(in.data() + blockStart + bgzfHeaderLen, 1, xlen, fp_) !=
+              xlen or
+          !findBSIZE(in.data() + blockStart + bgzfHeaderLen, xlen, bsize)) {
+        // Not a BGZF member; there's no way to recover the block boundaries.
+        finishReading_(false);
+        return;
+      }
+      size_t blockLen = static_cast<size_t>(bsize) + 1;
+      size_t headLen = bgzfHeaderLen + xlen;
+      if (blockLen < headLen + 8) {
+        finishReading_(false);
+        return;
+      }
+      in.resize(blockStart + blockLen);
+      size_t rest = blockLen - headLen;
+      if (std::fread(in.data() + blockStart + headLen, 1, rest, fp_) != rest) {
+        finishReading_(false);
+        return;
+      }
+      // ISIZE (the inflated size mod 2^32) is the last field of the member
+      uint32_t isize = unpackLE32(in.data() + blockStart + blockLen - 4);
+      job->blocks.emplace_back(blockStart, static_cast<uint32_t>(blockLen),
+                               isize);
+      totalOut += isize;
+    }
+    if (job->blocks.empty()) {
+      break;
+    }
+    job->outLen = totalOut;
+    if (job->out.size() < totalOut) {
+      job->out.resize(totalOut);
+    }
+    publishSlot_(true);
+  }
+  finishReading_(true);
+}
+
+void ParallelInflateStream::readZstdFrames_() {
+  if (fp_ == nullptr) {
+    finishReading_(false);
+    return;
+  }
+  bool eof{false};
+  while (!eof) {
+    auto* job = acquireSlot_();
+    if (job == nullptr) {
+      return;
+    }
+    auto& in = job->in;
+    in.clear();
+    while (in.size() < zstdBytesPerJob) {
+      size_t frameStart = in.size();
+      uint64_t frameLen{0};
+      uint32_t contentSize{0};
+      auto status = nextZstdFrame(fp_, &in, frameLen, contentSize);
+      if (status == FrameStatus::END) {
+        eof = true;
+        break;
+      }
+      if (status == FrameStatus::BAD or
+          frameLen > std::numeric_limits<uint32_t>::max()) {
+        finishReading_(false);
+        return;
+      }
+      job->blocks.emplace_back(frameStart, static_cast<uint32_t>(frameLen),
+                               contentSize);
+    }
+    if (job->blocks.empty()) {
+      break;
+    }
+    // the workers determine outLen, since not every frame has to give its
+    // decompressed size
+    publishSlot_(true);
+  }
+  finishReading_(true);
+}
+
+void ParallelInflateStream::readSequential_() {
+  while (true) {
+    auto* job = acquireSlot_();
+    if (job == nullptr) {
+      return;
+    }
+    if (job->out.size() < sequentialChunkSize) {
+      job->out.resize(sequentialChunkSize);
+    }
+    int nread = source_->read(job->out.data(), sequentialChunkSize);
+    if (nread < 0) {
+      finishReading_(false);
+      return;
+    } else if (nread == 0) {
+      break;
+    }
+    job->outLen = static_cast<size_t>(nread);
+    publishSlot_(false);
+  }
+  finishReading_(true);
+}
+
+bool ParallelInflateStream::inflateJob_(InflateJob& job, z_stream& zs) {
+  size_t outPos{0};
+  // If a block fails, what the blocks before it gave is still handed over
+  // (ahead of the error).
+  job.outLen = 0;
+  for (auto& b : job.blocks) {
+    size_t offset = std::get<0>(b);
+    uint32_t clen = std::get<1>(b);
+    uint32_t isize = std::get<2>(b);
+    if (inflateReset(&zs) != Z_OK) {
+      return false;
+    }
+    // An empty block (e.g. the EOF marker) has nothing to write, and the
+    // output of a job made up only of such blocks may not even be allocated;
+    // zlib wants somewhere to write to regardless.
+    Bytef empty;
+    zs.next_in = job.in.data() + offset;
+    zs.avail_in = clen;
+    zs.next_out = (isize == 0)
+                      ? &empty
+                      : reinterpret_cast<Bytef*>(job.out.data() + outPos);
+    zs.avail_out = (isize == 0) ? 1 : isize;
+    // Every BGZF block is a complete gzip member, so zlib checks the
+    // CRC and length trailer for us here.
+    int ret = inflate(&zs, Z_FINISH);
+    if (ret != Z_STREAM_END or zs.total_out != isize) {
+      return false;
+    }
+    outPos += isize;
+    job.outLen = outPos;
+  }
+  return true;
+}
+
+bool ParallelInflateStream::decodeZstdJob_(InflateJob& job,
+                                           ZSTD_DCtx_s* dctx) {
+#ifdef HAVE_ZSTD
+  size_t outPos{0};
+  // as for BGZF, the frames before a bad one are handed over
+  job.outLen = 0;
+  for (auto& f : job.blocks) {
+    const unsigned char* src = job.in.data() + std::get<0>(f);
+    uint32_t clen = std::get<1>(f);
+    uint32_t contentSize = std::get<2>(f);
+    if (contentSize != unknownContentSize) {
+      if (job.out.size() < outPos + contentSize) {
+        job.out.resize(outPos + contentSize);
+      }
+      // (this also checks the frame's checksum, if it has one)
+      size_t ret = ZSTD_decompressDCtx(dctx, job.out.data() + outPos,
+                                       contentSize, src, clen);
+      if (ZSTD_isError(ret) or ret != contentSize) {
+        return false;
+      }
+      outPos += contentSize;
+      job.outLen = outPos;
+      continue;
+    }
+    // the size is unknown; stream the frame into a growing buffer
+    ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+    ZSTD_inBuffer zin{src, clen, 0};
+    size_t ret{1};
+    while (ret != 0) {
+      if (job.out.size() < outPos + ZSTD_DStreamOutSize()) {
+        job.out.resize(outPos + ZSTD_DStreamOutSize());
+      }
+      ZSTD_outBuffer zout{job.out.data() + outPos, job.out.size() - outPos, 0};
+      ret = ZSTD_decompressStream(dctx, &zout, &zin);
+      if (ZSTD_isError(ret)) {
+        return false;
+      }
+      outPos += zout.pos;
+      if (ret != 0 and zin.pos == zin.size and zout.pos < zout.size) {
+        // the frame is truncated
+        return false;
+      }
+    }
+    job.outLen = outPos;
+  }
+  return true;
+#else
+  (void)job;
+  (void)dctx;
+  return false;
+#endif
+}
+
+void ParallelInflateStream::inflateWorker_() {
+  z_stream zs;
+  std::memset(&zs, 0, sizeof(zs));
+  // 16 + MAX_WBITS => expect (and verify) a gzip wrapper
+  bool zsOK = (inflateInit2(&zs, 16 + MAX_WBITS) == Z_OK);
+  ZSTD_DCtx_s* dctx{nullptr};
+#ifdef HAVE_ZSTD
+  if (zstdFrames_) {
+    dctx = ZSTD_createDCtx();
+  }
+#endif
+
+  while (true) {
+    InflateJob* job{nullptr};
+    {
+      std::unique_lock<std::mutex> lock(m_);
+      workerCV_.wait(lock, [this]() {
+        return stop_ or (inflateID_ < readID_) or readerDone_;
+      });
+      if (stop_ or (inflateID_ >= readID_ and readerDone_)) {
+        break;
+      }
+      job = ring_[inflateID_ % ring_.size()].get();
+      ++inflateID_;
+    }
+
+    if (zstdFrames_ ? (dctx == nullptr) : !zsOK) {
+      job->outLen = 0;
+      job->ok = false;
+    } else {
+      job->ok = zstdFrames_ ? decodeZstdJob_(*job, dctx)
+                            : inflateJob_(*job, zs);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      job->state = SlotState::DONE;
+    }
+    consumerCV_.notify_all();
+  }
+  inflateEnd(&zs);
+#ifdef HAVE_ZSTD
+  if (dctx != nullptr) {
+    ZSTD_freeDCtx(dctx);
+  }
+#endif
+}
+
+int ParallelInflateStream::read(void* buf, unsigned len) {
+  char* dest = static_cast<char*>(buf);
+  unsigned copied{0};
+  while (copied < len) {
+    if (cur_ != nullptr and curPos_ < cur_->outLen) {
+      size_t n = std::min(static_cast<size_t>(len - copied),
+                          cur_->outLen - curPos_);
+      std::memcpy(dest + copied, cur_->out.data() + curPos_, n);
+      copied += n;
+      curPos_ += n;
+      continue;
+    }
+    if (cur_ != nullptr and !cur_->ok) {
+      // all that could be decompressed before the error is out; report the
+      // error (from now on, since cur_ stays where it is)
+      return (copied > 0) ? static_cast<int>(copied) : -1;
+    }
+
+    std::unique_lock<std::mutex> lock(m_);
+    if (cur_ != nullptr) {
+      // we've drained this batch; hand the slot back to the reader
+      cur_->state = SlotState::EMPTY;
+      cur_ = nullptr;
+      ++consumeID_;
+      readerCV_.notify_one();
+    }
+    auto& next = ring_[consumeID_ % ring_.size()];
+    consumerCV_.wait(lock, [this, &next]() {
+      return stop_ or (consumeID_ < readID_ and next->state == SlotState::DONE) or
+             (readerDone_ and consumeID_ >= readID_);
+    });
+    if (stop_) {
+      return -1;
+    }
+    if (consumeID_ >= readID_) {
+      // nothing left; report a read error only once all valid data is out
+      if (!readerOK_ and copied == 0) {
+        return -1;
+      }
+      break;
+    }
+    // (a batch that failed is still taken, for what it did decompress)
+    cur_ = next.get();
+    curPos_ = 0;
+  }
+  return static_cast<int>(copied);
+}
+
+} // namespace fastx_parser
@@ -791,6 +791,35 @@ bool GZipWriter::writeMeta(const SalmonOpts& opts, const ExpT& experiment, const
     oa(cereal::make_nvp("num_fragments_filtered_vm", mstats.numFragmentsFiltered.load()));
     oa(cereal::make_nvp("num_alignments_below_threshold_for_mapped_fragments_vm",
                         mstats.numMappingsFiltered.load()));
+    oa(cereal::make_nvp("mapping_threads_starved_seconds", mstats.mapperStarvedNs.load() / 1e9));
+    oa(cereal::make_nvp("parsing_threads_starved_seconds", mstats.parserStarvedNs.load() / 1e9));
+    oa(cereal::make_nvp("mapping_threads_parsing_seconds", mstats.mapperParsingNs.load() / 1e9));
+    if (mstats.secondsToMapping > 0.0) {
+      oa(cereal::make_nvp("startup_parser_start_seconds", mstats.parserStartSeconds));
+      oa(cereal::make_nvp("startup_index_load_seconds", mstats.indexLoadSeconds));
+      oa(cereal::make_nvp("startup_transcript_load_seconds", mstats.transcriptLoadSeconds));
+      oa(cereal::make_nvp("startup_seconds_to_mapping", mstats.secondsToMapping));
+    }
+    if (mstats.numInferenceThreads > 0) {
+      oa(cereal::make_nvp("inference_threads", mstats.numInferenceThreads));
+      oa(cereal::make_nvp("inference_queue_depth", mstats.inferenceQueueDepth));
+      oa(cereal::make_nvp("inference_batches", mstats.numInferenceBatches.load()));
+      oa(cereal::make_nvp("mapping_threads_queue_wait_seconds", mstats.mapperQueueWaitNs.load() / 1e9));
+      oa(cereal::make_nvp("inference_threads_queue_wait_seconds", mstats.inferenceQueueWaitNs.load() / 1e9));
+    }
+    if (mstats.dtlbMissesCounted) {
+      uint64_t numProcessed = experiment.numObservedFragments();
+      oa(cereal::make_nvp("dtlb_misses", mstats.dtlbMisses.load()));
+      oa(cereal::make_nvp("dtlb_misses_per_million_reads",
+                          (numProcessed > 0) ? mstats.dtlbMisses.load() / (numProcessed / 1e6) : 0.0));
+    }
+    if (mstats.numDupCacheLookups > 0) {
+      uint64_t lookups = mstats.numDupCacheLookups.load();
+      uint64_t hits = mstats.numDupCacheHits.load();
+      oa(cereal::make_nvp("dup_cache_lookups", lookups));
+      oa(cereal::make_nvp("dup_cache_hits", hits));
+      oa(cereal::make_nvp("dup_cache_hit_rate", static_cast<double>(hits) / lookups));
+    }
     oa(cereal::make_nvp("percent_mapped",
                         experiment.effectiveMappingRate() * 100.0));
     oa(cereal::make_nvp("call", std::string("quant")));
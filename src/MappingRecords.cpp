@@ -0,0 +1,320 @@
+#include "MappingRecords.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "FastxParserStreams.hpp"
+#include "Transcript.hpp"
+#include "xxhash.h"
+
+namespace {
+
+const char fileMagic[8] = {'S', 'A', 'L', 'M', 'O', 'N', 'M', 'R'};
+
+// the flags of a fragment
+constexpr uint8_t fragPaired{0x1};
+
+// the bits of an alignment : its orientation, that of its mate, whether
+// its estimated alignment probability is 1 (and so isn't recorded), and
+// its mate status (in the top bits)
+constexpr uint8_t alnFwd{0x1};
+constexpr uint8_t alnMateFwd{0x2};
+constexpr uint8_t alnProbOne{0x4};
+constexpr uint8_t alnMateStatusShift{4};
+
+// (little endian)
+inline void appendU32(std::string& out, uint32_t v) {
+  out.push_back(static_cast<char>(v));
+  out.push_back(static_cast<char>(v >> 8));
+  out.push_back(static_cast<char>(v >> 16));
+  out.push_back(static_cast<char>(v >> 24));
+}
+
+inline void appendU64(std::string& out, uint64_t v) {
+  appendU32(out, static_cast<uint32_t>(v));
+  appendU32(out, static_cast<uint32_t>(v >> 32));
+}
+
+inline uint64_t getU64(const unsigned char* p, size_t len) {
+  uint64_t v{0};
+  for (size_t i = 0; i < len; ++i) {
+    v |= static_cast<uint64_t>(p[i]) << (8 * i);
+  }
+  return v;
+}
+
+inline void appendVarint(std::string& out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<char>(v));
+}
+
+inline uint64_t zigzag(int64_t v) {
+  return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+inline int64_t unzigzag(uint64_t v) {
+  return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+constexpr size_t headerSize{sizeof(fileMagic) + 4 + 8 + 8 + 1 + 1};
+
+} // namespace
+
+namespace salmon {
+namespace mapping_records {
+
+using MateStatus = pufferfish::util::MateStatus;
+
+std::string encodeHeader(const FileHeader& header) {
+  std::string out(fileMagic, sizeof(fileMagic));
+  appendU32(out, header.version);
+  appendU64(out, header.numTranscripts);
+  appendU64(out, header.namesHash);
+  out.push_back(static_cast<char>(header.libFormatID));
+  out.push_back(static_cast<char>(header.autoDetect ? 1 : 0));
+  return out;
+}
+
+uint64_t transcriptNamesHash(const std::vector<Transcript>& transcripts) {
+  uint64_t h{0};
+  for (auto& t : transcripts) {
+    // (with the terminating '\0', so that the boundaries of the names count)
+    h = XXH64(t.RefName.c_str(), t.RefName.size() + 1, h);
+  }
+  return h;
+}
+
+void ChunkEncoder::append(bool isPaired,
+                          const std::vector<QuasiAlignment>& alignments) {
+  ++numFragments_;
+  appendVarint(payload_, alignments.size());
+  if (alignments.empty()) {
+    return;
+  }
+  payload_.push_back(static_cast<char>(isPaired ? fragPaired : 0));
+
+  int64_t prevTid{0};
+  for (auto& aln : alignments) {
+    bool bothMapped = (aln.mateStatus == MateStatus::PAIRED_END_PAIRED);
+    double estAlnProb = aln.estAlnProb();
+    uint8_t bits = static_cast<uint8_t>(aln.mateStatus) << alnMateStatusShift;
+    bits |= aln.fwd ? alnFwd : 0;
+    bits |= aln.mateIsFwd ? alnMateFwd : 0;
+    bits |= (estAlnProb == 1.0) ? alnProbOne : 0;
+
+    int64_t tid = static_cast<int64_t>(aln.tid);
+    appendVarint(payload_, zigzag(tid - prevTid));
+    prevTid = tid;
+    appendVarint(payload_, zigzag(aln.pos));
+    payload_.push_back(static_cast<char>(bits));
+    appendVarint(payload_, aln.readLen);
+    appendVarint(payload_, aln.fragLen);
+    appendVarint(payload_, zigzag(aln.score));
+    appendVarint(payload_, aln.numHits);
+    if (bothMapped) {
+      appendVarint(payload_, zigzag(static_cast<int64_t>(aln.matePos) - aln.pos));
+      appendVarint(payload_, aln.mateLen);
+      appendVarint(payload_, zigzag(aln.mateScore));
+    }
+    if (estAlnProb != 1.0) {
+      uint64_t probBits;
+      std::memcpy(&probBits, &estAlnProb, sizeof(probBits));
+      appendU64(payload_, probBits);
+    }
+  }
+}
+
+void ChunkEncoder::finish(std::string& out) {
+  out.clear();
+  appendU32(out, numFragments_);
+  appendU32(out, static_cast<uint32_t>(payload_.size()));
+  out.append(payload_);
+  payload_.clear();
+  numFragments_ = 0;
+}
+
+bool ChunkDecoder::getVarint_(uint64_t& v) {
+  v = 0;
+  for (uint32_t shift = 0; p_ < end_ and shift < 64; shift += 7) {
+    auto b = static_cast<unsigned char>(*p_++);
+    v |= static_cast<uint64_t>(b & 0x7f) << shift;
+    if (b < 0x80) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ChunkDecoder::getBytes_(void* out, size_t len) {
+  if (static_cast<size_t>(end_ - p_) < len) {
+    return false;
+  }
+  std::memcpy(out, p_, len);
+  p_ += len;
+  return true;
+}
+
+bool ChunkDecoder::next(bool& isPaired,
+                        std::vector<QuasiAlignment>& alignments) {
+  alignments.clear();
+  isPaired = false;
+  uint64_t numAlignments{0};
+  if (!getVarint_(numAlignments)) {
+    return false;
+  }
+  if (numAlignments == 0) {
+    return true;
+  }
+  uint8_t fragFlags{0};
+  if (!getBytes_(&fragFlags, 1)) {
+    return false;
+  }
+  isPaired = (fragFlags & fragPaired) != 0;
+
+  int64_t tid{0};
+  for (uint64_t i = 0; i < numAlignments; ++i) {
+    uint64_t tidDelta, pos, readLen, fragLen, score, numHits;
+    uint8_t bits{0};
+    if (!(getVarint_(tidDelta) and getVarint_(pos) and getBytes_(&bits, 1) and
+          getVarint_(readLen) and getVarint_(fragLen) and getVarint_(score) and
+          getVarint_(numHits))) {
+      return false;
+    }
+    tid += unzigzag(tidDelta);
+    auto mateStatus = static_cast<MateStatus>(bits >> alnMateStatusShift);
+    bool bothMapped = (mateStatus == MateStatus::PAIRED_END_PAIRED);
+
+    alignments.emplace_back(static_cast<uint32_t>(tid),
+                            static_cast<int32_t>(unzigzag(pos)),
+                            (bits & alnFwd) != 0,
+                            static_cast<uint32_t>(readLen), cigar_,
+                            static_cast<uint32_t>(fragLen), bothMapped);
+    auto& aln = alignments.back();
+    aln.score = static_cast<int32_t>(unzigzag(score));
+    aln.numHits = static_cast<uint32_t>(numHits);
+    aln.mateStatus = mateStatus;
+    aln.mateIsFwd = (bits & alnMateFwd) != 0;
+    if (bothMapped) {
+      uint64_t matePos, mateLen, mateScore;
+      if (!(getVarint_(matePos) and getVarint_(mateLen) and
+            getVarint_(mateScore))) {
+        return false;
+      }
+      aln.matePos = static_cast<int32_t>(aln.pos + unzigzag(matePos));
+      aln.mateLen = static_cast<uint32_t>(mateLen);
+      aln.mateScore = static_cast<int32_t>(unzigzag(mateScore));
+    } else if (mateStatus == MateStatus::SINGLE_END) {
+      // as filled in by the mapping of single-end reads
+      aln.mateLen = aln.readLen;
+      aln.matePos = 0;
+      aln.mateIsFwd = true;
+      aln.mateScore = 0;
+    }
+    double estAlnProb{1.0};
+    if (!(bits & alnProbOne)) {
+      unsigned char b[8];
+      if (!getBytes_(b, sizeof(b))) {
+        return false;
+      }
+      uint64_t probBits = getU64(b, sizeof(b));
+      std::memcpy(&estAlnProb, &probBits, sizeof(estAlnProb));
+    }
+    aln.estAlnProb(estAlnProb);
+  }
+  return true;
+}
+
+MappingRecordReader::MappingRecordReader(const std::string& path,
+                                         uint32_t numThreads) {
+  auto compression = fastx_parser::detectCompression(path);
+  if (compression != fastx_parser::Compression::BGZF) {
+    fail_("it is not a mapping record file (written with --saveMappings)");
+    return;
+  }
+  in_.reset(new fastx_parser::ParallelInflateStream(
+      path, std::max(1u, numThreads), compression));
+
+  unsigned char buf[headerSize];
+  bool atEnd{false};
+  if (!readFully_(buf, headerSize, atEnd) or
+      std::memcmp(buf, fileMagic, sizeof(fileMagic)) != 0) {
+    fail_("it is not a mapping record file (written with --saveMappings)");
+    return;
+  }
+  const unsigned char* p = buf + sizeof(fileMagic);
+  header_.version = static_cast<uint32_t>(getU64(p, 4));
+  header_.numTranscripts = getU64(p + 4, 8);
+  header_.namesHash = getU64(p + 12, 8);
+  header_.libFormatID = p[20];
+  header_.autoDetect = (p[21] != 0);
+  if (header_.version != formatVersion) {
+    fail_("it was written by a version of salmon whose mapping records (version " +
+          std::to_string(header_.version) + ") can't be read by this one (version " +
+          std::to_string(formatVersion) + ")");
+  }
+}
+
+MappingRecordReader::~MappingRecordReader() {}
+
+bool MappingRecordReader::good() const {
+  std::lock_guard<std::mutex> lock(m_);
+  return ok_;
+}
+
+std::string MappingRecordReader::error() const {
+  std::lock_guard<std::mutex> lock(m_);
+  return error_;
+}
+
+void MappingRecordReader::fail_(std::string msg) {
+  if (ok_) {
+    error_ = std::move(msg);
+  }
+  ok_ = false;
+}
+
+bool MappingRecordReader::readFully_(void* buf, size_t len, bool& atEnd) {
+  auto* out = static_cast<char*>(buf);
+  size_t got{0};
+  atEnd = false;
+  while (got < len) {
+    int n = in_->read(out + got, static_cast<unsigned>(len - got));
+    if (n <= 0) {
+      atEnd = (n == 0 and got == 0);
+      return false;
+    }
+    got += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool MappingRecordReader::nextChunk(uint32_t& numFragments, std::string& chunk) {
+  std::lock_guard<std::mutex> lock(m_);
+  if (!ok_ or done_) {
+    return false;
+  }
+  unsigned char sizes[8];
+  bool atEnd{false};
+  if (!readFully_(sizes, sizeof(sizes), atEnd)) {
+    done_ = true;
+    if (!atEnd) {
+      fail_("it is truncated or corrupt");
+    }
+    return false;
+  }
+  numFragments = static_cast<uint32_t>(getU64(sizes, 4));
+  auto numBytes = static_cast<size_t>(getU64(sizes + 4, 4));
+  chunk.resize(numBytes);
+  if (numBytes > 0 and !readFully_(&chunk[0], numBytes, atEnd)) {
+    done_ = true;
+    fail_("it is truncated or corrupt");
+    return false;
+  }
+  return true;
+}
+
+} // namespace mapping_records
+} // namespace salmon
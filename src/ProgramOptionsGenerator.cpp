@@ -208,6 +208,21 @@ namespace salmon {
        "format.  By default, output will be directed to "
        "stdout, but an alternative file name can be "
        "provided instead.")
+      ("mappingsFormat", po::value<string>(&sopt.mappingsFormatStr)
+       ->default_value(salmon::defaults::mappingsFormatStr),
+       "The format of the mappings written with --writeMappings : SAM (the default) or BAM.  "
+       "BAM is encoded by the mapping threads and compressed by a pool of threads of its own "
+       "(see --bamThreads), rather than written as text through a single logger.")
+      ("bamThreads", po::value<uint32_t>(&sopt.numBAMThreads)
+       ->default_value(salmon::defaults::numBAMThreads),
+       "The number of threads compressing the BAM output of --mappingsFormat BAM, in "
+       "addition to the mapping threads.  0 (the default) uses half as many as there are "
+       "mapping threads (and at least 1).")
+      ("saveMappings", po::value<string>(&sopt.saveMappingsFile),
+       "Record the mappings of every fragment (the targets, positions, orientations, fragment "
+       "lengths and scores of its alignments) in a compact, compressed binary file at this path, "
+       "from which the sample can be quantified again, without mapping its reads, with "
+       "--fromMappings.  The file is only valid with the index used to write it.")
       /*
       ("consistentHits,c",
        po::bool_switch(&(sopt.consistentHits))->default_value(salmon::defaults::consistentHits),
@@ -258,7 +273,12 @@ namespace salmon {
       ("mates1,1", po::value<vector<string>>(&(sopt.mate1ReadFiles))->multitoken(),
        "File containing the #1 mates")
       ("mates2,2", po::value<vector<string>>(&(sopt.mate2ReadFiles))->multitoken(),
-       "File containing the #2 mates");
+       "File containing the #2 mates")
+      ("fromMappings", po::value<string>(&sopt.fromMappingsFile),
+       "Quantify the mappings recorded (with --saveMappings) in this file, rather than mapping "
+       "reads; no read files are given.  The index must be the one with which the file was "
+       "written, and the library type (-l) of the same kind (single-end or paired-end); the "
+       "options that govern quantification (e.g. bias correction) may differ.");
     return mapin;
   }
 
@@ -521,6 +541,109 @@ namespace salmon {
       ("skipQuant", po::bool_switch(&(sopt.skipQuant))->default_value(salmon::defaults::skipQuant),
        "Skip performing the actual transcript quantification (including any Gibbs sampling or bootstrapping)."
        )
+      ("decompressionThreads",
+       po::value<uint32_t>(&(sopt.numDecompressionThreads))->default_value(salmon::defaults::numDecompressionThreads),
+       "The number of threads, in addition to those given by --threads, used to decompress "
+       "each input read file (for paired-end input, these are split between the two mates).  "
+       "BGZF-compressed files (e.g. those written by bgzip) are split into blocks, and zstd files "
+       "made up of independent frames (e.g. those written by pzstd) into frames, that are "
+       "decompressed in parallel; other gzip or zstd files are decompressed sequentially, but off "
+       "of the parsing thread.  A value of 0 (the default) decompresses on the parsing thread itself.")
+      ("readArena",
+       po::bool_switch(&(sopt.readArena))->default_value(salmon::defaults::readArena),
+       "Have the parser copy the bases and names of each chunk of reads into a single, "
+       "recycled buffer, and hand the records to the mapping threads as views into that "
+       "buffer, rather than as individually allocated strings.")
+      ("mmapReads",
+       po::bool_switch(&(sopt.mmapReads))->default_value(salmon::defaults::mmapReads),
+       "Memory map uncompressed read files and parse them in place.  Each file (pair) is cut "
+       "into segments at matching record boundaries, so that several threads (e.g. starved "
+       "mapping threads, with --consumerParsing) can parse the same file (pair) at once; with --readArena, the reads are handed out as views directly "
+       "into the mapped files.  Compressed files are read as usual.")
+      ("consumerParsing",
+       po::bool_switch(&(sopt.consumerParsing))->default_value(salmon::defaults::consumerParsing),
+       "Use a single dedicated parsing thread, and have mapping threads that have waited for "
+       "reads for a while parse a file (pair) themselves, handing it back once they have "
+       "outpaced the other mapping threads.  With --mmapReads, they can also parse segments of "
+       "the file (pair) being parsed.  By default, the number of parsing threads is fixed up "
+       "front (2 for several file pairs and more than 8 threads, and 1 otherwise), and only "
+       "they parse.")
+      ("parserWaitStrategy",
+       po::value<string>(&sopt.parserWaitStrategyStr)->default_value(salmon::defaults::parserWaitStrategyStr),
+       "How the mapping threads wait for reads, and the parsing threads for the mapping threads.  "
+       "SPIN (the default) spins and yields, which gives the lowest latency but keeps waiting threads "
+       "on the CPU.  BLOCK puts waiting threads to sleep, which uses much less CPU time when reading "
+       "the input is the bottleneck (e.g. on shared nodes or slow file systems).")
+      ("prefetchIndex",
+       po::bool_switch(&(sopt.prefetchIndex))->default_value(salmon::defaults::prefetchIndex),
+       "Before loading the index, map its files read-only and read them into the page cache "
+       "with all --threads in parallel, rather than leaving them to be read sequentially by "
+       "the loader.  This speeds up loading a large index from cold storage, and the page "
+       "cache is shared by all salmon processes on the host that load the same index.")
+      ("hugePages",
+       po::value<string>(&sopt.hugePagesStr)->default_value(salmon::defaults::hugePagesStr),
+       "Back the index and the large internal tables (e.g. the equivalence class map) with "
+       "2MB pages, to cut the TLB misses of the random lookups made while mapping.  OFF (the "
+       "default) uses regular pages.  THP marks them for transparent huge pages (and, on Linux "
+       ">= 6.1, collapses the loaded index into huge pages right away).  HUGETLB takes the "
+       "internal tables from the reserved huge page pool (see /proc/sys/vm/nr_hugepages), "
+       "falling back to THP when it is exhausted; the index is handled as with THP.")
+      ("countTLBMisses",
+       po::bool_switch(&(sopt.countTLBMisses))->default_value(salmon::defaults::countTLBMisses),
+       "Count the data TLB misses of the mapping phase with the CPU's performance counters "
+       "(Linux only, subject to /proc/sys/kernel/perf_event_paranoid), and report them, per "
+       "million reads, in aux_info/meta_info.json.")
+      ("dupCacheSize",
+       po::value<uint32_t>(&(sopt.dupCacheSize))->default_value(salmon::defaults::dupCacheSize),
+       "The number of recently seen reads (rounded up to a power of 2) whose mappings each "
+       "mapping thread caches, keyed by their exact sequence, so that exact duplicates "
+       "(common in deeply sequenced libraries) skip mapping and alignment.  The results are "
+       "the same as without the cache; its hit rate is reported in aux_info/meta_info.json.  "
+       "0 (the default) disables the cache.")
+      ("seedBatchSize",
+       po::value<uint32_t>(&(sopt.seedBatchSize))->default_value(salmon::defaults::seedBatchSize),
+       "[experimental] Before mapping each batch of this many reads (e.g. 16 - 64), look up the "
+       "seed k-mers of all of them in the index, so that the mapping of each read may find what "
+       "it looks up in the cache.  The seeds are then looked up again as the reads are mapped, so "
+       "this is only worthwhile if it is measured to be (e.g. with scripts/bench_quant.sh, on the "
+       "reads and index at hand).  0 (the default) maps the reads one at a time.")
+      ("reorderReads",
+       po::bool_switch(&(sopt.reorderReads))->default_value(salmon::defaults::reorderReads),
+       "Map the reads of each chunk (of 5000 reads) in the order of their minimizers (the k-mer "
+       "of the read, or of its first mate, with the smallest hash), rather than in the order of "
+       "the input, so that reads that share k-mers, and so likely come from the same part of the "
+       "transcriptome, are mapped one after another and find the index entries they look up in "
+       "the cache.  The output (including that of --writeMappings and --writeUnmappedNames) is "
+       "still in the order of the input.  Not used with --writeOrphanLinks.")
+      ("inferenceThreads",
+       po::value<uint32_t>(&(sopt.numInferenceThreads))->default_value(salmon::defaults::numInferenceThreads),
+       "Split quantification into two stages that run concurrently : the (-p) mapping threads "
+       "only map the reads, and hand each chunk they have mapped over to this many inference "
+       "threads of their own, which compute the fragment probabilities and update the "
+       "equivalence classes and the bias and fragment length models.  The time each stage "
+       "spent waiting on the other is reported in aux_info/meta_info.json, to balance the "
+       "two.  0 (the default) does both on the mapping threads.  Not used with --fromMappings.")
+      ("inferenceQueueDepth",
+       po::value<uint32_t>(&(sopt.inferenceQueueDepth))->default_value(salmon::defaults::inferenceQueueDepth),
+       "With --inferenceThreads, the number of mapped chunks (of 5000 reads) that can be "
+       "waiting for, or be quantified by, the inference threads; the mapping threads wait "
+       "when they are all taken.  0 (the default) uses the number of mapping threads plus "
+       "twice the number of inference threads.")
+      ("threadLocalEqClasses",
+       po::bool_switch(&(sopt.threadLocalEqClasses))->default_value(salmon::defaults::threadLocalEqClasses),
+       "Count the equivalence classes of each thread in hash maps of its own, rather than in "
+       "a single concurrent map that every thread updates (and that is resized under them), "
+       "and merge the maps of the threads, in parallel, once all of the fragments are "
+       "processed.  This removes the contention on the shared map, at the cost of holding a "
+       "copy of the common classes per thread until the merge.  Not used by alevin.")
+      ("batchMassUpdates",
+       po::bool_switch(&(sopt.batchMassUpdates))->default_value(salmon::defaults::batchMassUpdates),
+       "In the online inference, sum the mass that each thread assigns to the transcripts over "
+       "a mini-batch per transcript, and add the sums to the transcripts once the mini-batch "
+       "is done, rather than adding the mass of every alignment to its transcript as it's "
+       "computed.  This removes most of the contention of the threads on the masses of the "
+       "most abundant transcripts; the fragments of a mini-batch then see the masses as they "
+       "were at its start.")
       ("dumpEq", po::bool_switch(&(sopt.dumpEq))->default_value(salmon::defaults::dumpEq),
        "Dump the simple equivalence class counts "
        "that were computed during mapping or alignment.")
@@ -539,11 +662,9 @@ namespace salmon {
        "quantification to proceed.")
       ("reduceGCMemory",
        po::bool_switch(&(sopt.reduceGCMemory))->default_value(salmon::defaults::reduceGCMemory),
-       "If this option is selected, a more memory efficient (but slightly "
-       "slower) representation is "
-       "used to compute fragment GC content. Enabling this will reduce "
-       "memory usage, but can also reduce "
-       "speed.  However, the results themselves will remain the same.")
+       "[Deprecated] : This option has no effect; fragment GC content is "
+       "always computed from a compact (rank-based) representation, and it "
+       "is kept only for backwards compatibility.")
       ("biasSpeedSamp",
        po::value<std::uint32_t>(&(sopt.pdfSampFactor))->default_value(salmon::defaults::biasSpeedSamp),
        "The value at which the fragment length PMF is down-sampled "
@@ -652,6 +773,19 @@ namespace salmon {
        "Use the traditional EM algorithm for optimization in the batch passes.")
       ("useVBOpt", po::bool_switch(&(sopt.useVBOpt))->default_value(salmon::defaults::useVBOpt),
        "Use the Variational Bayesian EM [default]")
+      ("floatEqWeights",
+       po::bool_switch(&(sopt.floatEqWeights))->default_value(salmon::defaults::floatEqWeights),
+       "Hold the weights of the equivalence classes in single (rather than double) precision "
+       "in the offline EM / VBEM and in the bootstraps.  This halves the memory that each of "
+       "their passes over the classes reads, at the cost of rounding the weights (the "
+       "estimates may differ in their last digits).")
+      ("componentEM",
+       po::bool_switch(&(sopt.componentEM))->default_value(salmon::defaults::componentEM),
+       "Split the equivalence classes into the connected components of the transcripts they "
+       "link, and run the offline EM / VBEM over each component on its own, until that "
+       "component converges (rather than over all of the classes until every transcript "
+       "converges).  The components run as parallel tasks, largest first.  The class "
+       "updates that this saved, and the time the optimization took, are logged.")
       ("rangeFactorizationBins",
        po::value<uint32_t>(&(sopt.rangeFactorizationBins))->default_value(salmon::defaults::rangeFactorizationBins),
        "Factorizes the likelihood used in quantification by adopting a new "
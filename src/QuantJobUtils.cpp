@@ -0,0 +1,134 @@
+#include "QuantJobUtils.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include "ProgramOptionsGenerator.hpp"
+#include "SalmonIndex.hpp"
+#include "SalmonIndexUtils.hpp"
+#include "SalmonIndexVersionInfo.hpp"
+#include "SalmonOpts.hpp"
+
+int salmonQuantify(int argc, const char* argv[]);
+
+namespace salmon {
+
+namespace job_utils {
+
+std::shared_ptr<SalmonIndex>
+loadResidentIndex(const std::string& indexDir, uint32_t prefetchThreads,
+                  std::shared_ptr<spdlog::logger>& log) {
+  boost::filesystem::path indexDirectory(indexDir);
+  SalmonIndexVersionInfo versionInfo;
+  versionInfo.load(indexDirectory / "versionInfo.json");
+  if (versionInfo.indexType() != SalmonIndexType::PUFF) {
+    log->critical("{} is not a (pufferfish-based) salmon index.", indexDir);
+    std::exit(1);
+  }
+
+  log->info("loading the index from {}", indexDir);
+  std::shared_ptr<SalmonIndex> index =
+      std::make_shared<SalmonIndex>(log, versionInfo.indexType());
+  index->load(indexDirectory, prefetchThreads);
+  salmon::index_utils::setResidentIndex(indexDir, index);
+  return index;
+}
+
+std::set<std::string> quantOptionNames(const std::vector<std::string>& args) {
+  namespace po = boost::program_options;
+  // as in salmonQuantify; the values go to a throw-away SalmonOpts
+  int32_t numBiasSamples{0};
+  SalmonOpts sopt;
+  salmon::ProgramOptionsGenerator pogen;
+  po::options_description all;
+  all.add(pogen.getMappingInputOptions(sopt))
+      .add(pogen.getBasicOptions(sopt))
+      .add(pogen.getMappingSpecificOptions(sopt))
+      .add(pogen.getAdvancedOptions(numBiasSamples, sopt))
+      .add(pogen.getTestingOptions(sopt))
+      .add(pogen.getHiddenOptions(sopt))
+      .add(pogen.getDeprecatedOptions(sopt));
+
+  auto parsed =
+      po::command_line_parser(args).options(all).allow_unregistered().run();
+  std::set<std::string> names;
+  for (auto& o : parsed.options) {
+    if (!o.unregistered) {
+      names.insert(o.string_key);
+    }
+  }
+  return names;
+}
+
+bool isAlignmentModeJob(const std::vector<std::string>& args) {
+  for (auto& a : args) {
+    if (a.compare(0, 2, "-a") == 0 or a.compare(0, 2, "-e") == 0 or
+        a.compare(0, 12, "--alignments") == 0 or
+        a.compare(0, 11, "--eqclasses") == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+pid_t startQuantJob(const std::vector<std::string>& args,
+                    const std::string& cwd, int outFd,
+                    const std::vector<int>& closeFds) {
+  std::cout.flush();
+  std::cerr.flush();
+  pid_t pid = ::fork();
+  if (pid != 0) {
+    return pid;
+  }
+
+  for (auto fd : closeFds) {
+    ::close(fd);
+  }
+  std::signal(SIGINT, SIG_DFL);
+  std::signal(SIGTERM, SIG_DFL);
+  std::signal(SIGPIPE, SIG_DFL);
+  if (outFd >= 0) {
+    ::dup2(outFd, STDOUT_FILENO);
+    ::dup2(outFd, STDERR_FILENO);
+    ::close(outFd);
+  }
+
+  if (::chdir(cwd.c_str()) != 0) {
+    std::cerr << "could not change to the directory " << cwd << " : "
+              << std::strerror(errno) << "\n";
+    std::exit(1);
+  }
+
+  std::vector<const char*> argv{"salmon"};
+  for (auto& a : args) {
+    argv.push_back(a.c_str());
+  }
+  int status{1};
+  try {
+    status = salmonQuantify(static_cast<int>(argv.size()), argv.data());
+  } catch (std::exception& e) {
+    std::cerr << "the job failed with : [" << e.what() << "]\n";
+  }
+  std::cout.flush();
+  std::cerr.flush();
+  // as at the end of `salmon quant`, i.e. flushing the loggers
+  std::exit(status);
+}
+
+int jobExitCode(int waitStatus) {
+  return WIFEXITED(waitStatus) ? WEXITSTATUS(waitStatus)
+                               : 128 + WTERMSIG(waitStatus);
+}
+
+} // namespace job_utils
+
+} // namespace salmon
@@ -1,4 +1,5 @@
 #include "SBModel.hpp"
+#include "PackedSeq.hpp"
 #include <sstream>
 #include <utility>
 
@@ -198,6 +199,21 @@ bool SBModel::addSequence(const Mer& mer, double weight) {
   return true;
 }
 
+bool SBModel::addPackedContext(uint64_t ctx, bool revCmp, double weight) {
+  // Bring the context to the layout of Mer (first base in the highest bits);
+  // the reverse complement is then just the complement of the word as given.
+  uint64_t mask = (_contextLength >= 32)
+                      ? ~uint64_t(0)
+                      : (uint64_t(1) << (2 * _contextLength)) - 1;
+  uint64_t w = revCmp ? (~ctx & mask)
+                      : fastx_parser::PackedSeq::reverseBases(ctx, _contextLength);
+  for (int32_t i = 0; i < _contextLength; ++i) {
+    uint64_t idx = (w >> _shifts[i]) & ((uint64_t(1) << _widths[i]) - 1);
+    _probs(idx, i) += weight;
+  }
+  return true;
+}
+
 /**
  * Once the _prob matrix has been filled out with observations, calling
  * this function will normalize all counts so that the entries of _prob
@@ -61,6 +61,8 @@ int help(const std::vector<std::string>& opts) { //}int argc, char* argv[]) {
   helpMsg.write("     swim  Perform super-secret operation\n");
   helpMsg.write(
       "     quantmerge Merge multiple quantifications into a single file\n");
+  helpMsg.write(
+      "     serve Keep an index loaded, and run quant jobs sent to a socket\n");
 
   std::cout << helpMsg.str();
   return 0;
@@ -150,6 +152,7 @@ int salmonAlignmentQuantify(int argc, const char* argv[]);
 // TODO : PF_INTEGRATION
 int salmonBarcoding(int argc, const char* argv[]);
 int salmonQuantMerge(int argc, const char* argv[]);
+int salmonServe(int argc, const char* argv[]);
 
 bool verbose = false;
 
@@ -230,6 +233,7 @@ int main(int argc, char* argv[]) {
         {{"index", salmonIndex},
          {"quant", salmonQuantify},
          {"quantmerge", salmonQuantMerge},
+         {"serve", salmonServe},
          // TODO : PF_INTEGRATION
          {"alevin", salmonBarcoding},
          {"swim", salmonSwim}});
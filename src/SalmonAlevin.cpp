@@ -136,6 +136,7 @@ namespace alevin{
   /****** QUASI MAPPING DECLARATIONS  *******/
 
   using paired_parser = fastx_parser::FastxParser<fastx_parser::ReadPair>;
+  using paired_view_parser = fastx_parser::FastxParser<fastx_parser::ReadPairView>;
   using single_parser = fastx_parser::FastxParser<fastx_parser::ReadSeq>;
 
   using TranscriptID = uint32_t;
@@ -369,9 +370,9 @@ void processMiniBatchSimple(ReadExperimentT& readExp, ForgettingMassCalculator&
 }
 
 /// START QUASI
-template <typename IndexT, typename ProtocolT>
+template <typename IndexT, typename ProtocolT, typename FragT>
 void processReadsQuasi(
-                       paired_parser* parser, ReadExperimentT& readExp, ReadLibrary& rl,
+                       fastx_parser::FastxParser<FragT>* parser, ReadExperimentT& readExp, ReadLibrary& rl,
                        AlnGroupVec<QuasiAlignment>& structureVec,
                        std::atomic<uint64_t>& numObservedFragments,
                        std::atomic<uint64_t>& numAssignedFragments,
@@ -486,6 +487,9 @@ void processReadsQuasi(
   size_t numDecoyFrags{0};
   const double decoyThreshold = salmonOpts.decoyThreshold;
   std::string readSubSeq;
+  // only used if the parser hands out views into its read arena
+  std::string barcodeReadBuf;
+  fastx_parser::ReadPair ownedPairBuf;
   //////////////////////
 
   auto rg = parser->getReadGroup();
@@ -502,6 +506,7 @@ void processReadsQuasi(
 
     for (size_t i = 0; i < rangeSize; ++i) { // For all the read in this batch
       auto& rp = rg[i];
+      auto& barcodeRead = salmon::mapping_utils::readSequence(rp.first, barcodeReadBuf);
       readLenLeft = rp.first.seq.length();
       readLenRight= rp.second.seq.length();
 
@@ -522,14 +527,12 @@ void processReadsQuasi(
       //////////////////////////////////////////////////////////////
       // extracting barcodes
       size_t barcodeLength = alevinOpts.protocol.barcodeLength;
-      size_t umiLength = alevinOpts.protocol.umiLength;
-      std::string umi;//, barcode;
       nonstd::optional<std::string> barcode;
       nonstd::optional<uint32_t> barcodeIdx;
       bool seqOk;
 
       if (alevinOpts.protocol.end == bcEnd::FIVE){
-        barcode = aut::extractBarcode(rp.first.seq, alevinOpts.protocol);
+        barcode = aut::extractBarcode(barcodeRead, alevinOpts.protocol);
         seqOk = (barcode.has_value()) ?
           aut::sequenceCheck(*barcode, Sequence::BARCODE) : false;
 
@@ -573,23 +576,22 @@ void processReadsQuasi(
         if (barcodeIdx) {
           //corrBarcodeIndex = barcodeMap[barcodeIndex];
           jointHitGroup.setBarcode(*barcodeIdx);
-          aut::extractUMI(rp.first.seq, alevinOpts.protocol, umi);
-
-          if ( umiLength != umi.size() ) {
+          // The parser packs the reads (see enablePackedReads() below), so
+          // the UMI's k-mer is cut straight out of the 2-bit encoding.
+          uint64_t umiWord{0};
+          bool isUmiIdxOk{false};
+          if ( !aut::extractUMI(rg.packed(i), alevinOpts.protocol, umiWord, isUmiIdxOk) ) {
             smallSeqs += 1;
           } else{
-            alevin::types::AlevinUMIKmer umiIdx;
-            bool isUmiIdxOk = umiIdx.fromChars(umi);
-
             if(isUmiIdxOk){
-              jointHitGroup.setUMI(umiIdx.word(0));
+              jointHitGroup.setUMI(umiWord);
 
               auto seq_len = rp.second.seq.size();
               if (alevinOpts.trimRight > 0) {
                 if ( !tooShortRight ) {
                   //std::string sub_seq = rp.second.seq.substr(0, seq_len-alevinOpts.trimRight);
                   //auto rh = hitCollector(sub_seq, saSearcher, hcInfo);
-                  readSubSeq = rp.second.seq.substr(0, seq_len-alevinOpts.trimRight);
+                  readSubSeq.assign(rp.second.seq.data(), seq_len-alevinOpts.trimRight);
                   auto rh = memCollector(readSubSeq, qc,
                                          true, // isLeft
                                          false // verbose
@@ -597,7 +599,7 @@ void processReadsQuasi(
                   //auto rh = hitCollector(readSubSeq, saSearcher, hcInfo);
                 }
               } else {
-                readSubSeq = rp.second.seq;
+                readSubSeq.assign(rp.second.seq.data(), seq_len);
                 auto rh = tooShortRight ? false : memCollector(readSubSeq, qc,
                                        true, // isLeft
                                        false // verbose
@@ -705,7 +707,7 @@ void processReadsQuasi(
         } //end-if validate mapping
 
         if (writeQuasimappings) {
-          writeAlignmentsToStream(rp, formatter, jointAlignments, sstream, true, true);
+          writeAlignmentsToStream(salmon::mapping_utils::ownedRecord(rp, ownedPairBuf), formatter, jointAlignments, sstream, true, true);
           /*
           rapmap::utils::writeAlignmentsToStream(rp, formatter,
                                                  hctr, jointHits, sstream);
@@ -715,7 +717,7 @@ void processReadsQuasi(
       if (writeUnmapped and mapType == salmon::utils::MappingType::UNMAPPED) {
         // If we have no mappings --- then there's nothing to do
         // unless we're outputting names for un-mapped reads
-        unmappedNames << rp.first.name << ' ' << salmon::utils::str(mapType) << '\n';
+        unmappedNames << salmon::mapping_utils::readName(rp.first) << ' ' << salmon::utils::str(mapType) << '\n';
       }
 
       validHits += jointAlignments.size();
@@ -809,6 +811,8 @@ void processReadLibrary(
   auto indexType = sidx->indexType();
 
   std::unique_ptr<paired_parser> pairedParserPtr{nullptr};
+  // used instead of the above with --readArena
+  std::unique_ptr<paired_view_parser> pairedViewParserPtr{nullptr};
 
   /** sequence-specific and GC-fragment bias vectors --- each thread gets it's
    * own **/
@@ -826,14 +830,26 @@ void processReadLibrary(
     }
 
     size_t numFiles = rl.mates1().size() + rl.mates2().size();
+    // One dedicated parsing thread, taken from the mapping threads; with
+    // --consumerParsing, mapping threads that run out of reads parse the
+    // other file pairs themselves.
     uint32_t numParsingThreads{1};
     // HACK!
     if(numThreads > 1){
       numThreads -= 1;
     }
-    if (rl.mates1().size() > 1 and numThreads > 8) { numParsingThreads = 2; numThreads -= 1;}
-    pairedParserPtr.reset(new paired_parser(rl.mates1(), rl.mates2(), numThreads, numParsingThreads, miniBatchSize));
-    pairedParserPtr->start();
+    if (!salmonOpts.consumerParsing and rl.mates1().size() > 1 and numThreads > 8) { numParsingThreads = 2; numThreads -= 1;}
+    if (salmonOpts.readArena) {
+      pairedViewParserPtr.reset(new paired_view_parser(rl.mates1(), rl.mates2(), numThreads, numParsingThreads, miniBatchSize));
+      salmon::mapping_utils::configureReadParser(*pairedViewParserPtr, salmonOpts);
+      pairedViewParserPtr->enablePackedReads(true);
+      pairedViewParserPtr->start();
+    } else {
+      pairedParserPtr.reset(new paired_parser(rl.mates1(), rl.mates2(), numThreads, numParsingThreads, miniBatchSize));
+      salmon::mapping_utils::configureReadParser(*pairedParserPtr, salmonOpts);
+      pairedParserPtr->enablePackedReads(true);
+      pairedParserPtr->start();
+    }
 
     /*
     std::vector<std::vector<uint64_t>> uniqueFLDs(numThreads);
@@ -858,11 +874,18 @@ void processReadLibrary(
 
     // True if we have a sparse index, false otherwise
     bool isSparse = sidx->isSparse();
+    auto processWithIndex = [&](size_t i, auto* index) {
+      if (pairedViewParserPtr) {
+        processFunctor(i, pairedViewParserPtr.get(), index);
+      } else {
+        processFunctor(i, pairedParserPtr.get(), index);
+      }
+    };
     for (size_t i = 0; i < numThreads; ++i) {
       if (isSparse) {
-        processFunctor(i, pairedParserPtr.get(), sidx->puffSparseIndex());
+        processWithIndex(i, sidx->puffSparseIndex());
       } else {
-        processFunctor(i, pairedParserPtr.get(), sidx->puffIndex());
+        processWithIndex(i, sidx->puffIndex());
       }
     } // End spawn all threads
 
@@ -870,7 +893,17 @@ void processReadLibrary(
       t.join();
     }
 
-    pairedParserPtr->stop();
+    fastx_parser::ParserStats parserStats;
+    if (pairedViewParserPtr) {
+      parserStats = pairedViewParserPtr->stats();
+      pairedViewParserPtr->stop();
+    } else {
+      parserStats = pairedParserPtr->stats();
+      pairedParserPtr->stop();
+    }
+    mstats.mapperStarvedNs += parserStats.consumerStarvedNs;
+    mstats.parserStarvedNs += parserStats.parserStarvedNs;
+    mstats.mapperParsingNs += parserStats.consumerParsingNs;
 
     // At this point, if we were using decoy transcripts, we don't need them anymore and can get
     // rid of them.
@@ -1079,6 +1112,10 @@ void quantifyLibrary(ReadExperimentT& experiment,
 
   salmonOpts.jointLog->info("Number of fragments discarded because they are best-mapped to decoys : {:n}",
                             mstats.numDecoyFragments.load());
+  salmonOpts.jointLog->info("Time mapping threads waited for reads : {:.2f}s (spent parsing : {:.2f}s); "
+                            "time parsing threads waited on mapping threads : {:.2f}s",
+                            mstats.mapperStarvedNs.load() / 1e9, mstats.mapperParsingNs.load() / 1e9,
+                            mstats.parserStarvedNs.load() / 1e9);
 
   if (totalAssignedFragments < salmonOpts.numBurninFrags) {
     std::atomic<bool> dummyBool{false};
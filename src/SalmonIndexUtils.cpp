@@ -0,0 +1,144 @@
+#include "SalmonIndexUtils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+
+namespace salmon {
+
+namespace index_utils {
+
+namespace {
+// the unit of work of a prefetching thread; a multiple of any page size
+constexpr size_t prefetchPieceLen{64 * 1024 * 1024};
+// files smaller than this (metadata, logs) aren't worth prefetching
+constexpr size_t minPrefetchFileLen{1024 * 1024};
+
+// Fault in [offset, offset + len) of the file; returns false if it couldn't
+// be mapped.
+bool prefetchPiece(int fd, size_t offset, size_t len) {
+  void* p = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, offset);
+  if (p == MAP_FAILED) {
+    return false;
+  }
+  madvise(p, len, MADV_WILLNEED);
+  long pageLen = sysconf(_SC_PAGESIZE);
+  size_t step = (pageLen > 0) ? static_cast<size_t>(pageLen) : 4096;
+  const volatile char* bytes = static_cast<const volatile char*>(p);
+  char sink{0};
+  for (size_t i = 0; i < len; i += step) {
+    sink ^= bytes[i];
+  }
+  (void)sink;
+  munmap(p, len);
+  return true;
+}
+} // namespace
+
+PrefetchStats prefetchIndexFiles(const std::string& indexDir,
+                                 uint32_t numThreads) {
+  namespace bfs = boost::filesystem;
+  auto start = std::chrono::steady_clock::now();
+  PrefetchStats stats;
+
+  std::vector<std::pair<std::string, size_t>> files;
+  boost::system::error_code ec;
+  for (bfs::directory_iterator it(indexDir, ec), end; !ec and it != end;
+       it.increment(ec)) {
+    if (!bfs::is_regular_file(it->status())) {
+      continue;
+    }
+    size_t len = bfs::file_size(it->path(), ec);
+    if (!ec and len >= minPrefetchFileLen) {
+      files.emplace_back(it->path().string(), len);
+    }
+  }
+  std::sort(files.begin(), files.end(),
+            [](const std::pair<std::string, size_t>& a,
+               const std::pair<std::string, size_t>& b) {
+              return a.second > b.second;
+            });
+
+  std::vector<int> fds;
+  // (file, offset, length) of every piece
+  std::vector<std::tuple<size_t, size_t, size_t>> pieces;
+  for (auto& f : files) {
+    int fd = open(f.first.c_str(), O_RDONLY);
+    if (fd < 0) {
+      continue;
+    }
+    size_t fileID = fds.size();
+    fds.push_back(fd);
+    for (size_t off = 0; off < f.second; off += prefetchPieceLen) {
+      pieces.emplace_back(fileID, off, std::min(prefetchPieceLen, f.second - off));
+    }
+    stats.numBytes += f.second;
+  }
+  stats.numFiles = fds.size();
+
+  std::atomic<size_t> nextPiece{0};
+  auto worker = [&]() -> void {
+    size_t i;
+    while ((i = nextPiece++) < pieces.size()) {
+      auto& piece = pieces[i];
+      prefetchPiece(fds[std::get<0>(piece)], std::get<1>(piece),
+                    std::get<2>(piece));
+    }
+  };
+  size_t numWorkers = std::max(static_cast<size_t>(1),
+                               std::min(static_cast<size_t>(numThreads), pieces.size()));
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < numWorkers; ++i) {
+    workers.emplace_back(worker);
+  }
+  worker();
+  for (auto& t : workers) {
+    t.join();
+  }
+  for (int fd : fds) {
+    close(fd);
+  }
+
+  stats.seconds = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+  return stats;
+}
+
+namespace {
+std::string residentIndexDir_;
+std::weak_ptr<SalmonIndex> residentIndex_;
+
+std::string canonicalDir(const std::string& dir) {
+  boost::system::error_code ec;
+  auto p = boost::filesystem::canonical(dir, ec);
+  return ec ? dir : p.string();
+}
+} // namespace
+
+void setResidentIndex(const std::string& indexDir,
+                      const std::shared_ptr<SalmonIndex>& index) {
+  residentIndexDir_ = canonicalDir(indexDir);
+  residentIndex_ = index;
+}
+
+std::shared_ptr<SalmonIndex> residentIndex(const std::string& indexDir) {
+  if (residentIndexDir_.empty() or
+      canonicalDir(indexDir) != residentIndexDir_) {
+    return nullptr;
+  }
+  return residentIndex_.lock();
+}
+
+} // namespace index_utils
+
+} // namespace salmon
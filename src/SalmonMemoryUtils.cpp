@@ -0,0 +1,165 @@
+#include "SalmonMemoryUtils.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+namespace salmon {
+
+namespace memory_utils {
+
+namespace {
+std::atomic<HugePageMode> hugePageMode_{HugePageMode::OFF};
+
+inline size_t roundUp(size_t n, size_t to) { return ((n + to - 1) / to) * to; }
+
+inline void* mapAnonymous(size_t len, int extraFlags) {
+  return mmap(nullptr, len, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS | extraFlags, -1, 0);
+}
+} // namespace
+
+void setHugePageMode(HugePageMode mode) { hugePageMode_ = mode; }
+
+HugePageMode hugePageMode() { return hugePageMode_; }
+
+void* allocateLarge(size_t bytes) {
+  size_t len = roundUp(bytes, hugePageLen);
+#if defined(MAP_HUGETLB)
+  if (hugePageMode() == HugePageMode::HUGETLB) {
+    int flags = MAP_HUGETLB;
+#if defined(MAP_HUGE_SHIFT)
+    flags |= (21 << MAP_HUGE_SHIFT); // 2MB pages, whatever the default size
+#endif
+    void* p = mapAnonymous(len, flags);
+    if (p != MAP_FAILED) {
+      return p;
+    }
+  }
+#endif
+  // Map an extra huge page so that the region can be trimmed to start at a
+  // huge page boundary; otherwise its ends can't be backed by huge pages.
+  void* raw = mapAnonymous(len + hugePageLen, 0);
+  if (raw == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+  uintptr_t rawStart = reinterpret_cast<uintptr_t>(raw);
+  uintptr_t start = roundUp(rawStart, hugePageLen);
+  if (start > rawStart) {
+    munmap(raw, start - rawStart);
+  }
+  size_t tail = (rawStart + len + hugePageLen) - (start + len);
+  if (tail > 0) {
+    munmap(reinterpret_cast<void*>(start + len), tail);
+  }
+  void* p = reinterpret_cast<void*>(start);
+#if defined(MADV_HUGEPAGE)
+  if (hugePageMode() != HugePageMode::OFF) {
+    madvise(p, len, MADV_HUGEPAGE);
+  }
+#endif
+  return p;
+}
+
+void deallocateLarge(void* p, size_t bytes) {
+  munmap(p, roundUp(bytes, hugePageLen));
+}
+
+size_t adviseHugePages() {
+  size_t advised{0};
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  std::ifstream maps("/proc/self/maps");
+  std::string line;
+  while (std::getline(maps, line)) {
+    // start-end perms offset dev inode [path]
+    std::istringstream fields(line);
+    std::string range, perms, offset, dev, path;
+    uint64_t inode{0};
+    fields >> range >> perms >> offset >> dev >> inode;
+    std::getline(fields, path);
+    auto pathStart = path.find_first_not_of(' ');
+    path = (pathStart == std::string::npos) ? "" : path.substr(pathStart);
+    if (inode != 0 or perms.compare(0, 2, "rw") != 0 or
+        (!path.empty() and path != "[heap]")) {
+      continue;
+    }
+    auto dash = range.find('-');
+    uintptr_t b = std::stoull(range.substr(0, dash), nullptr, 16);
+    uintptr_t e = std::stoull(range.substr(dash + 1), nullptr, 16);
+    // only the whole huge pages within the mapping can be backed by one
+    b = roundUp(b, hugePageLen);
+    e = (e / hugePageLen) * hugePageLen;
+    if (e <= b) {
+      continue;
+    }
+    void* p = reinterpret_cast<void*>(b);
+    if (madvise(p, e - b, MADV_HUGEPAGE) == 0) {
+      advised += e - b;
+#if defined(MADV_COLLAPSE)
+      madvise(p, e - b, MADV_COLLAPSE);
+#endif
+    }
+  }
+#endif
+  return advised;
+}
+
+DTLBMissCounter::~DTLBMissCounter() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool DTLBMissCounter::start() {
+#if defined(__linux__)
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.disabled = 1;
+  attr.inherit = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  fd_ = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+  if (fd_ < 0) {
+    return false;
+  }
+  ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+  return true;
+#else
+  return false;
+#endif
+}
+
+uint64_t DTLBMissCounter::stop() {
+  uint64_t count{0};
+#if defined(__linux__)
+  if (fd_ >= 0) {
+    ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd_, &count, sizeof(count)) != sizeof(count)) {
+      count = 0;
+    }
+  }
+#endif
+  return count;
+}
+
+} // namespace memory_utils
+
+} // namespace salmon
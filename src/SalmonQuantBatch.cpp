@@ -0,0 +1,294 @@
+/**
+>HEADER
+    Copyright (c) 2013, 2014, 2015, 2016 Rob Patro rob.patro@cs.stonybrook.edu
+
+    This file is part of Salmon.
+
+    Salmon is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Salmon is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Salmon.  If not, see <http://www.gnu.org/licenses/>.
+<HEADER
+**/
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+// logger includes
+#include "spdlog/spdlog.h"
+
+#include "QuantJobUtils.hpp"
+#include "SalmonIndex.hpp"
+
+/**
+ * salmon quant --batch <manifest>
+ *
+ * Quantify many samples against one index, which is loaded once.  Each line
+ * of the manifest names the output directory of a sample, followed by its
+ * read library options (e.g. "out/s1 -l A -1 s1_1.fq.gz -2 s1_2.fq.gz");
+ * blank lines, and lines starting with '#', are skipped.  The other options
+ * (other than -i, -p and --maxJobs) are passed to every sample.
+ *
+ * Up to --maxJobs samples are quantified at once, and the -p threads are
+ * split between them.  Each sample runs as a `salmon quant` job (see
+ * job_utils), so that its output is that of running `salmon quant` on it.
+ */
+
+namespace {
+
+struct BatchSample {
+  std::string outputDirectory;
+  std::vector<std::string> options;
+  int status{-1};
+  double seconds{0.0};
+};
+
+// Parse the manifest; returns false (having logged why) if it is malformed.
+bool readManifest(const std::string& path, std::vector<BatchSample>& samples,
+                  std::shared_ptr<spdlog::logger>& log) {
+  std::ifstream manifest(path);
+  if (!manifest.good()) {
+    log->critical("Could not open the manifest {}", path);
+    return false;
+  }
+  std::string line;
+  size_t lineNo{0};
+  while (std::getline(manifest, line)) {
+    ++lineNo;
+    std::istringstream fields(line);
+    BatchSample sample;
+    if (!(fields >> sample.outputDirectory) or
+        sample.outputDirectory.front() == '#') {
+      continue;
+    }
+    std::string field;
+    while (fields >> field) {
+      sample.options.push_back(field);
+    }
+    std::set<std::string> names;
+    try {
+      names = salmon::job_utils::quantOptionNames(sample.options);
+    } catch (boost::program_options::error& e) {
+      log->critical("line {} of the manifest : {}", lineNo, e.what());
+      return false;
+    }
+    if (names.count("index") or names.count("output") or
+        names.count("threads")) {
+      log->critical("line {} of the manifest : the index, the output directory "
+                    "and the threads of a sample can't be set in the manifest.",
+                    lineNo);
+      return false;
+    }
+    samples.push_back(sample);
+  }
+  if (samples.empty()) {
+    log->critical("The manifest {} lists no samples", path);
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+int salmonQuantBatch(int argc, const char* argv[]) {
+  using std::string;
+  namespace bfs = boost::filesystem;
+  namespace po = boost::program_options;
+
+  string manifestPath;
+  string indexDirectory;
+  uint32_t numThreads{std::max(1u, std::thread::hardware_concurrency())};
+  uint32_t maxJobs{1};
+
+  po::options_description batchOpts("salmon quant --batch options");
+  batchOpts.add_options()("help,h", "produce help message")
+    ("batch", po::value<string>(&manifestPath)->required(),
+     "A manifest of the samples to quantify: one sample per line, giving its "
+     "output directory and then its read library options.")
+    ("index,i", po::value<string>(&indexDirectory)->required(),
+     "salmon index, which is loaded once for all of the samples")
+    ("threads,p", po::value<uint32_t>(&numThreads)->default_value(numThreads),
+     "The number of threads used, in total; they are split evenly between the "
+     "samples that are quantified at once.")
+    ("maxJobs,j", po::value<uint32_t>(&maxJobs)->default_value(1),
+     "The number of samples quantified at once.");
+
+  try {
+    auto parsed = po::command_line_parser(argc, argv)
+                      .options(batchOpts)
+                      .allow_unregistered()
+                      .run();
+    po::variables_map vm;
+    po::store(parsed, vm);
+
+    if (vm.count("help")) {
+      auto hstring = R"(
+quant --batch
+==========
+Quantify the samples listed in a manifest against one
+index, which is loaded once.  Any other quant options
+are passed to every sample.
+)";
+      std::cout << hstring << std::endl;
+      std::cout << batchOpts << std::endl;
+      std::exit(0);
+    }
+    po::notify(vm);
+
+    // the options for every sample
+    std::vector<string> commonOptions =
+        po::collect_unrecognized(parsed.options, po::include_positional);
+    if (salmon::job_utils::quantOptionNames(commonOptions).count("output")) {
+      std::cerr << "The output directory of each sample is given in the "
+                   "manifest (and not with -o).\n";
+      std::exit(1);
+    }
+    if (salmon::job_utils::isAlignmentModeJob(commonOptions)) {
+      std::cerr << "Only mapping-based quantification can be run as a batch.\n";
+      std::exit(1);
+    }
+
+    // The logger is synchronous, as the samples are forked from this process.
+    auto consoleSink =
+        std::make_shared<spdlog::sinks::ansicolor_stderr_sink_mt>();
+    auto log = spdlog::create("batchLog", {consoleSink});
+
+    std::vector<BatchSample> samples;
+    if (!readManifest(manifestPath, samples, log)) {
+      std::exit(1);
+    }
+    maxJobs = std::max(1u, std::min(maxJobs, static_cast<uint32_t>(samples.size())));
+    uint32_t threadsPerJob = std::max(1u, numThreads / maxJobs);
+    log->info("quantifying {} sample(s), {} at once with {} thread(s) each",
+              samples.size(), maxJobs, threadsPerJob);
+
+    auto index = salmon::job_utils::loadResidentIndex(indexDirectory, 0, log);
+    string cwd = bfs::current_path().string();
+
+    using Clock = std::chrono::steady_clock;
+    std::map<pid_t, std::pair<size_t, Clock::time_point>> running;
+    size_t next{0};
+    size_t numFailed{0};
+    while (next < samples.size() or !running.empty()) {
+      while (next < samples.size() and running.size() < maxJobs) {
+        auto& sample = samples[next];
+        std::vector<string> args{"--index", indexDirectory, "-p",
+                                 std::to_string(threadsPerJob)};
+        args.insert(args.end(), commonOptions.begin(), commonOptions.end());
+        args.insert(args.end(), sample.options.begin(), sample.options.end());
+        args.insert(args.end(), {"-o", sample.outputDirectory});
+
+        // When samples run at once, their console output would be
+        // interleaved, so it is written to the log directory of each.
+        int outFd{-1};
+        if (maxJobs > 1) {
+          bfs::path logDir = bfs::path(sample.outputDirectory) / "logs";
+          boost::system::error_code ec;
+          bfs::create_directories(logDir, ec);
+          string consolePath = (logDir / "console.log").string();
+          outFd = ::open(consolePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+          if (outFd < 0) {
+            log->warn("could not open {} : {}; the console output of the "
+                      "sample is discarded",
+                      consolePath, std::strerror(errno));
+            outFd = ::open("/dev/null", O_WRONLY);
+          }
+        }
+        pid_t pid = salmon::job_utils::startQuantJob(args, cwd, outFd, {});
+        if (outFd >= 0) {
+          ::close(outFd);
+        }
+        if (pid < 0) {
+          log->error("could not start the quantification of {} : {}",
+                     sample.outputDirectory, std::strerror(errno));
+          sample.status = 1;
+          ++numFailed;
+        } else {
+          log->info("started sample {} of {} : {}", next + 1, samples.size(),
+                    sample.outputDirectory);
+          running[pid] = {next, Clock::now()};
+        }
+        ++next;
+      }
+      if (running.empty()) {
+        continue;
+      }
+
+      int status{0};
+      pid_t pid = ::waitpid(-1, &status, 0);
+      if (pid < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        log->critical("waiting for the samples failed : {}", std::strerror(errno));
+        std::exit(1);
+      }
+      auto it = running.find(pid);
+      if (it == running.end()) {
+        continue;
+      }
+      auto& sample = samples[it->second.first];
+      sample.status = salmon::job_utils::jobExitCode(status);
+      sample.seconds =
+          std::chrono::duration<double>(Clock::now() - it->second.second).count();
+      if (sample.status != 0) {
+        ++numFailed;
+        log->error("the quantification of {} failed (status {})",
+                   sample.outputDirectory, sample.status);
+      } else {
+        log->info("finished {} in {:.1f} s", sample.outputDirectory,
+                  sample.seconds);
+      }
+      running.erase(it);
+    }
+
+    std::cerr << "\nsample\tstatus\tseconds\n";
+    for (auto& sample : samples) {
+      std::cerr << sample.outputDirectory << '\t' << sample.status << '\t'
+                << sample.seconds << '\n';
+    }
+    if (numFailed > 0) {
+      log->error("{} of {} sample(s) failed", numFailed, samples.size());
+      return 1;
+    }
+    log->info("quantified {} sample(s)", samples.size());
+  } catch (po::error& e) {
+    std::cerr << "Exception : [" << e.what() << "]. Exiting.\n";
+    std::exit(1);
+  } catch (const spdlog::spdlog_ex& ex) {
+    std::cerr << "logger failed with : [" << ex.what() << "]. Exiting.\n";
+    std::exit(1);
+  } catch (std::exception& e) {
+    std::cerr << "Exception : [" << e.what() << "]\n";
+    std::cerr << argv[0] << " quant --batch was invoked improperly.\n";
+    std::cerr << "For usage information, try " << argv[0]
+              << " quant --batch <manifest> --help\nExiting.\n";
+    std::exit(1);
+  }
+  return 0;
+}
@@ -22,6 +22,7 @@
 #include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cmath>
 #include <cstdio>
 #include <exception>
@@ -79,6 +80,7 @@
 #include "cereal/archives/binary.hpp"
 #include "cereal/types/vector.hpp"
 
+#include "blockingconcurrentqueue.h"
 #include "concurrentqueue.h"
 
 // salmon includes
@@ -104,16 +106,21 @@
 #include "ForgettingMassCalculator.hpp"
 #include "FragmentLengthDistribution.hpp"
 #include "GZipWriter.hpp"
+#include "MappingRecords.hpp"
+#include "TranscriptMassAccumulator.hpp"
 
 #include "EffectiveLengthStats.hpp"
 #include "PairedAlignmentFormatter.hpp"
 #include "ProgramOptionsGenerator.hpp"
+#include "ReadDuplicateCache.hpp"
 #include "ReadExperiment.hpp"
 //#include "RapMapUtils.hpp"
 //#include "SACollector.hpp"
 //#include "SASearcher.hpp"
 //#include "HitManager.hpp"
 #include "SalmonOpts.hpp"
+#include "SeedPrefetcher.hpp"
+#include "MinimizerOrder.hpp"
 //#include "SingleAlignmentFormatter.hpp"
 #include "tsl/hopscotch_map.h"
 #include "edlib.h"
@@ -135,6 +142,8 @@ using MergeResult = pufferfish::util::MergeResult;
 
 using paired_parser = fastx_parser::FastxParser<fastx_parser::ReadPair>;
 using single_parser = fastx_parser::FastxParser<fastx_parser::ReadSeq>;
+using paired_view_parser = fastx_parser::FastxParser<fastx_parser::ReadPairView>;
+using single_view_parser = fastx_parser::FastxParser<fastx_parser::ReadSeqView>;
 
 using TranscriptID = uint32_t;
 using TranscriptIDVector = std::vector<TranscriptID>;
@@ -144,6 +153,93 @@ constexpr uint32_t miniBatchSize{5000};
 
 template <typename AlnT> using AlnGroupVec = std::vector<AlignmentGroup<AlnT>>;
 
+/**
+ * The read parser of a library; only the member matching the library type
+ * (and --readArena) is set.  `pending` marks parsers that salmonQuantify
+ * started for the first library while the index was loading, and that the
+ * first call to processReadLibrary takes over.
+ */
+struct ReadParsers {
+  std::unique_ptr<paired_parser> paired{nullptr};
+  std::unique_ptr<single_parser> single{nullptr};
+  std::unique_ptr<paired_view_parser> pairedView{nullptr};
+  std::unique_ptr<single_view_parser> singleView{nullptr};
+  bool pending{false};
+};
+
+// Create and start the parser for `rl`, to be consumed by numThreads
+// mapping threads.
+void startReadParsers(ReadLibrary& rl, SalmonOpts& salmonOpts,
+                      size_t numThreads, ReadParsers& parsers) {
+  if (rl.format().type == ReadType::PAIRED_END) {
+
+    if (rl.mates1().size() != rl.mates2().size()) {
+      salmonOpts.jointLog->error("The number of provided files for "
+                                 "-1 and -2 must be the same!");
+      std::exit(1);
+    }
+
+    // With --consumerParsing, a single dedicated parsing thread; when it
+    // can't keep up and there are more file pairs, mapping threads that run
+    // out of reads parse the others (and go back to mapping once they've
+    // outpaced the mappers).  With --mmapReads, they can also help with the
+    // file pair being parsed.
+    uint32_t numParsingThreads{1};
+    // HACK!
+    if (!salmonOpts.consumerParsing and rl.mates1().size() > 1 and
+        numThreads > 8) {
+      numParsingThreads = 2;
+    }
+    if (salmonOpts.readArena) {
+      parsers.pairedView.reset(new paired_view_parser(rl.mates1(), rl.mates2(),
+                                                      numThreads, numParsingThreads,
+                                                      miniBatchSize));
+      salmon::mapping_utils::configureReadParser(*parsers.pairedView, salmonOpts);
+      parsers.pairedView->start();
+    } else {
+      parsers.paired.reset(new paired_parser(rl.mates1(), rl.mates2(),
+                                             numThreads, numParsingThreads,
+                                             miniBatchSize));
+      salmon::mapping_utils::configureReadParser(*parsers.paired, salmonOpts);
+      parsers.paired->start();
+    }
+  } else if (rl.format().type == ReadType::SINGLE_END) {
+    // see above
+    uint32_t numParsingThreads{1};
+    // HACK!
+    if (!salmonOpts.consumerParsing and rl.unmated().size() > 1 and
+        numThreads > 8) {
+      numParsingThreads = 2;
+    }
+    if (salmonOpts.readArena) {
+      parsers.singleView.reset(new single_view_parser(rl.unmated(), numThreads,
+                                                      numParsingThreads, miniBatchSize));
+      salmon::mapping_utils::configureReadParser(*parsers.singleView, salmonOpts);
+      parsers.singleView->start();
+    } else {
+      parsers.single.reset(new single_parser(rl.unmated(), numThreads,
+                                             numParsingThreads, miniBatchSize));
+      salmon::mapping_utils::configureReadParser(*parsers.single, salmonOpts);
+      parsers.single->start();
+    }
+  }
+}
+
+// The header of the BAM output of the mappings (--mappingsFormat BAM); its
+// references are the transcripts, whose ids the mappings carry.
+std::string bamMappingsHeader(const std::vector<Transcript>& transcripts) {
+  fmt::MemoryWriter text;
+  text << "@HD\tVN:1.0\tSO:unsorted\n";
+  std::vector<std::pair<std::string, uint32_t>> refs;
+  refs.reserve(transcripts.size());
+  for (auto& t : transcripts) {
+    text << "@SQ\tSN:" << t.RefName << "\tLN:" << t.CompleteLength << '\n';
+    refs.emplace_back(t.RefName, t.CompleteLength);
+  }
+  text << "@PG\tID:salmon\tPN:salmon\tVN:" << salmon::version << '\n';
+  return salmon::bam_utils::encodeHeader(text.str(), refs);
+}
+
 template <typename AlnT>
 using AlnGroupVecRange = core::range<typename AlnGroupVec<AlnT>::iterator>;
 
@@ -156,10 +252,115 @@ template <typename AlnT>
 using AlnGroupQueue = tbb::concurrent_queue<AlignmentGroup<AlnT>*>;
 #endif
 
+/**
+ * The queues between the two stages of the staged pipeline
+ * (--inferenceThreads), in which the mapping threads only map, and a
+ * separate pool of inference threads runs processMiniBatch (the fragment
+ * probabilities, the equivalence classes and the bias and fragment length
+ * updates) on the chunks they've mapped.
+ *
+ * A fixed set of batches (the queue depth) circulates between the stages.
+ * A mapping thread that has mapped a chunk into its alignment groups swaps
+ * them with those of a free batch (so that it maps the next chunk into the
+ * groups of that batch, without copying the alignments), and queues the
+ * batch for the inference threads, which release it once it's quantified.
+ * The mapping threads wait when every batch is queued or being quantified,
+ * which bounds the memory held by the mapped reads.
+ */
+template <typename AlnT>
+class InferencePipeline {
+public:
+  struct Batch {
+    AlnGroupVec<AlnT> groups;
+    size_t numGroups{0};
+  };
+
+  InferencePipeline(uint32_t depth, size_t batchSize) {
+    batches_.reserve(depth);
+    for (uint32_t i = 0; i < depth; ++i) {
+      batches_.emplace_back(new Batch{AlnGroupVec<AlnT>(batchSize), 0});
+      free_.enqueue(batches_.back().get());
+    }
+  }
+
+  // Hand the first numGroups groups of a mapped chunk over to be quantified;
+  // groups is left with the (stale) groups of a free batch.
+  void submit(AlnGroupVec<AlnT>& groups, size_t numGroups) {
+    Batch* b{nullptr};
+    if (!free_.try_dequeue(b)) {
+      auto start = std::chrono::steady_clock::now();
+      free_.wait_dequeue(b);
+      mapperWaitNs_ += elapsedNs_(start);
+    }
+    std::swap(b->groups, groups);
+    b->numGroups = numGroups;
+    ++numBatches_;
+    mapped_.enqueue(b);
+  }
+
+  // The next mapped batch, or nullptr once the mapping is finished
+  Batch* next() {
+    Batch* b{nullptr};
+    if (!mapped_.try_dequeue(b)) {
+      auto start = std::chrono::steady_clock::now();
+      mapped_.wait_dequeue(b);
+      inferenceWaitNs_ += elapsedNs_(start);
+    }
+    return b;
+  }
+
+  void release(Batch* b) { free_.enqueue(b); }
+
+  // Called once every mapping thread is done; each of the numInferenceThreads
+  // threads then gets a nullptr after the last batch.
+  void finish(uint32_t numInferenceThreads) {
+    for (uint32_t i = 0; i < numInferenceThreads; ++i) {
+      mapped_.enqueue(nullptr);
+    }
+  }
+
+  uint64_t numBatches() const { return numBatches_; }
+  uint64_t mapperWaitNs() const { return mapperWaitNs_; }
+  uint64_t inferenceWaitNs() const { return inferenceWaitNs_; }
+
+private:
+  static uint64_t elapsedNs_(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  }
+
+  std::vector<std::unique_ptr<Batch>> batches_;
+  moodycamel::BlockingConcurrentQueue<Batch*> free_;
+  moodycamel::BlockingConcurrentQueue<Batch*> mapped_;
+  std::atomic<uint64_t> numBatches_{0};
+  std::atomic<uint64_t> mapperWaitNs_{0};
+  std::atomic<uint64_t> inferenceWaitNs_{0};
+};
+
 //#include "LightweightAlignmentDefs.hpp"
 
 using ReadExperimentT = ReadExperiment<EquivalenceClassBuilder<TGValue>>;
 
+// What the duplicate read cache (--dupCacheSize) keeps about the mapping of
+// a read: its filtered alignments, and what its mapping added to the mapping
+// statistics, which each duplicate adds again.
+struct CachedReadMapping {
+  std::vector<QuasiAlignment> alignments;
+  salmon::utils::MappingType mapType{salmon::utils::MappingType::UNMAPPED};
+  bool hadHits{false};
+  bool isPaired{false};
+  uint32_t numMappingsDropped{0};
+  uint32_t numFragsDropped{0};
+  uint32_t numDecoyFrags{0};
+  uint32_t numOrphansRescued{0};
+  // what the mapping added to the hit counters
+  uint64_t numDovetails{0};
+  uint64_t numMappedAtLeastAKmer{0};
+  uint64_t peHits{0};
+};
+using ReadDuplicateCacheT = ReadDuplicateCache<CachedReadMapping>;
+
 template <typename AlnT>
 void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc,
                       uint64_t firstTimestepOfRound, ReadLibrary& readLib,
@@ -176,7 +377,8 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
                       std::atomic<uint64_t>& numAssignedFragments,
                       std::default_random_engine& randEng, bool initialRound,
                       std::atomic<bool>& burnedIn, double& maxZeroFrac,
-                      distribution_utils::LogCMFCache& logCMFCache) {
+                      distribution_utils::LogCMFCache& logCMFCache,
+                      TranscriptMassAccumulator& massAccumulator) {
 
   using salmon::math::LOG_0;
   using salmon::math::LOG_1;
@@ -248,6 +450,10 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
   double startingCumulativeMass =
       fmCalc.cumulativeLogMassAt(firstTimestepOfRound);
 
+  // With --batchMassUpdates, the mass of the batch is summed in this
+  // thread's accumulator, and added to the transcripts once it's done
+  bool batchMassUpdates{salmonOpts.batchMassUpdates};
+
   auto isUnexpectedOrphan = [](AlnT& aln, LibraryFormat expectedLibFormat) -> bool {
     return (expectedLibFormat.type == ReadType::PAIRED_END and
             aln.mateStatus != MateStatus::PAIRED_END_PAIRED);
@@ -583,8 +789,12 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
         auto& transcript = transcripts[transcriptID];
 
         // Add the new mass to this transcript
-        double newMass = logForgettingMass + aln.logProb;
-        transcript.addMass(newMass);
+        if (batchMassUpdates) {
+          massAccumulator.add(transcriptID, aln.logProb);
+        } else {
+          double newMass = logForgettingMass + aln.logProb;
+          transcript.addMass(newMass);
+        }
 
         // Paired-end
         if (aln.libFormat().type == ReadType::PAIRED_END) {
@@ -716,6 +926,10 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
     } // end read group
   }   // end timer
 
+  if (batchMassUpdates) {
+    massAccumulator.flush(transcripts, logForgettingMass);
+  }
+
   if (zeroProbFrags > 0) {
     auto batchReads = batchHits.size();
     maxZeroFrac = std::max(
@@ -736,10 +950,204 @@ void processMiniBatch(ReadExperimentT& readExp, ForgettingMassCalculator& fmCalc
 }
 
 
+/**
+ * Draw a sequence-specific bias sample from (at most) one, randomly chosen,
+ * alignment of a mapped paired-end fragment, and set the library format of
+ * each of its alignments.  This is done for the fragments as they're mapped,
+ * and for those read back from a mapping record file (--fromMappings).
+ */
+template <typename RandomEngineT>
+void samplePairedBiasAndSetFormats(std::vector<QuasiAlignment>& jointAlignments,
+                                   bool isPaired,
+                                   std::vector<Transcript>& transcripts,
+                                   BiasParams& observedBiasParams,
+                                   SalmonOpts& salmonOpts, RandomEngineT& eng) {
+  auto& readBiasFW = observedBiasParams.seqBiasModelFW;
+  auto& readBiasRC = observedBiasParams.seqBiasModelRC;
+
+  bool needBiasSample = salmonOpts.biasCorrect;
+
+  std::uniform_int_distribution<> dis(0, jointAlignments.size());
+  // Randomly select a hit from which to draw the bias sample.
+  int32_t hitSamp{dis(eng)};
+  int32_t hn{0};
+
+  for (auto& h : jointAlignments) {
+
+    // ---- Collect bias samples ------ //
+
+    // If bias correction is turned on, and we haven't sampled a mapping
+    // for this read yet, and we haven't collected the required number of
+    // samples overall.
+    if (needBiasSample and salmonOpts.numBiasSamples > 0 and isPaired and
+        hn == hitSamp) {
+      auto& t = transcripts[h.tid];
+
+      // The "start" position is the leftmost position if
+      // map to the forward strand, and the leftmost
+      // position + the read length if we map to the reverse complement.
+
+      // read 1
+      int32_t pos1 = static_cast<int32_t>(h.pos);
+      auto dir1 = salmon::utils::boolToDirection(h.fwd);
+      int32_t startPos1 = h.fwd ? pos1 : (pos1 + h.readLen - 1);
+
+      // read 2
+      int32_t pos2 = static_cast<int32_t>(h.matePos);
+      auto dir2 = salmon::utils::boolToDirection(h.mateIsFwd);
+      int32_t startPos2 = h.mateIsFwd ? pos2 : (pos2 + h.mateLen - 1);
+
+      bool success = false;
+
+      if ((dir1 != dir2) and // Shouldn't be from the same strand
+          (startPos1 > 0 and startPos1 < static_cast<int32_t>(t.RefLength)) and
+          (startPos2 > 0 and startPos2 < static_cast<int32_t>(t.RefLength))) {
+
+        // the contexts are read straight from the 2-bit sequence
+        const auto& txpSeq = t.sequenceView();
+
+        auto& readBias1 = (h.fwd) ? readBiasFW : readBiasRC;
+        auto& readBias2 = (h.mateIsFwd) ? readBiasFW : readBiasRC;
+
+        int32_t fwPre = readBias1.contextBefore(!h.fwd);
+        int32_t fwPost = readBias1.contextAfter(!h.fwd);
+
+        int32_t rcPre = readBias2.contextBefore(!h.mateIsFwd);
+        int32_t rcPost = readBias2.contextAfter(!h.mateIsFwd);
+
+        bool read1RC = !h.fwd;
+        bool read2RC = !h.mateIsFwd;
+
+        if ((startPos1 >= readBias1.contextBefore(read1RC) and
+             startPos1 + readBias1.contextAfter(read1RC) <
+             static_cast<int32_t>(t.RefLength)) and
+            (startPos2 >= readBias2.contextBefore(read2RC) and
+             startPos2 + readBias2.contextAfter(read2RC) < static_cast<int32_t>(t.RefLength))) {
+
+          int32_t fwPos = (h.fwd) ? startPos1 : startPos2;
+          int32_t rcPos = (h.fwd) ? startPos2 : startPos1;
+          if (fwPos < rcPos) {
+            // reads 1 and 2 are on opposite strands, so exactly one
+            // of the contexts is reverse complemented
+            uint64_t leftCtx =
+                txpSeq.word(startPos1 - readBias1.contextBefore(read1RC),
+                            readBias1.getContextLength());
+            uint64_t rightCtx =
+                txpSeq.word(startPos2 - readBias2.contextBefore(read2RC),
+                            readBias2.getContextLength());
+
+            success = readBias1.addPackedContext(leftCtx, read1RC, 1.0);
+            success = readBias2.addPackedContext(rightCtx, read2RC, 1.0);
+          }
+        }
+
+        if (success) {
+          salmonOpts.numBiasSamples -= 1;
+          needBiasSample = false;
+        }
+      }
+    }
+    // ---- Collect bias samples ------ //
+    ++hn;
+
+    switch (h.mateStatus) {
+    case MateStatus::PAIRED_END_LEFT: {
+      h.format = salmon::utils::hitType(h.pos, h.fwd);
+    } break;
+    case MateStatus::PAIRED_END_RIGHT: {
+      // we pass in !h.fwd here because the right read
+      // will have the opposite orientation from its mate.
+      // NOTE : We will try recording what the mapped fragment
+      // actually is, not to infer what it's mate should be.
+      h.format = salmon::utils::hitType(h.pos, h.fwd);
+    } break;
+    case MateStatus::PAIRED_END_PAIRED: {
+      uint32_t end1Pos = (h.fwd) ? h.pos : h.pos + h.readLen;
+      uint32_t end2Pos =
+          (h.mateIsFwd) ? h.matePos : h.matePos + h.mateLen;
+      bool canDovetail = false;
+      h.format =
+          salmon::utils::hitType(end1Pos, h.fwd, h.readLen, end2Pos,
+                                 h.mateIsFwd, h.mateLen, canDovetail);
+    } break;
+    case MateStatus::SINGLE_END: {
+      // do nothing
+    } break;
+    default:
+      break;
+    }
+  }
+}
+
+// As samplePairedBiasAndSetFormats, for the alignments of a single-end read
+template <typename RandomEngineT>
+void sampleSingleBiasAndSetFormats(std::vector<QuasiAlignment>& jointAlignments,
+                                   std::vector<Transcript>& transcripts,
+                                   BiasParams& observedBiasParams,
+                                   SalmonOpts& salmonOpts, RandomEngineT& eng) {
+  auto& readBiasFW = observedBiasParams.seqBiasModelFW;
+  auto& readBiasRC = observedBiasParams.seqBiasModelRC;
+
+  bool needBiasSample = salmonOpts.biasCorrect;
+
+  std::uniform_int_distribution<> dis(0, jointAlignments.size());
+  // Randomly select a hit from which to draw the bias sample.
+  int32_t hitSamp{dis(eng)};
+  int32_t hn{0};
+
+  // ---- Collect bias samples ------ //
+  for (auto& h : jointAlignments) {
+
+    int32_t pos = static_cast<int32_t>(h.pos);
+
+    // If bias correction is turned on, and we haven't sampled a mapping
+    // for this read yet, and we haven't collected the required number of
+    // samples overall.
+    if (needBiasSample and salmonOpts.numBiasSamples > 0 and hn == hitSamp) {
+      // the "start" position is the leftmost position if
+      // we hit the forward strand, and the leftmost
+      // position + the read length if we hit the reverse complement
+      int32_t startPos = h.fwd ? pos : pos + h.readLen;
+
+      auto& t = transcripts[h.tid];
+      if (startPos > 0 and startPos < static_cast<int32_t>(t.RefLength)) {
+        auto& readBias = (h.fwd) ? readBiasFW : readBiasRC;
+        const auto& txpSeq = t.sequenceView();
+
+        bool success{false};
+        // If the context exists around the read, add it to the observed
+        // read start sequences.
+        if (startPos >= readBias.contextBefore(!h.fwd) and
+            startPos + readBias.contextAfter(!h.fwd) < static_cast<int32_t>(t.RefLength)) {
+          uint64_t context =
+              txpSeq.word(startPos - readBias.contextBefore(!h.fwd),
+                          readBias.getContextLength());
+          success = readBias.addPackedContext(context, !h.fwd, 1.0);
+        }
+
+        if (success) {
+          salmonOpts.numBiasSamples -= 1;
+          needBiasSample = false;
+        }
+      }
+    }
+    // ---- Collect bias samples ------ //
+
+    switch (h.mateStatus) {
+    case MateStatus::SINGLE_END: {
+      h.format = salmon::utils::hitType(h.pos, h.fwd);
+    } break;
+    default:
+      break;
+    }
+  }
+}
+
 /// START QUASI
-template <typename IndexT>
-void processReads(
-    paired_parser* parser, ReadExperimentT& readExp, ReadLibrary& rl,
+template <typename IndexT, typename FragT>
+typename std::enable_if<fastx_parser::is_paired_record<FragT>::value>::type
+processReads(
+    fastx_parser::FastxParser<FragT>* parser, ReadExperimentT& readExp, ReadLibrary& rl,
     AlnGroupVec<QuasiAlignment>& structureVec,
     std::atomic<uint64_t>& numObservedFragments,
     std::atomic<uint64_t>& numAssignedFragments,
@@ -755,6 +1163,7 @@ void processReads(
     std::mutex& iomutex, bool initialRound, std::atomic<bool>& burnedIn,
     volatile bool& writeToCache,
     MappingStatistics& mstats,
+    InferencePipeline<QuasiAlignment>* pipeline,
     size_t threadID) {
 
   uint64_t count_fwd = 0, count_bwd = 0;
@@ -771,6 +1180,7 @@ void processReads(
   double maxZeroFrac{0.0};
   // false below because in this function, we have a paired-end library
   distribution_utils::LogCMFCache logCMFCache(&fragLengthDist, false);
+  TranscriptMassAccumulator massAccumulator;
 
   // Write unmapped reads
   fmt::MemoryWriter unmappedNames;
@@ -784,17 +1194,6 @@ void processReads(
   spdlog::logger* orphanLinkLogger =
       (writeOrphanLinks) ? salmonOpts.orphanLinkLog.get() : nullptr;
 
-  auto& readBiasFW =
-      observedBiasParams
-          .seqBiasModelFW; // readExp.readBias(salmon::utils::Direction::FORWARD);
-  auto& readBiasRC =
-      observedBiasParams
-          .seqBiasModelRC; // readExp.readBias(salmon::utils::Direction::REVERSE_COMPLEMENT);
-
-  // k-mers for sequence bias context
-  Mer leftMer;
-  Mer rightMer;
-
   uint64_t firstTimestepOfRound = fmCalc.getCurrentTimestep();
   size_t minK = qidx->k();
 
@@ -833,6 +1232,20 @@ void processReads(
   uint64_t firstDecoyIndex = qidx->firstDecoyIndex();
   //*******
 
+  // The orphan links are written from the unfiltered hits, which aren't
+  // cached.
+  ReadDuplicateCacheT dupCache(salmonOpts.dupCacheSize);
+  bool useDupCache = dupCache.enabled() and !writeOrphanLinks;
+  SeedPrefetcher<IndexT> seedPrefetcher(qidx, salmonOpts.seedBatchSize);
+  // The orphan links are written as the reads are mapped, and so the reads
+  // aren't reordered if they are written.  Otherwise, what is written about
+  // each read is recorded, and written once the chunk is mapped, in the
+  // order of the reads.
+  MinimizerOrder readOrder(salmonOpts.reorderReads and !writeOrphanLinks, qidx->k());
+  std::vector<uint8_t> readHadHits;
+  std::vector<uint8_t> readIsPaired;
+  std::vector<salmon::utils::MappingType> readMapType;
+
   bool hardFilter = salmonOpts.hardFilter;
 
   pufferfish::util::HitCounters hctr;
@@ -841,6 +1254,19 @@ void processReads(
   fmt::MemoryWriter sstream;
   auto* qmLog = salmonOpts.qmLog.get();
   bool writeQuasimappings = (qmLog != nullptr);
+  // With --mappingsFormat BAM, the records are encoded into this thread's
+  // buffer, which is handed to the BAM writer at the end of each chunk.
+  auto* bamWriter = salmonOpts.bamWriter.get();
+  bool writeBAM = (bamWriter != nullptr);
+  salmon::bam_utils::BAMRecordEncoder bamEncoder;
+  std::string bamBuf;
+  // With --saveMappings, the mappings of the fragments of each chunk are
+  // recorded here (in the order of the reads, like the other outputs), and
+  // the chunk is handed to the record writer before it's quantified.
+  auto* recordWriter = salmonOpts.mappingRecordWriter.get();
+  bool saveMappings = (recordWriter != nullptr);
+  salmon::mapping_records::ChunkEncoder recordEncoder;
+  std::string recordBuf;
 
   /*
   auto ap{selective_alignment::utils::AlignmentPolicy::DEFAULT};
@@ -861,7 +1287,40 @@ void processReads(
 
   uint32_t readLen{0}, mateLen{0}, totLen{0};
 
+  // only used if the parser hands out views into its read arena
+  std::string leftSeqBuf, rightSeqBuf;
+  fastx_parser::ReadPair ownedPairBuf;
+
   auto rg = parser->getReadGroup();
+  auto writeReadOutput = [&](size_t i, bool hadHits, bool isPaired,
+                             salmon::utils::MappingType mapType) {
+    if (saveMappings) {
+      recordEncoder.append(isPaired, structureVec[i].alignments());
+    }
+    if (writeQuasimappings and hadHits) {
+      writeAlignmentsToStream(salmon::mapping_utils::ownedRecord(rg[i], ownedPairBuf), formatter,
+                              structureVec[i].alignments(),
+                              sstream,
+                              true, // write orphans
+                              true  // transcript ID's already decoded (taking care of short refs)
+                              );
+    }
+    if (writeBAM and hadHits) {
+      salmon::mapping_utils::appendBAMRecords(
+          salmon::mapping_utils::readName(rg[i].first),
+          salmon::mapping_utils::readSequence(rg[i].first, leftSeqBuf),
+          salmon::mapping_utils::readSequence(rg[i].second, rightSeqBuf),
+          structureVec[i].alignments(), bamEncoder, bamBuf);
+    }
+    if (writeUnmapped and
+        mapType != salmon::utils::MappingType::PAIRED_MAPPED) {
+      // If we have no mappings --- then there's nothing to do
+      // unless we're outputting names for un-mapped reads
+      unmappedNames << salmon::mapping_utils::readName(rg[i].first) << ' ' << salmon::utils::str(mapType)
+                    << '\n';
+    }
+  };
+
   while (parser->refill(rg)) {
     rangeSize = rg.size();
 
@@ -875,12 +1334,26 @@ void processReads(
       std::exit(1);
     }
 
+    readOrder.compute(rg, rangeSize);
+    if (readOrder.enabled()) {
+      readHadHits.resize(rangeSize);
+      readIsPaired.resize(rangeSize);
+      readMapType.resize(rangeSize);
+    }
+
     bool tryAlign{salmonOpts.validateMappings};
-    for (size_t i = 0; i < rangeSize; ++i) { // For all the reads in this batch
+    // For all the reads in this batch, in the order in which they are mapped
+    for (size_t j = 0; j < rangeSize; ++j) {
+      if (seedPrefetcher.enabled() and j % seedPrefetcher.batchSize() == 0) {
+        seedPrefetcher.prefetch(rg, j, std::min(j + seedPrefetcher.batchSize(), rangeSize), readOrder);
+      }
+      size_t i = readOrder[j];
       auto& rp = rg[i];
+      auto& leftSeq = salmon::mapping_utils::readSequence(rp.first, leftSeqBuf);
+      auto& rightSeq = salmon::mapping_utils::readSequence(rp.second, rightSeqBuf);
 
-      readLen = static_cast<uint32_t >(rp.first.seq.length());
-      mateLen = static_cast<uint32_t >(rp.second.seq.length());
+      readLen = static_cast<uint32_t >(leftSeq.length());
+      mateLen = static_cast<uint32_t >(rightSeq.length());
       totLen = readLen + mateLen;
 
       // -- start resetting local variables
@@ -904,356 +1377,287 @@ void processReads(
       mapType = salmon::utils::MappingType::UNMAPPED;
       // -- done resetting local varaibles
 
-      readLenLeft = rp.first.seq.length();
-      readLenRight = rp.second.seq.length();
+      readLenLeft = leftSeq.length();
+      readLenRight = rightSeq.length();
       bool tooShortLeft = (readLenLeft < minK);
       bool tooShortRight = (readLenRight < minK);
 
-      bool lh = tooShortLeft ? false :
-        memCollector(rp.first.seq,
-                     qc,
-                     true, // isLeft
-                     false // verbose
-                     );
-      bool rh = tooShortRight ? false :
-        memCollector(rp.second.seq,
-                     qc,
-                     false, // isLeft
-                     false // verbose
-                     );
-      memCollector.findChains(rp.first.seq,
-                              leftHits,
-                              salmonOpts.fragLenDistMax,
-                              MateStatus::PAIRED_END_LEFT,
-                              true, // heuristic chaining
-                              true, // isLeft
-                              false // verbose
-                              );
-      memCollector.findChains(rp.second.seq,
-                              rightHits,
-                              salmonOpts.fragLenDistMax,
-                              MateStatus::PAIRED_END_RIGHT,
-                              true,  // heuristic chaining
-                              false, // isLeft
-                              false  // verbose
-                              );
-
-      hctr.numMappedAtLeastAKmer += (leftHits.size() > 0 || rightHits.size() > 0) ? 1 : 0;
-
-      // TODO : PF_INTEGRATION
-      /*
-      if (!tryAlign) {
-        leftHits.erase( std::remove_if(leftHits.begin(), leftHits.end(),
-                                       [&transcripts](QuasiAlignment& a) {
-                                         return a.tid >= transcripts.size(); }),
-                        leftHits.end() );
-        rightHits.erase( std::remove_if(rightHits.begin(), rightHits.end(),
-                                        [&transcripts](QuasiAlignment& a) {
-                                          return a.tid >= transcripts.size(); }),
-                         rightHits.end() );
-      }
-      */
-
-
-      bool haveOrphans = false;
-      MergeResult mergeRes{MergeResult::HAD_NONE};
-      // Consider a read as too short if both ends are too short
-      if (tooShortLeft and tooShortRight) {
-        ++shortFragStats.numTooShort;
-        shortFragStats.shortest = std::min(shortFragStats.shortest,
-                                           std::max(readLenLeft, readLenRight));
-      } else {
-        // TODO : PF_INTEGRATION
-        //
-        //
-        bool noDiscordant = false;
-        mergeRes = pufferfish::util::joinReadsAndFilter(leftHits, rightHits, jointHits,
-                                                        salmonOpts.fragLenDistMax,
-                                                        totLen,
-                                                        memCollector.getConsensusFraction(),
-                                                        firstDecoyIndex,
-                                                        mpol, hctr);
-
-        // IMPORTANT NOTE : Orphan recovery currently assumes a
-        // library type where mates are on separate strands
-        // so (IU, ISF, ISR).  If the library type is different
-        // we should either raise a warning / error, or implement
-        // library-type generic recovery.
-        bool mergeStatusOR = (mergeRes == pufferfish::util::MergeResult::HAD_EMPTY_INTERSECTION or
-                              mergeRes == pufferfish::util::MergeResult::HAD_ONLY_LEFT or
-                              mergeRes == pufferfish::util::MergeResult::HAD_ONLY_RIGHT);
-        haveOrphans = mergeStatusOR;
-        if ( mergeStatusOR and salmonOpts.recoverOrphans and !tooManyHits ) {
-          // TODO NOTE : do futher testing
-          bool recoveredAny = selective_alignment::utils::recoverOrphans(rp.first.seq, rp.second.seq, recoveredHits, jointHits, puffaligner, false);
-          numOrphansRescued += recoveredAny ? 1 : 0;
-          // if we recovered a mate, then we have no orphans.
-          haveOrphans = !recoveredAny;
-        }
-
-        hctr.peHits += jointHits.size();
-
+      // A read identical to one that is still in the cache takes its
+      // mappings (and its statistics) from the cache.
+      ReadDuplicateCacheT::Entry* dupSlot{nullptr};
+      bool cachedRead = useDupCache and !(tooShortLeft and tooShortRight) and
+                        dupCache.lookup(leftSeq, rightSeq, dupSlot);
+      bool isPaired{false};
+      bool hadHits{false};
+      if (cachedRead) {
+        auto& cached = dupSlot->value;
+        jointAlignments = cached.alignments;
+        mapType = cached.mapType;
+        hadHits = cached.hadHits;
+        isPaired = cached.isPaired;
+        numMappingsDropped += cached.numMappingsDropped;
+        numFragsDropped += cached.numFragsDropped;
+        numDecoyFrags += cached.numDecoyFrags;
+        numOrphansRescued += cached.numOrphansRescued;
+        hctr.numDovetails += cached.numDovetails;
+        hctr.numMappedAtLeastAKmer += cached.numMappedAtLeastAKmer;
+        hctr.peHits += cached.peHits;
         if (initialRound) {
-          upperBoundHits += (jointHits.size() > 0);
+          upperBoundHits += hadHits ? 1 : 0;
         }
+      } else {
+        size_t mappingsDroppedBefore{numMappingsDropped};
+        size_t fragsDroppedBefore{numFragsDropped};
+        size_t decoyFragsBefore{numDecoyFrags};
+        size_t orphansRescuedBefore{numOrphansRescued};
+        uint64_t dovetailsBefore = hctr.numDovetails;
+        uint64_t mappedAtLeastAKmerBefore = hctr.numMappedAtLeastAKmer;
+        uint64_t peHitsBefore = hctr.peHits;
+
+        bool lh = tooShortLeft ? false :
+          memCollector(leftSeq,
+                       qc,
+                       true, // isLeft
+                       false // verbose
+                       );
+        bool rh = tooShortRight ? false :
+          memCollector(rightSeq,
+                       qc,
+                       false, // isLeft
+                       false // verbose
+                       );
+        memCollector.findChains(leftSeq,
+                                leftHits,
+                                salmonOpts.fragLenDistMax,
+                                MateStatus::PAIRED_END_LEFT,
+                                true, // heuristic chaining
+                                true, // isLeft
+                                false // verbose
+                                );
+        memCollector.findChains(rightSeq,
+                                rightHits,
+                                salmonOpts.fragLenDistMax,
+                                MateStatus::PAIRED_END_RIGHT,
+                                true,  // heuristic chaining
+                                false, // isLeft
+                                false  // verbose
+                                );
+
+        hctr.numMappedAtLeastAKmer += (leftHits.size() > 0 || rightHits.size() > 0) ? 1 : 0;
 
-        // If the read mapped to > maxReadOccs places, discard it
-        if (jointHits.size() > salmonOpts.maxReadOccs) {
-          jointAlignmentGroup.clearAlignments();
+        // TODO : PF_INTEGRATION
+        /*
+        if (!tryAlign) {
+          leftHits.erase( std::remove_if(leftHits.begin(), leftHits.end(),
+                                         [&transcripts](QuasiAlignment& a) {
+                                           return a.tid >= transcripts.size(); }),
+                          leftHits.end() );
+          rightHits.erase( std::remove_if(rightHits.begin(), rightHits.end(),
+                                          [&transcripts](QuasiAlignment& a) {
+                                            return a.tid >= transcripts.size(); }),
+                           rightHits.end() );
         }
-      }
+        */
 
-      // TODO : PF_INTEGRATION
-      // NOTE : Under our new definition of orphans, alignments of read ends
-      // can be orphans even if the other read end aligns to the same reference.
-      // It only matters that the alignments were not paired.  Thus, it is possible
-      // below to have the same reference appear on the left and right side of an orphan link.
-      if (writeOrphanLinks) {
-        // We have orphans if either
-        // 1) there are *no* hits or
-        // 2) there are hits for *both* the left and right reads, but not to the
-        // same txp
-        salmonOpts.jointLog->info("{} :: {} ", rp.first.name, rp.second.name);
-        if (haveOrphans and mergeRes == pufferfish::util::MergeResult::HAD_EMPTY_INTERSECTION) {
-          auto it = jointHits.begin();
-          // NOTE : if we have orphans from both left and right (and hence HAD_EMPTY_INTERSECTION)
-          // then joinReadsAndFilter will put all of the left orphans first, followed by right orphans.
-          while (it != jointHits.end() and it->isLeftAvailable() ) {
-            orphanLinks << qidx->getRefId(it->tid) << ',' << it->leftClust->firstRefPos() << "\t";
-            ++it;
-          }
-          orphanLinks << ":";
-          while (it != jointHits.end() and it->isRightAvailable() ) {
-            orphanLinks << qidx->getRefId(it->tid) << ',' << it->rightClust->firstRefPos() << "\t";
-            ++it;
-          }
-          orphanLinks << "\n";
-        }
-      }
 
-      //salmonOpts.jointLog->info("num hits before alignment = {:n}", jointHits.size());
-      // If we have mappings, then process them.
-      if (!jointHits.empty()) {
-        bool isPaired = jointHits.front().mateStatus ==
-                        MateStatus::PAIRED_END_PAIRED;
-        if (isPaired) {
-          mapType = salmon::utils::MappingType::PAIRED_MAPPED;
-        }
-        // If we are ignoring orphans
-        if (!salmonOpts.allowOrphans) {
-          // If the mappings for the current read are not properly-paired (i.e.
-          // are orphans)
-          // then just clear the group.
-          if (!isPaired) {
-            jointAlignmentGroup.clearAlignments();
+        bool haveOrphans = false;
+        MergeResult mergeRes{MergeResult::HAD_NONE};
+        // Consider a read as too short if both ends are too short
+        if (tooShortLeft and tooShortRight) {
+          ++shortFragStats.numTooShort;
+          shortFragStats.shortest = std::min(shortFragStats.shortest,
+                                             std::max(readLenLeft, readLenRight));
+        } else {
+          // TODO : PF_INTEGRATION
+          //
+          //
+          bool noDiscordant = false;
+          mergeRes = pufferfish::util::joinReadsAndFilter(leftHits, rightHits, jointHits,
+                                                          salmonOpts.fragLenDistMax,
+                                                          totLen,
+                                                          memCollector.getConsensusFraction(),
+                                                          firstDecoyIndex,
+                                                          mpol, hctr);
+
+          // IMPORTANT NOTE : Orphan recovery currently assumes a
+          // library type where mates are on separate strands
+          // so (IU, ISF, ISR).  If the library type is different
+          // we should either raise a warning / error, or implement
+          // library-type generic recovery.
+          bool mergeStatusOR = (mergeRes == pufferfish::util::MergeResult::HAD_EMPTY_INTERSECTION or
+                                mergeRes == pufferfish::util::MergeResult::HAD_ONLY_LEFT or
+                                mergeRes == pufferfish::util::MergeResult::HAD_ONLY_RIGHT);
+          haveOrphans = mergeStatusOR;
+          if ( mergeStatusOR and salmonOpts.recoverOrphans and !tooManyHits ) {
+            // TODO NOTE : do futher testing
+            bool recoveredAny = selective_alignment::utils::recoverOrphans(leftSeq, rightSeq, recoveredHits, jointHits, puffaligner, false);
+            numOrphansRescued += recoveredAny ? 1 : 0;
+            // if we recovered a mate, then we have no orphans.
+            haveOrphans = !recoveredAny;
           }
-        }
 
-        if (tryAlign and !jointHits.empty()) {
-          // clear the aligner for this read
-          puffaligner.clear();
-          bestScorePerTranscript.clear();
+          hctr.peHits += jointHits.size();
 
-          // the best scores start out as invalid
-          /*
-          int32_t bestScore = invalidScore;
-          int32_t secondBestScore = invalidScore;
-          int32_t bestDecoyScore = invalidScore;
-          */
-
-          salmon::mapping_utils::MappingScoreInfo msi = {invalidScore, invalidScore, invalidScore, decoyThreshold};
-          std::vector<decltype(msi.bestScore)> scores(jointHits.size(), 0);
-          size_t idx{0};
-          bool isMultimapping = (jointHits.size() > 1);
-
-          for (auto &&jointHit : jointHits) {
-            auto hitScore = puffaligner.calculateAlignments(rp.first.seq, rp.second.seq, jointHit, hctr, isMultimapping, false);
-            bool validScore = (hitScore != invalidScore);
-            numMappingsDropped += validScore ? 0 : 1;
-            auto tid = qidx->getRefId(jointHit.tid);
-            salmon::mapping_utils::updateRefMappings(tid, hitScore, idx, transcripts, invalidScore, msi, 
-                              //bestScore, secondBestScore, bestDecoyScore,
-                              scores, bestScorePerTranscript, perm);
-            ++idx;
+          if (initialRound) {
+            upperBoundHits += (jointHits.size() > 0);
           }
 
-          //bool bestHitDecoy = (msi.bestScore < msi.bestDecoyScore);
-          bool bestHitDecoy = msi.haveOnlyDecoyMappings();
-          if (msi.bestScore > invalidScore and !bestHitDecoy) {
-            salmon::mapping_utils::filterAndCollectAlignments(jointHits,
-                                       scores,
-                                       perm,
-                                       readLen,
-                                       mateLen,
-                                       false, // true for single-end false otherwise
-                                       tryAlign,
-                                       hardFilter,
-                                       salmonOpts.scoreExp,
-                                       msi,
-                                       /*
-                                       bestScore,
-                                       secondBestScore,
-                                       bestDecoyScore,
-                                       */
-                                       jointAlignments);
-          } else {
-            numDecoyFrags += bestHitDecoy ? 1 : 0;
-            ++numFragsDropped;
+          // If the read mapped to > maxReadOccs places, discard it
+          if (jointHits.size() > salmonOpts.maxReadOccs) {
             jointAlignmentGroup.clearAlignments();
           }
-        } else if (isPaired and noDovetail) {
-          salmonOpts.jointLog->warn("HAVE NOT THOUGHT ABOUT THIS CODE-PATH YET!");
-          jointAlignments.erase(
-                          std::remove_if(jointAlignments.begin(), jointAlignments.end(),
-                                         [](const QuasiAlignment& h) -> bool {
-                                           if (h.fwd != h.mateIsFwd) {
-                                             if (h.fwd and (h.pos > h.matePos)) {
-                                               return true;
-                                             } else if (h.mateIsFwd and (h.matePos > h.pos)) {
-                                               return true;
-                                             }
-                                           }
-                                           return false;
-                                         }),
-                          jointAlignments.end());
         }
 
-        bool needBiasSample = salmonOpts.biasCorrect;
-
-        std::uniform_int_distribution<> dis(0, jointAlignments.size());
-        // Randomly select a hit from which to draw the bias sample.
-        int32_t hitSamp{dis(eng)};
-        int32_t hn{0};
-
-        for (auto& h : jointAlignments) {
-
-          // ---- Collect bias samples ------ //
-
-          // If bias correction is turned on, and we haven't sampled a mapping
-          // for this read yet, and we haven't collected the required number of
-          // samples overall.
-          if (needBiasSample and salmonOpts.numBiasSamples > 0 and isPaired and
-              hn == hitSamp) {
-            auto& t = transcripts[h.tid];
-
-            // The "start" position is the leftmost position if
-            // map to the forward strand, and the leftmost
-            // position + the read length if we map to the reverse complement.
-
-            // read 1
-            int32_t pos1 = static_cast<int32_t>(h.pos);
-            auto dir1 = salmon::utils::boolToDirection(h.fwd);
-            int32_t startPos1 = h.fwd ? pos1 : (pos1 + h.readLen - 1);
-
-            // read 2
-            int32_t pos2 = static_cast<int32_t>(h.matePos);
-            auto dir2 = salmon::utils::boolToDirection(h.mateIsFwd);
-            int32_t startPos2 = h.mateIsFwd ? pos2 : (pos2 + h.mateLen - 1);
-
-            bool success = false;
-
-            if ((dir1 != dir2) and // Shouldn't be from the same strand
-                (startPos1 > 0 and startPos1 < static_cast<int32_t>(t.RefLength)) and
-                (startPos2 > 0 and startPos2 < static_cast<int32_t>(t.RefLength))) {
-
-              const char* txpStart = t.Sequence();
-              const char* txpEnd = txpStart + t.RefLength;
-
-              const char* readStart1 = txpStart + startPos1;
-              auto& readBias1 = (h.fwd) ? readBiasFW : readBiasRC;
-
-              const char* readStart2 = txpStart + startPos2;
-              auto& readBias2 = (h.mateIsFwd) ? readBiasFW : readBiasRC;
-
-              int32_t fwPre = readBias1.contextBefore(!h.fwd);
-              int32_t fwPost = readBias1.contextAfter(!h.fwd);
-
-              int32_t rcPre = readBias2.contextBefore(!h.mateIsFwd);
-              int32_t rcPost = readBias2.contextAfter(!h.mateIsFwd);
-
-              bool read1RC = !h.fwd;
-              bool read2RC = !h.mateIsFwd;
-
-              if ((startPos1 >= readBias1.contextBefore(read1RC) and
-                   startPos1 + readBias1.contextAfter(read1RC) <
-                   static_cast<int32_t>(t.RefLength)) and
-                  (startPos2 >= readBias2.contextBefore(read2RC) and
-                   startPos2 + readBias2.contextAfter(read2RC) < static_cast<int32_t>(t.RefLength))) {
-
-                int32_t fwPos = (h.fwd) ? startPos1 : startPos2;
-                int32_t rcPos = (h.fwd) ? startPos2 : startPos1;
-                if (fwPos < rcPos) {
-                  leftMer.from_chars(txpStart + startPos1 -
-                                     readBias1.contextBefore(read1RC));
-                  rightMer.from_chars(txpStart + startPos2 -
-                                      readBias2.contextBefore(read2RC));
-                  if (read1RC) {
-                    leftMer.reverse_complement();
-                  } else {
-                    rightMer.reverse_complement();
-                  }
-
-                  success = readBias1.addSequence(leftMer, 1.0);
-                  success = readBias2.addSequence(rightMer, 1.0);
-                }
-              }
+        // TODO : PF_INTEGRATION
+        // NOTE : Under our new definition of orphans, alignments of read ends
+        // can be orphans even if the other read end aligns to the same reference.
+        // It only matters that the alignments were not paired.  Thus, it is possible
+        // below to have the same reference appear on the left and right side of an orphan link.
+        if (writeOrphanLinks) {
+          // We have orphans if either
+          // 1) there are *no* hits or
+          // 2) there are hits for *both* the left and right reads, but not to the
+          // same txp
+          salmonOpts.jointLog->info("{} :: {} ", salmon::mapping_utils::readName(rp.first), salmon::mapping_utils::readName(rp.second));
+          if (haveOrphans and mergeRes == pufferfish::util::MergeResult::HAD_EMPTY_INTERSECTION) {
+            auto it = jointHits.begin();
+            // NOTE : if we have orphans from both left and right (and hence HAD_EMPTY_INTERSECTION)
+            // then joinReadsAndFilter will put all of the left orphans first, followed by right orphans.
+            while (it != jointHits.end() and it->isLeftAvailable() ) {
+              orphanLinks << qidx->getRefId(it->tid) << ',' << it->leftClust->firstRefPos() << "\t";
+              ++it;
+            }
+            orphanLinks << ":";
+            while (it != jointHits.end() and it->isRightAvailable() ) {
+              orphanLinks << qidx->getRefId(it->tid) << ',' << it->rightClust->firstRefPos() << "\t";
+              ++it;
+            }
+            orphanLinks << "\n";
+          }
+        }
 
-              if (success) {
-                salmonOpts.numBiasSamples -= 1;
-                needBiasSample = false;
-              }
+        //salmonOpts.jointLog->info("num hits before alignment = {:n}", jointHits.size());
+        // If we have mappings, then process them.
+        if (!jointHits.empty()) {
+          isPaired = jointHits.front().mateStatus ==
+                     MateStatus::PAIRED_END_PAIRED;
+          if (isPaired) {
+            mapType = salmon::utils::MappingType::PAIRED_MAPPED;
+          }
+          // If we are ignoring orphans
+          if (!salmonOpts.allowOrphans) {
+            // If the mappings for the current read are not properly-paired (i.e.
+            // are orphans)
+            // then just clear the group.
+            if (!isPaired) {
+              jointAlignmentGroup.clearAlignments();
             }
           }
-          // ---- Collect bias samples ------ //
-          ++hn;
 
-          switch (h.mateStatus) {
-          case MateStatus::PAIRED_END_LEFT: {
-            h.format = salmon::utils::hitType(h.pos, h.fwd);
-          } break;
-          case MateStatus::PAIRED_END_RIGHT: {
-            // we pass in !h.fwd here because the right read
-            // will have the opposite orientation from its mate.
-            // NOTE : We will try recording what the mapped fragment
-            // actually is, not to infer what it's mate should be.
-            h.format = salmon::utils::hitType(h.pos, h.fwd);
-          } break;
-          case MateStatus::PAIRED_END_PAIRED: {
-            uint32_t end1Pos = (h.fwd) ? h.pos : h.pos + h.readLen;
-            uint32_t end2Pos =
-                (h.mateIsFwd) ? h.matePos : h.matePos + h.mateLen;
-            bool canDovetail = false;
-            h.format =
-                salmon::utils::hitType(end1Pos, h.fwd, h.readLen, end2Pos,
-                                       h.mateIsFwd, h.mateLen, canDovetail);
-          } break;
-          case MateStatus::SINGLE_END: {
-            // do nothing
-          } break;
-          default:
-            break;
+          if (tryAlign and !jointHits.empty()) {
+            // clear the aligner for this read
+            puffaligner.clear();
+            bestScorePerTranscript.clear();
+
+            // the best scores start out as invalid
+            /*
+            int32_t bestScore = invalidScore;
+            int32_t secondBestScore = invalidScore;
+            int32_t bestDecoyScore = invalidScore;
+            */
+
+            salmon::mapping_utils::MappingScoreInfo msi = {invalidScore, invalidScore, invalidScore, decoyThreshold};
+            std::vector<decltype(msi.bestScore)> scores(jointHits.size(), 0);
+            size_t idx{0};
+            bool isMultimapping = (jointHits.size() > 1);
+
+            for (auto &&jointHit : jointHits) {
+              auto hitScore = puffaligner.calculateAlignments(leftSeq, rightSeq, jointHit, hctr, isMultimapping, false);
+              bool validScore = (hitScore != invalidScore);
+              numMappingsDropped += validScore ? 0 : 1;
+              auto tid = qidx->getRefId(jointHit.tid);
+              salmon::mapping_utils::updateRefMappings(tid, hitScore, idx, transcripts, invalidScore, msi, 
+                                //bestScore, secondBestScore, bestDecoyScore,
+                                scores, bestScorePerTranscript, perm);
+              ++idx;
+            }
+
+            //bool bestHitDecoy = (msi.bestScore < msi.bestDecoyScore);
+            bool bestHitDecoy = msi.haveOnlyDecoyMappings();
+            if (msi.bestScore > invalidScore and !bestHitDecoy) {
+              salmon::mapping_utils::filterAndCollectAlignments(jointHits,
+                                         scores,
+                                         perm,
+                                         readLen,
+                                         mateLen,
+                                         false, // true for single-end false otherwise
+                                         tryAlign,
+                                         hardFilter,
+                                         salmonOpts.scoreExp,
+                                         msi,
+                                         /*
+                                         bestScore,
+                                         secondBestScore,
+                                         bestDecoyScore,
+                                         */
+                                         jointAlignments);
+            } else {
+              numDecoyFrags += bestHitDecoy ? 1 : 0;
+              ++numFragsDropped;
+              jointAlignmentGroup.clearAlignments();
+            }
+          } else if (isPaired and noDovetail) {
+            salmonOpts.jointLog->warn("HAVE NOT THOUGHT ABOUT THIS CODE-PATH YET!");
+            jointAlignments.erase(
+                            std::remove_if(jointAlignments.begin(), jointAlignments.end(),
+                                           [](const QuasiAlignment& h) -> bool {
+                                             if (h.fwd != h.mateIsFwd) {
+                                               if (h.fwd and (h.pos > h.matePos)) {
+                                                 return true;
+                                               } else if (h.mateIsFwd and (h.matePos > h.pos)) {
+                                                 return true;
+                                               }
+                                             }
+                                             return false;
+                                           }),
+                            jointAlignments.end());
           }
         }
 
-        if (writeQuasimappings) {
-          writeAlignmentsToStream(rp, formatter,
-                                  jointAlignments,
-                                  sstream,
-                                  true, // write orphans
-                                  true  // transcript ID's already decoded (taking care of short refs)
-                                  );
+        hadHits = !jointHits.empty();
+        if (dupSlot != nullptr) {
+          auto& cached = dupSlot->value;
+          cached.alignments = jointAlignments;
+          cached.mapType = mapType;
+          cached.hadHits = hadHits;
+          cached.isPaired = isPaired;
+          cached.numMappingsDropped = numMappingsDropped - mappingsDroppedBefore;
+          cached.numFragsDropped = numFragsDropped - fragsDroppedBefore;
+          cached.numDecoyFrags = numDecoyFrags - decoyFragsBefore;
+          cached.numOrphansRescued = numOrphansRescued - orphansRescuedBefore;
+          cached.numDovetails = hctr.numDovetails - dovetailsBefore;
+          cached.numMappedAtLeastAKmer =
+              hctr.numMappedAtLeastAKmer - mappedAtLeastAKmerBefore;
+          cached.peHits = hctr.peHits - peHitsBefore;
+          dupCache.fill(dupSlot, leftSeq, rightSeq);
         }
+      }
+
+      // If we have mappings, then process them.
+      if (hadHits) {
+        samplePairedBiasAndSetFormats(jointAlignments, isPaired, transcripts,
+                                      observedBiasParams, salmonOpts, eng);
       } else {
         // This read was completely unmapped.
         mapType = salmon::utils::MappingType::UNMAPPED;
       }
 
-      if (writeUnmapped and
-          mapType != salmon::utils::MappingType::PAIRED_MAPPED) {
-        // If we have no mappings --- then there's nothing to do
-        // unless we're outputting names for un-mapped reads
-        unmappedNames << rp.first.name << ' ' << salmon::utils::str(mapType)
-                      << '\n';
+      if (readOrder.enabled()) {
+        readHadHits[i] = hadHits;
+        readIsPaired[i] = isPaired;
+        readMapType[i] = mapType;
+      } else {
+        writeReadOutput(i, hadHits, isPaired, mapType);
       }
 
       validHits += jointAlignments.size();
@@ -1281,6 +1685,13 @@ void processReads(
 
     } // end for i < j->nb_filled
 
+    if (readOrder.enabled() and
+        (writeQuasimappings or writeBAM or writeUnmapped or saveMappings)) {
+      for (size_t i = 0; i < rangeSize; ++i) {
+        writeReadOutput(i, readHadHits[i], readIsPaired[i], readMapType[i]);
+      }
+    }
+
     if (writeUnmapped) {
       std::string outStr(unmappedNames.str());
       // Get rid of last newline
@@ -1301,6 +1712,15 @@ void processReads(
       sstream.clear();
     }
 
+    if (writeBAM) {
+      bamWriter->write(bamBuf);
+    }
+
+    if (saveMappings) {
+      recordEncoder.finish(recordBuf);
+      recordWriter->write(recordBuf);
+    }
+
     if (writeOrphanLinks) {
       std::string outStr(orphanLinks.str());
       // Get rid of last newline
@@ -1312,6 +1732,14 @@ void processReads(
     }
 
     prevObservedFrags = numObservedFragments;
+
+    // With the staged pipeline, the inference threads quantify the chunk,
+    // while this thread goes on to map the next one
+    if (pipeline) {
+      pipeline->submit(structureVec, rangeSize);
+      continue;
+    }
+
     AlnGroupVecRange<QuasiAlignment> hitLists = {structureVec.begin(), structureVec.begin()+rangeSize};
 
     /*
@@ -1327,7 +1755,8 @@ void processReads(
          * NOTE : test new el model in future
          * obsEffLengths,
          */
-        numAssignedFragments, eng, initialRound, burnedIn, maxZeroFrac, logCMFCache);
+        numAssignedFragments, eng, initialRound, burnedIn, maxZeroFrac, logCMFCache,
+        massAccumulator);
   }
 
   if (maxZeroFrac > 0.0) {
@@ -1341,6 +1770,8 @@ void processReads(
   mstats.numFragmentsFiltered += numFragsDropped;
   mstats.numDovetails += hctr.numDovetails;
   mstats.numDecoyFragments += numDecoyFrags;
+  mstats.numDupCacheLookups += dupCache.numLookups();
+  mstats.numDupCacheHits += dupCache.numHits();
   /*
   salmonOpts.jointLog->info("Number of orphans rescued in this thread {}",
                             numOrphansRescued);
@@ -1353,9 +1784,10 @@ void processReads(
 
 // To use the parser in the following, we get ReadGroups until none is
 // available.
-template <typename IndexT>
-void processReads(
-    single_parser* parser, ReadExperimentT& readExp, ReadLibrary& rl,
+template <typename IndexT, typename FragT>
+typename std::enable_if<!fastx_parser::is_paired_record<FragT>::value>::type
+processReads(
+    fastx_parser::FastxParser<FragT>* parser, ReadExperimentT& readExp, ReadLibrary& rl,
     AlnGroupVec<QuasiAlignment>& structureVec,
     std::atomic<uint64_t>& numObservedFragments,
     std::atomic<uint64_t>& numAssignedFragments,
@@ -1371,6 +1803,7 @@ void processReads(
     std::mutex& iomutex, bool initialRound, std::atomic<bool>& burnedIn,
     volatile bool& writeToCache,
     MappingStatistics& mstats,
+    InferencePipeline<QuasiAlignment>* pipeline,
     size_t threadID) {
 
    uint64_t count_fwd = 0, count_bwd = 0;
@@ -1388,6 +1821,7 @@ void processReads(
    double maxZeroFrac{0.0};
    // true below because in this function, we have a single-end library
    distribution_utils::LogCMFCache logCMFCache(&fragLengthDist, true);
+   TranscriptMassAccumulator massAccumulator;
 
    // Write unmapped reads
    fmt::MemoryWriter unmappedNames;
@@ -1395,10 +1829,6 @@ void processReads(
    spdlog::logger* unmappedLogger =
        (writeUnmapped) ? salmonOpts.unmappedLog.get() : nullptr;
 
-   auto& readBiasFW = observedBiasParams.seqBiasModelFW;
-   auto& readBiasRC = observedBiasParams.seqBiasModelRC;
-   Mer context;
-
 
    uint64_t firstTimestepOfRound = fmCalc.getCurrentTimestep();
    size_t minK = qidx->k();
@@ -1445,6 +1875,19 @@ void processReads(
    fmt::MemoryWriter sstream;
    auto* qmLog = salmonOpts.qmLog.get();
    bool writeQuasimappings = (qmLog != nullptr);
+   // With --mappingsFormat BAM, the records are encoded into this thread's
+   // buffer, which is handed to the BAM writer at the end of each chunk.
+   auto* bamWriter = salmonOpts.bamWriter.get();
+   bool writeBAM = (bamWriter != nullptr);
+   salmon::bam_utils::BAMRecordEncoder bamEncoder;
+   std::string bamBuf;
+   // With --saveMappings, the mappings of the fragments of each chunk are
+   // recorded here (in the order of the reads, like the other outputs), and
+   // the chunk is handed to the record writer before it's quantified.
+   auto* recordWriter = salmonOpts.mappingRecordWriter.get();
+   bool saveMappings = (recordWriter != nullptr);
+   salmon::mapping_records::ChunkEncoder recordEncoder;
+   std::string recordBuf;
 
    std::string rc1; rc1.reserve(300);
 
@@ -1459,7 +1902,40 @@ void processReads(
    //std::vector<salmon::mapping::CacheEntry> alnCache; alnCache.reserve(15);
    AlnCacheMap alnCache; alnCache.reserve(16);
 
+   ReadDuplicateCacheT dupCache(salmonOpts.dupCacheSize);
+   bool useDupCache = dupCache.enabled();
+   const std::string noMate;
+   SeedPrefetcher<IndexT> seedPrefetcher(qidx, salmonOpts.seedBatchSize);
+   // What is written about each read is written once the chunk is mapped,
+   // in the order of the reads, if they are reordered.
+   MinimizerOrder readOrder(salmonOpts.reorderReads, qidx->k());
+   std::vector<uint8_t> readHadHits;
+
+   // only used if the parser hands out views into its read arena
+   std::string readSeqBuf;
+   fastx_parser::ReadSeq ownedReadBuf;
+
    auto rg = parser->getReadGroup();
+   auto writeReadOutput = [&](size_t i, bool hadHits) {
+     if (saveMappings) {
+       recordEncoder.append(false, structureVec[i].alignments());
+     }
+     if (writeQuasimappings) {
+       writeAlignmentsToStreamSingle(salmon::mapping_utils::ownedRecord(rg[i], ownedReadBuf), formatter, structureVec[i].alignments(), sstream, false, true);
+     }
+     if (writeBAM and hadHits) {
+       salmon::mapping_utils::appendBAMRecords(
+           salmon::mapping_utils::readName(rg[i]),
+           salmon::mapping_utils::readSequence(rg[i], readSeqBuf), noMate,
+           structureVec[i].alignments(), bamEncoder, bamBuf);
+     }
+     if (writeUnmapped and !hadHits) {
+       // If we have no mappings --- then there's nothing to do
+       // unless we're outputting names for un-mapped reads
+       unmappedNames << salmon::mapping_utils::readName(rg[i]) << " u\n";
+     }
+   };
+
    while (parser->refill(rg)) {
      rangeSize = rg.size();
      if (rangeSize > structureVec.size()) {
@@ -1472,10 +1948,21 @@ void processReads(
        std::exit(1);
      }
 
+     readOrder.compute(rg, rangeSize);
+     if (readOrder.enabled()) {
+       readHadHits.resize(rangeSize);
+     }
+
      bool tryAlign{salmonOpts.validateMappings};
-     for (size_t i = 0; i < rangeSize; ++i) { // For all the read in this batch
+     // For all the reads in this batch, in the order in which they are mapped
+     for (size_t j = 0; j < rangeSize; ++j) {
+       if (seedPrefetcher.enabled() and j % seedPrefetcher.batchSize() == 0) {
+         seedPrefetcher.prefetch(rg, j, std::min(j + seedPrefetcher.batchSize(), rangeSize), readOrder);
+       }
+       size_t i = readOrder[j];
        auto& rp = rg[i];
-       readLen = rp.seq.length();
+       auto& readSeq = salmon::mapping_utils::readSequence(rp, readSeqBuf);
+       readLen = readSeq.length();
        tooShort = (readLen < minK);
        //tooManyHits = false;
        //localUpperBoundHits = 0;
@@ -1490,172 +1977,152 @@ void processReads(
        jointAlignments.clear();
        tooManyHits = false;
 
-       bool lh = tooShort ? false :
-                 memCollector(rp.seq,
-                              qc,
-                              true, // isLeft
-                              false // verbose
-                 );
-
-       memCollector.findChains(rp.seq,
-                               hits,
-                               salmonOpts.fragLenDistMax,
-                               MateStatus::SINGLE_END,
-                               true, // heuristic chaining
-                               true, // isLeft
-                               false // verbose
-                               );
-       // TODO : PF_INTEGRATION
-/*
-       if (!tryAlign) {
-         jointHits.erase( std::remove_if(jointHits.begin(), jointHits.end(),
-                                        [&transcripts](QuasiAlignment& a) {
-                                          return a.tid >= transcripts.size(); }),
-                          jointHits.end() );
-       }
-*/
-
-       // If the fragment was too short, record it
-       if (tooShort) {
-         ++shortFragStats.numTooShort;
-         shortFragStats.shortest = std::min(shortFragStats.shortest, readLen);
-       } else {
-         pufferfish::util::joinReadsAndFilterSingle(hits, jointHits,
-                                                    readLen,
-                                                    memCollector.getConsensusFraction()); 
-         hctr.peHits += jointHits.size();
+       // A read identical to one that is still in the cache takes its
+       // mappings (and its statistics) from the cache.
+       ReadDuplicateCacheT::Entry* dupSlot{nullptr};
+       bool cachedRead = useDupCache and !tooShort and
+                         dupCache.lookup(readSeq, noMate, dupSlot);
+       bool hadHits{false};
+       if (cachedRead) {
+         auto& cached = dupSlot->value;
+         jointAlignments = cached.alignments;
+         hadHits = cached.hadHits;
+         numMappingsDropped += cached.numMappingsDropped;
+         numFragsDropped += cached.numFragsDropped;
+         numDecoyFrags += cached.numDecoyFrags;
+         hctr.peHits += cached.peHits;
          if (initialRound) {
-           upperBoundHits += (jointHits.size() > 0);
+           upperBoundHits += hadHits ? 1 : 0;
+         }
+       } else {
+         size_t mappingsDroppedBefore{numMappingsDropped};
+         size_t fragsDroppedBefore{numFragsDropped};
+         size_t decoyFragsBefore{numDecoyFrags};
+         uint64_t peHitsBefore = hctr.peHits;
+
+         bool lh = tooShort ? false :
+                   memCollector(readSeq,
+                                qc,
+                                true, // isLeft
+                                false // verbose
+                   );
+
+         memCollector.findChains(readSeq,
+                                 hits,
+                                 salmonOpts.fragLenDistMax,
+                                 MateStatus::SINGLE_END,
+                                 true, // heuristic chaining
+                                 true, // isLeft
+                                 false // verbose
+                                 );
+         // TODO : PF_INTEGRATION
+  /*
+         if (!tryAlign) {
+           jointHits.erase( std::remove_if(jointHits.begin(), jointHits.end(),
+                                          [&transcripts](QuasiAlignment& a) {
+                                            return a.tid >= transcripts.size(); }),
+                            jointHits.end() );
          }
+  */
+
+         // If the fragment was too short, record it
+         if (tooShort) {
+           ++shortFragStats.numTooShort;
+           shortFragStats.shortest = std::min(shortFragStats.shortest, readLen);
+         } else {
+           pufferfish::util::joinReadsAndFilterSingle(hits, jointHits,
+                                                      readLen,
+                                                      memCollector.getConsensusFraction()); 
+           hctr.peHits += jointHits.size();
+           if (initialRound) {
+             upperBoundHits += (jointHits.size() > 0);
+           }
+
+           // If the read mapped to > maxReadOccs places, discard it
+           if (jointHits.size() > salmonOpts.maxReadOccs) {
+             jointHitGroup.clearAlignments();
+           }
 
-         // If the read mapped to > maxReadOccs places, discard it
-         if (jointHits.size() > salmonOpts.maxReadOccs) {
-           jointHitGroup.clearAlignments();
          }
 
-       }
 
+         if (tryAlign and !jointHits.empty()) {
 
-       if (tryAlign and !jointHits.empty()) {
+           // clear the aligner for this read
+           puffaligner.clear();
+           bestScorePerTranscript.clear();
 
-         // clear the aligner for this read
-         puffaligner.clear();
-         bestScorePerTranscript.clear();
+           // the best scores start out as invalid
+           /*
+           int32_t bestScore = invalidScore;
+           int32_t secondBestScore = invalidScore;
+           int32_t bestDecoyScore = invalidScore;
+           */
+           salmon::mapping_utils::MappingScoreInfo msi = {invalidScore, invalidScore, invalidScore, decoyThreshold};
 
-         // the best scores start out as invalid
-         /*
-         int32_t bestScore = invalidScore;
-         int32_t secondBestScore = invalidScore;
-         int32_t bestDecoyScore = invalidScore;
-         */
-         salmon::mapping_utils::MappingScoreInfo msi = {invalidScore, invalidScore, invalidScore, decoyThreshold};
-
-         std::vector<decltype(msi.bestScore)> scores(jointHits.size(), 0);
-         size_t idx{0};
-         bool isMultimapping = (jointHits.size() > 1);
-
-         for (auto &&jointHit : jointHits) {
-           auto hitScore = puffaligner.calculateAlignments(rp.seq, jointHit, hctr, isMultimapping, false);
-           bool validScore = (hitScore != invalidScore);
-           numMappingsDropped += validScore ? 0 : 1;
-           auto tid = qidx->getRefId(jointHit.tid);
-           salmon::mapping_utils::updateRefMappings(tid, hitScore, idx, transcripts, invalidScore, 
-                            msi,
-                            //bestScore, secondBestScore, bestDecoyScore,
-                             scores, bestScorePerTranscript, perm);
-           ++idx;
-         }
-         
-         //bool bestHitDecoy = (msi.bestScore < msi.bestDecoyScore);
-         bool bestHitDecoy = msi.haveOnlyDecoyMappings();
-         if (msi.bestScore > invalidScore and !bestHitDecoy) {
-           salmon::mapping_utils::filterAndCollectAlignments(jointHits,
-                                      scores,
-                                      perm,
-                                      readLen,
-                                      readLen,
-                                      true, // true for single-end false otherwise
-                                      tryAlign,
-                                      hardFilter,
-                                      salmonOpts.scoreExp,
-                                      msi,
-                                      /*
-                                      bestScore,
-                                      secondBestScore,
-                                      bestDecoyScore,
-                                      */
-                                      jointAlignments);
-         } else {
-           numDecoyFrags += bestHitDecoy ? 1 : 0;
-           ++numFragsDropped;
-           jointHitGroup.clearAlignments();
-         }
-       }
+           std::vector<decltype(msi.bestScore)> scores(jointHits.size(), 0);
+           size_t idx{0};
+           bool isMultimapping = (jointHits.size() > 1);
 
-       bool needBiasSample = salmonOpts.biasCorrect;
-
-       std::uniform_int_distribution<> dis(0, jointAlignments.size());
-       // Randomly select a hit from which to draw the bias sample.
-       int32_t hitSamp{dis(eng)};
-       int32_t hn{0};
-
-       // ---- Collect bias samples ------ //
-       for (auto& h : jointAlignments) {
-
-         int32_t pos = static_cast<int32_t>(h.pos);
-
-         // If bias correction is turned on, and we haven't sampled a mapping
-         // for this read yet, and we haven't collected the required number of
-         // samples overall.
-       if (needBiasSample and salmonOpts.numBiasSamples > 0 and hn == hitSamp) {
-           // the "start" position is the leftmost position if
-           // we hit the forward strand, and the leftmost
-           // position + the read length if we hit the reverse complement
-           int32_t startPos = h.fwd ? pos : pos + h.readLen;
-
-           auto& t = transcripts[h.tid];
-           if (startPos > 0 and startPos < static_cast<int32_t>(t.RefLength)) {
-             auto& readBias = (h.fwd) ? readBiasFW : readBiasRC;
-             const char* txpStart = t.Sequence();
-
-             bool success{false};
-             // If the context exists around the read, add it to the observed
-             // read start sequences.
-             if (startPos >= readBias.contextBefore(!h.fwd) and
-                 startPos + readBias.contextAfter(!h.fwd) < static_cast<int32_t>(t.RefLength)) {
-               context.from_chars(txpStart + startPos -
-                                  readBias.contextBefore(!h.fwd));
-               if (!h.fwd) {
-                 context.reverse_complement();
-               }
-               success = readBias.addSequence(context, 1.0);
-             }
-
-             if (success) {
-               salmonOpts.numBiasSamples -= 1;
-               needBiasSample = false;
-             }
+           for (auto &&jointHit : jointHits) {
+             auto hitScore = puffaligner.calculateAlignments(readSeq, jointHit, hctr, isMultimapping, false);
+             bool validScore = (hitScore != invalidScore);
+             numMappingsDropped += validScore ? 0 : 1;
+             auto tid = qidx->getRefId(jointHit.tid);
+             salmon::mapping_utils::updateRefMappings(tid, hitScore, idx, transcripts, invalidScore, 
+                              msi,
+                              //bestScore, secondBestScore, bestDecoyScore,
+                               scores, bestScorePerTranscript, perm);
+             ++idx;
+           }
+         
+           //bool bestHitDecoy = (msi.bestScore < msi.bestDecoyScore);
+           bool bestHitDecoy = msi.haveOnlyDecoyMappings();
+           if (msi.bestScore > invalidScore and !bestHitDecoy) {
+             salmon::mapping_utils::filterAndCollectAlignments(jointHits,
+                                        scores,
+                                        perm,
+                                        readLen,
+                                        readLen,
+                                        true, // true for single-end false otherwise
+                                        tryAlign,
+                                        hardFilter,
+                                        salmonOpts.scoreExp,
+                                        msi,
+                                        /*
+                                        bestScore,
+                                        secondBestScore,
+                                        bestDecoyScore,
+                                        */
+                                        jointAlignments);
+           } else {
+             numDecoyFrags += bestHitDecoy ? 1 : 0;
+             ++numFragsDropped;
+             jointHitGroup.clearAlignments();
            }
          }
-         // ---- Collect bias samples ------ //
-
-         switch (h.mateStatus) {
-         case MateStatus::SINGLE_END: {
-           h.format = salmon::utils::hitType(h.pos, h.fwd);
-         } break;
-         default:
-           break;
+
+         hadHits = !jointHits.empty();
+         if (dupSlot != nullptr) {
+           auto& cached = dupSlot->value;
+           cached.alignments = jointAlignments;
+           cached.hadHits = hadHits;
+           cached.numMappingsDropped = numMappingsDropped - mappingsDroppedBefore;
+           cached.numFragsDropped = numFragsDropped - fragsDroppedBefore;
+           cached.numDecoyFrags = numDecoyFrags - decoyFragsBefore;
+           // (the single-end hits are counted in peHits too)
+           cached.peHits = hctr.peHits - peHitsBefore;
+           dupCache.fill(dupSlot, readSeq, noMate);
          }
        }
 
-       if (writeQuasimappings) {
-         writeAlignmentsToStreamSingle(rp, formatter, jointAlignments, sstream, false, true);
-       }
+       sampleSingleBiasAndSetFormats(jointAlignments, transcripts,
+                                     observedBiasParams, salmonOpts, eng);
 
-       if (writeUnmapped and jointHits.empty()) {
-         // If we have no mappings --- then there's nothing to do
-         // unless we're outputting names for un-mapped reads
-         unmappedNames << rp.name << " u\n";
+       if (readOrder.enabled()) {
+         readHadHits[i] = hadHits;
+       } else {
+         writeReadOutput(i, hadHits);
        }
 
        validHits += jointAlignments.size();
@@ -1682,6 +2149,13 @@ void processReads(
 
      } // end for i < j->nb_filled
 
+     if (readOrder.enabled() and
+         (writeQuasimappings or writeBAM or writeUnmapped or saveMappings)) {
+       for (size_t i = 0; i < rangeSize; ++i) {
+         writeReadOutput(i, readHadHits[i]);
+       }
+     }
+
      if (writeUnmapped) {
        std::string outStr(unmappedNames.str());
        // Get rid of last newline
@@ -1702,7 +2176,23 @@ void processReads(
        sstream.clear();
      }
 
+     if (writeBAM) {
+       bamWriter->write(bamBuf);
+     }
+
+     if (saveMappings) {
+       recordEncoder.finish(recordBuf);
+       recordWriter->write(recordBuf);
+     }
+
      prevObservedFrags = numObservedFragments;
+
+     // see the paired-end processReads
+     if (pipeline) {
+       pipeline->submit(structureVec, rangeSize);
+       continue;
+     }
+
      AlnGroupVecRange<QuasiAlignment> hitLists = {structureVec.begin(), structureVec.begin()+rangeSize};
        /*boost::make_iterator_range(
          structurevec.begin(), structurevec.begin() + rangesize);*/
@@ -1713,7 +2203,8 @@ void processReads(
           * NOTE : test new el model in future
           * obsEffLengths,
           **/
-         numAssignedFragments, eng, initialRound, burnedIn, maxZeroFrac, logCMFCache);
+         numAssignedFragments, eng, initialRound, burnedIn, maxZeroFrac, logCMFCache,
+         massAccumulator);
    }
    readExp.updateShortFrags(shortFragStats);
 
@@ -1725,11 +2216,167 @@ void processReads(
    mstats.numMappingsFiltered += numMappingsDropped;
    mstats.numFragmentsFiltered += numFragsDropped;
    mstats.numDecoyFragments += numDecoyFrags;
+   mstats.numDupCacheLookups += dupCache.numLookups();
+   mstats.numDupCacheHits += dupCache.numHits();
 }
 
 /// DONE QUASI
 
 
+/**
+ * Quantify the fragments of a read library from the mappings recorded for
+ * them with --saveMappings (see MappingRecords.hpp), rather than by mapping
+ * its reads.  Each thread decodes the chunks that it reads from the file into
+ * its alignment groups, samples the sequence bias and sets the library
+ * formats of the alignments, as processReads does, and quantifies each chunk
+ * with processMiniBatch.
+ */
+void replayMappings(salmon::mapping_records::MappingRecordReader& reader,
+                    ReadExperimentT& readExp, ReadLibrary& rl,
+                    AlnGroupVec<QuasiAlignment>& structureVec,
+                    std::atomic<uint64_t>& numObservedFragments,
+                    std::atomic<uint64_t>& numAssignedFragments,
+                    std::atomic<uint64_t>& validHits,
+                    std::atomic<uint64_t>& upperBoundHits,
+                    std::vector<Transcript>& transcripts,
+                    ForgettingMassCalculator& fmCalc,
+                    ClusterForest& clusterForest,
+                    FragmentLengthDistribution& fragLengthDist,
+                    BiasParams& observedBiasParams, SalmonOpts& salmonOpts,
+                    std::mutex& iomutex, bool initialRound,
+                    std::atomic<bool>& burnedIn) {
+  // Seed with a real random value, if available
+  std::random_device rd;
+
+  // Create a random uniform distribution
+  std::default_random_engine eng(rd());
+
+  uint64_t prevObservedFrags{1};
+  double maxZeroFrac{0.0};
+  bool isSingleEnd = (rl.format().type == ReadType::SINGLE_END);
+  distribution_utils::LogCMFCache logCMFCache(&fragLengthDist, isSingleEnd);
+  TranscriptMassAccumulator massAccumulator;
+  uint64_t firstTimestepOfRound = fmCalc.getCurrentTimestep();
+  bool quiet = salmonOpts.quiet;
+
+  auto corrupt = [&salmonOpts](const std::string& msg) -> void {
+    salmonOpts.jointLog->error("The mapping record file [{}] {}.",
+                               salmonOpts.fromMappingsFile, msg);
+    salmonOpts.jointLog->flush();
+    spdlog::drop_all();
+    std::exit(1);
+  };
+
+  uint32_t numFragments{0};
+  std::string chunk;
+  bool isPaired{false};
+  while (reader.nextChunk(numFragments, chunk)) {
+    // (the chunks were written by the mapping threads, whose chunks are no
+    // larger than ours)
+    if (numFragments > structureVec.size()) {
+      corrupt(fmt::format("holds a chunk of {} fragments, but at most {} can be "
+                          "processed together", numFragments, structureVec.size()));
+    }
+
+    salmon::mapping_records::ChunkDecoder decoder(chunk);
+    for (size_t i = 0; i < numFragments; ++i) {
+      auto& jointAlignments = structureVec[i].alignments();
+      if (!decoder.next(isPaired, jointAlignments)) {
+        corrupt("is corrupt");
+      }
+      bool hadHits = !jointAlignments.empty();
+
+      if (isSingleEnd) {
+        sampleSingleBiasAndSetFormats(jointAlignments, transcripts,
+                                      observedBiasParams, salmonOpts, eng);
+      } else if (hadHits) {
+        samplePairedBiasAndSetFormats(jointAlignments, isPaired, transcripts,
+                                      observedBiasParams, salmonOpts, eng);
+      }
+
+      upperBoundHits += hadHits ? 1 : 0;
+      validHits += jointAlignments.size();
+      ++numObservedFragments;
+      if (!quiet and numObservedFragments % 500000 == 0) {
+        iomutex.lock();
+        const char RESET_COLOR[] = "\x1b[0m";
+        char green[] = "\x1b[30m";
+        green[3] = '0' + static_cast<char>(fmt::GREEN);
+        char red[] = "\x1b[30m";
+        red[3] = '0' + static_cast<char>(fmt::RED);
+        if (initialRound) {
+          fmt::print(stderr, "\033[A\r\r{}processed{} {:n} {}fragments{}\n",
+                     green, red, numObservedFragments, green, RESET_COLOR);
+          fmt::print(stderr, "hits: {:n}, hits per frag:  {}", validHits,
+                     validHits / static_cast<float>(prevObservedFrags));
+        } else {
+          fmt::print(stderr, "\r\r{}processed{} {:n} {}fragments{}", green, red,
+                     numObservedFragments, green, RESET_COLOR);
+        }
+        iomutex.unlock();
+      }
+    }
+
+    prevObservedFrags = numObservedFragments;
+    AlnGroupVecRange<QuasiAlignment> hitLists = {structureVec.begin(), structureVec.begin() + numFragments};
+    processMiniBatch<QuasiAlignment>(
+        readExp, fmCalc, firstTimestepOfRound, rl, salmonOpts, hitLists,
+        transcripts, clusterForest, fragLengthDist, observedBiasParams,
+        numAssignedFragments, eng, initialRound, burnedIn, maxZeroFrac, logCMFCache,
+        massAccumulator);
+  }
+
+  if (maxZeroFrac > 0.0) {
+    salmonOpts.jointLog->info("Thread saw mini-batch with a maximum of "
+                              "{0:.2f}\% zero probability fragments",
+                              maxZeroFrac);
+  }
+}
+
+/**
+ * An inference thread of the staged pipeline (--inferenceThreads) : quantify
+ * the chunks mapped by the mapping threads with processMiniBatch, until they
+ * are all done.  The mapping threads have already sampled the sequence bias
+ * and set the library formats of the alignments.
+ */
+void inferMappedBatches(InferencePipeline<QuasiAlignment>& pipeline,
+                        ReadExperimentT& readExp, ReadLibrary& rl,
+                        std::atomic<uint64_t>& numAssignedFragments,
+                        std::vector<Transcript>& transcripts,
+                        ForgettingMassCalculator& fmCalc,
+                        ClusterForest& clusterForest,
+                        FragmentLengthDistribution& fragLengthDist,
+                        BiasParams& observedBiasParams, SalmonOpts& salmonOpts,
+                        bool initialRound, std::atomic<bool>& burnedIn) {
+  // Seed with a real random value, if available
+  std::random_device rd;
+
+  // Create a random uniform distribution
+  std::default_random_engine eng(rd());
+
+  double maxZeroFrac{0.0};
+  bool isSingleEnd = (rl.format().type == ReadType::SINGLE_END);
+  distribution_utils::LogCMFCache logCMFCache(&fragLengthDist, isSingleEnd);
+  TranscriptMassAccumulator massAccumulator;
+  uint64_t firstTimestepOfRound = fmCalc.getCurrentTimestep();
+
+  while (auto* batch = pipeline.next()) {
+    AlnGroupVecRange<QuasiAlignment> hitLists = {batch->groups.begin(), batch->groups.begin() + batch->numGroups};
+    processMiniBatch<QuasiAlignment>(
+        readExp, fmCalc, firstTimestepOfRound, rl, salmonOpts, hitLists,
+        transcripts, clusterForest, fragLengthDist, observedBiasParams,
+        numAssignedFragments, eng, initialRound, burnedIn, maxZeroFrac, logCMFCache,
+        massAccumulator);
+    pipeline.release(batch);
+  }
+
+  if (maxZeroFrac > 0.0) {
+    salmonOpts.jointLog->info("Thread saw mini-batch with a maximum of "
+                              "{0:.2f}\% zero probability fragments",
+                              maxZeroFrac);
+  }
+}
+
 template <typename AlnT>
 void processReadLibrary(
     ReadExperimentT& readExp, ReadLibrary& rl, SalmonIndex* sidx,
@@ -1744,7 +2391,8 @@ void processReadLibrary(
     FragmentLengthDistribution& fragLengthDist, 
     SalmonOpts& salmonOpts, double coverageThresh, bool greedyChain,
     std::mutex& iomutex, size_t numThreads,
-    std::vector<AlnGroupVec<AlnT>>& structureVec, volatile bool& writeToCache, MappingStatistics& mstats) {
+    std::vector<AlnGroupVec<AlnT>>& structureVec, volatile bool& writeToCache, MappingStatistics& mstats,
+    ReadParsers& prestartedParsers) {
 
   std::vector<std::thread> threads;
 
@@ -1775,12 +2423,40 @@ void processReadLibrary(
                                                                              nullptr, parserPtrDeleter);
   std::unique_ptr<single_parser, decltype(parserPtrDeleter)> singleParserPtr(
                                                                              nullptr, parserPtrDeleter);
+  // used instead of the two above with --readArena
+  std::unique_ptr<paired_view_parser, decltype(parserPtrDeleter)> pairedViewParserPtr(
+                                                                             nullptr, parserPtrDeleter);
+  std::unique_ptr<single_view_parser, decltype(parserPtrDeleter)> singleViewParserPtr(
+                                                                             nullptr, parserPtrDeleter);
+
+  // With --inferenceThreads, the mapping threads hand the chunks they've
+  // mapped over to a separate pool of threads, which quantifies them.  The
+  // mappings recorded with --saveMappings are still replayed by threads that
+  // quantify them as they go.
+  uint32_t numInferenceThreads =
+      rl.fromMappingRecords() ? 0 : salmonOpts.numInferenceThreads;
+  std::unique_ptr<InferencePipeline<QuasiAlignment>> pipeline;
+  if (numInferenceThreads > 0) {
+    uint32_t queueDepth = salmonOpts.inferenceQueueDepth;
+    if (queueDepth == 0) {
+      queueDepth = static_cast<uint32_t>(numThreads) + 2 * numInferenceThreads;
+    }
+    pipeline.reset(new InferencePipeline<QuasiAlignment>(
+        queueDepth, structureVec.front().size()));
+    mstats.numInferenceThreads = numInferenceThreads;
+    mstats.inferenceQueueDepth = queueDepth;
+    salmonOpts.jointLog->info("Mapping with {} threads, and quantifying with {} "
+                              "threads (at most {} chunks queued between them)",
+                              numThreads, numInferenceThreads, queueDepth);
+  }
 
   /** sequence-specific and GC-fragment bias vectors --- each thread gets it's
-   * own **/
+   * own (the mapping threads sample the sequence bias, the inference threads,
+   * if any, update the rest) **/
   std::vector<BiasParams> observedBiasParams(
-      numThreads, BiasParams(salmonOpts.numConditionalGCBins,
-                             salmonOpts.numFragGCBins, false));
+      numThreads + numInferenceThreads,
+      BiasParams(salmonOpts.numConditionalGCBins, salmonOpts.numFragGCBins,
+                 false));
 
   /**
    * NOTE : test new el model in future
@@ -1791,7 +2467,11 @@ void processReadLibrary(
   // generic lambda.
   auto processFunctor = [&](size_t i, auto* parserPtr, auto* index) {
     if (salmonOpts.qmFileName != "" and i == 0) {
-      writeSAMHeader(*index, salmonOpts.qmLog);
+      if (salmonOpts.writeBAMMappings) {
+        salmonOpts.bamWriter->writeHeader(bamMappingsHeader(transcripts));
+      } else {
+        writeSAMHeader(*index, salmonOpts.qmLog);
+      }
     }
     auto threadFun = [&, i, parserPtr, index]() -> void {
       processReads(parserPtr, readExp, rl, structureVec[i],
@@ -1799,43 +2479,50 @@ void processReadLibrary(
                         upperBoundHits, index, transcripts,
                         fmCalc, clusterForest, fragLengthDist, observedBiasParams[i],
                         salmonOpts, coverageThresh, iomutex, initialRound,
-                        burnedIn, writeToCache, mstats, i);
+                        burnedIn, writeToCache, mstats, pipeline.get(), i);
     };
     threads.emplace_back(threadFun);
   };
 
-  // If the read library is paired-end
-  // ------ Paired-end --------
+  salmon::memory_utils::DTLBMissCounter tlbCounter;
+  bool countingTLBMisses{false};
+  if (salmonOpts.countTLBMisses) {
+    countingTLBMisses = tlbCounter.start();
+    if (!countingTLBMisses) {
+      salmonOpts.jointLog->warn("Could not open the dTLB miss counter (perf_event_open); "
+                                "the misses will not be reported.");
+    }
+  }
+
   bool isPairedEnd = rl.format().type == ReadType::PAIRED_END;
   bool isSingleEnd = rl.format().type == ReadType::SINGLE_END;
 
-  if (isPairedEnd) {
-
-    if (rl.mates1().size() != rl.mates2().size()) {
-      salmonOpts.jointLog->error("The number of provided files for "
-                                 "-1 and -2 must be the same!");
-      std::exit(1);
-    }
+  // With --saveMappings, the file starts with what it needs to be replayed
+  // against this index and library
+  if (salmonOpts.mappingRecordWriter) {
+    salmon::mapping_records::FileHeader recordHeader;
+    recordHeader.numTranscripts = transcripts.size();
+    recordHeader.namesHash = salmon::mapping_records::transcriptNamesHash(transcripts);
+    recordHeader.libFormatID = rl.format().formatID();
+    recordHeader.autoDetect = rl.autoDetect();
+    salmonOpts.mappingRecordWriter->writeHeader(
+        salmon::mapping_records::encodeHeader(recordHeader));
+  }
 
-    size_t numFiles = rl.mates1().size() + rl.mates2().size();
-    uint32_t numParsingThreads{1};
-    // HACK!
-    if (rl.mates1().size() > 1 and numThreads > 8) {
-      numParsingThreads = 2;
-    }
-    pairedParserPtr.reset(new paired_parser(rl.mates1(), rl.mates2(),
-                                            numThreads, numParsingThreads,
-                                            miniBatchSize));
-    pairedParserPtr->start();
-  } else if (isSingleEnd) {
-    uint32_t numParsingThreads{1};
-    // HACK!
-    if (rl.unmated().size() > 1 and numThreads > 8) {
-      numParsingThreads = 2;
-    }
-    singleParserPtr.reset(new single_parser(rl.unmated(), numThreads,
-                                            numParsingThreads, miniBatchSize));
-    singleParserPtr->start();
+  // use the parser that was started while the index loaded, if there is one
+  // (there are no reads to parse if the mappings are read from a mapping
+  // record file)
+  ReadParsers parsers;
+  ReadParsers& libParsers = prestartedParsers.pending ? prestartedParsers : parsers;
+  if (!libParsers.pending and !rl.fromMappingRecords()) {
+    startReadParsers(rl, salmonOpts, numThreads, libParsers);
+  }
+  libParsers.pending = false;
+  pairedParserPtr.reset(libParsers.paired.release());
+  singleParserPtr.reset(libParsers.single.release());
+  pairedViewParserPtr.reset(libParsers.pairedView.release());
+  singleViewParserPtr.reset(libParsers.singleView.release());
+  if (isSingleEnd) {
     fragLengthDist.cacheCMF();
   }
 
@@ -1853,24 +2540,85 @@ void processReadLibrary(
     break;
   case SalmonIndexType::PUFF: {
     bool isSparse = sidx->isSparse();
+    // dispatch on the type of parser that was started above
+    auto processWithIndex = [&](size_t i, auto* index) {
+      if (isPairedEnd) {
+        if (pairedViewParserPtr) {processFunctor(i, pairedViewParserPtr.get(), index);}
+        else {processFunctor(i, pairedParserPtr.get(), index);}
+      } else if (isSingleEnd) {
+        if (singleViewParserPtr) {processFunctor(i, singleViewParserPtr.get(), index);}
+        else {processFunctor(i, singleParserPtr.get(), index);}
+      }
+    };
+    if (mstats.secondsToMapping == 0.0) {
+      mstats.secondsToMapping = std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - mstats.startupBegin).count();
+    }
     for (size_t i = 0; i < numThreads; ++i) {
       // NOTE: we *must* capture i by value here, b/c it can (sometimes, does)
       // change value before the lambda below is evaluated --- crazy!
-      if (isSparse) {
-        if (isPairedEnd) {processFunctor(i, pairedParserPtr.get(), sidx->puffSparseIndex());}
-        else if (isSingleEnd) {processFunctor(i, singleParserPtr.get(), sidx->puffSparseIndex());}
+      if (rl.fromMappingRecords()) {
+        threads.emplace_back([&, i]() -> void {
+          replayMappings(*salmonOpts.mappingRecordReader, readExp, rl,
+                         structureVec[i], numObservedFragments,
+                         numAssignedFragments, numValidHits, upperBoundHits,
+                         transcripts, fmCalc, clusterForest, fragLengthDist,
+                         observedBiasParams[i], salmonOpts, iomutex,
+                         initialRound, burnedIn);
+        });
+      } else if (isSparse) {
+        processWithIndex(i, sidx->puffSparseIndex());
       } else { // dense index
-        if (isPairedEnd) {processFunctor(i, pairedParserPtr.get(), sidx->puffIndex());}
-        else if (isSingleEnd) {processFunctor(i, singleParserPtr.get(), sidx->puffIndex());}
+        processWithIndex(i, sidx->puffIndex());
       }
     }
   }
     break;
   } // end switch
 
+  std::vector<std::thread> inferenceThreads;
+  for (uint32_t j = 0; j < numInferenceThreads; ++j) {
+    inferenceThreads.emplace_back([&, j]() -> void {
+      inferMappedBatches(*pipeline, readExp, rl, numAssignedFragments,
+                         transcripts, fmCalc, clusterForest, fragLengthDist,
+                         observedBiasParams[numThreads + j], salmonOpts,
+                         initialRound, burnedIn);
+    });
+  }
+
   for (auto& t : threads) {
     t.join();
   }
+  if (pipeline) {
+    pipeline->finish(numInferenceThreads);
+    for (auto& t : inferenceThreads) {
+      t.join();
+    }
+    mstats.numInferenceBatches += pipeline->numBatches();
+    mstats.mapperQueueWaitNs += pipeline->mapperWaitNs();
+    mstats.inferenceQueueWaitNs += pipeline->inferenceWaitNs();
+  }
+  if (rl.fromMappingRecords() and !salmonOpts.mappingRecordReader->good()) {
+    salmonOpts.jointLog->error("Could not read the mapping record file [{}]: {}.",
+                               salmonOpts.fromMappingsFile,
+                               salmonOpts.mappingRecordReader->error());
+    salmonOpts.jointLog->flush();
+    spdlog::drop_all();
+    std::exit(1);
+  }
+  if (countingTLBMisses) {
+    mstats.dtlbMisses += tlbCounter.stop();
+    mstats.dtlbMissesCounted = true;
+  }
+
+  fastx_parser::ParserStats parserStats;
+  if (pairedParserPtr) { parserStats = pairedParserPtr->stats(); }
+  else if (singleParserPtr) { parserStats = singleParserPtr->stats(); }
+  else if (pairedViewParserPtr) { parserStats = pairedViewParserPtr->stats(); }
+  else if (singleViewParserPtr) { parserStats = singleViewParserPtr->stats(); }
+  mstats.mapperStarvedNs += parserStats.consumerStarvedNs;
+  mstats.parserStarvedNs += parserStats.parserStarvedNs;
+  mstats.mapperParsingNs += parserStats.consumerParsingNs;
 
   // At this point, if we were using decoy transcripts, we don't need them anymore and can get
   // rid of them.
@@ -1979,7 +2727,8 @@ template <typename AlnT>
 void quantifyLibrary(ReadExperimentT& experiment, bool greedyChain,
                      SalmonOpts& salmonOpts,
                      MappingStatistics& mstats,
-                     double coverageThresh, uint32_t numQuantThreads) {
+                     double coverageThresh, uint32_t numQuantThreads,
+                     ReadParsers& prestartedParsers) {
 
   bool burnedIn = (salmonOpts.numBurninFrags == 0);
   uint64_t numRequiredFragments = salmonOpts.numRequiredFragments;
@@ -2068,7 +2817,8 @@ void quantifyLibrary(ReadExperimentT& experiment, bool greedyChain,
                                upperBoundHits, initialRound, burnedIn, fmCalc,
                                fragLengthDist, salmonOpts,
                                coverageThresh, greedyChain, ioMutex,
-                               numQuantThreads, groupVec, writeToCache, mstats);
+                               numQuantThreads, groupVec, writeToCache, mstats,
+                               prestartedParsers);
 
       numAssignedFragments = totalAssignedFragments - prevNumAssignedFragments;
       prevNumAssignedFragments = totalAssignedFragments;
@@ -2150,6 +2900,10 @@ void quantifyLibrary(ReadExperimentT& experiment, bool greedyChain,
   if (!salmonOpts.allowDovetail) {
     salmonOpts.jointLog->info("Number of fragments discarded because they have only dovetail (discordant) mappings to valid targets : {:n}", mstats.numDovetails.load());
   }
+  salmonOpts.jointLog->info("Time mapping threads waited for reads : {:.2f}s (spent parsing : {:.2f}s); "
+                            "time parsing threads waited on mapping threads : {:.2f}s",
+                            mstats.mapperStarvedNs.load() / 1e9, mstats.mapperParsingNs.load() / 1e9,
+                            mstats.parserStarvedNs.load() / 1e9);
 
   // If we didn't achieve burnin, then at least compute effective
   // lengths and mention this to the user.
@@ -2186,6 +2940,65 @@ void quantifyLibrary(ReadExperimentT& experiment, bool greedyChain,
   jointLog->info("finished quantifyLibrary()");
 }
 
+/**
+ * The read library quantified with --fromMappings, whose mappings are read
+ * from the mapping record file.  Its type is the one given with -l, which
+ * must be of the kind (single-end or paired-end) of the library whose
+ * mappings were recorded; if it's to be detected (-l A), the detection starts
+ * from the default type of that kind, as it does for read files.
+ */
+std::vector<ReadLibrary> mappingRecordLibraries(SalmonOpts& sopt,
+                                                boost::program_options::variables_map& vm) {
+  auto jointLog = sopt.jointLog;
+  auto exitWithError = [&jointLog](const std::string& msg) -> void {
+    jointLog->critical(msg);
+    jointLog->flush();
+    spdlog::drop_all();
+    std::exit(1);
+  };
+
+  if (vm.count("unmatedReads") or vm.count("mates1") or vm.count("mates2")) {
+    exitWithError("The reads of a library quantified with --fromMappings were mapped "
+                  "when its mappings were recorded; no read files (-r, -1 or -2) "
+                  "can be given.");
+  }
+
+  auto& header = sopt.mappingRecordReader->header();
+  auto recordedFormat = LibraryFormat::formatFromID(header.libFormatID);
+  std::string libTypeStr = vm["libType"].as<std::string>();
+  bool autoLibType = (libTypeStr.length() == 1 and
+                      (libTypeStr.front() == 'a' or libTypeStr.front() == 'A'));
+  LibraryFormat libFmt =
+      (recordedFormat.type == ReadType::PAIRED_END)
+          ? LibraryFormat(ReadType::PAIRED_END, ReadOrientation::TOWARD,
+                          ReadStrandedness::U)
+          : LibraryFormat(ReadType::SINGLE_END, ReadOrientation::NONE,
+                          ReadStrandedness::U);
+  if (!autoLibType) {
+    libFmt = salmon::utils::parseLibraryFormatStringNew(libTypeStr);
+  }
+  if (libFmt.type != recordedFormat.type) {
+    exitWithError(fmt::format(
+        "The mappings in [{}] are those of a {} library, but the library type "
+        "given (-l {}) is that of a {} library.",
+        sopt.fromMappingsFile,
+        (recordedFormat.type == ReadType::PAIRED_END) ? "paired-end" : "single-end",
+        libTypeStr,
+        (libFmt.type == ReadType::PAIRED_END) ? "paired-end" : "single-end"));
+  }
+
+  std::vector<ReadLibrary> libs;
+  libs.emplace_back(libFmt);
+  libs.back().setMappingRecordFile(sopt.fromMappingsFile);
+  if (autoLibType) {
+    libs.back().enableAutodetect();
+  }
+  jointLog->info("Quantifying the mappings recorded in {}.", sopt.fromMappingsFile);
+  return libs;
+}
+
+int salmonQuantBatch(int argc, const char* argv[]);
+
 int salmonQuantify(int argc, const char* argv[]) {
   using std::cerr;
   using std::vector;
@@ -2193,6 +3006,15 @@ int salmonQuantify(int argc, const char* argv[]) {
   namespace bfs = boost::filesystem;
   namespace po = boost::program_options;
 
+  // `salmon quant --batch <manifest>` quantifies many samples (see
+  // SalmonQuantBatch.cpp).
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--batch") == 0 or
+        std::strncmp(argv[i], "--batch=", 8) == 0) {
+      return salmonQuantBatch(argc, argv);
+    }
+  }
+
   int32_t numBiasSamples{0};
 
   SalmonOpts sopt;
@@ -2278,7 +3100,9 @@ transcript abundance from RNA-seq reads
 
     // ==== Library format processing ===
     vector<ReadLibrary> readLibraries =
-      salmon::utils::extractReadLibraries(orderedOptions);
+      sopt.fromMappingsFile.empty()
+          ? salmon::utils::extractReadLibraries(orderedOptions)
+          : mappingRecordLibraries(sopt, vm);
 
     if (readLibraries.size() == 0) {
       jointLog->error(
@@ -2289,6 +3113,13 @@ transcript abundance from RNA-seq reads
           "option (-l) *comes before* the read libraries.");
       std::exit(1);
     }
+    // The mappings of only one library can be recorded in a file
+    if (!sopt.saveMappingsFile.empty() and readLibraries.size() > 1) {
+      jointLog->error("The mappings of only one read library can be recorded "
+                      "with --saveMappings, but {} were given.",
+                      readLibraries.size());
+      std::exit(1);
+    }
     // ==== END: Library format processing ===
 
     SalmonIndexVersionInfo versionInfo;
@@ -2297,11 +3128,45 @@ transcript abundance from RNA-seq reads
     auto idxType = versionInfo.indexType();
 
     MappingStatistics mstats;
+    // Start parsing (and decompressing) the first read library before
+    // loading the index, so that the first chunks of reads are ready when
+    // the index is; the mapping threads then start on them right away.
+    auto startupBegin = std::chrono::steady_clock::now();
+    ReadParsers prestartedParsers;
+    readLibraries.front().checkValid();
+    if (!readLibraries.front().fromMappingRecords()) {
+      startReadParsers(readLibraries.front(), sopt, sopt.numThreads, prestartedParsers);
+      prestartedParsers.pending = true;
+    }
+    auto parsersStarted = std::chrono::steady_clock::now();
     ReadExperimentT experiment(readLibraries, indexDirectory, sopt);
+    mstats.startupBegin = startupBegin;
+    mstats.parserStartSeconds =
+        std::chrono::duration<double>(parsersStarted - startupBegin).count();
+    mstats.indexLoadSeconds = experiment.indexLoadSeconds();
+    mstats.transcriptLoadSeconds = experiment.transcriptLoadSeconds();
+
+    // The recorded mappings can only be replayed against the targets they
+    // were mapped to
+    if (sopt.mappingRecordReader) {
+      auto& recordHeader = sopt.mappingRecordReader->header();
+      auto& txps = experiment.transcripts();
+      if (recordHeader.numTranscripts != txps.size() or
+          recordHeader.namesHash != salmon::mapping_records::transcriptNamesHash(txps)) {
+        jointLog->error("The mappings in [{}] were recorded against an index with "
+                        "other targets ({} of them) than this one ({}); they can only "
+                        "be quantified with the index with which they were recorded.",
+                        sopt.fromMappingsFile, recordHeader.numTranscripts, txps.size());
+        jointLog->flush();
+        spdlog::drop_all();
+        std::exit(1);
+      }
+    }
 
     // This will be the class in charge of maintaining our
     // rich equivalence classes
     experiment.equivalenceClassBuilder().setMaxResizeThreads(sopt.maxHashResizeThreads);
+    experiment.equivalenceClassBuilder().setThreadLocal(sopt.threadLocalEqClasses);
     experiment.equivalenceClassBuilder().start();
 
     auto indexType = experiment.getIndex()->indexType();
@@ -2336,7 +3201,8 @@ transcript abundance from RNA-seq reads
         sopt.allowOrphans = !sopt.discardOrphansQuasi;
         sopt.useQuasi = true;
         quantifyLibrary<QuasiAlignment>(experiment, greedyChain,
-                                        sopt, mstats, sopt.coverageThresh, sopt.numThreads);
+                                        sopt, mstats, sopt.coverageThresh, sopt.numThreads,
+                                        prestartedParsers);
       } break;
       }
     } catch (const InsufficientAssignedFragments& iaf) {
@@ -2542,7 +3408,14 @@ transcript abundance from RNA-seq reads
     }
 
     // if we wrote quasimappings, flush that buffer
-    if (sopt.qmFileName != "") {
+    if (sopt.bamWriter) {
+      if (!sopt.bamWriter->close()) {
+        jointLog->error("Writing the mappings to {} failed.", sopt.qmFileName);
+        jointLog->flush();
+        spdlog::drop_all();
+        std::exit(1);
+      }
+    } else if (sopt.qmFileName != "") {
       sopt.qmLog->flush();
       // if we wrote to a buffer other than stdout, close
       // the file
@@ -2551,6 +3424,13 @@ transcript abundance from RNA-seq reads
       }
     }
 
+    if (sopt.mappingRecordWriter and !sopt.mappingRecordWriter->close()) {
+      jointLog->error("Recording the mappings in {} failed.", sopt.saveMappingsFile);
+      jointLog->flush();
+      spdlog::drop_all();
+      std::exit(1);
+    }
+
     sopt.runStopTime = salmon::utils::getCurrentTimeAsString();
 
     // Write meta-information about the run
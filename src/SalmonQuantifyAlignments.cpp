@@ -59,6 +59,7 @@ extern "C" {
 #include "SalmonUtils.hpp"
 #include "Sampler.hpp"
 #include "TextBootstrapWriter.hpp"
+#include "TranscriptMassAccumulator.hpp"
 #include "TranscriptCluster.hpp"
 #include "spdlog/spdlog.h"
 #include "pufferfish/Util.hpp"
@@ -194,6 +195,10 @@ void processMiniBatch(AlignmentLibraryT<FragT>& alnLib,
 
   double startingCumulativeMass =
       fmCalc.cumulativeLogMassAt(firstTimestepOfRound);
+  // With --batchMassUpdates, the mass of each mini-batch is summed here,
+  // and added to the transcripts once it's done
+  bool batchMassUpdates{salmonOpts.batchMassUpdates};
+  TranscriptMassAccumulator massAccumulator;
   LibraryFormat expectedLibraryFormat = alnLib.format();
   uint32_t numBurninFrags{salmonOpts.numBurninFrags};
   bool noLengthCorrection{salmonOpts.noLengthCorrection};
@@ -544,8 +549,12 @@ void processMiniBatch(AlignmentLibraryT<FragT>& alnLib,
             auto transcriptID = aln->transcriptID();
             auto& transcript = refs[transcriptID];
 
-            double newMass = logForgettingMass + aln->logProb;
-            transcript.addMass(newMass);
+            if (batchMassUpdates) {
+              massAccumulator.add(transcriptID, aln->logProb);
+            } else {
+              double newMass = logForgettingMass + aln->logProb;
+              transcript.addMass(newMass);
+            }
             transcript.setLastTimestepUpdated(currentMinibatchTimestep);
 
             // ---- Collect seq-specific bias samples ------ //
@@ -894,6 +903,10 @@ void processMiniBatch(AlignmentLibraryT<FragT>& alnLib,
         */
       } // end timer
 
+      if (batchMassUpdates) {
+        massAccumulator.flush(refs, logForgettingMass);
+      }
+
       // If we're not keeping around a cache, then
       // reclaim the memory for these fragments and alignments
       // and delete the mini batch.
@@ -1273,6 +1286,7 @@ bool processSample(AlignmentLibraryT<ReadT>& alnLib, size_t requiredObservations
   auto& jointLog = sopt.jointLog;
   // EQCLASS
   alnLib.equivalenceClassBuilder().setMaxResizeThreads(sopt.maxHashResizeThreads);
+  alnLib.equivalenceClassBuilder().setThreadLocal(sopt.threadLocalEqClasses);
   alnLib.equivalenceClassBuilder().start();
 
   bool burnedIn = false;
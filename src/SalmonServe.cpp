@@ -0,0 +1,420 @@
+/**
+>HEADER
+    Copyright (c) 2013, 2014, 2015, 2016 Rob Patro rob.patro@cs.stonybrook.edu
+
+    This file is part of Salmon.
+
+    Salmon is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Salmon is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Salmon.  If not, see <http://www.gnu.org/licenses/>.
+<HEADER
+**/
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+// logger includes
+#include "spdlog/spdlog.h"
+
+#include "QuantJobUtils.hpp"
+#include "SalmonConfig.hpp"
+#include "SalmonIndex.hpp"
+
+/**
+ * salmon serve
+ *
+ * Loads an index once, and then runs `salmon quant` jobs against it as they
+ * arrive on a UNIX socket.  Each job runs in a process forked from the
+ * server, so that it shares the server's copy of the loaded index (the
+ * pages aren't copied, as the jobs only read them), while the rest of its
+ * state, its threads, and its failures, are its own; a job runs exactly as
+ * `salmon quant` would with the same arguments (its output is the same).
+ *
+ * Protocol: a client connects and sends the number of fields of its request
+ * and then the fields: its working directory, and then the arguments to
+ * `salmon quant` (without `-i`, which defaults to the served index).  The
+ * number of fields, and the length of each field (which precedes its
+ * bytes), are sent as 32-bit unsigned integers in network byte order, so
+ * that any argument, including an empty one, can be passed.  The whole
+ * request has to arrive within requestTimeoutMs.  The job's log (its stdout
+ * and stderr) is sent back on the connection, followed by a last line
+ * "salmon-serve-status <N>", where <N> is the exit status of the job, after
+ * which the server closes the connection.  See
+ * scripts/salmon_serve_client.py.
+ */
+
+namespace {
+
+// the prefix of the last line sent to the client of a job
+constexpr const char* statusPrefix = "salmon-serve-status ";
+// a job request larger than this is rejected
+constexpr size_t maxRequestLen = 1 << 20;
+// a client has this long to send its whole request; the requests are read
+// by the server itself, so a client that connects and stalls mustn't hold up
+// the others for long.
+constexpr int requestTimeoutMs = 10000;
+// how often the server checks for the end of a job (and for a request to
+// stop) while it runs as many jobs as it may
+constexpr useconds_t jobPollUs = 100000;
+
+std::atomic<bool> stopRequested{false};
+
+void requestStop(int) { stopRequested = true; }
+
+struct ServeOptions {
+  std::string indexDirectory;
+  std::string socketPath;
+  uint32_t maxJobs{1};
+  uint32_t prefetchThreads{0};
+};
+
+bool writeAll(int fd, const std::string& s) {
+  size_t done{0};
+  while (done < s.size()) {
+    auto n = ::write(fd, s.data() + done, s.size() - done);
+    if (n < 0 and errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    done += n;
+  }
+  return true;
+}
+
+// Read exactly len bytes into buf, before the deadline.
+bool readFully(int fd, char* buf, size_t len,
+               std::chrono::steady_clock::time_point deadline) {
+  size_t done{0};
+  while (done < len) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now())
+                    .count();
+    if (left <= 0 or stopRequested) {
+      return false;
+    }
+    pollfd pfd{fd, POLLIN, 0};
+    int ready = ::poll(&pfd, 1, static_cast<int>(left));
+    if (ready < 0 and errno == EINTR) {
+      continue;
+    }
+    if (ready <= 0) {
+      return false;
+    }
+    auto n = ::read(fd, buf + done, len - done);
+    if (n < 0 and errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    done += n;
+  }
+  return true;
+}
+
+bool readLength(int fd, uint32_t& len,
+                std::chrono::steady_clock::time_point deadline) {
+  unsigned char b[4];
+  if (!readFully(fd, reinterpret_cast<char*>(b), sizeof(b), deadline)) {
+    return false;
+  }
+  len = (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) |
+        (uint32_t(b[2]) << 8) | uint32_t(b[3]);
+  return true;
+}
+
+// Read a job from the client: its working directory, and then the arguments
+// to quant.  Returns false if the request is malformed, too large, or
+// incomplete when it times out.
+bool readJob(int fd, std::string& cwd, std::vector<std::string>& args) {
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::milliseconds(requestTimeoutMs);
+  uint32_t numFields{0};
+  if (!readLength(fd, numFields, deadline) or numFields == 0 or
+      numFields > maxRequestLen / sizeof(uint32_t)) {
+    return false;
+  }
+  std::vector<std::string> fields(numFields);
+  size_t total{0};
+  for (auto& f : fields) {
+    uint32_t len{0};
+    if (!readLength(fd, len, deadline)) {
+      return false;
+    }
+    total += sizeof(uint32_t) + len;
+    if (total > maxRequestLen) {
+      return false;
+    }
+    f.resize(len);
+    if (len > 0 and !readFully(fd, &f[0], len, deadline)) {
+      return false;
+    }
+  }
+  if (fields.front().empty()) {
+    return false;
+  }
+  cwd = fields.front();
+  args.assign(fields.begin() + 1, fields.end());
+  return true;
+}
+
+int listenOn(const std::string& path, std::shared_ptr<spdlog::logger>& log) {
+  sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  if (path.size() >= sizeof(addr.sun_path)) {
+    log->critical("The socket path {} is too long", path);
+    return -1;
+  }
+  addr.sun_family = AF_UNIX;
+  std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+  // a socket left behind by a server that didn't stop cleanly
+  struct stat st;
+  if (::lstat(path.c_str(), &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      log->critical("{} exists, and is not a socket", path);
+      return -1;
+    }
+    ::unlink(path.c_str());
+  }
+
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 or
+      ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 or
+      ::listen(fd, 64) != 0) {
+    log->critical("Could not listen on {} : {}", path, std::strerror(errno));
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    return -1;
+  }
+  return fd;
+}
+
+} // namespace
+
+int salmonServe(int argc, const char* argv[]) {
+  using std::string;
+  namespace po = boost::program_options;
+
+  ServeOptions serveOpts;
+  po::options_description generic("\n"
+                                  "basic options");
+  generic.add_options()("version,v", "print version string")
+    ("help,h", "produce help message")
+    ("index,i", po::value<string>(&serveOpts.indexDirectory)->required(),
+     "salmon index to load and serve")
+    ("socket,s", po::value<string>(&serveOpts.socketPath)->required(),
+     "Path of the UNIX socket on which to accept quant jobs.")
+    ("maxJobs,j",
+     po::value<uint32_t>(&serveOpts.maxJobs)->default_value(1),
+     "The maximum number of jobs to run at once; further jobs wait for "
+     "one of these to finish.  Each job uses the number of threads given "
+     "by its own -p.")
+    ("prefetchThreads",
+     po::value<uint32_t>(&serveOpts.prefetchThreads)->default_value(0),
+     "If not 0, read the index files into the page cache with this many "
+     "threads before loading them (see quant --prefetchIndex).");
+
+  po::options_description all("salmon serve options");
+  all.add(generic);
+
+  po::variables_map vm;
+  try {
+    auto orderedOptions =
+        po::command_line_parser(argc, argv).options(all).run();
+
+    po::store(orderedOptions, vm);
+
+    if (vm.count("help")) {
+      auto hstring = R"(
+serve
+==========
+Load an index once, and run quant jobs sent to a
+UNIX socket against it (see scripts/salmon_serve_client.py).
+)";
+      std::cerr << hstring << std::endl;
+      std::cerr << all << std::endl;
+      std::exit(0);
+    }
+
+    po::notify(vm);
+    if (serveOpts.maxJobs == 0) {
+      serveOpts.maxJobs = 1;
+    }
+
+    // The logger is synchronous: the server forks its jobs, and the
+    // thread of an asynchronous logger wouldn't exist in them.
+    auto consoleSink =
+        std::make_shared<spdlog::sinks::ansicolor_stderr_sink_mt>();
+    auto log = spdlog::create("serveLog", {consoleSink});
+
+    // The jobs run in the directories of their clients, so the index is
+    // named (both to load it, and in the --index given to the jobs) by its
+    // absolute path.
+    boost::system::error_code ec;
+    auto indexPath =
+        boost::filesystem::canonical(serveOpts.indexDirectory, ec);
+    if (ec) {
+      log->critical("could not find the index {} : {}",
+                    serveOpts.indexDirectory, ec.message());
+      std::exit(1);
+    }
+    serveOpts.indexDirectory = indexPath.string();
+
+    auto index = salmon::job_utils::loadResidentIndex(
+        serveOpts.indexDirectory, serveOpts.prefetchThreads, log);
+
+    int listenFd = listenOn(serveOpts.socketPath, log);
+    if (listenFd < 0) {
+      std::exit(1);
+    }
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+    std::signal(SIGPIPE, SIG_IGN);
+    log->info("serving {} on {} (at most {} job(s) at once)",
+              serveOpts.indexDirectory, serveOpts.socketPath,
+              serveOpts.maxJobs);
+
+    // the running jobs, and the connections of their clients
+    std::map<pid_t, int> jobs;
+    uint64_t numJobs{0};
+
+    auto reapJobs = [&jobs, &log](bool block) -> void {
+      int status{0};
+      pid_t pid;
+      while (!jobs.empty() and
+             (pid = ::waitpid(-1, &status, block ? 0 : WNOHANG)) > 0) {
+        auto it = jobs.find(pid);
+        if (it == jobs.end()) {
+          continue;
+        }
+        int code = salmon::job_utils::jobExitCode(status);
+        writeAll(it->second, string(statusPrefix) + std::to_string(code) + "\n");
+        ::close(it->second);
+        log->info("job {} finished with status {}", pid, code);
+        jobs.erase(it);
+        block = false;
+      }
+    };
+
+    while (!stopRequested) {
+      reapJobs(false);
+      // don't take new jobs while at the limit; they wait in the backlog.
+      // (The wait is a poll, rather than a blocking waitpid, which the stop
+      // signals wouldn't interrupt.)
+      if (jobs.size() >= serveOpts.maxJobs) {
+        ::usleep(jobPollUs);
+        continue;
+      }
+      pollfd pfd{listenFd, POLLIN, 0};
+      int ready = ::poll(&pfd, 1, 200);
+      if (ready <= 0 or !(pfd.revents & POLLIN)) {
+        continue;
+      }
+      int conn = ::accept(listenFd, nullptr, nullptr);
+      if (conn < 0) {
+        continue;
+      }
+
+      string cwd;
+      std::vector<string> args;
+      if (!readJob(conn, cwd, args)) {
+        writeAll(conn, "salmon serve : malformed job request\n" +
+                           string(statusPrefix) + "1\n");
+        ::close(conn);
+        continue;
+      }
+      if (salmon::job_utils::isAlignmentModeJob(args)) {
+        writeAll(conn, "salmon serve : only mapping-based quant jobs can be "
+                       "served\n" + string(statusPrefix) + "1\n");
+        ::close(conn);
+        continue;
+      }
+
+      bool hasIndex{false};
+      try {
+        hasIndex = salmon::job_utils::quantOptionNames(args).count("index") > 0;
+      } catch (po::error& e) {
+        writeAll(conn, "salmon serve : " + string(e.what()) + "\n" +
+                           string(statusPrefix) + "1\n");
+        ::close(conn);
+        continue;
+      }
+      if (!hasIndex) {
+        args.insert(args.begin(), {"--index", serveOpts.indexDirectory});
+      }
+      std::vector<int> closeFds{listenFd};
+      for (auto& j : jobs) {
+        closeFds.push_back(j.second);
+      }
+      pid_t pid = salmon::job_utils::startQuantJob(args, cwd, conn, closeFds);
+      if (pid < 0) {
+        log->error("could not start a job : {}", std::strerror(errno));
+        writeAll(conn, "salmon serve : could not start the job\n" +
+                           string(statusPrefix) + "1\n");
+        ::close(conn);
+        continue;
+      }
+      ++numJobs;
+      jobs[pid] = conn;
+      string cmd;
+      for (auto& a : args) {
+        cmd += " " + a;
+      }
+      log->info("job {} (#{}) started in {} : quant{}", pid, numJobs, cwd, cmd);
+    }
+
+    log->info("stopping; waiting for {} running job(s)", jobs.size());
+    while (!jobs.empty()) {
+      reapJobs(true);
+    }
+    ::close(listenFd);
+    ::unlink(serveOpts.socketPath.c_str());
+    log->info("served {} job(s)", numJobs);
+  } catch (po::error& e) {
+    std::cerr << "Exception : [" << e.what() << "]. Exiting.\n";
+    std::exit(1);
+  } catch (const spdlog::spdlog_ex& ex) {
+    std::cerr << "logger failed with : [" << ex.what() << "]. Exiting.\n";
+    std::exit(1);
+  } catch (std::exception& e) {
+    std::cerr << "Exception : [" << e.what() << "]\n";
+    std::cerr << argv[0] << " serve was invoked improperly.\n";
+    std::cerr << "For usage information, try " << argv[0]
+              << " serve --help\nExiting.\n";
+    std::exit(1);
+  }
+  return 0;
+}
@@ -14,10 +14,12 @@
 #include "tbb/parallel_for.h"
 
 #include "AlignmentLibrary.hpp"
+#include "BAMWriter.hpp"
 #include "DistributionUtils.hpp"
 #include "GCFragModel.hpp"
 #include "KmerContext.hpp"
 #include "LibraryFormat.hpp"
+#include "MappingRecords.hpp"
 #include "ReadExperiment.hpp"
 #include "ReadPair.hpp"
 #include "SBModel.hpp"
@@ -1570,6 +1572,57 @@ bool createAuxMapLoggers_(SalmonOpts& sopt,
 
   auto jointLog = sopt.jointLog;
 
+  // The mapping record file (see MappingRecords.hpp)
+  if (!sopt.saveMappingsFile.empty() or !sopt.fromMappingsFile.empty()) {
+    if (sopt.alevinMode) {
+      jointLog->critical("alevin can't record (--saveMappings) or replay (--fromMappings) "
+                         "the mappings.");
+      return false;
+    }
+    if (!sopt.saveMappingsFile.empty() and !sopt.fromMappingsFile.empty()) {
+      jointLog->critical("--saveMappings and --fromMappings can't be used together.");
+      return false;
+    }
+  }
+  if (!sopt.fromMappingsFile.empty()) {
+    if (sopt.qmFileName != "" or sopt.writeUnmappedNames or sopt.writeOrphanLinks) {
+      jointLog->critical("With --fromMappings, the reads aren't mapped, so --writeMappings, "
+                         "--writeUnmappedNames and --writeOrphanLinks can't be used.");
+      return false;
+    }
+    if (!bfs::is_regular_file(sopt.fromMappingsFile)) {
+      jointLog->critical("The mapping record file [{}] given to --fromMappings does not exist.",
+                         sopt.fromMappingsFile);
+      return false;
+    }
+    sopt.mappingRecordReader =
+        std::make_shared<salmon::mapping_records::MappingRecordReader>(
+            sopt.fromMappingsFile, std::max(1u, sopt.numThreads / 2));
+    if (!sopt.mappingRecordReader->good()) {
+      jointLog->critical("Could not read the mapping record file [{}] given to --fromMappings: {}.",
+                         sopt.fromMappingsFile, sopt.mappingRecordReader->error());
+      return false;
+    }
+  }
+  if (!sopt.saveMappingsFile.empty()) {
+    sopt.saveMappingsFile = boost::filesystem::absolute(sopt.saveMappingsFile).string();
+    bfs::path recordDir = boost::filesystem::path(sopt.saveMappingsFile).parent_path();
+    if (!boost::filesystem::is_directory(recordDir) and
+        !boost::filesystem::create_directories(recordDir)) {
+      jointLog->error("Couldn't create requested directory {} in which "
+                      "to place the mapping record file", recordDir.string());
+      return false;
+    }
+    uint32_t numRecordThreads = std::max(1u, sopt.numThreads / 2);
+    sopt.mappingRecordWriter =
+        std::make_shared<BAMWriter>(sopt.saveMappingsFile, numRecordThreads);
+    if (!sopt.mappingRecordWriter->good()) {
+      jointLog->error("Could not create file for recording the mappings [{}]",
+                      sopt.saveMappingsFile);
+      return false;
+    }
+  }
+
   // Create the file (and logger) for outputting unmapped reads, if the user has
   // asked for it.
   if (sopt.writeUnmappedNames) {
@@ -1631,6 +1684,22 @@ bool createAuxMapLoggers_(SalmonOpts& sopt,
   bool writeQuasimappings = (sopt.qmFileName != "");
 
   if (writeQuasimappings) {
+    std::transform(sopt.mappingsFormatStr.begin(), sopt.mappingsFormatStr.end(),
+                   sopt.mappingsFormatStr.begin(), ::toupper);
+    if (sopt.mappingsFormatStr == "SAM") {
+      sopt.writeBAMMappings = false;
+    } else if (sopt.mappingsFormatStr == "BAM") {
+      sopt.writeBAMMappings = true;
+    } else {
+      jointLog->critical("The argument {} for --mappingsFormat is invalid. Valid options are "
+                         "SAM and BAM.", sopt.mappingsFormatStr);
+      return false;
+    }
+    if (sopt.writeBAMMappings and sopt.alevinMode) {
+      jointLog->critical("alevin can only write the mappings as SAM (--mappingsFormat SAM).");
+      return false;
+    }
+
     std::streambuf* qmBuf{nullptr};
     // output to stdout
     if (sopt.qmFileName == "-") {
@@ -1649,7 +1718,7 @@ bool createAuxMapLoggers_(SalmonOpts& sopt,
       }
       // if the directory already existed, or we created it successfully, open
       // the file
-      if (qmDirSuccess) {
+      if (qmDirSuccess and !sopt.writeBAMMappings) {
         sopt.qmFile.open(sopt.qmFileName);
         // Make sure file opened successfully.
         if (!sopt.qmFile.is_open()) {
@@ -1659,7 +1728,7 @@ bool createAuxMapLoggers_(SalmonOpts& sopt,
           return false;
         }
         qmBuf = sopt.qmFile.rdbuf();
-      } else {
+      } else if (!qmDirSuccess) {
         bfs::path qmFileName =
             boost::filesystem::path(sopt.qmFileName).filename();
         jointLog->error("Couldn't create requested directory {} in which "
@@ -1668,6 +1737,21 @@ bool createAuxMapLoggers_(SalmonOpts& sopt,
         return false;
       }
     }
+    // The BAM writer writes to the file (or stdout) itself, from its own
+    // threads.
+    if (sopt.writeBAMMappings) {
+      uint32_t numBAMThreads = (sopt.numBAMThreads > 0)
+                                   ? sopt.numBAMThreads
+                                   : std::max(1u, sopt.numThreads / 2);
+      sopt.bamWriter = std::make_shared<BAMWriter>(sopt.qmFileName, numBAMThreads);
+      if (!sopt.bamWriter->good()) {
+        jointLog->error("Could not create file for writing the mappings [{}]",
+                        sopt.qmFileName);
+        return false;
+      }
+      return true;
+    }
+
     // Now set the output stream to the buffer, which is
     // either std::cout, or a file.
     sopt.qmStream.reset(new std::ostream(qmBuf));
@@ -1906,6 +1990,40 @@ bool processQuantOptions(SalmonOpts& sopt,
     }
   }
 
+  {
+    std::transform(sopt.parserWaitStrategyStr.begin(), sopt.parserWaitStrategyStr.end(),
+                   sopt.parserWaitStrategyStr.begin(), ::toupper);
+    if ( sopt.parserWaitStrategyStr == "SPIN" ) {
+      sopt.blockingParserWait = false;
+    } else if ( sopt.parserWaitStrategyStr == "BLOCK" ) {
+      sopt.blockingParserWait = true;
+    } else {
+      jointLog->critical("The argument {} for --parserWaitStrategy is invalid. Valid options are "
+                         "SPIN and BLOCK.", sopt.parserWaitStrategyStr);
+      jointLog->flush();
+      return false;
+    }
+  }
+
+  {
+    using salmon::memory_utils::HugePageMode;
+    std::transform(sopt.hugePagesStr.begin(), sopt.hugePagesStr.end(),
+                   sopt.hugePagesStr.begin(), ::toupper);
+    if ( sopt.hugePagesStr == "OFF" ) {
+      sopt.hugePageMode = HugePageMode::OFF;
+    } else if ( sopt.hugePagesStr == "THP" ) {
+      sopt.hugePageMode = HugePageMode::THP;
+    } else if ( sopt.hugePagesStr == "HUGETLB" ) {
+      sopt.hugePageMode = HugePageMode::HUGETLB;
+    } else {
+      jointLog->critical("The argument {} for --hugePages is invalid. Valid options are "
+                         "OFF, THP and HUGETLB.", sopt.hugePagesStr);
+      jointLog->flush();
+      return false;
+    }
+    salmon::memory_utils::setHugePageMode(sopt.hugePageMode);
+  }
+
   // The growing list of thou shalt nots
   {
     try {
@@ -2478,6 +2596,8 @@ int contextSize = outsideContext + insideContext;
         auto& expectPos3 = expectedDist.local().expectPos3;
 
         std::string rcSeq;
+        // the transcript's sequence, if it has to be decoded from the index
+        std::string txpSeq;
         // For each transcript
         for (auto it : boost::irange(range.begin(), range.end())) {
 
@@ -2524,7 +2644,7 @@ int contextSize = outsideContext + insideContext;
           windowLensTP.setZero();
 
           // This transcript's sequence
-          const char* tseq = txp.Sequence();
+          const char* tseq = txp.asciiSequence(txpSeq);
           revComplement(tseq, refLen, rcSeq);
           const char* rseq = rcSeq.c_str();
 
@@ -2709,6 +2829,8 @@ int contextSize = outsideContext + insideContext;
       [&](const BlockedIndexRange& range) -> void {
 
         std::string rcSeq;
+        // the transcript's sequence, if it has to be decoded from the index
+        std::string txpSeq;
         // For each transcript
         for (auto it : boost::irange(range.begin(), range.end())) {
 
@@ -2759,7 +2881,7 @@ int contextSize = outsideContext + insideContext;
             std::vector<double> posFactorsRC(refLen, 1.0);
 
             // This transcript's sequence
-            const char* tseq = txp.Sequence();
+            const char* tseq = txp.asciiSequence(txpSeq);
             revComplement(tseq, refLen, rcSeq);
             const char* rseq = rcSeq.c_str();
 
@@ -3466,6 +3588,8 @@ Eigen::VectorXd updateEffectiveLengths(SalmonOpts& sopt, ReadExpT& readExp,
         auto& expectPos3 = expectedDist.local().expectPos3;
 
         std::string rcSeq;
+        // the transcript's sequence, if it has to be decoded from the index
+        std::string txpSeq;
         // For each transcript
         for (auto it : boost::irange(range.begin(), range.end())) {
 
@@ -3495,7 +3619,7 @@ txp.uniqueUpdateFraction() < 0.90) {
           double weight = (alphas[it] / effLensIn(it));
 
           // This transcript's sequence
-          const char* tseq = txp.Sequence();
+          const char* tseq = txp.asciiSequence(txpSeq);
           revComplement(tseq, refLen, rcSeq);
           const char* rseq = rcSeq.c_str();
 
@@ -3734,6 +3858,8 @@ txp.uniqueUpdateFraction() < 0.90) {
       [&](const BlockedIndexRange& range) -> void {
 
         std::string rcSeq;
+        // the transcript's sequence, if it has to be decoded from the index
+        std::string txpSeq;
         // For each transcript
         for (auto it : boost::irange(range.begin(), range.end())) {
 
@@ -3762,7 +3888,7 @@ txp.uniqueUpdateFraction() < 0.90) {
             std::vector<double> posFactorsRC(refLen, 1.0);
 
             // This transcript's sequence
-            const char* tseq = txp.Sequence();
+            const char* tseq = txp.asciiSequence(txpSeq);
             revComplement(tseq, refLen, rcSeq);
             const char* rseq = rcSeq.c_str();
 
@@ -0,0 +1,141 @@
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "EqClassComponents.hpp"
+#include "EquivalenceClassBuilder.hpp"
+#include "PackedEqClasses.hpp"
+
+namespace {
+
+using EqVecT = std::vector<std::pair<const TranscriptGroup, TGValue>>;
+
+void addClass(EqVecT& eqVec, std::vector<uint32_t> label,
+              std::vector<double> weights, uint64_t count) {
+  TGValue v(weights, count);
+  // (the EM reads the combined weights)
+  v.combinedWeights = weights;
+  eqVec.emplace_back(TranscriptGroup(label), v);
+}
+
+// The classes of three components, interleaved : {0, 2, 3, 5} (with the most
+// entries), {4, 7}, and {1}; transcript 6 is in no class
+EqVecT makeClasses() {
+  EqVecT eqVec;
+  addClass(eqVec, {4, 7}, {0.4, 0.6}, 6);
+  addClass(eqVec, {0, 2}, {0.5, 0.5}, 10);
+  addClass(eqVec, {4}, {1.0}, 3);
+  addClass(eqVec, {2, 5}, {0.2, 0.8}, 7);
+  addClass(eqVec, {5}, {1.0}, 2);
+  addClass(eqVec, {0, 3, 5}, {0.3, 0.3, 0.4}, 12);
+  addClass(eqVec, {1}, {1.0}, 5);
+  return eqVec;
+}
+
+// numIts passes of the EM over classes [classBegin, classEnd) of eqs, whose
+// transcripts are txps
+void runEM(const PackedEqClasses<double>& eqs, size_t classBegin,
+           size_t classEnd, const std::vector<uint32_t>& txps, size_t numIts,
+           std::vector<double>& alphas) {
+  std::vector<double> alphasPrime(alphas.size(), 0.0);
+  for (size_t it = 0; it < numIts; ++it) {
+    for (size_t i = classBegin; i < classEnd; ++i) {
+      double denom{0.0};
+      for (auto j = eqs.offsets[i]; j < eqs.offsets[i + 1]; ++j) {
+        denom += alphas[eqs.txps[j]] * eqs.combinedWeights[j];
+      }
+      for (auto j = eqs.offsets[i]; j < eqs.offsets[i + 1]; ++j) {
+        alphasPrime[eqs.txps[j]] += eqs.counts[i] * alphas[eqs.txps[j]] *
+                                    eqs.combinedWeights[j] / denom;
+      }
+    }
+    for (auto t : txps) {
+      alphas[t] = alphasPrime[t];
+      alphasPrime[t] = 0.0;
+    }
+  }
+}
+
+} // namespace
+
+SCENARIO("The equivalence classes are grouped by connected component") {
+  const size_t numTranscripts{8};
+
+  GIVEN("Classes over disjoint sets of transcripts") {
+    auto eqVec = makeClasses();
+    PackedEqClasses<double> eqs(eqVec);
+    EqClassComponents comps(eqs, numTranscripts);
+
+    THEN("there is a component per set, the largest first") {
+      REQUIRE(comps.size() == 3);
+      REQUIRE(comps.classOffsets == std::vector<uint64_t>({0, 4, 6, 7}));
+      REQUIRE(comps.numClasses(0) == 4);
+      REQUIRE(comps.numClasses(1) == 2);
+      REQUIRE(comps.numClasses(2) == 1);
+      // transcript 6, in no class, is in no component
+      REQUIRE(comps.txpOffsets == std::vector<uint64_t>({0, 4, 6, 7}));
+      REQUIRE(comps.txps == std::vector<uint32_t>({0, 2, 3, 5, 4, 7, 1}));
+      REQUIRE(comps.numTranscripts(0) == 4);
+    }
+
+    THEN("the classes of each component are contiguous, and in order") {
+      REQUIRE(eqs.size() == 7);
+      REQUIRE(eqs.classIDs == std::vector<uint32_t>({1, 3, 4, 5, 0, 2, 6}));
+      REQUIRE(eqs.counts == std::vector<uint64_t>({10, 7, 2, 12, 6, 3, 5}));
+      REQUIRE(eqs.offsets ==
+              std::vector<uint64_t>({0, 2, 4, 5, 8, 10, 11, 12}));
+      REQUIRE(eqs.txps ==
+              std::vector<uint32_t>({0, 2, 2, 5, 5, 0, 3, 5, 4, 7, 4, 1}));
+      REQUIRE(eqs.weights == std::vector<double>({0.5, 0.5, 0.2, 0.8, 1.0, 0.3,
+                                                  0.3, 0.4, 0.4, 0.6, 1.0,
+                                                  1.0}));
+      for (size_t c = 0; c < comps.size(); ++c) {
+        std::vector<bool> inComponent(numTranscripts, false);
+        for (auto i = comps.txpOffsets[c]; i < comps.txpOffsets[c + 1]; ++i) {
+          inComponent[comps.txps[i]] = true;
+        }
+        for (auto i = comps.classOffsets[c]; i < comps.classOffsets[c + 1];
+             ++i) {
+          for (auto j = eqs.offsets[i]; j < eqs.offsets[i + 1]; ++j) {
+            REQUIRE(inComponent[eqs.txps[j]]);
+          }
+        }
+      }
+    }
+  }
+
+  GIVEN("The EM, over all of the classes, and over each component alone") {
+    auto eqVec = makeClasses();
+    PackedEqClasses<double> global(eqVec);
+    PackedEqClasses<double> eqs(eqVec);
+    EqClassComponents comps(eqs, numTranscripts);
+    const size_t numIts{200};
+
+    std::vector<uint32_t> allTxps(numTranscripts);
+    for (uint32_t t = 0; t < numTranscripts; ++t) {
+      allTxps[t] = t;
+    }
+    std::vector<double> expected(numTranscripts, 1.0);
+    runEM(global, 0, global.size(), allTxps, numIts, expected);
+
+    std::vector<double> alphas(numTranscripts, 1.0);
+    alphas[6] = 0.0;
+    for (size_t c = 0; c < comps.size(); ++c) {
+      std::vector<uint32_t> txps(comps.txps.begin() + comps.txpOffsets[c],
+                                 comps.txps.begin() + comps.txpOffsets[c + 1]);
+      runEM(eqs, comps.classOffsets[c], comps.classOffsets[c + 1], txps,
+            numIts, alphas);
+    }
+
+    THEN("they give the same counts") {
+      double total{0.0};
+      for (size_t t = 0; t < numTranscripts; ++t) {
+        REQUIRE(alphas[t] == Approx(expected[t]));
+        total += alphas[t];
+      }
+      REQUIRE(total == Approx(45.0));
+      REQUIRE(alphas[1] == Approx(5.0));
+      REQUIRE(alphas[6] == 0.0);
+    }
+  }
+}
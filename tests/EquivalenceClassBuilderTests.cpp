@@ -0,0 +1,142 @@
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "EquivalenceClassBuilder.hpp"
+#include "spdlog/sinks/null_sink.h"
+
+namespace {
+
+struct ClassSummary {
+  uint64_t count{0};
+  std::vector<double> weights;
+};
+
+using ClassSummaries = std::map<std::vector<uint32_t>, ClassSummary>;
+
+// The classes of a finished builder, by label
+ClassSummaries summarize(EquivalenceClassBuilder<TGValue>& builder) {
+  ClassSummaries s;
+  for (auto& kv : builder.eqVec()) {
+    auto& c = s[kv.first.txps];
+    c.count = kv.second.count;
+    c.weights = kv.second.weights;
+  }
+  return s;
+}
+
+// The i-th fragment added by thread t : one of a few dozen classes (with
+// range factorization bins, for some), with weights that depend on the
+// thread, so that the merge has to add them up
+void addFragment(EquivalenceClassBuilder<TGValue>& builder, size_t t,
+                 size_t i) {
+  size_t c = (i * 7 + t) % 37;
+  std::vector<uint32_t> label;
+  std::vector<double> weights;
+  for (uint32_t j = 0; j <= c % 4; ++j) {
+    label.push_back(static_cast<uint32_t>(c + 50 * j));
+    weights.push_back(0.25 * (j + 1) + 0.5 * t);
+  }
+  if (c % 5 == 0) {
+    label.push_back(1000 + (c % 3));
+  }
+  builder.addGroup(TranscriptGroup(label), weights);
+}
+
+} // namespace
+
+SCENARIO("Equivalence classes counted in thread-local maps are those of the shared map") {
+  auto logger = std::make_shared<spdlog::logger>(
+      "eqBuilderTest", std::make_shared<spdlog::sinks::null_sink_mt>());
+  const size_t numThreads{4};
+  const size_t numFragments{5000};
+
+  GIVEN("The same fragments, added to a shared builder and to thread-local ones") {
+    EquivalenceClassBuilder<TGValue> shared(logger, numThreads);
+    shared.start();
+    // Two thread-local builders, filled at once by the same threads (each
+    // thread switching between them), and a third one that is started once
+    // they're finished, and filled by the same threads again
+    EquivalenceClassBuilder<TGValue> local1(logger, numThreads);
+    EquivalenceClassBuilder<TGValue> local2(logger, numThreads);
+    EquivalenceClassBuilder<TGValue> local3(logger, numThreads);
+    local1.setThreadLocal(true);
+    local2.setThreadLocal(true);
+    local3.setThreadLocal(true);
+    local1.start();
+    local2.start();
+
+    std::vector<std::thread> threads;
+    std::atomic<bool> firstDone{false};
+    std::atomic<size_t> numWaiting{0};
+    for (size_t t = 0; t < numThreads; ++t) {
+      threads.emplace_back([&, t]() -> void {
+        for (size_t i = 0; i < numFragments; ++i) {
+          addFragment(shared, t, i);
+        }
+        // (in blocks, switching builders between them)
+        const size_t blockSize{500};
+        for (size_t b = 0; b < numFragments; b += blockSize) {
+          for (size_t i = b; i < b + blockSize; ++i) {
+            addFragment(local1, t, i);
+          }
+          for (size_t i = b; i < b + blockSize; ++i) {
+            addFragment(local2, t, i);
+          }
+        }
+        ++numWaiting;
+        while (!firstDone) {
+          std::this_thread::yield();
+        }
+        for (size_t i = 0; i < numFragments; ++i) {
+          addFragment(local3, t, i);
+        }
+      });
+    }
+    while (numWaiting < numThreads) {
+      std::this_thread::yield();
+    }
+    shared.finish();
+    local1.finish();
+    local2.finish();
+    local3.start();
+    firstDone = true;
+    for (auto& t : threads) {
+      t.join();
+    }
+    local3.finish();
+
+    THEN("they have the same classes, counts and weights") {
+      auto expected = summarize(shared);
+      REQUIRE(!expected.empty());
+      uint64_t totalCount{0};
+      for (auto& kv : expected) {
+        totalCount += kv.second.count;
+      }
+      REQUIRE(totalCount == numThreads * numFragments);
+
+      for (auto* local : {&local1, &local2, &local3}) {
+        REQUIRE(local->eqVec().size() == shared.eqVec().size());
+        auto got = summarize(*local);
+        REQUIRE(got.size() == expected.size());
+        size_t numMismatched{0};
+        for (auto& kv : expected) {
+          auto it = got.find(kv.first);
+          if (it == got.end() or it->second.count != kv.second.count or
+              it->second.weights.size() != kv.second.weights.size()) {
+            ++numMismatched;
+            continue;
+          }
+          for (size_t j = 0; j < kv.second.weights.size(); ++j) {
+            if (it->second.weights[j] != Approx(kv.second.weights[j])) {
+              ++numMismatched;
+            }
+          }
+        }
+        REQUIRE(numMismatched == 0);
+      }
+    }
+  }
+}
@@ -0,0 +1,125 @@
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "FastxParserStreams.hpp"
+
+namespace {
+
+// A BGZF block (a gzip member with the "BC" extra sub-field) holding data
+std::string bgzfBlock(const std::string& data) {
+  z_stream zs{};
+  deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8,
+               Z_DEFAULT_STRATEGY);
+  std::string deflated(deflateBound(&zs, data.size()), '\0');
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  zs.avail_in = data.size();
+  zs.next_out = reinterpret_cast<Bytef*>(&deflated[0]);
+  zs.avail_out = deflated.size();
+  deflate(&zs, Z_FINISH);
+  deflated.resize(zs.total_out);
+  deflateEnd(&zs);
+
+  auto le = [](std::string& s, uint32_t v, size_t n) -> void {
+    for (size_t i = 0; i < n; ++i) {
+      s.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+    }
+  };
+  std::string block{"\x1f\x8b\x08\x04\x00\x00\x00\x00\x00\xff\x06\x00"
+                    "BC\x02\x00",
+                    16};
+  le(block, 18 + deflated.size() + 8 - 1, 2);
+  block += deflated;
+  le(block,
+     crc32(0, reinterpret_cast<const Bytef*>(data.data()), data.size()), 4);
+  le(block, data.size(), 4);
+  return block;
+}
+
+void writeFile(const std::string& fname, const std::string& contents) {
+  auto* fp = std::fopen(fname.c_str(), "wb");
+  std::fwrite(contents.data(), 1, contents.size(), fp);
+  std::fclose(fp);
+}
+
+// Read all of fname through a ParallelInflateStream, in reads of len bytes;
+// returns the last result of read() (0 at the end, -1 on an error)
+int readAll(const std::string& fname, std::string& out, unsigned len = 4096) {
+  fastx_parser::ParallelInflateStream in(fname, 2,
+                                         fastx_parser::Compression::BGZF);
+  std::vector<char> buf(len);
+  int n{0};
+  while ((n = in.read(buf.data(), len)) > 0) {
+    out.append(buf.data(), n);
+  }
+  return n;
+}
+
+} // namespace
+
+SCENARIO("BGZF input is inflated in parallel") {
+  const std::string fname{"bgzfStreamTest.gz"};
+  const std::string eofBlock = bgzfBlock("");
+
+  GIVEN("A file made of only the EOF block") {
+    writeFile(fname, eofBlock);
+    THEN("it reads as empty") {
+      std::string out;
+      REQUIRE(readAll(fname, out) == 0);
+      REQUIRE(out.empty());
+    }
+  }
+
+  GIVEN("Files of one or more full jobs of blocks, and the EOF block") {
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<> dis(0, 3);
+    THEN("all of the data is read back") {
+      // 16 blocks make up a job
+      for (size_t numBlocks : {16, 32, 21}) {
+        std::string expected;
+        std::string contents;
+        for (size_t b = 0; b < numBlocks; ++b) {
+          std::string data(0xff00, 'A');
+          for (auto& c : data) {
+            c = "ACGT"[dis(gen)];
+          }
+          expected += data;
+          contents += bgzfBlock(data);
+        }
+        contents += eofBlock;
+        writeFile(fname, contents);
+        std::string out;
+        REQUIRE(readAll(fname, out) == 0);
+        REQUIRE(out == expected);
+      }
+    }
+  }
+
+  GIVEN("A file with a corrupt block") {
+    std::string expected;
+    std::string contents;
+    for (size_t b = 0; b < 20; ++b) {
+      std::string data(1000, "ACGT"[b % 4]);
+      auto block = bgzfBlock(data);
+      if (b == 17) {
+        // break the CRC
+        block[block.size() - 8] ^= 0x1;
+      } else if (b < 17) {
+        expected += data;
+      }
+      contents += block;
+    }
+    contents += eofBlock;
+    writeFile(fname, contents);
+    THEN("the data before it is read back, and then the error is reported") {
+      std::string out;
+      REQUIRE(readAll(fname, out, 700) == -1);
+      REQUIRE(out == expected);
+    }
+  }
+
+  std::remove(fname.c_str());
+}
@@ -30,23 +30,47 @@ SCENARIO("GC sampling works properly") {
 	//names[tn] = "HI\0";
 	std::strcpy(txpSeqs[tn], s.c_str());
       }
-      std::vector<Transcript> txpsSampled;
-      std::vector<Transcript> txpsUnSampled;
+      // all of the sequences, concatenated and packed as pufferfish does
+      std::vector<uint64_t> refWords;
+      std::vector<uint64_t> offsets;
+      uint64_t totLen{0};
+      for (size_t tn = 0; tn < 1000; ++tn) {
+        offsets.push_back(totLen);
+        totLen += lengths[tn];
+      }
+      refWords.resize((totLen + 31) / 32, 0);
+      for (size_t tn = 0; tn < 1000; ++tn) {
+        for (size_t i = 0; i < lengths[tn]; ++i) {
+          uint64_t p = offsets[tn] + i;
+          uint64_t c = std::string("ACGT").find(txpSeqs[tn][i]);
+          refWords[p >> 5] |= c << (2 * (p & 31));
+        }
+      }
+
+      // the GC content is computed from the ASCII sequence for the former,
+      // and from the 2-bit sequence for the latter
+      std::vector<Transcript> txpsASCII;
+      std::vector<Transcript> txpsViewed;
       for (size_t tn = 0; tn < 1000; ++tn) {
 	auto len = lengths[tn];
-	txpsSampled.emplace_back(tn, names[tn], len); 
-	txpsUnSampled.emplace_back(tn, names[tn], len); 
-	txpsSampled[tn].setSequenceBorrowed(txpSeqs[tn], true, true);
-	txpsUnSampled[tn].setSequenceBorrowed(txpSeqs[tn], true, false);
+	txpsASCII.emplace_back(tn, names[tn], len);
+	txpsViewed.emplace_back(tn, names[tn], len);
+	txpsASCII[tn].setSequenceBorrowed(txpSeqs[tn], true);
+	txpsViewed[tn].setSequenceView(
+	    RefSeqView(refWords.data(), offsets[tn], len), true);
       }
-      
+
       WHEN("Computing GC content ") {
 
-        THEN("Sampled is the same as unsampled : ") {
+        THEN("The GC counts are exact : ") {
           for (size_t tn = 0; tn < 1000; ++tn) {
-            auto l = txpsSampled[tn].RefLength;
+            auto l = txpsASCII[tn].RefLength;
+            double count{0.0};
             for (size_t i = 0; i < l; ++i) {
-              REQUIRE(txpsSampled[tn].gcAt(i) == txpsUnSampled[tn].gcAt(i));
+              auto c = txpSeqs[tn][i];
+              count += (c == 'G' or c == 'C') ? 1.0 : 0.0;
+              REQUIRE(txpsASCII[tn].gcAt(i) == count);
+              REQUIRE(txpsViewed[tn].gcAt(i) == count);
             }
           }
         }
@@ -54,9 +78,9 @@ SCENARIO("GC sampling works properly") {
       }
 
       WHEN("Computing GC contexts") {
-        THEN("Sampled contexts are the same as unsampled contexts") {
+        THEN("The contexts from the 2-bit sequence are the same as from the ASCII sequence") {
         for (size_t tn = 0; tn < 1000; ++tn) {
-          auto l = txpsSampled[tn].RefLength;
+          auto l = txpsASCII[tn].RefLength;
           for (size_t i = 0; i < 1000; ++i) {
             bool v1, v2;
             auto s = dis(gen);
@@ -64,13 +88,24 @@ SCENARIO("GC sampling works properly") {
             decltype(s) e = s + len;
             if ( static_cast<decltype(l)>(s) >= l ) { s = l/2; }
             if ( static_cast<decltype(l)>(s) + len >= l ) { e= l-1; }
-            REQUIRE(txpsSampled[tn].gcDesc(s, e, v1) == txpsUnSampled[tn].gcDesc(s, e, v2));
+            REQUIRE(txpsASCII[tn].gcDesc(s, e, v1) == txpsViewed[tn].gcDesc(s, e, v2));
             }
           }
         }
 
       }
 
+      WHEN("Reading the sequences back") {
+        THEN("The 2-bit sequence decodes to the ASCII sequence") {
+          std::string buffer;
+          for (size_t tn = 0; tn < 1000; ++tn) {
+            REQUIRE(txpsViewed[tn].Sequence() == nullptr);
+            REQUIRE(std::string(txpsViewed[tn].asciiSequence(buffer)) ==
+                    std::string(txpSeqs[tn]));
+          }
+        }
+      }
+
       for (size_t tn = 0; tn < 1000; ++tn) {
 	delete txpSeqs[tn];
 	delete names[tn];
@@ -0,0 +1,176 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "BAMWriter.hpp"
+#include "MappingRecords.hpp"
+
+namespace {
+
+using salmon::mapping_records::QuasiAlignment;
+using MateStatus = pufferfish::util::MateStatus;
+
+struct Fragment {
+  bool isPaired{false};
+  std::vector<QuasiAlignment> alignments;
+};
+
+QuasiAlignment makeAlignment(uint32_t tid, int32_t pos, bool fwd,
+                             MateStatus mateStatus, bool mateFwd,
+                             double estAlnProb) {
+  std::string cigar;
+  bool bothMapped = (mateStatus == MateStatus::PAIRED_END_PAIRED);
+  QuasiAlignment aln(tid, pos, fwd, 101, cigar, bothMapped ? 250 : 0,
+                     bothMapped);
+  aln.score = fwd ? 180 : -12;
+  aln.numHits = 3;
+  aln.mateStatus = mateStatus;
+  if (bothMapped) {
+    aln.mateIsFwd = mateFwd;
+    // (the mate may start before the read)
+    aln.matePos = pos + (fwd ? 150 : -140);
+    aln.mateLen = 99;
+    aln.mateScore = 170;
+  } else if (mateStatus == MateStatus::SINGLE_END) {
+    aln.mateIsFwd = true;
+    aln.matePos = 0;
+    aln.mateLen = aln.readLen;
+    aln.mateScore = 0;
+  } else {
+    // an orphan keeps the mate orientation it was mapped with
+    aln.mateIsFwd = mateFwd;
+  }
+  aln.estAlnProb(estAlnProb);
+  return aln;
+}
+
+// The fragments of a library : paired, orphaned (either end) and single-end
+// alignments of both orientations, and unmapped fragments
+std::vector<Fragment> makeFragments(size_t numFragments) {
+  const MateStatus statuses[] = {
+      MateStatus::PAIRED_END_PAIRED, MateStatus::PAIRED_END_LEFT,
+      MateStatus::PAIRED_END_RIGHT, MateStatus::SINGLE_END};
+  std::vector<Fragment> fragments(numFragments);
+  for (size_t i = 0; i < numFragments; ++i) {
+    auto& frag = fragments[i];
+    size_t numAlignments = i % 5;
+    auto mateStatus = statuses[i % 4];
+    frag.isPaired = (mateStatus == MateStatus::PAIRED_END_PAIRED);
+    for (size_t j = 0; j < numAlignments; ++j) {
+      // targets that go down as well as up, and far apart
+      uint32_t tid = static_cast<uint32_t>((i * 7919 + j * 104729) % 200000);
+      int32_t pos = static_cast<int32_t>((i * 31 + j) % 5000) - 20;
+      bool fwd = ((i + j) % 2 == 0);
+      double estAlnProb = (j % 2 == 0) ? 1.0 : 1.0 / (i + j + 3);
+      frag.alignments.push_back(
+          makeAlignment(tid, pos, fwd, mateStatus, !fwd, estAlnProb));
+    }
+  }
+  return fragments;
+}
+
+bool sameAlignment(const QuasiAlignment& a, const QuasiAlignment& b) {
+  return a.tid == b.tid and a.pos == b.pos and a.fwd == b.fwd and
+         a.readLen == b.readLen and a.fragLen == b.fragLen and
+         a.score == b.score and a.numHits == b.numHits and
+         a.mateStatus == b.mateStatus and a.mateIsFwd == b.mateIsFwd and
+         a.matePos == b.matePos and a.mateLen == b.mateLen and
+         a.mateScore == b.mateScore and a.estAlnProb() == b.estAlnProb();
+}
+
+// Encode fragments, in chunks of chunkSize, into the mapping record file
+// fname (through a BAMWriter, as the mapping threads do)
+void writeRecords(const std::string& fname,
+                  const salmon::mapping_records::FileHeader& header,
+                  const std::vector<Fragment>& fragments, size_t chunkSize) {
+  BAMWriter writer(fname, 2);
+  writer.writeHeader(salmon::mapping_records::encodeHeader(header));
+  salmon::mapping_records::ChunkEncoder encoder;
+  std::string buf;
+  for (auto& frag : fragments) {
+    encoder.append(frag.isPaired, frag.alignments);
+    if (encoder.numFragments() == chunkSize) {
+      encoder.finish(buf);
+      writer.write(buf);
+    }
+  }
+  if (encoder.numFragments() > 0) {
+    encoder.finish(buf);
+    writer.write(buf);
+  }
+  writer.close();
+}
+
+} // namespace
+
+SCENARIO("Mapping records are read back as they were written") {
+  const std::string fname{"mappingRecordsTest.bin"};
+
+  GIVEN("A file of fragments, written in several chunks") {
+    salmon::mapping_records::FileHeader header;
+    header.numTranscripts = 200000;
+    header.namesHash = 0x0123456789abcdefULL;
+    header.libFormatID = 5;
+    header.autoDetect = true;
+
+    size_t chunkSize{37};
+    auto fragments = makeFragments(1000);
+    writeRecords(fname, header, fragments, chunkSize);
+
+    THEN("its header, chunks and fragments decode back unchanged") {
+      salmon::mapping_records::MappingRecordReader reader(fname, 2);
+      REQUIRE(reader.good());
+      REQUIRE(reader.header().version ==
+              salmon::mapping_records::formatVersion);
+      REQUIRE(reader.header().numTranscripts == header.numTranscripts);
+      REQUIRE(reader.header().namesHash == header.namesHash);
+      REQUIRE(reader.header().libFormatID == header.libFormatID);
+      REQUIRE(reader.header().autoDetect == header.autoDetect);
+
+      uint32_t numFragments{0};
+      std::string chunk;
+      size_t numChunks{0};
+      size_t numDecoded{0};
+      size_t numMismatched{0};
+      bool isPaired{false};
+      std::vector<QuasiAlignment> alignments;
+      while (reader.nextChunk(numFragments, chunk)) {
+        ++numChunks;
+        REQUIRE(numFragments <= chunkSize);
+        salmon::mapping_records::ChunkDecoder decoder(chunk);
+        for (uint32_t i = 0; i < numFragments; ++i, ++numDecoded) {
+          REQUIRE(numDecoded < fragments.size());
+          REQUIRE(decoder.next(isPaired, alignments));
+          auto& expected = fragments[numDecoded];
+          REQUIRE(isPaired == (!expected.alignments.empty() and
+                               expected.isPaired));
+          REQUIRE(alignments.size() == expected.alignments.size());
+          for (size_t j = 0; j < alignments.size(); ++j) {
+            if (!sameAlignment(alignments[j], expected.alignments[j])) {
+              ++numMismatched;
+            }
+          }
+        }
+        // every fragment of the chunk was used up
+        REQUIRE(!decoder.next(isPaired, alignments));
+      }
+      REQUIRE(reader.good());
+      REQUIRE(numChunks == (fragments.size() + chunkSize - 1) / chunkSize);
+      REQUIRE(numDecoded == fragments.size());
+      REQUIRE(numMismatched == 0);
+    }
+  }
+
+  GIVEN("A file that isn't one of mapping records") {
+    auto* fp = std::fopen(fname.c_str(), "wb");
+    std::fputs("@read\nACGT\n+\nIIII\n", fp);
+    std::fclose(fp);
+    THEN("it is rejected") {
+      salmon::mapping_records::MappingRecordReader reader(fname, 1);
+      REQUIRE(!reader.good());
+      REQUIRE(!reader.error().empty());
+    }
+  }
+
+  std::remove(fname.c_str());
+}
@@ -0,0 +1,106 @@
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "EquivalenceClassBuilder.hpp"
+#include "PackedEqClasses.hpp"
+
+namespace {
+
+using EqVecT = std::vector<std::pair<const TranscriptGroup, TGValue>>;
+
+void addClass(EqVecT& eqVec, std::vector<uint32_t> label,
+              std::vector<double> weights, uint64_t count, bool valid = true,
+              std::vector<double> combinedWeights = {}) {
+  TGValue v(weights, count);
+  v.combinedWeights = combinedWeights;
+  eqVec.emplace_back(TranscriptGroup(label), v);
+  eqVec.back().first.setValid(valid);
+}
+
+// Classes with weights that don't round to a float exactly
+EqVecT makeClasses() {
+  EqVecT eqVec;
+  addClass(eqVec, {3}, {1.0}, 10);
+  addClass(eqVec, {0, 2, 5}, {0.1, 0.3, 0.6}, 4, true, {0.2, 0.2, 0.6});
+  // invalid (degenerate) classes aren't packed
+  addClass(eqVec, {1, 4}, {0.5, 0.5}, 7, false);
+  // with range factorization, the label has bins after its transcripts
+  addClass(eqVec, {1, 4, 9, 12}, {1.0 / 3.0, 2.0 / 3.0}, 2);
+  addClass(eqVec, {2, 6}, {0.7, 0.3}, 1);
+  return eqVec;
+}
+
+} // namespace
+
+SCENARIO("The valid equivalence classes are packed") {
+
+  GIVEN("Classes, some invalid and one with range factorization bins") {
+    auto eqVec = makeClasses();
+    PackedEqClasses<double> eqs(eqVec);
+
+    THEN("the transcripts, weights and counts of the valid ones are laid out in order") {
+      REQUIRE(eqs.size() == 4);
+      REQUIRE(eqs.offsets == std::vector<uint64_t>({0, 1, 4, 6, 8}));
+      REQUIRE(eqs.txps == std::vector<uint32_t>({3, 0, 2, 5, 1, 4, 2, 6}));
+      REQUIRE(eqs.weights == std::vector<double>(
+                                 {1.0, 0.1, 0.3, 0.6, 1.0 / 3.0, 2.0 / 3.0, 0.7, 0.3}));
+      // 0 for the classes that have no combined weights yet
+      REQUIRE(eqs.combinedWeights ==
+              std::vector<double>({0.0, 0.2, 0.2, 0.6, 0.0, 0.0, 0.0, 0.0}));
+      REQUIRE(eqs.counts == std::vector<uint64_t>({10, 4, 2, 1}));
+      REQUIRE(eqs.classIDs == std::vector<uint32_t>({0, 1, 3, 4}));
+      REQUIRE(eqs.groupSize(1) == 3);
+      REQUIRE(eqs.groupSize(2) == 2);
+    }
+
+    THEN("removing classes keeps the others, in order") {
+      eqs.remove({false, true, false, true});
+      REQUIRE(eqs.size() == 2);
+      REQUIRE(eqs.offsets == std::vector<uint64_t>({0, 1, 3}));
+      REQUIRE(eqs.txps == std::vector<uint32_t>({3, 1, 4}));
+      REQUIRE(eqs.weights == std::vector<double>({1.0, 1.0 / 3.0, 2.0 / 3.0}));
+      REQUIRE(eqs.combinedWeights.size() == 3);
+      REQUIRE(eqs.counts == std::vector<uint64_t>({10, 2}));
+      REQUIRE(eqs.classIDs == std::vector<uint32_t>({0, 3}));
+
+      eqs.remove({true, true});
+      REQUIRE(eqs.size() == 0);
+      REQUIRE(eqs.offsets == std::vector<uint64_t>({0}));
+      REQUIRE(eqs.txps.empty());
+    }
+  }
+
+  GIVEN("Classes packed with single precision weights") {
+    auto eqVec = makeClasses();
+    auto original = makeClasses();
+    PackedEqClasses<float> eqs(eqVec);
+    REQUIRE(eqs.weights[1] == 0.1f);
+    for (size_t i = 0; i < eqs.combinedWeights.size(); ++i) {
+      eqs.combinedWeights[i] = 0.125f * (i + 1);
+    }
+    eqs.remove({false, false, true, false});
+
+    THEN("storing the weights keeps the (double) weights of the classes") {
+      eqs.storeWeights(eqVec, false);
+      for (size_t eqID = 0; eqID < eqVec.size(); ++eqID) {
+        REQUIRE(eqVec[eqID].second.weights == original[eqID].second.weights);
+      }
+      REQUIRE(eqVec[0].second.combinedWeights == std::vector<double>({0.125}));
+      REQUIRE(eqVec[1].second.combinedWeights ==
+              std::vector<double>({0.25, 0.375, 0.5}));
+      REQUIRE(eqVec[4].second.combinedWeights == std::vector<double>({0.875, 1.0}));
+      // the removed class, and the invalid one, are left as they were
+      REQUIRE(eqVec[3].second.combinedWeights.empty());
+      REQUIRE(eqVec[2].second.combinedWeights.empty());
+    }
+
+    THEN("the weights are only stored if asked to (once they were replaced)") {
+      std::fill(eqs.weights.begin(), eqs.weights.end(), 1.0f);
+      eqs.storeWeights(eqVec, true);
+      REQUIRE(eqVec[1].second.weights == std::vector<double>({1.0, 1.0, 1.0}));
+      REQUIRE(eqVec[3].second.weights == original[3].second.weights);
+      REQUIRE(eqVec[2].second.weights == original[2].second.weights);
+    }
+  }
+}
@@ -0,0 +1,104 @@
+#include <random>
+
+#include "AlevinTypes.hpp"
+#include "PackedSeq.hpp"
+#include "SBModel.hpp"
+
+SCENARIO("Reads are packed at 2 bits per base") {
+
+  GIVEN("A random read with some Ns") {
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<> dis(0, 4);
+    char nucs[] = {'A', 'C', 'G', 'T', 'N'};
+    std::string read(151, 'A');
+    for (auto& c : read) {
+      c = nucs[dis(gen)];
+    }
+    read[70] = 'c';
+    fastx_parser::PackedSeq packed;
+    packed.encode(read.data(), read.size());
+
+    THEN("every base and N can be read back") {
+      REQUIRE(packed.size() == read.size());
+      for (size_t i = 0; i < read.size(); ++i) {
+        char c = std::toupper(read[i]);
+        REQUIRE(packed.isN(i) == (c == 'N'));
+        if (c != 'N') {
+          REQUIRE(nucs[packed.base(i)] == c);
+        }
+      }
+    }
+
+    THEN("words and N queries agree with the bases, across word boundaries") {
+      for (size_t k : {1, 10, 16, 31, 32}) {
+        for (size_t pos = 0; pos + k <= read.size(); ++pos) {
+          uint64_t w = packed.word(pos, k);
+          uint64_t expected{0};
+          bool anyN{false};
+          for (size_t j = 0; j < k; ++j) {
+            expected |= uint64_t(packed.base(pos + j)) << (2 * j);
+            anyN = anyN or packed.isN(pos + j);
+          }
+          REQUIRE(w == expected);
+          REQUIRE(packed.hasN(pos, k) == anyN);
+          REQUIRE(fastx_parser::PackedSeq::reverseBases(
+                      packed.wordMSBFirst(pos, k), k) == w);
+        }
+      }
+    }
+  }
+
+  GIVEN("A read that is re-used for a shorter one") {
+    fastx_parser::PackedSeq packed;
+    std::string first(100, 'N');
+    std::string second(40, 'T');
+    packed.encode(first.data(), first.size());
+    packed.encode(second.data(), second.size());
+    THEN("nothing of the first read is left over") {
+      REQUIRE(packed.size() == 40);
+      REQUIRE(!packed.hasN());
+      REQUIRE(packed.word(8, 32) == ~uint64_t(0));
+    }
+  }
+}
+
+SCENARIO("Packed words match the k-mers they stand in for") {
+  std::mt19937 gen(7);
+  std::uniform_int_distribution<> dis(0, 3);
+  char nucs[] = {'A', 'C', 'G', 'T'};
+
+  GIVEN("A UMI") {
+    std::string umi(10, 'A');
+    for (auto& c : umi) {
+      c = nucs[dis(gen)];
+    }
+    alevin::types::AlevinUMIKmer::k(umi.size());
+    alevin::types::AlevinUMIKmer umiIdx;
+    umiIdx.fromChars(umi);
+    fastx_parser::PackedSeq packed;
+    packed.encode(umi.data(), umi.size());
+    THEN("its packed word is that of the UMI k-mer") {
+      REQUIRE(packed.word(0, umi.size()) == umiIdx.word(0));
+    }
+  }
+
+  GIVEN("Sequence-specific bias contexts") {
+    SBModel fromChars;
+    SBModel fromPacked;
+    size_t L = fromChars.getContextLength();
+    std::string seq(L, 'A');
+    fastx_parser::PackedSeq packed;
+    for (size_t n = 0; n < 1000; ++n) {
+      for (auto& c : seq) {
+        c = nucs[dis(gen)];
+      }
+      packed.encode(seq.data(), seq.size());
+      bool rc = (n % 2 == 1);
+      fromChars.addSequence(seq.data(), rc);
+      fromPacked.addPackedContext(packed.word(0, L), rc);
+    }
+    THEN("the counts are the same whichever way the contexts are added") {
+      REQUIRE(fromChars.counts() == fromPacked.counts());
+    }
+  }
+}
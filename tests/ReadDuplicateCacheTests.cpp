@@ -0,0 +1,63 @@
+#include <string>
+
+#include "ReadDuplicateCache.hpp"
+
+SCENARIO("The duplicate read cache returns what was cached for a read") {
+
+  GIVEN("A cache with a few slots") {
+    ReadDuplicateCache<int> cache(5);
+    ReadDuplicateCache<int>::Entry* slot{nullptr};
+
+    THEN("a read misses until it has been filled in, and then hits") {
+      REQUIRE(cache.enabled());
+      REQUIRE(!cache.lookup("ACGTACGT", "", slot));
+      // a miss that isn't filled in stays a miss
+      REQUIRE(!cache.lookup("ACGTACGT", "", slot));
+      slot->value = 42;
+      cache.fill(slot, "ACGTACGT", "");
+      REQUIRE(cache.lookup("ACGTACGT", "", slot));
+      REQUIRE(slot->value == 42);
+      REQUIRE(!cache.lookup("ACGTACGA", "", slot));
+      REQUIRE(cache.numLookups() == 4);
+      REQUIRE(cache.numHits() == 1);
+    }
+
+    THEN("a pair hits only with both mates, split at the same place") {
+      REQUIRE(!cache.lookup("AACC", "GGTT", slot));
+      slot->value = 7;
+      cache.fill(slot, "AACC", "GGTT");
+      REQUIRE(cache.lookup("AACC", "GGTT", slot));
+      REQUIRE(slot->value == 7);
+      REQUIRE(!cache.lookup("AACCG", "GTT", slot));
+      REQUIRE(!cache.lookup("AACC", "", slot));
+      REQUIRE(!cache.lookup("GGTT", "AACC", slot));
+    }
+  }
+
+  GIVEN("A cache with a single slot") {
+    ReadDuplicateCache<int> cache(1);
+    ReadDuplicateCache<int>::Entry* slot{nullptr};
+
+    THEN("each read that misses evicts the one before it") {
+      REQUIRE(!cache.lookup("AAAA", "", slot));
+      slot->value = 1;
+      cache.fill(slot, "AAAA", "");
+      REQUIRE(!cache.lookup("CCCC", "", slot));
+      slot->value = 2;
+      cache.fill(slot, "CCCC", "");
+      REQUIRE(!cache.lookup("AAAA", "", slot));
+      REQUIRE(!cache.lookup("CCCC", "", slot));
+      // pairs that concatenate to the same sequence don't collide, and even
+      // a miss that isn't filled in evicts what the slot held
+      slot->value = 3;
+      cache.fill(slot, "AC", "GT");
+      REQUIRE(!cache.lookup("A", "CGT", slot));
+      REQUIRE(!cache.lookup("AC", "GT", slot));
+    }
+  }
+
+  GIVEN("A cache of no entries") {
+    ReadDuplicateCache<int> cache(0);
+    THEN("it is disabled") { REQUIRE(!cache.enabled()); }
+  }
+}
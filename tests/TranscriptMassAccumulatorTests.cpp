@@ -0,0 +1,79 @@
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "SalmonMath.hpp"
+#include "TranscriptMassAccumulator.hpp"
+
+namespace {
+
+// A transcript mass, updated as Transcript::addMass does
+struct LogMass {
+  double mass{salmon::math::LOG_0};
+  void addMass(double inc) { mass = salmon::math::logAdd(mass, inc); }
+};
+
+} // namespace
+
+SCENARIO("Accumulated transcript masses match those added one at a time") {
+
+  GIVEN("Mini-batches of masses, with their forgetting masses") {
+    std::mt19937 gen(17);
+    std::uniform_real_distribution<> logProb(-12.0, 0.0);
+    std::uniform_int_distribution<uint32_t> hot(0, 9);
+    // enough distinct transcripts that the table grows within a batch
+    const size_t numTranscripts{20000};
+    std::uniform_int_distribution<uint32_t> cold(10, numTranscripts - 1);
+    const std::vector<size_t> batchSizes{100, 30000, 1, 5000};
+    const std::vector<double> logForgettingMasses{0.0, -0.35, -1.2, -3.0};
+
+    std::vector<LogMass> direct(numTranscripts);
+    std::vector<LogMass> accumulated(numTranscripts);
+    TranscriptMassAccumulator acc;
+
+    THEN("the masses of the transcripts are the same either way") {
+      for (size_t b = 0; b < batchSizes.size(); ++b) {
+        double logForgettingMass = logForgettingMasses[b];
+        for (size_t i = 0; i < batchSizes[b]; ++i) {
+          uint32_t tid = (i % 2 == 0) ? hot(gen) : cold(gen);
+          double p = logProb(gen);
+          direct[tid].addMass(logForgettingMass + p);
+          acc.add(tid, p);
+        }
+        // each transcript hit in the batch is updated once
+        REQUIRE(acc.size() <= batchSizes[b]);
+        acc.flush(accumulated, logForgettingMass);
+        REQUIRE(acc.size() == 0);
+      }
+
+      size_t numMismatched{0};
+      for (size_t t = 0; t < numTranscripts; ++t) {
+        double d = direct[t].mass;
+        double a = accumulated[t].mass;
+        if (salmon::math::isLog0(d) or salmon::math::isLog0(a)) {
+          numMismatched += (d != a);
+        } else {
+          numMismatched += (std::abs(d - a) > 1e-9 * std::max(1.0, std::abs(d)));
+        }
+      }
+      REQUIRE(numMismatched == 0);
+    }
+  }
+
+  GIVEN("An accumulator that has been flushed") {
+    TranscriptMassAccumulator acc;
+    std::vector<LogMass> masses(3);
+    acc.add(1, std::log(0.25));
+    acc.add(1, std::log(0.25));
+    acc.flush(masses, 0.0);
+
+    THEN("it starts over empty") {
+      REQUIRE(acc.size() == 0);
+      acc.add(2, std::log(0.5));
+      acc.flush(masses, std::log(0.5));
+      REQUIRE(salmon::math::isLog0(masses[0].mass));
+      REQUIRE(std::exp(masses[1].mass) == Approx(0.5));
+      REQUIRE(std::exp(masses[2].mass) == Approx(0.25));
+    }
+  }
+}
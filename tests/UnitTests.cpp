@@ -10,5 +10,13 @@ bool verbose=false; // Apparently, we *need* this (OSX)
 
 #include "GCSampleTests.cpp"
 #include "LibraryTypeTests.cpp"
+#include "PackedSeqTests.cpp"
+#include "FastxParserStreamsTests.cpp"
+#include "ReadDuplicateCacheTests.cpp"
+#include "MappingRecordsTests.cpp"
+#include "TranscriptMassAccumulatorTests.cpp"
+#include "PackedEqClassesTests.cpp"
+#include "EquivalenceClassBuilderTests.cpp"
+#include "EqClassComponentsTests.cpp"
 //#include "KmerHistTests.cpp"
 